@@ -0,0 +1,219 @@
+# Copyright (c) 2016 Jake Dharmasiri.
+# Licensed under the GNU GPLv3 License. See LICENSE for details.
+#
+# Background checker for Pylet's editors, run in its own interpreter so the
+# console's session is never touched. Each request on stdin is a line
+# "<id> <bytes>" followed by that many bytes of UTF-8 source; each answer is
+# one line of JSON: {"id": id, "problems": [[line, column, length, severity,
+# message], ...]} with one-based lines and zero-based character columns.
+
+import ast
+import builtins
+import json
+import sys
+
+IMPLICIT = set(dir(builtins)) | {
+    '__name__', '__file__', '__doc__', '__builtins__', '__spec__',
+    '__loader__', '__package__', '__path__', '__annotations__', '__class__'
+}
+
+FUNCTIONS = tuple(getattr(ast, name) for name in ('FunctionDef', 'AsyncFunctionDef') if hasattr(ast, name))
+COMPREHENSIONS = (ast.GeneratorExp, ast.ListComp, ast.SetComp, ast.DictComp)
+SCOPES = FUNCTIONS + COMPREHENSIONS + (ast.Lambda, ast.ClassDef)
+NAMED_EXPRESSIONS = tuple(getattr(ast, name) for name in ('NamedExpr',) if hasattr(ast, name))
+MATCH_CAPTURES = tuple(getattr(ast, name) for name in ('MatchAs', 'MatchStar', 'MatchMapping') if hasattr(ast, name))
+
+
+class Scope(object):
+    def __init__(self, node, is_class):
+        self.node = node
+        self.is_class = is_class
+        self.bound = set()
+
+
+def arguments(args):
+    found = list(getattr(args, 'posonlyargs', [])) + list(args.args) + list(args.kwonlyargs)
+    for extra in (args.vararg, args.kwarg):
+        if extra is not None:
+            found.append(extra)
+    return [getattr(arg, 'arg', arg) for arg in found]
+
+
+def string_value(node):
+    if isinstance(node, getattr(ast, 'Constant', ())) and isinstance(node.value, str):
+        return node.value
+    if hasattr(ast, 'Str') and isinstance(node, ast.Str):
+        return node.s
+    return None
+
+
+def type_parameters(node):
+    """Names of the PEP 695 parameters of a generic function, class or type alias."""
+    return set(param.name for param in getattr(node, 'type_params', None) or [])
+
+
+def comprehension_targets(comprehension):
+    """Walrus targets in a comprehension, which bind in the scope around it (PEP 572)."""
+    found = set()
+    stack = list(ast.iter_child_nodes(comprehension))
+    while stack:
+        node = stack.pop()
+        if isinstance(node, NAMED_EXPRESSIONS) and isinstance(node.target, ast.Name):
+            found.add(node.target.id)
+        if isinstance(node, SCOPES) and not isinstance(node, COMPREHENSIONS):
+            continue
+        stack.extend(ast.iter_child_nodes(node))
+    return found
+
+
+def bindings(scope_node):
+    """Names bound directly in a scope, without descending into nested ones."""
+    bound = set()
+    if isinstance(scope_node, FUNCTIONS + (ast.Lambda,)):
+        bound.update(arguments(scope_node.args))
+    stack = list(ast.iter_child_nodes(scope_node))
+    while stack:
+        node = stack.pop()
+        if isinstance(node, ast.Name) and not isinstance(node.ctx, ast.Load):
+            bound.add(node.id)
+        elif isinstance(node, (ast.Import, ast.ImportFrom)):
+            for alias in node.names:
+                if alias.name != '*':
+                    bound.add(alias.asname or alias.name.split('.')[0])
+        elif isinstance(node, ast.ExceptHandler) and isinstance(node.name, str):
+            bound.add(node.name)
+        elif isinstance(node, (ast.Global, getattr(ast, 'Nonlocal', ast.Global))):
+            bound.update(node.names)
+        elif isinstance(node, FUNCTIONS + (ast.ClassDef,)):
+            bound.add(node.name)
+        elif isinstance(node, MATCH_CAPTURES):
+            capture = node.rest if isinstance(node, ast.MatchMapping) else node.name
+            if capture is not None:
+                bound.add(capture)
+        if isinstance(node, COMPREHENSIONS):
+            bound.update(comprehension_targets(node))
+        if isinstance(node, SCOPES):
+            continue
+        stack.extend(ast.iter_child_nodes(node))
+    if isinstance(scope_node, COMPREHENSIONS):
+        for generator in scope_node.generators:
+            for target in ast.walk(generator.target):
+                if isinstance(target, ast.Name):
+                    bound.add(target.id)
+    return bound
+
+
+class Checker(object):
+    def __init__(self, source, tree):
+        self.lines = source.split('\n')
+        self.tree = tree
+        self.problems = []
+        self.loaded = set()
+        self.star = False
+        self.exported = set()
+
+    def column(self, line, offset):
+        """ast offsets count UTF-8 bytes; the editor counts characters."""
+        if 0 < line <= len(self.lines):
+            return len(self.lines[line - 1].encode('utf-8')[:offset].decode('utf-8', 'replace'))
+        return offset
+
+    def report(self, line, offset, length, severity, message):
+        self.problems.append([line, self.column(line, offset), length, severity, message])
+
+    def run(self):
+        for node in ast.walk(self.tree):
+            if isinstance(node, ast.ImportFrom) and any(alias.name == '*' for alias in node.names):
+                self.star = True
+            elif isinstance(node, ast.Name) and isinstance(node.ctx, ast.Load):
+                self.loaded.add(node.id)
+            elif isinstance(node, ast.Assign):
+                for target in node.targets:
+                    if isinstance(target, ast.Name) and target.id == '__all__':
+                        for item in ast.walk(node.value):
+                            if string_value(item) is not None:
+                                self.exported.add(string_value(item))
+        self.visit(self.tree, [])
+        self.unused_imports()
+        self.problems.sort()
+        return self.problems
+
+    def visit(self, node, chain):
+        # Type parameters live in a scope of their own, seen from the methods of a generic class too
+        params = type_parameters(node)
+        if params:
+            scope = Scope(node, False)
+            scope.bound = params
+            chain = chain + [scope]
+        if node is self.tree or isinstance(node, SCOPES):
+            scope = Scope(node, isinstance(node, ast.ClassDef))
+            scope.bound = bindings(node)
+            chain = chain + [scope]
+        if isinstance(node, ast.Name) and isinstance(node.ctx, ast.Load):
+            self.resolve(node, chain)
+        for child in ast.iter_child_nodes(node):
+            self.visit(child, chain)
+
+    def resolve(self, node, chain):
+        if self.star or node.id in IMPLICIT:
+            return
+        for depth, scope in enumerate(reversed(chain)):
+            # A class body's names are not visible from the functions inside it
+            if scope.is_class and depth > 0:
+                continue
+            if node.id in scope.bound:
+                return
+        self.report(node.lineno, node.col_offset, len(node.id), 'error', "undefined name '%s'" % node.id)
+
+    def unused_imports(self):
+        for node in ast.walk(self.tree):
+            if not isinstance(node, (ast.Import, ast.ImportFrom)):
+                continue
+            if isinstance(node, ast.ImportFrom) and node.module == '__future__':
+                continue
+            for alias in node.names:
+                if alias.name == '*':
+                    continue
+                name = alias.asname or alias.name.split('.')[0]
+                if name in self.loaded or name in self.exported:
+                    continue
+                text = self.lines[node.lineno - 1] if node.lineno <= len(self.lines) else ''
+                start = text.find(alias.asname or alias.name, self.column(node.lineno, node.col_offset))
+                if start < 0:
+                    start, length = self.column(node.lineno, node.col_offset), 0
+                else:
+                    length = len(alias.asname or alias.name)
+                self.problems.append([node.lineno, start, length, 'warning', "'%s' imported but unused" % name])
+
+
+def check(source):
+    try:
+        tree = compile(source, '<buffer>', 'exec', ast.PyCF_ONLY_AST)
+    except SyntaxError as error:
+        line = error.lineno or 1
+        column = max(0, (error.offset or 1) - 1)
+        return [[line, column, 0, 'error', error.msg]]
+    except (ValueError, TypeError) as error:
+        return [[1, 0, 0, 'error', str(error)]]
+    return Checker(source, tree).run()
+
+
+def main():
+    stdin = sys.stdin.buffer
+    stdout = sys.stdout
+    while True:
+        header = stdin.readline()
+        if not header:
+            return
+        request, size = header.split()
+        source = stdin.read(int(size)).decode('utf-8', 'replace')
+        try:
+            problems = check(source)
+        except Exception as error:  # A bug here must not take the checker down
+            problems = [[1, 0, 0, 'warning', 'checker failed: %s' % error]]
+        stdout.write(json.dumps({'id': int(request), 'problems': problems}) + '\n')
+        stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,229 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_brackets.h"
+#include <algorithm>
+
+BracketIndex::BracketIndex() :
+    root(0),
+    seed(0x9E3779B9u) {
+    /* Node 0 is the empty sentinel */
+    Node empty = Node();
+    empty.minBefore = empty.minAfter = NoBracket;
+    nodes.push_back(empty);
+    reset(1);
+}
+
+int BracketIndex::size() const {
+    return nodes[root].size;
+}
+
+void BracketIndex::reset(int count) {
+    nodes.resize(1);
+    freeNodes.clear();
+    root = build(count);
+}
+
+void BracketIndex::replace(int first, int removed, int added) {
+    int left, middle, right;
+    split(root, first, left, middle);
+    split(middle, removed, middle, right);
+    freeTree(middle);
+    root = merge(merge(left, build(added)), right);
+}
+
+void BracketIndex::set(int index, const Summary &summary) {
+    /* Walk down to the block, then recompute the aggregates on the way back up */
+    std::vector<int> path;
+    int t = root;
+    while (t) {
+        path.push_back(t);
+        const int leftSize = nodes[nodes[t].left].size;
+        if (index < leftSize) {
+            t = nodes[t].left;
+        } else if (index == leftSize) {
+            break;
+        } else {
+            index -= leftSize + 1;
+            t = nodes[t].right;
+        }
+    }
+    if (!t || nodes[t].own == summary) {
+        return;
+    }
+    nodes[t].own = summary;
+    for (int i = (int)path.size() - 1; i >= 0; --i) {
+        update(path[i]);
+    }
+}
+
+BracketIndex::Summary BracketIndex::at(int index) const {
+    int t = root;
+    while (t) {
+        const int leftSize = nodes[nodes[t].left].size;
+        if (index < leftSize) {
+            t = nodes[t].left;
+        } else if (index == leftSize) {
+            return nodes[t].own;
+        } else {
+            index -= leftSize + 1;
+            t = nodes[t].right;
+        }
+    }
+    return Summary();
+}
+
+int BracketIndex::depthBefore(int index) const {
+    int depth = 0;
+    int t = root;
+    while (t) {
+        const Node &node = nodes[t];
+        const int leftSize = nodes[node.left].size;
+        if (index <= leftSize) {
+            t = node.left;
+        } else {
+            depth += nodes[node.left].sum + node.own.net;
+            index -= leftSize + 1;
+            t = node.right;
+        }
+    }
+    return depth;
+}
+
+int BracketIndex::findForward(int from, int depth) const {
+    return forward(root, 0, 0, from, depth);
+}
+
+int BracketIndex::findBackward(int before, int depth) const {
+    return backward(root, 0, 0, before, depth);
+}
+
+int BracketIndex::createNode() {
+    int t;
+    if (!freeNodes.empty()) {
+        t = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        t = (int)nodes.size();
+        nodes.push_back(Node());
+    }
+    /* xorshift keeps the priorities random without pulling in <random> state per node */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node &node = nodes[t];
+    node.left = node.right = 0;
+    node.priority = seed;
+    node.own = Summary();
+    update(t);
+    return t;
+}
+
+void BracketIndex::freeTree(int t) {
+    if (!t) {
+        return;
+    }
+    freeTree(nodes[t].left);
+    freeTree(nodes[t].right);
+    freeNodes.push_back(t);
+}
+
+void BracketIndex::update(int t) {
+    Node &node = nodes[t];
+    const Node &left = nodes[node.left];
+    const Node &right = nodes[node.right];
+    const int beforeRight = left.sum + node.own.net;
+
+    node.size = left.size + 1 + right.size;
+    node.sum = beforeRight + right.sum;
+    node.minBefore = std::min(left.minBefore, std::min(left.sum + node.own.minBefore, beforeRight + right.minBefore));
+    node.minAfter = std::min(left.minAfter, std::min(left.sum + node.own.minAfter, beforeRight + right.minAfter));
+}
+
+int BracketIndex::merge(int a, int b) {
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = merge(nodes[a].right, b);
+        update(a);
+        return a;
+    }
+    nodes[b].left = merge(a, nodes[b].left);
+    update(b);
+    return b;
+}
+
+/* Splits off the first 'count' blocks of 't' into 'a', the rest into 'b' */
+void BracketIndex::split(int t, int count, int &a, int &b) {
+    if (!t) {
+        a = b = 0;
+        return;
+    }
+    const int leftSize = nodes[nodes[t].left].size;
+    if (count <= leftSize) {
+        int rest;
+        split(nodes[t].left, count, a, rest);
+        nodes[t].left = rest;
+        update(t);
+        b = t;
+    } else {
+        int rest;
+        split(nodes[t].right, count - leftSize - 1, rest, b);
+        nodes[t].right = rest;
+        update(t);
+        a = t;
+    }
+}
+
+int BracketIndex::build(int count) {
+    int t = 0;
+    for (int i = 0; i < count; ++i) {
+        t = merge(t, createNode());
+    }
+    return t;
+}
+
+/* 'base' is the depth at the start of subtree 't', 'offset' the number of its first block */
+int BracketIndex::forward(int t, int base, int offset, int from, int depth) const {
+    if (!t) {
+        return -1;
+    }
+    const Node &node = nodes[t];
+    if (offset + node.size <= from || base + node.minAfter > depth) {
+        return -1;
+    }
+    const int found = forward(node.left, base, offset, from, depth);
+    if (found >= 0) {
+        return found;
+    }
+    const int index = offset + nodes[node.left].size;
+    const int start = base + nodes[node.left].sum;
+    if (index >= from && start + node.own.minAfter <= depth) {
+        return index;
+    }
+    return forward(node.right, start + node.own.net, index + 1, from, depth);
+}
+
+int BracketIndex::backward(int t, int base, int offset, int before, int depth) const {
+    if (!t) {
+        return -1;
+    }
+    const Node &node = nodes[t];
+    if (offset >= before || base + node.minBefore > depth) {
+        return -1;
+    }
+    const int index = offset + nodes[node.left].size;
+    const int start = base + nodes[node.left].sum;
+    const int found = backward(node.right, start + node.own.net, index + 1, before, depth);
+    if (found >= 0) {
+        return found;
+    }
+    if (index < before && start + node.own.minBefore <= depth) {
+        return index;
+    }
+    return backward(node.left, base, offset, before, depth);
+}
@@ -0,0 +1,88 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_BRACKETS_H
+#define CODE_EDITOR_BRACKETS_H
+
+#include <vector>
+
+/*
+* Bracket depth index over the blocks of a document.
+*
+* Every block contributes a summary of its brackets: the net depth change and
+* the lowest depth reached before and after any of its brackets, relative to
+* the depth at the start of the block. The summaries are kept in an implicit
+* treap ordered by block number, so the depth at the start of a block and the
+* nearest block where the depth drops to a given level are found in O(log n),
+* and inserting or removing blocks does not renumber anything.
+*
+* Nothing in here is specific to brackets; the highlighter keeps further
+* instances for folding, one with indentation as the depth and one with
+* #region and #endregion comments as brackets.
+*/
+class BracketIndex {
+public:
+    enum { NoBracket = 1 << 29 };
+
+    struct Summary {
+        int net = 0;
+        int minBefore = NoBracket;
+        int minAfter = NoBracket;
+
+        bool operator==(const Summary &other) const {
+            return net == other.net && minBefore == other.minBefore && minAfter == other.minAfter;
+        }
+        bool operator!=(const Summary &other) const {
+            return !(*this == other);
+        }
+    };
+
+    BracketIndex();
+
+    int size() const;
+    void reset(int count);
+
+    /* Replaces 'removed' blocks starting at 'first' with 'added' empty ones */
+    void replace(int first, int removed, int added);
+    void set(int index, const Summary &summary);
+    Summary at(int index) const;
+
+    /* Bracket depth at the start of block 'index' */
+    int depthBefore(int index) const;
+
+    /* First block at or after 'from' in which some bracket leaves the depth at or below 'depth', or -1 */
+    int findForward(int from, int depth) const;
+
+    /* Last block before 'before' in which some bracket is reached at a depth at or below 'depth', or -1 */
+    int findBackward(int before, int depth) const;
+
+private:
+    struct Node {
+        int left;
+        int right;
+        unsigned int priority;
+        int size;
+        Summary own;
+        int sum;
+        int minBefore;
+        int minAfter;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root;
+    unsigned int seed;
+
+    int createNode();
+    void freeTree(int t);
+    void update(int t);
+    int merge(int a, int b);
+    void split(int t, int count, int &a, int &b);
+    int build(int count);
+    int forward(int t, int base, int offset, int from, int depth) const;
+    int backward(int t, int base, int offset, int before, int depth) const;
+};
+
+#endif // CODE_EDITOR_BRACKETS_H
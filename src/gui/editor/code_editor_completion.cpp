@@ -0,0 +1,578 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_completion.h"
+#include "code_editor_tokenizer.h"
+#include "src/python/python_lexer.h"
+#include "src/python/qpyconsole.h"
+#include <qapplication.h>
+#include <qdesktopwidget.h>
+#include <qevent.h>
+#include <qscrollbar.h>
+
+namespace {
+
+enum { RankLimit = 256 };
+
+inline bool startsWord(const QString &word, int i) {
+    const QChar previous = word.at(i - 1);
+    const QChar current = word.at(i);
+    return previous == QLatin1Char('_') || (current.isUpper() && previous.isLower()) || (current.isDigit() && !previous.isDigit());
+}
+
+/*
+* Scores 'word' for what was typed, or returns -1 unless the query is a
+* subsequence of the word that starts at its first character. Characters
+* matched in a row, at the start of a word part or in the same case score
+* more. 'lowered' is the query in lower case.
+*/
+int fuzzyScore(const QString &query, const QString &lowered, const QString &word) {
+    const int length = word.length();
+    if (length < query.length()) {
+        return -1;
+    }
+    int score = 0;
+    int last = -1;
+    int q = 0;
+    for (int i = 0; i < length && q < query.length(); ++i) {
+        const QChar c = word.at(i);
+        if (c != query.at(q) && c.toLower() != lowered.at(q)) {
+            if (i == 0) {
+                return -1;
+            }
+            continue;
+        }
+        int points = 1;
+        if (c == query.at(q)) {
+            points += 1;
+        }
+        if (i == last + 1) {
+            points += 4;
+        } else if (startsWord(word, i)) {
+            points += 3;
+        }
+        score += points;
+        last = i;
+        ++q;
+    }
+    return q == query.length() ? score : -1;
+}
+
+/* A bit per lower case letter, one for digits, one for the underscore and a few for everything else */
+quint32 lettersOf(const QString &word) {
+    quint32 letters = 0;
+    for (int i = 0; i < word.length(); ++i) {
+        const ushort c = word.at(i).toLower().unicode();
+        if (c >= 'a' && c <= 'z') {
+            letters |= 1u << (c - 'a');
+        } else if (c >= '0' && c <= '9') {
+            letters |= 1u << 26;
+        } else if (c == '_') {
+            letters |= 1u << 27;
+        } else {
+            letters |= 1u << (28 + (c & 3));
+        }
+    }
+    return letters;
+}
+
+/* Match quality first, then how often the word is used, then how little is left to type */
+int rankOf(int score, int uses, int extra) {
+    int frequency = 0;
+    while (uses > 1 && frequency < 10) {
+        uses >>= 1;
+        ++frequency;
+    }
+    return qBound(0, 20 + qMin(score, 40) * 4 + frequency * 3 - qMin(extra, 20), RankLimit - 1);
+}
+
+}
+
+WordTrie::WordTrie() {
+    const Node root = { 0, -1, -1, -1 };
+    nodes.push_back(root);
+}
+
+/* Siblings are kept in character order, so collecting walks the words alphabetically */
+void WordTrie::add(const QString &word, int delta) {
+    if (word.isEmpty() || delta == 0) {
+        return;
+    }
+    int node = 0;
+    for (int i = 0; i < word.length(); ++i) {
+        const ushort character = word.at(i).unicode();
+        int previous = -1;
+        int child = nodes[node].child;
+        while (child >= 0 && nodes[child].character < character) {
+            previous = child;
+            child = nodes[child].sibling;
+        }
+        if (child < 0 || nodes[child].character != character) {
+            const Node created = { character, -1, child, -1 };
+            nodes.push_back(created);
+            const int id = (int)nodes.size() - 1;
+            if (previous < 0) {
+                nodes[node].child = id;
+            } else {
+                nodes[previous].sibling = id;
+            }
+            child = id;
+        }
+        node = child;
+    }
+
+    if (nodes[node].word < 0) {
+        nodes[node].word = words.size();
+        words.append(word);
+        counts.append(0);
+    }
+    int &count = counts[nodes[node].word];
+    count = qMax(0, count + delta);
+}
+
+int WordTrie::childOf(int node, ushort character) const {
+    for (int child = nodes[node].child; child >= 0 && nodes[child].character <= character; child = nodes[child].sibling) {
+        if (nodes[child].character == character) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+int WordTrie::uses(const QString &word) const {
+    int node = 0;
+    for (int i = 0; i < word.length() && node >= 0; ++i) {
+        node = childOf(node, word.at(i).unicode());
+    }
+    return node > 0 && nodes[node].word >= 0 ? counts.at(nodes[node].word) : 0;
+}
+
+void WordTrie::collect(QChar first, QVector<int> &ids) const {
+    ushort heads[2] = { first.toLower().unicode(), first.toUpper().unicode() };
+    std::vector<int> stack;
+    for (int i = 0; i < (heads[0] == heads[1] ? 1 : 2); ++i) {
+        const int head = childOf(0, heads[i]);
+        if (head < 0) {
+            continue;
+        }
+        if (nodes[head].word >= 0 && counts.at(nodes[head].word) > 0) {
+            ids.append(nodes[head].word);
+        }
+        if (nodes[head].child >= 0) {
+            stack.push_back(nodes[head].child);
+        }
+
+        /* Depth first, children before siblings */
+        while (!stack.empty()) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.sibling >= 0) {
+                stack.push_back(node.sibling);
+            }
+            if (node.word >= 0 && counts.at(node.word) > 0) {
+                ids.append(node.word);
+            }
+            if (node.child >= 0) {
+                stack.push_back(node.child);
+            }
+        }
+    }
+}
+
+WordWorker *WordWorker::instance() {
+    static WordWorker *worker = 0;
+    if (!worker) {
+        qRegisterMetaType<WordJob>("WordJob");
+        qRegisterMetaType<WordResult>("WordResult");
+
+        worker = new WordWorker;
+        startWorkerThread(worker, "WordWorker");
+    }
+    return worker;
+}
+
+void WordWorker::post(const WordJob &job) {
+    QMetaObject::invokeMethod(this, "count", Qt::QueuedConnection, Q_ARG(WordJob, job));
+}
+
+void WordWorker::count(const WordJob &job) {
+    WordResult result;
+    result.owner = job.owner;
+    result.revision = job.revision;
+
+    std::vector<PythonLexer::Token> tokens;
+    int state = PythonLexer::StateNormal;
+    int lineStart = 0;
+    while (lineStart <= job.text.length()) {
+        int lineEnd = job.text.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0) {
+            lineEnd = job.text.length();
+        }
+        tokens.clear();
+        state = PythonLexer::tokenize(job.text.utf16() + lineStart, lineEnd - lineStart, state, tokens);
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const PythonLexer::Token &token = tokens[i];
+            if (token.kind != PythonLexer::Identifier && token.kind != PythonLexer::DefClass) {
+                continue;
+            }
+            const int start = lineStart + token.start;
+            if (job.cursor >= start && job.cursor <= start + token.length) {
+                continue;
+            }
+            ++result.counts[job.text.mid(start, token.length)];
+        }
+        lineStart = lineEnd + 1;
+    }
+
+    Q_EMIT counted(result);
+}
+
+CompletionIndex *CompletionIndex::instance() {
+    static CompletionIndex *index = 0;
+    if (!index) {
+        index = new CompletionIndex;
+    }
+    return index;
+}
+
+CompletionIndex::CompletionIndex() {
+    for (const char *const *word = PythonLexer::keywords(); *word; ++word) {
+        trie.add(QLatin1String(*word), 1);
+    }
+    for (const char *const *word = PythonLexer::builtins(); *word; ++word) {
+        trie.add(QLatin1String(*word), 1);
+    }
+    trie.add("self", 1);
+}
+
+const WordTrie &CompletionIndex::words() const {
+    return trie;
+}
+
+void CompletionIndex::setWords(quintptr owner, const WordCounts &counts) {
+    WordCounts &previous = sources[owner];
+    for (WordCounts::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        trie.add(it.key(), it.value() - previous.value(it.key()));
+    }
+    for (WordCounts::const_iterator it = previous.begin(); it != previous.end(); ++it) {
+        if (!counts.contains(it.key())) {
+            trie.add(it.key(), -it.value());
+        }
+    }
+    previous = counts;
+}
+
+void CompletionIndex::forget(quintptr owner) {
+    const WordCounts previous = sources.take(owner);
+    for (WordCounts::const_iterator it = previous.begin(); it != previous.end(); ++it) {
+        trie.add(it.key(), -it.value());
+    }
+}
+
+DocumentWords::DocumentWords(QPlainTextEdit *editor) :
+    QObject(editor),
+    editor(editor),
+    jobOwner(newJobOwner()) {
+
+    debounce = new QTimer(this);
+    debounce->setSingleShot(true);
+    debounce->setInterval(DebounceDelay);
+
+    connect(editor->document(), SIGNAL(contentsChanged()), this, SLOT(documentChanged()));
+    connect(debounce, SIGNAL(timeout()), this, SLOT(post()));
+    revision = editor->document()->revision();
+    connect(WordWorker::instance(), SIGNAL(counted(WordResult)), this, SLOT(counted(WordResult)));
+
+    debounce->start();
+}
+
+DocumentWords::~DocumentWords() {
+    CompletionIndex::instance()->forget(jobOwner);
+}
+
+void DocumentWords::documentChanged() {
+    if (editor->document()->revision() == revision) {
+        return;
+    }
+    revision = editor->document()->revision();
+    debounce->start();
+}
+
+void DocumentWords::post() {
+    if (jobPending) {
+        return;
+    }
+
+    WordJob job;
+    job.owner = jobOwner;
+    job.revision = revision;
+    job.cursor = editor->textCursor().position();
+    job.text = editor->document()->toPlainText();
+
+    jobPending = true;
+    WordWorker::instance()->post(job);
+}
+
+void DocumentWords::counted(const WordResult &result) {
+    if (result.owner != jobOwner) {
+        return;
+    }
+    jobPending = false;
+
+    CompletionIndex::instance()->setWords(jobOwner, result.counts);
+    if (result.revision != revision && !debounce->isActive()) {
+        post();
+    }
+}
+
+CompletionModel::CompletionModel(CompletionPopup *popup) :
+    QAbstractListModel(popup),
+    popup(popup) {
+}
+
+void CompletionModel::reset(int count) {
+    beginResetModel();
+    rows = count;
+    endResetModel();
+}
+
+int CompletionModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : rows;
+}
+
+QVariant CompletionModel::data(const QModelIndex &index, int role) const {
+    if (role != Qt::DisplayRole || !index.isValid() || index.row() >= rows) {
+        return QVariant();
+    }
+    return popup->wordAt(index.row());
+}
+
+CompletionPopup::CompletionPopup(QPlainTextEdit *editor) :
+    QListView(editor),
+    editor(editor) {
+
+    /* A tool tip window never takes the focus from the editor */
+    setWindowFlags(Qt::ToolTip);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+    setFocusPolicy(Qt::NoFocus);
+    setUniformItemSizes(true);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setSelectionMode(QAbstractItemView::SingleSelection);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+
+    QPalette colors = palette();
+    colors.setColor(QPalette::Inactive, QPalette::Highlight, colors.color(QPalette::Active, QPalette::Highlight));
+    colors.setColor(QPalette::Inactive, QPalette::HighlightedText, colors.color(QPalette::Active, QPalette::HighlightedText));
+    setPalette(colors);
+
+    model = new CompletionModel(this);
+    setModel(model);
+
+    editor->installEventFilter(this);
+    editor->viewport()->installEventFilter(this);
+    connect(this, SIGNAL(clicked(QModelIndex)), this, SLOT(accept()));
+    connect(editor->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(hide()));
+    hide();
+}
+
+void CompletionPopup::filter(const QString &prefix, const QString &expression, int wordStart) {
+    if (wordStart == dismissed) {
+        return;
+    }
+    dismissed = -1;
+
+    if (expression != scope) {
+        scope = expression;
+        attributes = expression.isEmpty() ? QStringList() : QPyConsole::attributes(expression);
+        filtered = false;
+    }
+    if (wordStart != start) {
+        start = wordStart;
+        filtered = false;
+    }
+
+    /* A longer query only ever matches fewer words */
+    if (filtered && !query.isEmpty() && prefix.length() > query.length() && prefix.startsWith(query, Qt::CaseInsensitive)) {
+        const QString lowered = prefix.toLower();
+        const quint32 letters = lettersOf(prefix);
+        size_t kept = 0;
+        for (size_t i = 0; i < matches.size(); ++i) {
+            Completion completion = matches[i];
+            if ((completion.letters & letters) != letters) {
+                continue;
+            }
+            const QString &word = wordAt((int)i);
+            const int score = fuzzyScore(prefix, lowered, word);
+            if (score < 0 || word == prefix) {
+                continue;
+            }
+            completion.rank = rankOf(score, completion.uses, word.length() - prefix.length());
+            matches[kept++] = completion;
+        }
+        matches.resize(kept);
+    } else {
+        collect(prefix);
+    }
+    query = prefix;
+    filtered = true;
+
+    if (matches.empty()) {
+        hide();
+        return;
+    }
+    rank();
+    model->reset((int)matches.size());
+    setCurrentIndex(model->index(0));
+    place();
+    show();
+}
+
+/* The candidates for a new query: the attributes looked up, or the words starting with its first character */
+void CompletionPopup::collect(const QString &prefix) {
+    matches.clear();
+    const WordTrie &words = CompletionIndex::instance()->words();
+    const QString lowered = prefix.toLower();
+
+    if (!attributes.isEmpty()) {
+        for (int i = 0; i < attributes.size(); ++i) {
+            const QString &name = attributes.at(i);
+            /* Private names only once an underscore is typed */
+            const int score = prefix.isEmpty() ? (name.startsWith(QLatin1Char('_')) ? -1 : 0) : fuzzyScore(prefix, lowered, name);
+            if (score < 0 || name == prefix) {
+                continue;
+            }
+            const int uses = words.uses(name);
+            const Completion completion = { i, lettersOf(name), uses, rankOf(score, uses, name.length() - prefix.length()) };
+            matches.push_back(completion);
+        }
+        return;
+    }
+
+    if (prefix.isEmpty()) {
+        return;
+    }
+    QVector<int> ids;
+    words.collect(prefix.at(0), ids);
+    matches.reserve(ids.size());
+    for (int i = 0; i < ids.size(); ++i) {
+        const QString &word = words.word(ids.at(i));
+        const int score = fuzzyScore(prefix, lowered, word);
+        if (score < 0 || word == prefix) {
+            continue;
+        }
+        const int uses = words.uses(ids.at(i));
+        const Completion completion = { ids.at(i), lettersOf(word), uses, rankOf(score, uses, word.length() - prefix.length()) };
+        matches.push_back(completion);
+    }
+}
+
+/* Ranks are small integers, so a stable counting sort orders the matches in linear time */
+void CompletionPopup::rank() {
+    int offsets[RankLimit + 1] = {};
+    for (size_t i = 0; i < matches.size(); ++i) {
+        ++offsets[RankLimit - matches[i].rank];
+    }
+    for (int r = 1; r <= RankLimit; ++r) {
+        offsets[r] += offsets[r - 1];
+    }
+    sorted.resize(matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+        sorted[offsets[RankLimit - 1 - matches[i].rank]++] = matches[i];
+    }
+    matches.swap(sorted);
+}
+
+const QString &CompletionPopup::wordAt(int row) const {
+    const int id = matches[row].id;
+    return attributes.isEmpty() ? CompletionIndex::instance()->words().word(id) : attributes.at(id);
+}
+
+bool CompletionPopup::handleKey(QKeyEvent *event) {
+    if (!isVisible()) {
+        return false;
+    }
+
+    const int rows = model->rowCount();
+    int row = currentIndex().row();
+    switch (event->key()) {
+        case Qt::Key_Up:
+            row = row > 0 ? row - 1 : rows - 1;
+            break;
+        case Qt::Key_Down:
+            row = row + 1 < rows ? row + 1 : 0;
+            break;
+        case Qt::Key_PageUp:
+            row = qMax(0, row - VisibleRows);
+            break;
+        case Qt::Key_PageDown:
+            row = qMin(rows - 1, row + VisibleRows);
+            break;
+        case Qt::Key_Tab: case Qt::Key_Return: case Qt::Key_Enter:
+            if (event->modifiers() & ~Qt::KeypadModifier) {
+                return false;
+            }
+            accept();
+            return true;
+        case Qt::Key_Escape:
+            dismissed = start;
+            hide();
+            return true;
+        default:
+            return false;
+    }
+    setCurrentIndex(model->index(row));
+    return true;
+}
+
+void CompletionPopup::accept() {
+    const QModelIndex index = currentIndex();
+    if (index.isValid()) {
+        QTextCursor cursor = editor->textCursor();
+        cursor.setPosition(start, QTextCursor::KeepAnchor);
+        cursor.insertText(wordAt(index.row()));
+        editor->setTextCursor(cursor);
+    }
+    filtered = false;
+    hide();
+}
+
+/* Below the start of the word, or above it when the screen ends first */
+void CompletionPopup::place() {
+    setFont(editor->font());
+    const QFontMetrics metrics(font());
+    int width = 0;
+    const int measured = qMin((int)matches.size(), (int)MeasuredRows);
+    for (int i = 0; i < measured; ++i) {
+        width = qMax(width, metrics.width(wordAt(i)));
+    }
+    const int frame = 2 * frameWidth();
+    const int rows = qMin((int)matches.size(), (int)VisibleRows);
+    const QSize size(qMax(width + frame + verticalScrollBar()->sizeHint().width() + metrics.averageCharWidth() * 2, (int)MinimumWidth),
+        rows * sizeHintForRow(0) + frame);
+
+    QTextCursor cursor = editor->textCursor();
+    cursor.setPosition(start);
+    const QRect caret = editor->cursorRect(cursor);
+    QPoint at = editor->viewport()->mapToGlobal(caret.bottomLeft());
+    const QRect screen = QApplication::desktop()->availableGeometry(editor);
+    if (at.y() + size.height() > screen.bottom()) {
+        at.setY(editor->viewport()->mapToGlobal(caret.topLeft()).y() - size.height());
+    }
+    at.setX(qMax(screen.left(), qMin(at.x(), screen.right() - size.width())));
+    setGeometry(QRect(at, size));
+}
+
+bool CompletionPopup::eventFilter(QObject *watched, QEvent *event) {
+    if (isVisible()) {
+        switch (event->type()) {
+            case QEvent::FocusOut: case QEvent::Hide: case QEvent::MouseButtonPress: case QEvent::Wheel:
+                hide();
+                break;
+            default:
+                break;
+        }
+    }
+    return QListView::eventFilter(watched, event);
+}
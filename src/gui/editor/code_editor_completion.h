@@ -0,0 +1,226 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_COMPLETION_H
+#define CODE_EDITOR_COMPLETION_H
+
+#include <qabstractitemmodel.h>
+#include <qhash.h>
+#include <qlistview.h>
+#include <qmetatype.h>
+#include <qobject.h>
+#include <qplaintextedit.h>
+#include <qtimer.h>
+#include <qvector.h>
+#include <vector>
+
+typedef QHash<QString, int> WordCounts;
+
+/* Snapshot of a document to count the identifiers of; the one touching 'cursor' is still being typed */
+struct WordJob {
+    quintptr owner = 0;
+    int revision = 0;
+    int cursor = -1;
+    QString text;
+};
+
+struct WordResult {
+    quintptr owner = 0;
+    int revision = 0;
+    WordCounts counts;
+};
+
+Q_DECLARE_METATYPE(WordJob)
+Q_DECLARE_METATYPE(WordResult)
+
+/*
+* Identifiers and how often each is used, in a trie of UTF-16 characters.
+* Nodes live in one array and link to their first child and next sibling, so
+* a word costs a node per character it does not share with another. Words
+* whose count drops to zero stay in place for when they come back, but are
+* no longer collected.
+*/
+class WordTrie {
+public:
+    WordTrie();
+
+    /* Adds 'delta' uses of 'word'; a negative delta takes uses away */
+    void add(const QString &word, int delta);
+    int uses(const QString &word) const;
+
+    /* Appends the ids of the words in use that start with 'first', in either case */
+    void collect(QChar first, QVector<int> &ids) const;
+
+    const QString &word(int id) const { return words.at(id); }
+    int uses(int id) const { return counts.at(id); }
+
+private:
+    struct Node {
+        ushort character;
+        int child;
+        int sibling;
+        int word;
+    };
+
+    std::vector<Node> nodes;
+    QVector<QString> words;
+    QVector<int> counts;
+
+    int childOf(int node, ushort character) const;
+};
+
+/*
+* Counts the identifiers of document snapshots on a worker thread shared by
+* every editor, with the same lexer as the highlighter, so words in strings
+* and comments never count.
+*/
+class WordWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide worker, living on its own thread */
+    static WordWorker *instance();
+    void post(const WordJob &job);
+
+public Q_SLOTS:
+    void count(const WordJob &job);
+
+Q_SIGNALS:
+    void counted(const WordResult &result);
+
+private:
+    WordWorker() {}
+};
+
+/*
+* The words every editor completes from: keywords and builtins, the
+* identifiers of the open documents and those of the project. Each source
+* hands over its whole count table and only the difference to the last one
+* touches the trie, so a document edit costs about as much as the words it
+* changed.
+*/
+class CompletionIndex {
+public:
+    /* The main thread's index */
+    static CompletionIndex *instance();
+
+    const WordTrie &words() const;
+
+    /* Replaces the words of 'owner', e.g. a document or the project */
+    void setWords(quintptr owner, const WordCounts &counts);
+    void forget(quintptr owner);
+
+private:
+    CompletionIndex();
+
+    WordTrie trie;
+    QHash<quintptr, WordCounts> sources;
+};
+
+/* Keeps the words of one document in the completion index, counted in the background after edits settle */
+class DocumentWords : public QObject {
+    Q_OBJECT
+
+public:
+    DocumentWords(QPlainTextEdit *editor);
+    ~DocumentWords();
+
+private:
+    enum { DebounceDelay = 500 };
+
+    QPlainTextEdit *editor;
+    QTimer *debounce;
+    const quintptr jobOwner;
+    int revision = 0;
+    bool jobPending = false;
+
+private Q_SLOTS:
+    void documentChanged();
+    void post();
+    void counted(const WordResult &result);
+};
+
+/* One row of the completion popup, a word of the trie or an attribute by id */
+struct Completion {
+    int id;
+    quint32 letters;    /* Characters the word contains, to rule it out before matching */
+    int uses;
+    int rank;
+};
+
+class CompletionPopup;
+
+class CompletionModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    CompletionModel(CompletionPopup *popup);
+
+    /* The popup's matches changed and now number 'rows' */
+    void reset(int rows);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+
+private:
+    CompletionPopup *popup;
+    int rows = 0;
+};
+
+/*
+* As-you-type completion for a code editor.
+*
+* The candidates for the first character come from the word trie, or from
+* the console's live namespace after a dot, and are ranked by how well they
+* fuzzily match what has been typed plus how often they are used. Each
+* further character only filters the previous matches again, which are plain
+* ids, so nothing is copied or allocated per key. The list view lays out
+* uniform rows and only ever draws the visible ones, so a hundred thousand
+* matches cost no more to show than ten.
+*/
+class CompletionPopup : public QListView {
+    Q_OBJECT
+
+public:
+    CompletionPopup(QPlainTextEdit *editor);
+
+    /*
+    * Shows the matches for 'prefix', typed at document position 'start' and
+    * following "'expression'." unless the expression is empty; hides when
+    * nothing matches.
+    */
+    void filter(const QString &prefix, const QString &expression, int start);
+
+    /* Navigates, accepts or dismisses a visible popup, returns false for every other key */
+    bool handleKey(QKeyEvent *event);
+
+    const QString &wordAt(int row) const;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    enum { VisibleRows = 10, MeasuredRows = 50, MinimumWidth = 160 };
+
+    QPlainTextEdit *editor;
+    CompletionModel *model;
+    std::vector<Completion> matches;
+    std::vector<Completion> sorted;
+    QString query;
+    QString scope;              /* Expression the attributes were looked up for */
+    QStringList attributes;
+    bool filtered = false;
+    int start = -1;
+    int dismissed = -1;         /* Start of the word the popup was closed on */
+
+    void collect(const QString &prefix);
+    void rank();
+    void place();
+
+private Q_SLOTS:
+    void accept();
+};
+
+#endif // CODE_EDITOR_COMPLETION_H
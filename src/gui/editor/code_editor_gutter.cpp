@@ -0,0 +1,183 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_gutter.h"
+#include "code_editor_highlighter.h"
+#include <qmath.h>
+
+GutterMarkers::GutterMarkers(QTextDocument *document) :
+    QObject(document),
+    document(document) {
+}
+
+int GutterMarkers::marker(const QTextBlock &block, GutterLayer layer) const {
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    return data ? data->markers[layer] : NoMarker;
+}
+
+void GutterMarkers::setMarker(const QTextBlock &block, GutterLayer layer, int value) {
+    if (!block.isValid()) {
+        return;
+    }
+    value = qBound(0, value, 255);
+
+    CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    if (!data) {
+        if (value == NoMarker) {
+            return;
+        }
+        data = new CodeBlockData;
+        QTextBlock(block).setUserData(data);
+    }
+    if (data->markers[layer] == value) {
+        return;
+    }
+
+    data->markers[layer] = (unsigned char)value;
+    Q_EMIT markersChanged(block.blockNumber(), block.blockNumber());
+}
+
+void GutterMarkers::setMarker(int blockNumber, GutterLayer layer, int value) {
+    setMarker(document->findBlockByNumber(blockNumber), layer, value);
+}
+
+void GutterMarkers::clearLayer(GutterLayer layer) {
+    int first = -1;
+    int last = -1;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+        if (data && data->markers[layer] != NoMarker) {
+            data->markers[layer] = NoMarker;
+            if (first < 0) {
+                first = block.blockNumber();
+            }
+            last = block.blockNumber();
+        }
+    }
+
+    if (first >= 0) {
+        Q_EMIT markersChanged(first, last);
+    }
+}
+
+GutterRenderer::GutterRenderer() {
+    for (int i = 0; i < 10; ++i) {
+        digitTexts[i].setText(QString(QChar('0' + i)));
+        digitTexts[i].setTextFormat(Qt::PlainText);
+        digitTexts[i].setPerformanceHint(QStaticText::AggressiveCaching);
+    }
+}
+
+void GutterRenderer::setFont(const QFont &font) {
+    digitFont = font;
+    digitWidth = 0;
+    for (int i = 0; i < 10; ++i) {
+        digitTexts[i].prepare(QTransform(), digitFont);
+        digitWidth = qMax(digitWidth, qCeil(digitTexts[i].size().width()));
+    }
+}
+
+const QFont &GutterRenderer::font() const {
+    return digitFont;
+}
+
+int GutterRenderer::width() const {
+    return MarkerColumn + digitWidth * digits + NumberOffset + 10;
+}
+
+bool GutterRenderer::setLineCount(int lines) {
+    int count = 1;
+    int max = qMax(1, lines);
+    while (max >= 10) {
+        max /= 10;
+        ++count;
+    }
+
+    if (count == digits) {
+        return false;
+    }
+    digits = count;
+    return true;
+}
+
+void GutterRenderer::paintBackground(QPainter &painter, const QRect &rect) const {
+    QRect background = rect;
+    background.setRight(qMin(rect.right(), width() - Margin - 1));
+    painter.fillRect(background, Qt::lightGray);
+}
+
+bool GutterRenderer::inMarkerColumn(int x) const {
+    return x >= 0 && x < MarkerColumn;
+}
+
+bool GutterRenderer::inFoldColumn(int x) const {
+    return x >= width() - NumberOffset && x < width() - Margin;
+}
+
+void GutterRenderer::paintRow(QPainter &painter, const QTextBlock &block, int number, int top, int height, GutterFold fold) const {
+    static const QColor green("#6AA84F"), red("#CC0000"), blue("#3D85C6"), error("#EA9999"), warning("#FFD966");
+    const int right = width() - Margin;
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+
+    if (data) {
+        if (int heat = data->markers[ProfileHeatLayer]) {
+            painter.fillRect(MarkerColumn, top, right - MarkerColumn - StripeWidth, height, QColor(255, 64, 0, heat * 3 / 4));
+        }
+
+        if (int coverage = data->markers[CoverageLayer]) {
+            painter.fillRect(right - StripeWidth, top, StripeWidth, height,
+                             coverage == CoveredLine ? green : red);
+        }
+
+        if (int change = data->markers[ChangeLayer]) {
+            if (change == RemovedBelow) {
+                painter.fillRect(right + 1, top + height - 2, StripeWidth, 2, red);
+            } else {
+                painter.fillRect(right + 1, top, StripeWidth, height,
+                                 change == AddedLine ? green : blue);
+            }
+        }
+
+        if (int severity = data->markers[ErrorLayer]) {
+            painter.fillRect(1, top + 1, MarkerColumn - 2, height - 2,
+                             severity == ErrorLine ? error : warning);
+        }
+
+        if (data->markers[BreakpointLayer] != NoMarker) {
+            const int size = qMin(MarkerColumn - 4, height - 2);
+            painter.save();
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(red);
+            painter.drawEllipse(QRectF((MarkerColumn - size) / 2.0, top + (height - size) / 2.0, size, size));
+            painter.restore();
+        }
+    }
+
+    /* Boxed minus or plus between the number and the margin */
+    if (fold != NoFold) {
+        const int size = qMin(NumberOffset - Margin - 3, height - 4) | 1;
+        const int x = width() - NumberOffset + (NumberOffset - Margin - size) / 2;
+        const int y = top + (height - size) / 2;
+        const int middle = size / 2;
+        painter.save();
+        painter.setPen(Qt::darkGray);
+        painter.setBrush(Qt::white);
+        painter.drawRect(x, y, size - 1, size - 1);
+        painter.drawLine(x + 2, y + middle, x + size - 3, y + middle);
+        if (fold == FoldClosed) {
+            painter.drawLine(x + middle, y + 2, x + middle, y + size - 3);
+        }
+        painter.restore();
+    }
+
+    /* Line number, right-aligned one cached digit at a time */
+    int x = width() - NumberOffset;
+    do {
+        x -= digitWidth;
+        painter.drawStaticText(x, top, digitTexts[number % 10]);
+        number /= 10;
+    } while (number > 0);
+}
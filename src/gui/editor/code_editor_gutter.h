@@ -0,0 +1,97 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_GUTTER_H
+#define CODE_EDITOR_GUTTER_H
+
+#include <qfont.h>
+#include <qobject.h>
+#include <qpainter.h>
+#include <qstatictext.h>
+#include <qtextdocument.h>
+#include <qtextobject.h>
+
+/* Marker layers of the gutter, painted in this order */
+enum GutterLayer {
+    ProfileHeatLayer,   /* 1 - 255, fills the row behind the line number */
+    CoverageLayer,      /* CoveredLine or MissedLine */
+    ChangeLayer,        /* AddedLine, ModifiedLine or RemovedBelow */
+    ErrorLayer,         /* WarningLine or ErrorLine */
+    BreakpointLayer,    /* Any non-zero value */
+    GutterLayerCount
+};
+
+enum GutterMarker {
+    NoMarker = 0,
+    CoveredLine = 1, MissedLine = 2,
+    AddedLine = 1, ModifiedLine = 2, RemovedBelow = 3,
+    WarningLine = 1, ErrorLine = 2
+};
+
+/* Fold handle drawn next to a line number */
+enum GutterFold {
+    NoFold,
+    FoldOpen,
+    FoldClosed
+};
+
+/*
+* Per-line markers of a document, one value per layer.
+* Markers live in the blocks' CodeBlockData, so they move along with their
+* line when text is inserted or removed above and vanish with it. Every change
+* reports the rows it touched so only those get repainted.
+*/
+class GutterMarkers : public QObject {
+    Q_OBJECT
+
+public:
+    GutterMarkers(QTextDocument *document);
+
+    int marker(const QTextBlock &block, GutterLayer layer) const;
+    void setMarker(const QTextBlock &block, GutterLayer layer, int value);
+    void setMarker(int blockNumber, GutterLayer layer, int value);
+    void clearLayer(GutterLayer layer);
+
+Q_SIGNALS:
+    void markersChanged(int firstBlock, int lastBlock);
+
+private:
+    QTextDocument *document;
+};
+
+/*
+* Paints the rows of the gutter. The digits are laid out once per font as
+* QStaticText and the width only changes when the line count gains or loses a
+* digit, so painting a row never shapes text or measures anything.
+*/
+class GutterRenderer {
+public:
+    enum { MarkerColumn = 14, StripeWidth = 3, NumberOffset = 20, Margin = 8 };
+
+    GutterRenderer();
+
+    void setFont(const QFont &font);
+    const QFont &font() const;
+    int width() const;
+
+    /* Returns whether the width changed */
+    bool setLineCount(int lines);
+
+    void paintBackground(QPainter &painter, const QRect &rect) const;
+    /* 'number' is the one-based line number of 'block' */
+    void paintRow(QPainter &painter, const QTextBlock &block, int number, int top, int height, GutterFold fold) const;
+
+    /* Whether a click at 'x' hits the marker column or the fold handles */
+    bool inMarkerColumn(int x) const;
+    bool inFoldColumn(int x) const;
+
+private:
+    QFont digitFont;
+    QStaticText digitTexts[10];
+    int digitWidth = 0;
+    int digits = 1;
+};
+
+#endif // CODE_EDITOR_GUTTER_H
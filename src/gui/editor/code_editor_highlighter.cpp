@@ -1,15 +1,50 @@
 /*
 * Copyright (c) 2016 Jake Dharmasiri.
 * Licensed under the GNU GPLv3 License. See LICENSE for details.
-*
-* The following is a C++ reimplementation of the PyQt
-* Python syntax highlighter described below:
-* https://wiki.python.org/moin/PyQt/Python%20syntax%20highlighting
 */
 
 #include "code_editor_highlighter.h"
+#include <qelapsedtimer.h>
+#include <qmap.h>
+#include <climits>
 
-PythonHighlighter::PythonHighlighter(QTextDocument *parent) : QSyntaxHighlighter(parent) {
+PythonHighlighter::PythonHighlighter(QTextDocument *parent) :
+    QObject(parent),
+    doc(parent),
+    formats(tokenFormats()),
+    dirtyFrom(INT_MAX),
+    forceUntil(-1),
+    jobOwner(newJobOwner()) {
+
+    for (int kind = 0; kind < PythonLexer::KindCount; ++kind) {
+        if (formats[kind] == formats[PythonLexer::Normal]) {
+            plainKinds |= 1u << kind;
+        }
+    }
+    lastBlockCount = doc->blockCount();
+    brackets.reset(lastBlockCount);
+    indents.reset(lastBlockCount);
+    regions.reset(lastBlockCount);
+
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(0);
+
+    connect(doc, SIGNAL(contentsChange(int, int, int)), this, SLOT(reformatBlocks(int, int, int)));
+    connect(idleTimer, SIGNAL(timeout()), this, SLOT(processIdle()));
+    connect(TokenizeWorker::instance(), SIGNAL(tokenized(TokenizeResult)), this, SLOT(tokenized(TokenizeResult)));
+
+    if (!doc->isEmpty()) {
+        rehighlight();
+    }
+}
+
+/* Built once on first use and shared read-only by every highlighter in the process */
+const QVector<QTextCharFormat> &PythonHighlighter::tokenFormats() {
+    static QVector<QTextCharFormat> formats;
+    if (!formats.isEmpty()) {
+        return formats;
+    }
 
     QMap<QString, QTextCharFormat> styles;
     styles["normal"] = createFormat(QBrush("#000000"));
@@ -24,151 +59,644 @@ PythonHighlighter::PythonHighlighter(QTextDocument *parent) : QSyntaxHighlighter
     styles["self"] = createFormat(QBrush("#000000"));
     styles["numbers"] = createFormat(QBrush("#000000"));
 
-    QList<QString> keywords;
-    keywords
-        << "and" << "assert" << "break" << "class" << "continue" << "def"
-        << "del" << "elif" << "else" << "except" << "exec" << "finally" << "for"
-        << "from" << "global" << "if" << "import" << "in" << "is" << "lambda"
-        << "not" << "or" << "pass" << "print" << "raise" << "return" << "try"
-        << "while" << "yield" << "None" << "True" << "False";
+    formats.resize(PythonLexer::KindCount);
+    formats[PythonLexer::Normal] = styles["normal"];
+    formats[PythonLexer::Identifier] = styles["normal"];
+    formats[PythonLexer::Keyword] = styles["keyword"];
+    formats[PythonLexer::Builtin] = styles["function"];
+    formats[PythonLexer::Self] = styles["self"];
+    formats[PythonLexer::DefClass] = styles["defclass"];
+    formats[PythonLexer::Operator] = styles["operator"];
+    formats[PythonLexer::Brace] = styles["brace"];
+    formats[PythonLexer::Number] = styles["numbers"];
+    formats[PythonLexer::String] = styles["string"];
+    formats[PythonLexer::DocString] = styles["comment2"];
+    formats[PythonLexer::Comment] = styles["comment"];
+    return formats;
+}
+
+void PythonHighlighter::setVisibleBlocks(int first, int last) {
+    if (first == firstVisible && last == lastVisible) {
+        return;
+    }
+    firstVisible = first;
+    lastVisible = last;
+    highlightVisible();
+}
+
+void PythonHighlighter::rehighlight() {
+    ++revision;
+    result = TokenizeResult();
+    dirtyFrom = 0;
+    forceUntil = doc->blockCount() - 1;
+    provisionalFirst = provisionalLast = -1;
+    highlightVisible();
+    if (dirtyFrom != INT_MAX) {
+        idleTimer->start();
+    }
+}
+
+void PythonHighlighter::reformatBlocks(int from, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+    if (applying) {
+        return;
+    }
+    ++revision;
+    result = TokenizeResult();
+
+    const int blockCount = doc->blockCount();
+    const int delta = blockCount - lastBlockCount;
+    lastBlockCount = blockCount;
 
-    QList<QString> functions;
-    functions
-        << "abs" << "all" << "any" << "ascii" << "bin" << "bool" << "bytearray"
-        << "bytes" << "callable" << "chr" << "classmethod" << "compile"
-        << "complex" << "delattr" << "dict" << "dir" << "divmod" << "enumerate"
-        << "eval" << "exec" << "filter" << "float" << "format" << "frozenset"
-        << "getattr" << "globals" << "hasattr" << "hash" << "help" << "hex"
-        << "id" << "input" << "int" << "isinstance" << "issubclass" << "iter"
-        << "len" << "list" << "locals" << "map" << "max" << "memoryview" << "min"
-        << "next" << "object" << "oct" << "open" << "ord" << "pow" << "print"
-        << "property" << "range" << "repr" << "reversed" << "round" << "set"
-        << "setattr" << "slice" << "sorted" << "staticmethod" << "str" << "sum"
-        << "super" << "tuple" << "type" << "vars" << "zip" << "__import__";
+    QTextBlock block = doc->findBlock(from);
+    if (!block.isValid()) {
+        brackets.reset(blockCount);
+        indents.reset(blockCount);
+        regions.reset(blockCount);
+        return;
+    }
+    QTextBlock last = doc->findBlock(from + charsAdded);
+    if (!last.isValid()) {
+        last = doc->lastBlock();
+    }
+    const int first = block.blockNumber();
+    const int lastChanged = last.blockNumber();
+
+    /* The changed blocks get fresh bracket and fold summaries once they are lexed */
+    const int added = lastChanged - first + 1;
+    const int removed = added - delta;
+    if (removed < 0 || first + removed > brackets.size()) {
+        brackets.reset(blockCount);
+        indents.reset(blockCount);
+        regions.reset(blockCount);
+    } else {
+        brackets.replace(first, removed, added);
+        indents.replace(first, removed, added);
+        regions.replace(first, removed, added);
+    }
 
-    QList<QString> operators;
-    operators
-        // Assignment
-        << "="
-        // Comparison
-        << "==" << "!=" << "<" << "<=" << ">" << ">="
-        // Arithmetic
-        << "\\+" << "-" << "\\*" << "/" << "//" << "\\%" << "\\*\\*"
-        // In-place
-        << "+=" << "-=" << "\\*=" << "/=" << "\\%="
-        // Bitwise
-        << "\\^" << "\\|" << "\\&" << "\\~" << ">>" << "<<";
+    /* Keep the queued range pointing at the same text */
+    if (dirtyFrom != INT_MAX && dirtyFrom > first) {
+        dirtyFrom = qMax(first, dirtyFrom + delta);
+    }
+    if (forceUntil > first) {
+        forceUntil = qMax(first, forceUntil + delta);
+    }
+    provisionalFirst = provisionalLast = -1;
+
+    if (first >= firstVisible && first <= lastVisible && lastChanged - first <= lastVisible - firstVisible) {
+        /* Typing in view: lex the edit and its cascade up to the bottom of the viewport */
+        int state = previousState(block);
+        int number = first;
+        while (block.isValid() && number <= lastVisible) {
+            const int oldState = block.userState();
+            state = highlightBlock(block, state, true);
+            ++number;
+            if (number > lastChanged && state == oldState) {
+                break;
+            }
+            block = block.next();
+        }
+        if (block.isValid() && number > lastVisible) {
+            /* The cascade leaves the viewport; finish it when idle */
+            dirtyFrom = qMin(dirtyFrom, number);
+            forceUntil = qMax(forceUntil, lastChanged);
+        }
+    } else {
+        dirtyFrom = qMin(dirtyFrom, first);
+        forceUntil = qMax(forceUntil, lastChanged);
+        highlightVisible();
+    }
 
-    QList<QString> braces;
-    braces
-        << "\\{" << "\\}" << "\\(" << "\\)" << "\\[" << "\\]";
+    if (dirtyFrom != INT_MAX) {
+        idleTimer->start();
+    }
+}
 
-    /* Blanket rules for keywords, operators, and braces */
-    for (int i = 0; i < keywords.size(); ++i) {
-        rules << std::make_tuple(QRegExp("\\b" + keywords.at(i) + "\\b"), 0, styles["keyword"]);
+void PythonHighlighter::processIdle() {
+    if (dirtyFrom == INT_MAX) {
+        return;
+    }
+    if (resultIndex < result.states.size()) {
+        applyResult();
+    } else if (!jobPending) {
+        postJob();
     }
-    for (int i = 0; i < functions.size(); ++i) {
-        rules << std::make_tuple(QRegExp("(^| )" + functions.at(i) + "\\("), 0, styles["function"]);
+    if (dirtyFrom != INT_MAX && !jobPending) {
+        idleTimer->start();
     }
-    for (int i = 0; i < operators.size(); ++i) {
-        rules << std::make_tuple(QRegExp(operators.at(i)), 0, styles["operator"]);
+}
+
+/* Sends a snapshot of the next queued blocks to the worker */
+void PythonHighlighter::postJob() {
+    QTextBlock block = doc->findBlockByNumber(dirtyFrom);
+    if (!block.isValid()) {
+        clearPending();
+        return;
     }
-    for (int i = 0; i < braces.size(); ++i) {
-        rules << std::make_tuple(QRegExp(braces.at(i)), 0, styles["brace"]);
+
+    TokenizeJob job;
+    job.owner = jobOwner;
+    job.revision = revision;
+    job.firstBlock = dirtyFrom;
+    job.startState = previousState(block);
+    int chars = 0;
+    while (block.isValid() && job.lines.size() < JobBlocks && chars < JobChars) {
+        const QString text = block.text();
+        chars += text.length();
+        job.lines.append(text);
+        block = block.next();
     }
 
-    /* All other rules */
-    rules
-        // Self
-        << std::make_tuple(QRegExp("\\bself\\b"), 0, styles["self"])
+    jobPending = true;
+    TokenizeWorker::instance()->post(job);
+}
+
+void PythonHighlighter::tokenized(const TokenizeResult &tokenizedResult) {
+    if (tokenizedResult.owner != jobOwner) {
+        return;
+    }
+    jobPending = false;
 
-        // Double-quoted string
-        << std::make_tuple(QRegExp("\"[^\"\\\\]*(\\\\.[^\"\\\\]*)*\""), 0, styles["string"])
+    /* Anything lexed from text that has changed since is thrown away */
+    if (tokenizedResult.revision == revision && tokenizedResult.firstBlock == dirtyFrom) {
+        result = tokenizedResult;
+        resultIndex = 0;
+    }
+    if (dirtyFrom != INT_MAX) {
+        idleTimer->start();
+    }
+}
 
-        // Single-quoted string
-        << std::make_tuple(QRegExp("'[^'\\\\]*(\\\\.[^'\\\\]*)*'"), 0, styles["string"])
+/* Applies the worker's spans in order until the states settle or the budget runs out */
+void PythonHighlighter::applyResult() {
+    QElapsedTimer timer;
+    timer.start();
 
-        // 'def' followed by identifier
-        << std::make_tuple(QRegExp("\\bdef\\b\\s*(\\w+)"), 1, styles["defclass"])
+    /* The viewport may have been lexed in the meantime, shifting the queue */
+    if (result.firstBlock + resultIndex != dirtyFrom) {
+        result = TokenizeResult();
+        return;
+    }
 
-        // 'class' followed by identifier
-        << std::make_tuple(QRegExp("\\bclass\\b\\s*(\\w+)"), 1, styles["defclass"])
+    QTextBlock block = doc->findBlockByNumber(dirtyFrom);
+    while (block.isValid() && resultIndex < result.states.size()) {
+        const int begin = resultIndex > 0 ? result.tokenEnds.at(resultIndex - 1) : 0;
+        const int oldState = block.userState();
+        const int state = result.states.at(resultIndex);
+        applyTokens(block, result.tokens.constData() + begin, result.tokenEnds.at(resultIndex) - begin);
+        block.setUserState(state);
+        ++resultIndex;
+        ++dirtyFrom;
+        if (state == oldState && dirtyFrom > forceUntil) {
+            clearPending();
+            return;
+        }
+        block = block.next();
+        if (timer.elapsed() >= SliceBudget) {
+            break;
+        }
+    }
 
-        // Numeric literals
-        << std::make_tuple(QRegExp("\\b[+-]?[0-9]+[lL]?\\b"), 0, styles["numbers"])
-        << std::make_tuple(QRegExp("\\b[+-]?0[xX][0-9A-Fa-f]+[lL]?\\b"), 0, styles["numbers"])
-        << std::make_tuple(QRegExp("\\b[+-]?[0-9]+(?:\\.[0-9]+)?(?:[eE][+-]?[0-9]+)?\\b"), 0, styles["numbers"])
+    if (!block.isValid()) {
+        clearPending();
+    } else if (resultIndex >= result.states.size()) {
+        result = TokenizeResult();
+    }
+}
 
-        // Space between '#" and newline
-        << std::make_tuple(QRegExp("#[^\\n]*"), 0, styles["comment"]);
+/* Lexes queued blocks in order on the GUI thread until the states settle or 'lastBlock' is passed */
+void PythonHighlighter::processPending(int lastBlock) {
+    QTextBlock block = doc->findBlockByNumber(dirtyFrom);
+    int state = previousState(block);
 
-    tri_single = std::make_tuple(QRegExp("'''"), 1, styles["comment2"]);
-    tri_double = std::make_tuple(QRegExp("\"\"\""), 2, styles["comment2"]);
+    while (block.isValid() && dirtyFrom <= lastBlock) {
+        const int oldState = block.userState();
+        state = highlightBlock(block, state, true);
+        ++dirtyFrom;
+        if (state == oldState && dirtyFrom > forceUntil) {
+            clearPending();
+            return;
+        }
+        block = block.next();
+    }
 
-    returnFormat = styles["keyword"];
-    normalFormat = styles["normal"];
+    if (!block.isValid()) {
+        clearPending();
+    }
 }
 
-void PythonHighlighter::highlightBlock(const QString &text) {
-    setFormat(0, text.length(), normalFormat);
+/*
+* Makes sure the visible blocks are highlighted. If the queue starts inside
+* the viewport it is simply processed up to the bottom of the view; if it starts
+* above, the visible blocks are highlighted provisionally from the stored
+* states of the blocks before them and verified later once the queue gets there.
+*/
+void PythonHighlighter::highlightVisible() {
+    if (dirtyFrom == INT_MAX || dirtyFrom > lastVisible) {
+        return;
+    }
+
+    if (dirtyFrom >= firstVisible) {
+        processPending(lastVisible);
+        return;
+    }
 
-    for (int i = 0; i < rules.size(); ++i) {
-        QRegExp expression = std::get<0>(rules.at(i));
-        int nth = std::get<1>(rules.at(i));
-        int index = expression.indexIn(text, 0);
+    if (provisionalFirst == firstVisible && provisionalLast == lastVisible) {
+        return;
+    }
+    provisionalFirst = firstVisible;
+    provisionalLast = lastVisible;
 
-        while (index >= 0) {
-            int length = expression.cap(nth).length();
-            index = expression.pos(nth);
-            setFormat(index, length, std::get<2>(rules.at(i)));
-            index = expression.indexIn(text, index + length);
+    QTextBlock block = doc->findBlockByNumber(firstVisible);
+    int chained = 0;
+    for (int number = firstVisible; block.isValid() && number <= lastVisible; ++number) {
+        int state = block.previous().isValid() ? block.previous().userState() : 0;
+        if (state < 0) {
+            state = chained;
         }
+        chained = highlightBlock(block, state, false);
+        block = block.next();
     }
+}
 
-    setCurrentBlockState(0);
+void PythonHighlighter::clearPending() {
+    result = TokenizeResult();
+    resultIndex = 0;
+    dirtyFrom = INT_MAX;
+    forceUntil = -1;
+    provisionalFirst = provisionalLast = -1;
+}
 
-    /* Multi-line strings */
-    bool inMultiline = matchMultiline(text, tri_single);
-    if (!inMultiline) {
-        inMultiline = matchMultiline(text, tri_double);
+int PythonHighlighter::previousState(const QTextBlock &block) const {
+    QTextBlock previous = block.previous();
+    if (!previous.isValid()) {
+        return PythonLexer::StateNormal;
     }
+    return qMax(previous.userState(), (int)PythonLexer::StateNormal);
+}
+
+/* Lexes one block and applies its formats, returning the state at its end */
+int PythonHighlighter::highlightBlock(QTextBlock block, int previousState, bool store) {
+    const QString text = block.text();
+    tokens.clear();
+    const int state = PythonLexer::tokenize(text.utf16(), text.length(), previousState, tokens);
+    applyTokens(block, tokens.data(), (int)tokens.size());
 
+    if (store) {
+        block.setUserState(state);
+    }
+    return state;
 }
 
-bool PythonHighlighter::matchMultiline(const QString &text, const std::tuple<QRegExp, int, QTextCharFormat> &multiRule) {
-    QRegExp delimiter = std::get<0>(multiRule);
-    int in_state = std::get<1>(multiRule);
-    QTextCharFormat style = std::get<2>(multiRule);
-    int start, add, end, length;
+/* Turns token spans into additional formats on the block's layout */
+void PythonHighlighter::applyTokens(QTextBlock block, const PythonLexer::Token *tokens, int count) {
+    updateBrackets(block, tokens, count);
+    updateFolding(block);
 
-    if (previousBlockState() == in_state) {
-        start = 0;
-        add = 0;
-    } else {
-        start = delimiter.indexIn(text);
-        add = delimiter.matchedLength();
+    QList<QTextLayout::FormatRange> ranges;
+    for (int i = 0; i < count; ++i) {
+        const PythonLexer::Token &token = tokens[i];
+        if (plainKinds & (1u << token.kind)) {
+            continue;
+        }
+        QTextLayout::FormatRange range;
+        range.start = token.start;
+        range.length = token.length;
+        range.format = formats[token.kind];
+        ranges.append(range);
     }
 
-    while (start >= 0) {
-        end = delimiter.indexIn(text, start + add);
+    /* Only touch the layout if something changed, relayouting is the expensive part */
+    QTextLayout *layout = block.layout();
+    const QList<QTextLayout::FormatRange> current = layout->additionalFormats();
+    bool changed = current.size() != ranges.size();
+    for (int i = 0; !changed && i < ranges.size(); ++i) {
+        const QTextLayout::FormatRange &a = current.at(i);
+        const QTextLayout::FormatRange &b = ranges.at(i);
+        changed = a.start != b.start || a.length != b.length || a.format != b.format;
+    }
+    if (changed) {
+        applying = true;
+        layout->setAdditionalFormats(ranges);
+        doc->markContentsDirty(block.position(), block.length());
+        applying = false;
+    }
+}
 
-        if (end >= add) {
-            length = end - start + add + delimiter.matchedLength();
-            setCurrentBlockState(0);
-        } else {
-            setCurrentBlockState(in_state);
-            length = text.length() - start + add;
+static inline bool isOpeningBracket(unsigned short c) {
+    return c == '(' || c == '[' || c == '{';
+}
+
+/* Records the block's brackets and refreshes its summary in the index */
+void PythonHighlighter::updateBrackets(QTextBlock block, const PythonLexer::Token *tokens, int count) {
+    CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    QString text;
+    QVector<CodeBlockData::Bracket> found;
+    for (int i = 0; i < count; ++i) {
+        if (tokens[i].kind != PythonLexer::Brace) {
+            continue;
+        }
+        if (text.isNull()) {
+            text = block.text();
         }
+        CodeBlockData::Bracket bracket;
+        bracket.position = tokens[i].start;
+        bracket.character = text.at(tokens[i].start).unicode();
+        found.append(bracket);
+    }
+    if (!data && found.isEmpty()) {
+        return;
+    }
 
-        setFormat(start, length, style);
-        start = delimiter.indexIn(text, start + length);
+    BracketIndex::Summary summary;
+    int depth = 0;
+    for (int i = 0; i < found.size(); ++i) {
+        summary.minBefore = qMin(summary.minBefore, depth);
+        depth += isOpeningBracket(found.at(i).character) ? 1 : -1;
+        summary.minAfter = qMin(summary.minAfter, depth);
     }
+    summary.net = depth;
 
-    if (currentBlockState() == in_state) {
+    if (!data) {
+        data = new CodeBlockData;
+        block.setUserData(data);
+    }
+    data->brackets = found;
+    data->summary = summary;
+    brackets.set(block.blockNumber(), summary);
+}
+
+/* Whether 'comment' is the marker 'word', alone or followed by a name: "region x" but not "regional" */
+static bool isMarker(const QStringRef &comment, const QLatin1String &word) {
+    if (!comment.startsWith(word)) {
+        return false;
+    }
+    if (comment.length() == word.size()) {
         return true;
+    }
+    const QChar next = comment.at(word.size());
+    return !next.isLetterOrNumber() && next != QLatin1Char('_');
+}
+
+/* Records the block's indentation and region markers in the fold indices */
+void PythonHighlighter::updateFolding(const QTextBlock &block) {
+    BracketIndex::Summary indent;
+    BracketIndex::Summary region;
+
+    const QString text = block.text();
+    int first = 0;
+    int column = 0;
+    for (; first < text.length(); ++first) {
+        const QChar c = text.at(first);
+        if (c == QLatin1Char(' ')) {
+            ++column;
+        } else if (c == QLatin1Char('\t')) {
+            column += 8 - column % 8;
+        } else {
+            break;
+        }
+    }
+
+    /* Lines inside a multi-line string and blank lines never start or end a fold */
+    if (!(previousState(block) & PythonLexer::StateStringMask) && first < text.length()) {
+        if (text.at(first) != QLatin1Char('#')) {
+            indent.minBefore = indent.minAfter = column;
+        } else {
+            const QStringRef comment = text.midRef(first + 1).trimmed();
+            if (isMarker(comment, QLatin1String("region"))) {
+                region.net = 1;
+                region.minBefore = 0;
+                region.minAfter = 1;
+            } else if (isMarker(comment, QLatin1String("endregion"))) {
+                region.net = -1;
+                region.minBefore = 0;
+                region.minAfter = -1;
+            }
+        }
+    }
+
+    const int number = block.blockNumber();
+    if (indents.at(number) != indent || regions.at(number) != region) {
+        indents.set(number, indent);
+        regions.set(number, region);
+        Q_EMIT foldsChanged();
+    }
+}
+
+int PythonHighlighter::foldEnd(int blockNumber) const {
+    int decidedBy;
+    return foldRange(blockNumber, &decidedBy);
+}
+
+/* Unlexed blocks look blank to the fold indices, so lex up to the block that decides the fold */
+int PythonHighlighter::settledFoldEnd(int blockNumber) {
+    for (;;) {
+        int decidedBy;
+        const int end = foldRange(blockNumber, &decidedBy);
+        if (dirtyFrom == INT_MAX || decidedBy < dirtyFrom) {
+            return end;
+        }
+        processPending(qMax(decidedBy, dirtyFrom + (int)JobBlocks));
+    }
+}
+
+/* 'decidedBy' receives the last block the answer depends on */
+int PythonHighlighter::foldRange(int blockNumber, int *decidedBy) const {
+    const int count = indents.size();
+    *decidedBy = blockNumber;
+    if (blockNumber < 0 || blockNumber + 1 >= count) {
+        return -1;
+    }
+
+    /* A region folds up to and including its #endregion */
+    if (regions.at(blockNumber).net > 0) {
+        const int end = regions.findForward(blockNumber + 1, regions.depthBefore(blockNumber));
+        *decidedBy = end >= 0 ? end : count;
+        return end;
+    }
+
+    const int indent = indents.at(blockNumber).minAfter;
+    if (indent == BracketIndex::NoBracket) {
+        return -1;
+    }
+
+    /* The next line that counts has to be indented deeper */
+    const int next = indents.findForward(blockNumber + 1, BracketIndex::NoBracket - 1);
+    if (next < 0 || indents.at(next).minAfter <= indent) {
+        *decidedBy = next >= 0 ? next : count;
+        return -1;
+    }
+
+    /* The fold runs up to the last such line before the indentation drops back */
+    int stop = indents.findForward(next, indent);
+    if (stop < 0) {
+        stop = count;
+    }
+    *decidedBy = stop;
+    int end = indents.findBackward(stop, BracketIndex::NoBracket - 1);
+
+    /* A multi-line string the fold ends in belongs to it */
+    QTextBlock block = doc->findBlockByNumber(end);
+    while (end + 1 < stop && (block.userState() & PythonLexer::StateStringMask) && block.userState() > 0) {
+        block = block.next();
+        ++end;
+    }
+    return end;
+}
+
+int PythonHighlighter::enclosingFold(int blockNumber) const {
+    if (foldEnd(blockNumber) >= 0) {
+        return blockNumber;
+    }
+
+    int indent = indents.at(blockNumber).minAfter;
+    if (indent == BracketIndex::NoBracket) {
+        const int previous = indents.findBackward(blockNumber, BracketIndex::NoBracket - 1);
+        if (previous < 0) {
+            return -1;
+        }
+        if (foldEnd(previous) >= blockNumber) {
+            return previous;
+        }
+        indent = indents.at(previous).minAfter;
+    }
+    if (indent <= 0) {
+        return -1;
+    }
+    return indents.findBackward(blockNumber, indent - 1);
+}
+
+void PythonHighlighter::relayout(int position, int length) {
+    applying = true;
+    doc->markContentsDirty(position, length);
+    applying = false;
+}
+
+bool PythonHighlighter::matchBracket(int position, int *match, int *depth) const {
+    QTextBlock block = doc->findBlock(position);
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    if (!data) {
+        return false;
+    }
+
+    /* Depth in front of the bracket, relative to the start of its block */
+    const int column = position - block.position();
+    int index = -1;
+    int local = 0;
+    for (int i = 0; i < data->brackets.size(); ++i) {
+        if (data->brackets.at(i).position == column) {
+            index = i;
+            break;
+        }
+        local += isOpeningBracket(data->brackets.at(i).character) ? 1 : -1;
+    }
+    if (index < 0) {
+        return false;
+    }
+
+    const int number = block.blockNumber();
+    const int start = brackets.depthBefore(number);
+    QTextBlock target;
+    int found = -1;
+
+    if (isOpeningBracket(data->brackets.at(index).character)) {
+        /* The closing bracket is the first one to bring the depth back down */
+        const int level = start + local;
+        int running = level + 1;
+        for (int i = index + 1; i < data->brackets.size() && found < 0; ++i) {
+            running += isOpeningBracket(data->brackets.at(i).character) ? 1 : -1;
+            if (running <= level) {
+                target = block;
+                found = data->brackets.at(i).position;
+            }
+        }
+        if (found < 0) {
+            const int targetNumber = brackets.findForward(number + 1, level);
+            target = doc->findBlockByNumber(targetNumber);
+            const CodeBlockData *targetData = static_cast<CodeBlockData*>(target.userData());
+            running = brackets.depthBefore(targetNumber);
+            for (int i = 0; targetData && i < targetData->brackets.size() && found < 0; ++i) {
+                running += isOpeningBracket(targetData->brackets.at(i).character) ? 1 : -1;
+                if (running <= level) {
+                    found = targetData->brackets.at(i).position;
+                }
+            }
+        }
+        *depth = level;
     } else {
+        /* The opening bracket is the last one reached at the depth the closing one leaves */
+        const int level = start + local - 1;
+        found = openingBefore(block, data, index, start + local, level, &target);
+        *depth = level;
+    }
+
+    if (found < 0 || !target.isValid()) {
         return false;
     }
+    *match = target.position() + found;
+    return true;
+}
+
+bool PythonHighlighter::enclosingBracket(int position, int *opener) const {
+    QTextBlock block = doc->findBlock(position);
+    if (!block.isValid()) {
+        return false;
+    }
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    const int column = position - block.position();
+    int index = 0;
+    int running = brackets.depthBefore(block.blockNumber());
+    for (; data && index < data->brackets.size() && data->brackets.at(index).position < column; ++index) {
+        running += isOpeningBracket(data->brackets.at(index).character) ? 1 : -1;
+    }
+    if (running <= 0) {
+        return false;
+    }
+
+    QTextBlock target;
+    const int found = openingBefore(block, data, index, running, running - 1, &target);
+    if (found < 0 || !target.isValid()) {
+        return false;
+    }
+    *opener = target.position() + found;
+    return true;
+}
+
+/*
+* Searches backwards from bracket 'index' of 'block', in front of which the
+* depth is 'running', for the last bracket reached at a depth of 'level' or less.
+* Returns its position in 'target', or -1.
+*/
+int PythonHighlighter::openingBefore(const QTextBlock &block, const CodeBlockData *data, int index, int running, int level, QTextBlock *target) const {
+    for (int i = index - 1; data && i >= 0; --i) {
+        running -= isOpeningBracket(data->brackets.at(i).character) ? 1 : -1;
+        if (running <= level) {
+            *target = block;
+            return data->brackets.at(i).position;
+        }
+    }
+
+    const int targetNumber = brackets.findBackward(block.blockNumber(), level);
+    *target = doc->findBlockByNumber(targetNumber);
+    const CodeBlockData *targetData = static_cast<CodeBlockData*>(target->userData());
+    if (!targetData) {
+        return -1;
+    }
+    running = brackets.depthBefore(targetNumber) + targetData->summary.net;
+    for (int i = targetData->brackets.size() - 1; i >= 0; --i) {
+        running -= isOpeningBracket(targetData->brackets.at(i).character) ? 1 : -1;
+        if (running <= level) {
+            return targetData->brackets.at(i).position;
+        }
+    }
+    return -1;
+}
+
+int PythonHighlighter::tokenizeLine(const QTextBlock &block, int length, std::vector<PythonLexer::Token> &lineTokens) const {
+    const QString text = block.text();
+    length = qBound(0, length, text.length());
+    return PythonLexer::tokenize(text.utf16(), length, previousState(block), lineTokens);
 }
 
 QTextCharFormat PythonHighlighter::createFormat(const QBrush &brush, const QString &style) {
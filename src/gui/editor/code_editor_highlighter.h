@@ -1,35 +1,156 @@
 /*
 * Copyright (c) 2016 Jake Dharmasiri.
 * Licensed under the GNU GPLv3 License. See LICENSE for details.
-*
-* The following is a C++ reimplementation of the PyQt
-* Python syntax highlighter described below:
-* https://wiki.python.org/moin/PyQt/Python%20syntax%20highlighting
 */
 
 #ifndef CODE_EDITOR_HIGHLIGHTER_H
 #define CODE_EDITOR_HIGHLIGHTER_H
 
-#include <qsyntaxhighlighter.h>
-#include <tuple>
+#include "src/python/python_lexer.h"
+#include "code_editor_tokenizer.h"
+#include "code_editor_brackets.h"
+#include "code_editor_gutter.h"
+#include <qtextdocument.h>
+#include <qtextobject.h>
+#include <qtextlayout.h>
+#include <qtimer.h>
+#include <qvector.h>
+#include <vector>
+
+/*
+* Brackets of a block as found by the lexer, so brackets in strings and comments never count,
+* and the block's gutter markers
+*/
+class CodeBlockData : public QTextBlockUserData {
+public:
+    struct Bracket {
+        int position;
+        unsigned short character;
+    };
+
+    QVector<Bracket> brackets;
+    BracketIndex::Summary summary;
+    unsigned char markers[GutterLayerCount] = {};
+    bool folded = false;
+};
 
-class PythonHighlighter : public QSyntaxHighlighter {
+/*
+* Incremental Python highlighter for the code editor.
+*
+* Unlike QSyntaxHighlighter, which re-highlights every changed block (and
+* every block whose state cascades) before returning, blocks are highlighted
+* viewport first. Whatever lies outside of the visible range is queued, sent
+* in chunks to the shared TokenizeWorker and the returned spans are applied in
+* time-boxed slices whenever the event loop is idle, so opening a large file or
+* toggling a triple quote never stalls the editor. Every edit bumps the revision,
+* which makes any result still in flight stale.
+*
+* Each block's user state holds the lexer state at its end, or -1 if the
+* block has never been verified against the block before it.
+*/
+class PythonHighlighter : public QObject {
     Q_OBJECT
 
 public:
-    PythonHighlighter(QTextDocument *parent = 0);
-    QTextCharFormat returnFormat;
-    QTextCharFormat normalFormat;
+    PythonHighlighter(QTextDocument *parent);
+
+    /* Formats indexed by PythonLexer::TokenKind, shared by all highlighters */
+    static const QVector<QTextCharFormat> &tokenFormats();
+
+    void setVisibleBlocks(int first, int last);
+    void rehighlight();
 
-protected:
-    void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
+    /*
+    * Looks up the bracket matching the one at document position 'position'.
+    * 'depth' receives the nesting depth of the pair; returns false if there
+    * is no bracket at 'position' or it is unmatched.
+    */
+    bool matchBracket(int position, int *match, int *depth) const;
+
+    /* Finds the innermost bracket still open at document position 'position' */
+    bool enclosingBracket(int position, int *opener) const;
+
+    /* Lexes the first 'length' characters of a block from the state the block before it ends in */
+    int tokenizeLine(const QTextBlock &block, int length, std::vector<PythonLexer::Token> &lineTokens) const;
+
+    /*
+    * Last block hidden when block 'blockNumber' is folded, or -1 if nothing
+    * folds there. A block folds the more indented lines after it, a #region
+    * comment everything up to its #endregion.
+    */
+    int foldEnd(int blockNumber) const;
+
+    /* Same as foldEnd(), but first lexes whatever queued blocks the answer depends on */
+    int settledFoldEnd(int blockNumber);
+
+    /* The block itself if it folds, otherwise the nearest less indented block before it, or -1 */
+    int enclosingFold(int blockNumber) const;
+
+    /* Relayouts a range of the document, e.g. after hiding blocks, without it counting as an edit */
+    void relayout(int position, int length);
+
+Q_SIGNALS:
+    void foldsChanged();
 
 private:
-    QList<std::tuple<QRegExp, int, QTextCharFormat>> rules;
-    std::tuple<QRegExp, int, QTextCharFormat> tri_single, tri_double;
+    enum {
+        SliceBudget = 8, /* ms per idle slice */
+        JobBlocks = 4096,
+        JobChars = 256 * 1024
+    };
+
+    QTextDocument *doc;
+    QTimer *idleTimer;
+    const QVector<QTextCharFormat> &formats;
+    unsigned int plainKinds = 0; /* token kinds drawn like normal text, which need no format range */
+    std::vector<PythonLexer::Token> tokens;
+
+    /* Blocks from dirtyFrom on may be stale; everything up to forceUntil must be lexed */
+    int dirtyFrom;
+    int forceUntil;
+    int firstVisible = 0;
+    int lastVisible = 100;
+    int provisionalFirst = -1;
+    int provisionalLast = -1;
+    int lastBlockCount = 1;
+    bool applying = false;
+
+    /* Background tokenization: at most one job in flight, results applied from resultIndex on */
+    const quintptr jobOwner;
+    int revision = 0;
+    bool jobPending = false;
+    TokenizeResult result;
+    int resultIndex = 0;
+
+    /* Bracket summary of every block, kept in step with the document's blocks */
+    BracketIndex brackets;
+
+    /*
+    * Fold structure: the indentation of every line that counts for folding as
+    * the depth, blank, comment and string continuation lines left empty, and
+    * #region and #endregion comments as opening and closing brackets.
+    */
+    BracketIndex indents;
+    BracketIndex regions;
+
+    int highlightBlock(QTextBlock block, int previousState, bool store);
+    void applyTokens(QTextBlock block, const PythonLexer::Token *tokens, int count);
+    void updateBrackets(QTextBlock block, const PythonLexer::Token *tokens, int count);
+    void updateFolding(const QTextBlock &block);
+    int foldRange(int blockNumber, int *decidedBy) const;
+    void postJob();
+    void applyResult();
+    int previousState(const QTextBlock &block) const;
+    int openingBefore(const QTextBlock &block, const CodeBlockData *data, int index, int running, int level, QTextBlock *target) const;
+    void processPending(int lastBlock);
+    void highlightVisible();
+    void clearPending();
+    static QTextCharFormat createFormat(const QBrush &brush, const QString &style = "");
 
-    bool matchMultiline(const QString &text, const std::tuple<QRegExp, int, QTextCharFormat> &multiRule);
-    QTextCharFormat createFormat(const QBrush &brush, const QString &style = "");
+private Q_SLOTS:
+    void reformatBlocks(int from, int charsRemoved, int charsAdded);
+    void processIdle();
+    void tokenized(const TokenizeResult &result);
 };
 
 #endif // CODE_EDITOR_HIGHLIGHTER_H
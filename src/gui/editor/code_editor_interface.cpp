@@ -11,15 +11,45 @@
 #include <qcoreapplication.h>
 #include <qtextobject.h>
 #include <qpainter.h>
+#include <qscrollbar.h>
+#include <qevent.h>
+#include <qfileinfo.h>
+#include <qtooltip.h>
 #include <qdebug.h>
 
 CodeEditor::CodeEditor(QSettings* s, QWidget* parent, const QString &filePath) :
     location(filePath),
-    QPlainTextEdit(parent) {
+    jobOwner(newJobOwner()),
+    QPlainTextEdit(parent),
+    latency("CodeEditor") {
 
     lineNumbers = new LineNumberWidget(this);
 
-    updateLineNumbersWidth(0);
+    /* Syntax highlighter for Python documents */
+    highlighter = new PythonHighlighter(this->document());
+
+    /* Breakpoints, errors and other per-line markers drawn in the gutter */
+    markers = new GutterMarkers(this->document());
+
+    /* Outline and go-to-definition, parsed in the background */
+    symbols = new DocumentSymbols(this->document());
+
+    /* Find bar matches, searched incrementally */
+    search = new DocumentSearch(this->document());
+
+    /* Syntax errors and cheap static checks, run in a separate interpreter */
+    lint = new DocumentLint(this->document(), markers);
+    LintWorker::instance()->setInterpreter(s->value("Lint/sInterpreter", LintWorker::defaultInterpreter()).toString());
+    lintAllowed = s->value("Lint/bEnabled", true).toBool();
+    updateLinting();
+
+    /* Identifiers offered while typing, counted in the background */
+    words = new DocumentWords(this);
+    completion = new CompletionPopup(this);
+    autoComplete = s->value("Editor/bAutoComplete", true).toBool();
+
+    gutter.setFont(monoFont);
+    updateLineNumbersWidth(blockCount());
     highlightCurrentLine();
 
     tabSpacing = s->value("Editor/iTabSpacing", 4).toInt();
@@ -34,29 +64,37 @@ CodeEditor::CodeEditor(QSettings* s, QWidget* parent, const QString &filePath) :
     setWordWrapMode(QTextOption::NoWrap);
     setTabStopWidth(tabSpacing * fontMetrics().width(' '));
 
-    /* Syntax highlighter for Python documents */
-    highlighter = new PythonHighlighter(this->document());
-
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateLineNumbersWidth(int)));
     connect(this, SIGNAL(updateRequest(QRect, int)), this, SLOT(updateLineNumbersArea(QRect, int)));
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(highlightCurrentLine()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(highlightCurrentLine()));
+    connect(search, SIGNAL(matchesChanged()), this, SLOT(highlightCurrentLine()));
+    connect(lint, SIGNAL(problemsChanged()), this, SLOT(highlightCurrentLine()));
+    connect(markers, SIGNAL(markersChanged(int, int)), this, SLOT(updateMarkerRows(int, int)));
+    connect(highlighter, SIGNAL(foldsChanged()), lineNumbers, SLOT(update()));
 }
 
 int CodeEditor::lineNumbersWidth() {
-    int digits = 1;
-    int max = qMax(1, blockCount());
-    while (max >= 10) {
-        max /= 10;
-        ++digits;
-    }
+    return gutter.width();
+}
 
-    int space = fontMetrics().width(QLatin1Char('9')) * digits;
+/* Only touches the margins when the line count gains or loses a digit or the font changes */
+void CodeEditor::updateLineNumbersWidth(int newBlockCount) {
+    gutter.setLineCount(newBlockCount);
+    if (gutter.width() == gutterWidth) {
+        return;
+    }
+    gutterWidth = gutter.width();
+    setViewportMargins(gutterWidth, 0, 0, 0);
 
-    return space + 30; /* width offset */
+    QRect cr = contentsRect();
+    lineNumbers->setGeometry(QRect(cr.left(), cr.top(), gutterWidth, cr.height()));
 }
 
-void CodeEditor::updateLineNumbersWidth(int /* newBlockCount */) {
-    setViewportMargins(lineNumbersWidth(), 0, 0, 0);
+/* Untitled buffers are taken to be Python until saved as something else */
+void CodeEditor::updateLinting() {
+    const QString suffix = QFileInfo(location).suffix().toLower();
+    lint->setEnabled(lintAllowed && (location.isEmpty() || suffix == "py" || suffix == "pyw"));
 }
 
 void CodeEditor::updateLineNumbersArea(const QRect &rect, int dy) {
@@ -66,19 +104,71 @@ void CodeEditor::updateLineNumbersArea(const QRect &rect, int dy) {
         lineNumbers->update(0, rect.y(), lineNumbers->width(), rect.height());
     }
 
-    if (rect.contains(viewport()->rect())) {
-        updateLineNumbersWidth(0);
+    /* Let the highlighter know which blocks to do first; blocks inside folds take no room on screen */
+    QTextBlock block = firstVisibleBlock();
+    const int firstBlock = block.blockNumber();
+    int lastBlock = firstBlock;
+    int top = (int)blockBoundingGeometry(block).translated(contentOffset()).top();
+    while (block.isValid() && top <= viewport()->height()) {
+        lastBlock = block.blockNumber();
+        top += (int)blockBoundingRect(block).height();
+        block = nextShownBlock(block);
+    }
+    highlighter->setVisibleBlocks(firstBlock, lastBlock);
+}
+
+/*
+* The next block on screen after 'block'. A collapsed fold is jumped over as a
+* whole, so loops over the screen never step through the lines it hides.
+*/
+QTextBlock CodeEditor::nextShownBlock(const QTextBlock &block) const {
+    QTextBlock next = block.next();
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    if (data && data->folded) {
+        /* Unless edits made the fold longer than what was hidden when it closed */
+        const QTextBlock last = document()->findBlockByNumber(highlighter->foldEnd(block.blockNumber()));
+        if (last.isValid() && !last.isVisible() && last.blockNumber() > block.blockNumber()) {
+            next = last.next();
+        }
+    }
+    while (next.isValid() && !next.isVisible()) {
+        next = next.next();
+    }
+    return next;
+}
+
+/* Repaints the rows of the given blocks that are on screen, and nothing else */
+void CodeEditor::updateMarkerRows(int firstBlock, int lastBlock) {
+    QTextBlock block = firstVisibleBlock();
+    int blockNumber = block.blockNumber();
+    int top = (int)blockBoundingGeometry(block).translated(contentOffset()).top();
+    int dirtyTop = -1;
+    int dirtyBottom = -1;
+
+    while (block.isValid() && top <= viewport()->height() && blockNumber <= lastBlock) {
+        int bottom = top + (int)blockBoundingRect(block).height();
+        if (block.isVisible() && blockNumber >= firstBlock) {
+            if (dirtyTop < 0) {
+                dirtyTop = top;
+            }
+            dirtyBottom = bottom;
+        }
+
+        block = nextShownBlock(block);
+        top = bottom;
+        blockNumber = block.blockNumber();
+    }
+
+    if (dirtyTop >= 0) {
+        lineNumbers->update(0, dirtyTop, lineNumbers->width(), dirtyBottom - dirtyTop);
     }
 }
 
 void CodeEditor::lineNumbersPaintEvent(QPaintEvent *event) {
     QPainter painter(lineNumbers);
-    QRect lineNumberBG = event->rect();
-    lineNumberBG.setWidth(lineNumberBG.width() - 8);
-    painter.fillRect(lineNumberBG, Qt::lightGray);
-
-    monoFont.setPointSize(this->font().pointSize());
-    painter.setFont(monoFont);
+    gutter.paintBackground(painter, event->rect());
+    painter.setFont(gutter.font());
+    painter.setPen(Qt::black);
 
     QTextBlock block = firstVisibleBlock();
     int blockNumber = block.blockNumber();
@@ -87,15 +177,141 @@ void CodeEditor::lineNumbersPaintEvent(QPaintEvent *event) {
 
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
-            QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::black);
-            painter.drawText(-20, top, lineNumbers->width(), fontMetrics().height(), Qt::AlignRight, number);
+            const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+            GutterFold fold = NoFold;
+            if (data && data->folded) {
+                fold = FoldClosed;
+            } else if (highlighter->foldEnd(blockNumber) >= 0) {
+                fold = FoldOpen;
+            }
+            gutter.paintRow(painter, block, blockNumber + 1, top, bottom - top, fold);
         }
 
-        block = block.next();
+        block = nextShownBlock(block);
         top = bottom;
         bottom = top + (int)blockBoundingRect(block).height();
-        ++blockNumber;
+        blockNumber = block.blockNumber();
+    }
+}
+
+/* Clicking the marker column toggles a breakpoint, clicking a fold handle the fold */
+void CodeEditor::lineNumbersMousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    QTextBlock block = cursorForPosition(QPoint(0, event->y())).block();
+    if (gutter.inMarkerColumn(event->x())) {
+        markers->setMarker(block, BreakpointLayer, markers->marker(block, BreakpointLayer) ? NoMarker : 1);
+    } else if (gutter.inFoldColumn(event->x())) {
+        const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+        setFolded(block, !(data && data->folded));
+    }
+}
+
+void CodeEditor::toggleFoldAtCursor() {
+    QTextBlock block = textCursor().block();
+    const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+    if (data && data->folded) {
+        setFolded(block, false);
+        return;
+    }
+
+    const int header = highlighter->enclosingFold(block.blockNumber());
+    if (header >= 0) {
+        setFolded(document()->findBlockByNumber(header), true);
+    }
+}
+
+/*
+* Folding only flips block visibility and has the layout drop the hidden
+* blocks' line counts, no text is laid out, so even huge folds are instant.
+*/
+void CodeEditor::setFolded(QTextBlock header, bool fold) {
+    const int end = highlighter->settledFoldEnd(header.blockNumber());
+    CodeBlockData *data = static_cast<CodeBlockData*>(header.userData());
+    if (fold == (data && data->folded) || (fold && end < 0)) {
+        return;
+    }
+    if (!data) {
+        data = new CodeBlockData;
+        header.setUserData(data);
+    }
+    data->folded = fold;
+
+    if (!fold) {
+        showBlocks(header, end);
+        return;
+    }
+
+    /* Keep the cursor out of the hidden blocks */
+    const int cursorBlock = textCursor().blockNumber();
+    if (cursorBlock > header.blockNumber() && cursorBlock <= end) {
+        QTextCursor cursor = textCursor();
+        cursor.setPosition(header.position() + header.length() - 1);
+        setTextCursor(cursor);
+    }
+
+    QTextBlock block = header.next();
+    QTextBlock last;
+    for (int number = header.blockNumber() + 1; block.isValid() && number <= end; ++number) {
+        block.setVisible(false);
+        last = block;
+        block = block.next();
+    }
+    if (last.isValid()) {
+        const int from = header.next().position();
+        highlighter->relayout(from, last.position() + last.length() - from);
+    }
+    lineNumbers->update();
+}
+
+/* Shows the hidden blocks after 'header' up to 'end', or the whole hidden run if 'end' is -1 */
+void CodeEditor::showBlocks(const QTextBlock &header, int end) {
+    QTextBlock block = header.next();
+    QTextBlock last;
+    int number = header.blockNumber() + 1;
+    while (block.isValid() && !block.isVisible() && (end < 0 || number <= end)) {
+        block.setVisible(true);
+        last = block;
+
+        /* Folds nested inside stay folded */
+        const CodeBlockData *data = static_cast<CodeBlockData*>(block.userData());
+        if (data && data->folded) {
+            const int innerEnd = highlighter->settledFoldEnd(number);
+            if (innerEnd > number) {
+                block = document()->findBlockByNumber(innerEnd);
+                number = innerEnd;
+                last = block;
+            }
+        }
+        block = block.next();
+        ++number;
+    }
+
+    if (last.isValid()) {
+        const int from = header.next().position();
+        highlighter->relayout(from, last.position() + last.length() - from);
+    }
+    lineNumbers->update();
+}
+
+/* Unfolds whatever hides 'block', e.g. after the cursor was moved into a fold */
+void CodeEditor::revealBlock(const QTextBlock &block) {
+    while (!block.isVisible()) {
+        QTextBlock header = block.previous();
+        while (header.isValid() && !header.isVisible()) {
+            header = header.previous();
+        }
+        if (!header.isValid()) {
+            return;
+        }
+
+        setFolded(header, false);
+        if (!block.isVisible()) {
+            /* The fold changed shape since it was folded */
+            showBlocks(header, -1);
+        }
     }
 }
 
@@ -106,7 +322,49 @@ void CodeEditor::resizeEvent(QResizeEvent *event) {
     lineNumbers->setGeometry(QRect(cr.left(), cr.top(), lineNumbersWidth(), cr.height()));
 }
 
+void CodeEditor::changeEvent(QEvent *event) {
+    QPlainTextEdit::changeEvent(event);
+
+    /* Zooming changes the font size, so the digits follow it in the gutter's own font and are laid out again */
+    if (event->type() == QEvent::FontChange) {
+        QFont numbers = monoFont;
+        if (font().pointSizeF() > 0) {
+            numbers.setPointSizeF(font().pointSizeF());
+        }
+        gutter.setFont(numbers);
+        updateLineNumbersWidth(blockCount());
+        lineNumbers->update();
+    }
+}
+
+void CodeEditor::paintEvent(QPaintEvent *event) {
+    QPlainTextEdit::paintEvent(event);
+    latency.painted();
+}
+
+/* Shows the message of the problem under the mouse */
+bool CodeEditor::viewportEvent(QEvent *event) {
+    if (event->type() == QEvent::ToolTip) {
+        QHelpEvent *help = static_cast<QHelpEvent*>(event);
+        const QString message = lint->messageAt(cursorForPosition(help->pos()).position());
+        if (message.isEmpty()) {
+            QToolTip::hideText();
+            event->ignore();
+        } else {
+            QToolTip::showText(help->globalPos(), message, viewport());
+        }
+        return true;
+    }
+    return QPlainTextEdit::viewportEvent(event);
+}
+
 void CodeEditor::keyPressEvent(QKeyEvent *event) {
+    LatencyKey<QPlainTextEdit> key(latency, this);
+
+    if (completion->handleKey(event)) {
+        return;
+    }
+
     if ((event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) && (event->modifiers() == Qt::ShiftModifier)) {
         event->setModifiers(Qt::NoModifier);
     }
@@ -123,66 +381,9 @@ void CodeEditor::keyPressEvent(QKeyEvent *event) {
             break;
         }
 
-                          /* Check line for colons and return keyword to handle indentation on next line*/
+                          /* Indent the new line from the tokens and brackets in front of the cursor */
         case Qt::Key_Return: case Qt::Key_Enter: {
-            QString currentBlock = this->textCursor().block().text();
-            QString::const_iterator iter = currentBlock.begin();
-
-            QString whitespace;
-            while (iter != currentBlock.end()) {
-                const QChar &c = *iter;
-                if (c == ' ' || c == '\t') {
-                    whitespace.append(c);
-                    ++iter;
-                } else {
-                    break;
-                }
-            }
-
-            QString colonSearch;
-            QString returnSearch;
-
-            /* TODO: Handle edge cases where cursor is before colon or return keyword
-             *       Handle paranthetical parameter indentation.
-             */
-
-            Q_FOREACH(QTextLayout::FormatRange r, textCursor().block().layout()->additionalFormats()) {
-                if (r.format == highlighter->normalFormat) {
-                    colonSearch.append(currentBlock.mid(r.start, r.length));
-                }
-                if (r.format == highlighter->returnFormat) {
-                    returnSearch.append(currentBlock.mid(r.start, r.length));
-                }
-            }
-
-            if (colonSearch.contains(QRegExp(":"))) {
-                if (tabsEmitSpaces) {
-                    whitespace += QString(tabSpacing, ' ');
-                } else {
-                    whitespace.append('\t');
-                }
-            } else if (returnSearch.contains(QRegExp("return"))) {
-                unsigned int tabOver = 0;
-                Q_FOREACH(QChar c, whitespace) {
-                    if (c == ' ') {
-                        tabOver += 1;
-                    }
-                    if (c == '\t') {
-                        tabOver += tabSpacing;
-                    }
-                }
-                tabOver /= tabSpacing;
-                if (tabOver > 0) {
-                    tabOver -= 1;
-                }
-
-                if (tabsEmitSpaces) {
-                    whitespace = QString(tabSpacing * tabOver, ' ');
-                } else {
-                    whitespace = QString(tabOver, '\t');
-                }
-            }
-
+            const QString whitespace = newLineIndent(textCursor().selectionStart());
             QPlainTextEdit::keyPressEvent(event);
             this->textCursor().insertText(whitespace);
 
@@ -225,11 +426,191 @@ void CodeEditor::keyPressEvent(QKeyEvent *event) {
             break;
         }
     }
+
+    updateCompletion(event);
+}
+
+/* Opens or refilters the completion popup after a key that typed or erased part of a word, closes it after any other */
+void CodeEditor::updateCompletion(QKeyEvent *event) {
+    switch (event->key()) {
+        case Qt::Key_Shift: case Qt::Key_Control: case Qt::Key_Alt: case Qt::Key_Meta: case Qt::Key_AltGr:
+            return;
+        default:
+            break;
+    }
+
+    const QString typed = event->text();
+    const bool typedWord = typed.length() == 1 && (typed.at(0).isLetterOrNumber() || typed.at(0) == '_' || typed.at(0) == '.');
+    const bool erased = (event->key() == Qt::Key_Backspace || event->key() == Qt::Key_Delete) && completion->isVisible();
+    const QTextCursor cursor = textCursor();
+    if (!autoComplete || cursor.hasSelection() || !(typedWord || erased)) {
+        completion->hide();
+        return;
+    }
+
+    const QTextBlock block = cursor.block();
+    const QString text = block.text();
+    const int column = cursor.positionInBlock();
+    int wordStart = column;
+    while (wordStart > 0 && (text.at(wordStart - 1).isLetterOrNumber() || text.at(wordStart - 1) == '_')) {
+        --wordStart;
+    }
+    const QString prefix = text.mid(wordStart, column - wordStart);
+
+    /* After a dot, the dotted name in front of it if there is one, e.g. os.path in os.path.jo */
+    QString expression;
+    const bool afterDot = wordStart > 0 && text.at(wordStart - 1) == '.';
+    if (afterDot) {
+        int expressionStart = wordStart - 1;
+        while (expressionStart > 0 && (text.at(expressionStart - 1).isLetterOrNumber() || text.at(expressionStart - 1) == '_' || text.at(expressionStart - 1) == '.')) {
+            --expressionStart;
+        }
+        expression = text.mid(expressionStart, wordStart - 1 - expressionStart);
+        const QStringList parts = expression.split('.');
+        for (int i = 0; i < parts.size(); ++i) {
+            if (parts.at(i).isEmpty() || parts.at(i).at(0).isDigit()) {
+                expression.clear();
+                break;
+            }
+        }
+    }
+
+    /* A dot after a name opens the popup right away, a word once it is long enough */
+    const int shortest = completion->isVisible() ? 1 : MinCompletionPrefix;
+    if ((expression.isEmpty() && prefix.length() < shortest) || (!prefix.isEmpty() && prefix.at(0).isDigit())) {
+        completion->hide();
+        return;
+    }
+
+    /* Nothing to complete in strings, comments and numbers */
+    std::vector<PythonLexer::Token> tokens;
+    highlighter->tokenizeLine(block, column, tokens);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const PythonLexer::Token &token = tokens[i];
+        if (token.start < column && token.start + token.length >= column) {
+            if (token.kind == PythonLexer::String || token.kind == PythonLexer::DocString ||
+                token.kind == PythonLexer::Comment || token.kind == PythonLexer::Number) {
+                completion->hide();
+                return;
+            }
+        }
+    }
+
+    completion->filter(prefix, expression, block.position() + wordStart);
+}
+
+static QString leadingWhitespace(const QString &text, int limit) {
+    int length = 0;
+    while (length < limit && (text.at(length) == ' ' || text.at(length) == '\t')) {
+        ++length;
+    }
+    return text.left(length);
+}
+
+static bool isKeyword(const QString &text, const PythonLexer::Token &token, const char *word) {
+    return token.kind == PythonLexer::Keyword && text.midRef(token.start, token.length) == QLatin1String(word);
+}
+
+/* Whitespace for 'levels' indentation levels */
+QString CodeEditor::indentString(int levels) const {
+    if (tabsEmitSpaces) {
+        return QString(tabSpacing * levels, ' ');
+    }
+    return QString(levels, '\t');
+}
+
+/* Visual width of leading whitespace in indentation levels */
+int CodeEditor::indentLevels(const QString &whitespace) const {
+    int columns = 0;
+    Q_FOREACH(QChar c, whitespace) {
+        columns += (c == '\t') ? tabSpacing : 1;
+    }
+    return columns / qMax(1, tabSpacing);
+}
+
+/*
+* Works out the indentation of a line broken at 'position'. Inside brackets
+* the new line hangs off the innermost open bracket; otherwise it is indented
+* after a trailing colon and dedented after return, pass, raise, break and
+* continue, both judged from the lexer's tokens so strings and comments never count.
+*/
+QString CodeEditor::newLineIndent(int position) {
+    QTextBlock block = document()->findBlock(position);
+    const QString text = block.text();
+    const int column = position - block.position();
+
+    int opener;
+    if (highlighter->enclosingBracket(position, &opener)) {
+        const QTextBlock openerBlock = document()->findBlock(opener);
+        const QString openerText = (openerBlock == block) ? text : openerBlock.text();
+        const int openerColumn = opener - openerBlock.position();
+        const int end = (openerBlock == block) ? column : openerText.length();
+        const QString openerWhitespace = leadingWhitespace(openerText, openerText.length());
+
+        /* Nothing after the bracket: hanging indent, otherwise line up with its first argument */
+        bool hanging = true;
+        for (int i = openerColumn + 1; i < end && hanging; ++i) {
+            hanging = openerText.at(i).isSpace();
+        }
+        if (hanging) {
+            return openerWhitespace + indentString(1);
+        }
+        return openerWhitespace + QString(openerColumn + 1 - openerWhitespace.length(), ' ');
+    }
+
+    std::vector<PythonLexer::Token> tokens;
+    const int state = highlighter->tokenizeLine(block, column, tokens);
+    QString whitespace = leadingWhitespace(text, column);
+    if (state & PythonLexer::StateStringMask) {
+        /* Inside a multi-line string */
+        return whitespace;
+    }
+
+    /* A line closing brackets opened further up belongs to the statement that opened them */
+    QTextBlock statement = block;
+    while (highlighter->enclosingBracket(statement.position(), &opener)) {
+        statement = document()->findBlock(opener);
+    }
+    QString statementText = text;
+    std::vector<PythonLexer::Token> statementTokens;
+    if (statement != block) {
+        statementText = statement.text();
+        whitespace = leadingWhitespace(statementText, statementText.length());
+        highlighter->tokenizeLine(statement, statementText.length(), statementTokens);
+    }
+    const std::vector<PythonLexer::Token> &firstTokens = (statement != block) ? statementTokens : tokens;
+
+    for (int i = (int)tokens.size() - 1; i >= 0; --i) {
+        const PythonLexer::Token &token = tokens[i];
+        if (token.kind == PythonLexer::Comment) {
+            continue;
+        }
+        if (token.kind == PythonLexer::Operator && token.length == 1 && text.at(token.start) == ':') {
+            return whitespace + indentString(1);
+        }
+        break;
+    }
+
+    for (size_t i = 0; i < firstTokens.size(); ++i) {
+        const PythonLexer::Token &token = firstTokens[i];
+        if (isKeyword(statementText, token, "return") || isKeyword(statementText, token, "pass") ||
+            isKeyword(statementText, token, "raise") || isKeyword(statementText, token, "break") ||
+            isKeyword(statementText, token, "continue")) {
+            return indentString(qMax(0, indentLevels(whitespace) - 1));
+        }
+        break;
+    }
+
+    return whitespace;
 }
 
 void CodeEditor::highlightCurrentLine() {
     QList<QTextEdit::ExtraSelection> extraSelection;
 
+    if (!textCursor().block().isVisible()) {
+        revealBlock(textCursor().block());
+    }
+
     if (!isReadOnly()) {
         QTextEdit::ExtraSelection selection;
 
@@ -242,9 +623,107 @@ void CodeEditor::highlightCurrentLine() {
         extraSelection.append(selection);
     }
 
+    /* Search hits, only those on screen */
+    if (!search->pattern().isEmpty()) {
+        const QTextBlock top = firstVisibleBlock();
+        const QTextBlock bottom = cursorForPosition(QPoint(0, viewport()->height())).block();
+        int first, last;
+        search->range(top.position(), bottom.position() + bottom.length(), &first, &last);
+        last = qMin(last, first + (int)MaxSearchHighlights);
+        for (int i = first; i < last; ++i) {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(QColor("#FFE599"));
+            selection.cursor = QTextCursor(document());
+            selection.cursor.setPosition(search->at(i).start);
+            selection.cursor.setPosition(search->at(i).start + search->at(i).length, QTextCursor::KeepAnchor);
+            extraSelection.append(selection);
+        }
+    }
+
+    /* Lint problems, only those on screen */
+    if (!lint->problems().isEmpty()) {
+        const int top = firstVisibleBlock().position();
+        const QTextBlock bottom = cursorForPosition(QPoint(0, viewport()->height())).block();
+        const int end = bottom.position() + bottom.length();
+        const QVector<DocumentLint::Problem> &problems = lint->problems();
+        for (int i = 0; i < problems.size(); ++i) {
+            if (problems.at(i).range.selectionEnd() < top || problems.at(i).range.selectionStart() > end) {
+                continue;
+            }
+            QTextEdit::ExtraSelection selection;
+            selection.format.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+            selection.format.setUnderlineColor(problems.at(i).error ? QColor("#E06666") : QColor("#E69138"));
+            selection.cursor = problems.at(i).range;
+            extraSelection.append(selection);
+        }
+    }
+
+    /* Matching bracket pair, colored by its nesting depth */
+    int bracket, match, depth;
+    if (findBracketPair(&bracket, &match, &depth)) {
+        static const QColor rainbow[] = {
+            QColor("#FFD966"), QColor("#9FC5E8"), QColor("#B6D7A8"), QColor("#EA9999"), QColor("#D5A6BD")
+        };
+        const int colors = sizeof(rainbow) / sizeof(rainbow[0]);
+        const QColor pairColor = rainbow[((depth % colors) + colors) % colors];
+
+        const int positions[] = { bracket, match };
+        for (int i = 0; i < 2; ++i) {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(pairColor);
+            selection.cursor = QTextCursor(document());
+            selection.cursor.setPosition(positions[i]);
+            selection.cursor.setPosition(positions[i] + 1, QTextCursor::KeepAnchor);
+            extraSelection.append(selection);
+        }
+    }
+
     setExtraSelections(extraSelection);
 }
 
+/* Finds the bracket right after or right before the cursor and its match */
+bool CodeEditor::findBracketPair(int *bracket, int *match, int *depth) {
+    const int position = textCursor().position();
+    if (highlighter->matchBracket(position, match, depth)) {
+        *bracket = position;
+        return true;
+    }
+    if (position > 0 && highlighter->matchBracket(position - 1, match, depth)) {
+        *bracket = position - 1;
+        return true;
+    }
+    return false;
+}
+
+/* Moves the cursor to the start of zero-based 'line', unfolding it if needed */
+void CodeEditor::goToLine(int line) {
+    QTextBlock block = document()->findBlockByNumber(line);
+    if (!block.isValid()) {
+        return;
+    }
+    revealBlock(block);
+
+    QTextCursor cursor(block);
+    setTextCursor(cursor);
+    centerCursor();
+    setFocus();
+}
+
+QString CodeEditor::wordUnderCursor() const {
+    QTextCursor cursor = textCursor();
+    cursor.select(QTextCursor::WordUnderCursor);
+    return cursor.selectedText();
+}
+
+void CodeEditor::jumpToMatchingBracket() {
+    int bracket, match, depth;
+    if (findBracketPair(&bracket, &match, &depth)) {
+        QTextCursor cursor = textCursor();
+        cursor.setPosition(match);
+        setTextCursor(cursor);
+    }
+}
+
 void CodeEditor::zoomInSlot() {
     this->zoomIn(2);
 }
@@ -9,8 +9,14 @@
 #ifndef CODE_EDITOR_INTERFACE_H
 #define CODE_EDITOR_INTERFACE_H
 
+#include "code_editor_completion.h"
 #include "code_editor_highlighter.h"
-#include <qfilesystemwatcher.h>
+#include "code_editor_journal.h"
+#include "code_editor_gutter.h"
+#include "code_editor_lint.h"
+#include "code_editor_search.h"
+#include "code_editor_symbols.h"
+#include "src/gui/latency_monitor.h"
 #include <qplaintextedit.h>
 #include <qsettings.h>
 
@@ -19,35 +25,81 @@ class CodeEditor : public QPlainTextEdit {
 
 public:
     CodeEditor(QSettings *s, QWidget* parent = 0, const QString &filePath = "");
-    QFileSystemWatcher* watchdog = nullptr;
     QString filename;
     QString location;
+    GutterMarkers* markers;
+    DocumentSymbols* symbols;
+    DocumentSearch* search;
+    DocumentLint* lint;
+    DocumentJournal* journal = nullptr;
+    const quintptr jobOwner;    /* Names this editor in load and save jobs */
 
     void lineNumbersPaintEvent(QPaintEvent *event);
+    void lineNumbersMousePressEvent(QMouseEvent *event);
     int lineNumbersWidth();
+    void goToLine(int line);
+    QString wordUnderCursor() const;
+
+    /* Turns the checks on or off for what 'location' now names */
+    void updateLinting();
     int tabSpacing;
     bool tabsEmitSpaces;
     bool pendingRefresh = false;
     int untrackedID = 0;
+    QByteArray encoding = "UTF-8";
+    bool byteOrderMark = false;
+    bool loading = false;       /* Still being filled from its file */
+    int pendingLine = -1;       /* Zero-based line to go to once loaded */
+    int pendingCursor = -1;     /* Cursor position and scroll bar value to restore once loaded */
+    int pendingScroll = -1;
+    bool saving = false;        /* A snapshot of it is being written */
+    bool saveAgain = false;     /* Saved again while 'saving' */
+    bool externalChange = false;    /* Its file changed while 'saving' */
+    bool runAfterSave = false;      /* Run once 'saving' is done */
 
 protected:
     void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
     void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    bool viewportEvent(QEvent *event) Q_DECL_OVERRIDE;
+    void changeEvent(QEvent *event) Q_DECL_OVERRIDE;
 
 private:
+    enum { MaxSearchHighlights = 2000, MinCompletionPrefix = 2 };
+
     QWidget *lineNumbers;
+    GutterRenderer gutter;
+    int gutterWidth = 0;
     QFont monoFont = QFont("Courier New", 12, QFont::Normal, false);
     PythonHighlighter* highlighter;
+    bool lintAllowed = true;
+    DocumentWords* words;
+    CompletionPopup* completion;
+    bool autoComplete;
+    LatencyProbe latency;
+
+    bool findBracketPair(int *bracket, int *match, int *depth);
+    QString newLineIndent(int position);
+    QString indentString(int levels) const;
+    int indentLevels(const QString &whitespace) const;
+    void setFolded(QTextBlock header, bool fold);
+    void showBlocks(const QTextBlock &header, int end);
+    QTextBlock nextShownBlock(const QTextBlock &block) const;
+    void revealBlock(const QTextBlock &block);
+    void updateCompletion(QKeyEvent *event);
 
 private Q_SLOTS:
     void updateLineNumbersWidth(int newBlockCount);
     void updateLineNumbersArea(const QRect &, int);
+    void updateMarkerRows(int firstBlock, int lastBlock);
     void highlightCurrentLine();
 
 public Q_SLOTS:
     void zoomInSlot();
     void zoomOutSlot();
     void resetZoom(int zoom = 12);
+    void jumpToMatchingBracket();
+    void toggleFoldAtCursor();
 };
 
 #endif // CODE_EDITOR_INTERFACE_H
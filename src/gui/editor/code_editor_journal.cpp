@@ -0,0 +1,383 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_journal.h"
+#include "code_editor_loader.h"
+#include "code_editor_tokenizer.h"
+#include <qcoreapplication.h>
+#include <qcryptographichash.h>
+#include <qdatastream.h>
+#include <qdatetime.h>
+#include <qdir.h>
+#include <qmap.h>
+#include <qset.h>
+#include <qstandardpaths.h>
+#include <qtextcursor.h>
+#include <qdebug.h>
+#include <climits>
+
+namespace {
+
+enum { Magic = 0x504A524E, Version = 1 };
+
+QByteArray headerOf(int kind, const JournalBase &base) {
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(Magic) << quint32(Version) << quint8(kind) << base.location << base.title
+        << base.encoding << base.byteOrderMark << base.size << base.hash;
+    return header;
+}
+
+bool readHeader(QDataStream &in, int *kind, JournalBase *base) {
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint8 baseKind = 0;
+    in >> magic >> version;
+    if (magic != Magic || version != Version) {
+        return false;
+    }
+    in >> baseKind >> base->location >> base->title >> base->encoding >> base->byteOrderMark >> base->size >> base->hash;
+    *kind = baseKind;
+    return in.status() == QDataStream::Ok;
+}
+
+/* The decoded text of the file at 'path'; with 'base', only if the file is still the one described */
+bool readText(const QString &path, QString *text, const JournalBase *base = 0) {
+    QFile source(path);
+    if (!source.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = source.readAll();
+    if (base && (data.size() != base->size || QCryptographicHash::hash(data, QCryptographicHash::Sha1) != base->hash)) {
+        return false;
+    }
+    QByteArray encoding;
+    bool byteOrderMark;
+    *text = TextDecoder::decode(data, &encoding, &byteOrderMark);
+    return true;
+}
+
+QString journalPath(const QString &directory, const QString &name, int generation, const QString &suffix) {
+    return directory + "/" + name + "." + QString::number(generation) + "." + suffix;
+}
+
+}
+
+JournalSession *JournalSession::instance() {
+    static JournalSession *session = 0;
+    if (!session) {
+        session = new JournalSession;
+    }
+    return session;
+}
+
+JournalSession::JournalSession() :
+    QObject(qApp) {
+
+    root = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal";
+    dir = root + "/" + QString::number(QCoreApplication::applicationPid()) + "-" +
+        QString::number(QDateTime::currentMSecsSinceEpoch());
+    QDir().mkpath(dir);
+
+    /* Held until exit; only a dead process's lock counts as stale */
+    lock = new QLockFile(dir + "/session.lock");
+    lock->setStaleLockTime(0);
+    if (!lock->tryLock(0)) {
+        qDebug() << "Unable to lock the edit journal directory" << dir;
+    }
+}
+
+/* A session that leaves no edits behind leaves nothing at all */
+JournalSession::~JournalSession() {
+    const bool clean = QDir(dir).entryList(QStringList() << "*.journal", QDir::Files).isEmpty();
+    delete lock;
+    if (clean) {
+        QDir(dir).removeRecursively();
+    }
+    qDeleteAll(orphanLocks);
+}
+
+QString JournalSession::nextName() {
+    return QString::number(++counter);
+}
+
+QVector<RecoveredDocument> JournalSession::orphans() {
+    QVector<RecoveredDocument> documents;
+    const QStringList sessions = QDir(root).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (int i = 0; i < sessions.size(); ++i) {
+        const QString path = root + "/" + sessions.at(i);
+        if (path == dir || orphaned.contains(path)) {
+            continue;
+        }
+        QLockFile *orphanLock = new QLockFile(path + "/session.lock");
+        orphanLock->setStaleLockTime(0);
+        if (!orphanLock->tryLock(0)) {
+            /* Another Pylet is still running */
+            delete orphanLock;
+            continue;
+        }
+        orphanLocks.append(orphanLock);
+        orphaned.append(path);
+
+        QSet<QString> names;
+        const QStringList journals = QDir(path).entryList(QStringList() << "*.journal", QDir::Files);
+        for (int k = 0; k < journals.size(); ++k) {
+            names.insert(journals.at(k).section('.', 0, 0));
+        }
+        for (QSet<QString>::const_iterator name = names.constBegin(); name != names.constEnd(); ++name) {
+            RecoveredDocument document;
+            if (DocumentJournal::recover(path, *name, &document)) {
+                documents.append(document);
+            }
+        }
+    }
+    return documents;
+}
+
+void JournalSession::removeOrphans() {
+    for (int i = 0; i < orphaned.size(); ++i) {
+        orphanLocks.at(i)->unlock();
+        QDir(orphaned.at(i)).removeRecursively();
+    }
+    qDeleteAll(orphanLocks);
+    orphanLocks.clear();
+    orphaned.clear();
+}
+
+DocumentJournal::DocumentJournal(QPlainTextEdit *editor) :
+    QObject(editor),
+    editor(editor),
+    doc(editor->document()),
+    name(JournalSession::instance()->nextName()),
+    jobOwner(newJobOwner()) {
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(FlushDelay);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    connect(doc, SIGNAL(contentsChange(int, int, int)), this, SLOT(documentChanged(int, int, int)));
+    connect(FileSaver::instance(), SIGNAL(saved(SavedFile)), this, SLOT(snapshotSaved(SavedFile)));
+    revision = doc->revision();
+}
+
+/* The journal outlives the editor when Pylet quits with unsaved edits */
+DocumentJournal::~DocumentJournal() {
+    writePending();
+}
+
+void DocumentJournal::reset(const JournalBase &base) {
+    discard();
+    this->base = base;
+}
+
+void DocumentJournal::discard() {
+    flushTimer->stop();
+    pending.clear();
+    file.close();
+    active = false;
+    compacting = 0;
+    removeGenerations(INT_MAX);
+    revision = doc->revision();
+}
+
+QString DocumentJournal::pathOf(int generation, const QString &suffix) const {
+    return journalPath(JournalSession::instance()->directory(), name, generation, suffix);
+}
+
+/* Starts the next generation, whose edits apply to 'kind' of base */
+void DocumentJournal::open(BaseKind kind) {
+    file.close();
+    ++generation;
+    file.setFileName(pathOf(generation, "journal"));
+    active = true;
+    written = 0;
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Unable to write edit journal" << file.fileName();
+        return;
+    }
+    file.write(headerOf(kind, base));
+    file.flush();
+}
+
+/* Highlighting reports format changes too, which replace nothing and leave the revision alone */
+void DocumentJournal::documentChanged(int position, int removed, int added) {
+    if (editor->isReadOnly() || (removed == added && doc->revision() == revision)) {
+        return;
+    }
+    revision = doc->revision();
+    if (!active) {
+        open(base.size < 0 ? EmptyBase : FileBase);
+    }
+
+    /* The range may run past the last block's end, which is not part of the text */
+    const int end = qMin(position + added, doc->characterCount() - 1);
+    QTextCursor cursor(doc);
+    cursor.setPosition(position);
+    cursor.setPosition(end, QTextCursor::KeepAnchor);
+    QString inserted = cursor.selectedText();
+    inserted.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << qint32(position) << qint32(removed) << inserted;
+    pending += record;
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+void DocumentJournal::writePending() {
+    if (pending.isEmpty()) {
+        return;
+    }
+    if (file.isOpen()) {
+        file.write(pending);
+        file.flush();
+    }
+    written += pending.size();
+    pending.clear();
+}
+
+/* Compacting once the journal outgrows the document keeps its cost proportional to the edits */
+void DocumentJournal::flush() {
+    writePending();
+    if (!compacting && written > CompactMinimum && written > qint64(doc->characterCount()) * 2) {
+        compact();
+    }
+}
+
+void DocumentJournal::compact() {
+    if (!active || compacting) {
+        return;
+    }
+    compacting = generation + 1;
+
+    SaveJob job;
+    job.owner = jobOwner;
+    job.path = pathOf(compacting, "base");
+    job.encoding = "UTF-8";
+    DocumentSnapshot* snapshot = new DocumentSnapshot(doc, job);
+    connect(snapshot, SIGNAL(completed()), this, SLOT(snapshotTaken()));
+    snapshot->start();
+}
+
+/* The snapshot holds every edit so far; the ones after it go to the next generation */
+void DocumentJournal::snapshotTaken() {
+    if (!active || compacting != generation + 1) {
+        return;
+    }
+    writePending();
+    open(SnapshotBase);
+}
+
+/* Older generations are only deleted once the snapshot replacing them is on disk */
+void DocumentJournal::snapshotSaved(const SavedFile &saved) {
+    if (saved.owner != jobOwner || !compacting || saved.path != pathOf(compacting, "base")) {
+        return;
+    }
+    const int compacted = compacting;
+    compacting = 0;
+    if (!saved.error.isEmpty()) {
+        qDebug() << "Unable to compact edit journal:" << saved.error;
+        return;
+    }
+    removeGenerations(compacted);
+}
+
+void DocumentJournal::removeGenerations(int below) {
+    QDir directory(JournalSession::instance()->directory());
+    const QStringList files = directory.entryList(QStringList() << name + ".*", QDir::Files);
+    for (int i = 0; i < files.size(); ++i) {
+        if (files.at(i).section('.', 1, 1).toInt() < below) {
+            directory.remove(files.at(i));
+        }
+    }
+}
+
+bool DocumentJournal::recover(const QString &directory, const QString &name, RecoveredDocument *document) {
+    QSet<int> bases;
+    QMap<int, QString> journals;
+    const QStringList files = QDir(directory).entryList(QStringList() << name + ".*", QDir::Files);
+    for (int i = 0; i < files.size(); ++i) {
+        const int generation = files.at(i).section('.', 1, 1).toInt();
+        const QString suffix = files.at(i).section('.', 2);
+        if (suffix == "journal") {
+            journals.insert(generation, directory + "/" + files.at(i));
+        } else if (suffix == "base") {
+            bases.insert(generation);
+        }
+    }
+    const QList<int> generations = journals.keys();
+
+    /* Start from the newest base that made it to disk */
+    QString text;
+    int first = -1;
+    for (int i = generations.size() - 1; i >= 0 && first < 0; --i) {
+        QFile journal(journals.value(generations.at(i)));
+        if (!journal.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        QDataStream in(&journal);
+        in.setVersion(QDataStream::Qt_5_0);
+        int kind;
+        JournalBase base;
+        if (!readHeader(in, &kind, &base)) {
+            return false;
+        }
+        if (kind == SnapshotBase) {
+            if (!bases.contains(generations.at(i))) {
+                continue;
+            }
+            QFile snapshot(journalPath(directory, name, generations.at(i), "base"));
+            if (!snapshot.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                return false;
+            }
+            text = QString::fromUtf8(snapshot.readAll());
+        } else if (kind == FileBase) {
+            if (!readText(base.location, &text, &base)) {
+                qDebug() << "Edit journal of" << base.location << "is for a version of the file that is gone";
+                return false;
+            }
+        }
+        first = i;
+    }
+    if (first < 0) {
+        return false;
+    }
+
+    /* Then replay each generation's edits in turn; a record cut short by the crash ends them */
+    for (int i = first; i < generations.size() && generations.at(i) == generations.at(first) + i - first; ++i) {
+        QFile journal(journals.value(generations.at(i)));
+        if (!journal.open(QIODevice::ReadOnly)) {
+            break;
+        }
+        QDataStream in(&journal);
+        in.setVersion(QDataStream::Qt_5_0);
+        int kind;
+        if (!readHeader(in, &kind, &document->base)) {
+            break;
+        }
+        while (!in.atEnd()) {
+            qint32 position;
+            qint32 removed;
+            QString inserted;
+            in >> position >> removed >> inserted;
+            if (in.status() != QDataStream::Ok || position < 0 || position > text.length() || removed < 0) {
+                break;
+            }
+            text.replace(position, qMin(int(removed), text.length() - position), inserted);
+        }
+    }
+    document->text = text;
+
+    /* Nothing to recover if the document ended up as its file is anyway */
+    QString current;
+    if (document->base.location.isEmpty()) {
+        return !text.isEmpty();
+    }
+    return !readText(document->base.location, &current) || current != text;
+}
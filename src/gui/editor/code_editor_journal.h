@@ -0,0 +1,132 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_JOURNAL_H
+#define CODE_EDITOR_JOURNAL_H
+
+#include "code_editor_saver.h"
+#include <qfile.h>
+#include <qlockfile.h>
+#include <qobject.h>
+#include <qplaintextedit.h>
+#include <qtimer.h>
+#include <qvector.h>
+
+/* What a journal's edits apply to: an empty document, or a file as it was read or saved */
+struct JournalBase {
+    QString location;           /* Empty for an untitled buffer */
+    QString title;
+    QByteArray encoding = "UTF-8";
+    bool byteOrderMark = false;
+    qint64 size = -1;           /* Of the file, -1 for an empty document */
+    QByteArray hash;            /* SHA-1 of the file */
+};
+
+/* A document rebuilt from the journal a crashed session left behind */
+struct RecoveredDocument {
+    JournalBase base;
+    QString text;
+};
+
+/*
+* The journals of this session live in a directory of their own, locked for
+* as long as the session runs. A directory nobody holds the lock of belongs
+* to a session that ended without saving everything, most likely a crash.
+*/
+class JournalSession : public QObject {
+    Q_OBJECT
+
+public:
+    /* The running session */
+    static JournalSession *instance();
+    ~JournalSession();
+
+    QString directory() const { return dir; }
+
+    /* A journal name no other document of this session uses */
+    QString nextName();
+
+    /* Documents with unsaved edits in the journals of sessions that are no longer running */
+    QVector<RecoveredDocument> orphans();
+
+    /* Deletes the journals orphans() looked at */
+    void removeOrphans();
+
+private:
+    JournalSession();
+
+    QString root;
+    QString dir;
+    QLockFile *lock;
+    int counter = 0;
+    QStringList orphaned;
+    QList<QLockFile*> orphanLocks;
+};
+
+/*
+* Journals the edits of a document so unsaved work survives a crash.
+*
+* Each edit appends its position, the length it removed and the text it
+* inserted, so recording costs as much as the edit and never depends on the
+* size of the document. Records are batched and appended every few hundred
+* milliseconds. Once the journal outgrows the document it is compacted: a
+* snapshot is written in the background and the edits after it go to a new
+* journal, the older ones being deleted once the snapshot is on disk.
+*
+* The journal only exists while the document differs from its base; the
+* editor stack resets it whenever the document matches its file again.
+* Changes made while the editor is read-only, as it is while being filled
+* from its file, are taken to be part of the base.
+*/
+class DocumentJournal : public QObject {
+    Q_OBJECT
+
+public:
+    DocumentJournal(QPlainTextEdit *editor);
+    ~DocumentJournal();
+
+    /* The document now holds exactly 'base'; later edits are journaled against it */
+    void reset(const JournalBase &base);
+
+    /* Deletes the journal, e.g. because the document was closed without saving */
+    void discard();
+
+    /* Replaces the journal with a snapshot of the document */
+    void compact();
+
+    /* Rebuilds the document journaled as 'name' in 'directory'; false when nothing is worth recovering */
+    static bool recover(const QString &directory, const QString &name, RecoveredDocument *document);
+
+private:
+    enum { FlushDelay = 300, CompactMinimum = 1024 * 1024 };
+    enum BaseKind { EmptyBase, FileBase, SnapshotBase };
+
+    QPlainTextEdit *editor;
+    QTextDocument *doc;
+    const QString name;
+    const quintptr jobOwner;
+    JournalBase base;
+    QFile file;
+    QByteArray pending;
+    QTimer *flushTimer;
+    qint64 written = 0;
+    int revision = 0;
+    int generation = 0;
+    int compacting = 0;         /* Generation whose snapshot is being written */
+    bool active = false;
+
+    QString pathOf(int generation, const QString &suffix) const;
+    void open(BaseKind kind);
+    void writePending();
+    void removeGenerations(int below);
+
+private Q_SLOTS:
+    void documentChanged(int position, int removed, int added);
+    void flush();
+    void snapshotTaken();
+    void snapshotSaved(const SavedFile &saved);
+};
+
+#endif // CODE_EDITOR_JOURNAL_H
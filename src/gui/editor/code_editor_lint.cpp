@@ -0,0 +1,285 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_lint.h"
+#include "code_editor_tokenizer.h"
+#include <qcoreapplication.h>
+#include <qfile.h>
+#include <qjsonarray.h>
+#include <qjsondocument.h>
+#include <qjsonobject.h>
+#include <qtextobject.h>
+#include <qdebug.h>
+
+LintWorker *LintWorker::instance() {
+    static LintWorker *worker = 0;
+    if (!worker) {
+        worker = new LintWorker;
+    }
+    return worker;
+}
+
+QString LintWorker::defaultInterpreter() {
+#ifdef Q_OS_WIN
+    return "python";
+#else
+    return "python3";
+#endif
+}
+
+LintWorker::LintWorker() :
+    QObject(qApp) {
+
+    QFile source(":/scripts/pylet_lint.py");
+    if (source.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        script = QString::fromUtf8(source.readAll());
+    }
+
+    process = new QProcess(this);
+    process->setStandardErrorFile(QProcess::nullDevice());
+    connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(readOutput()));
+    connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(failed(QProcess::ProcessError)));
+
+    watchdog = new QTimer(this);
+    watchdog->setSingleShot(true);
+    watchdog->setInterval(Timeout);
+    connect(watchdog, SIGNAL(timeout()), this, SLOT(timedOut()));
+}
+
+void LintWorker::setInterpreter(const QString &path) {
+    if (path == interpreter) {
+        return;
+    }
+    interpreter = path;
+    broken = false;
+    restart();
+}
+
+void LintWorker::post(quintptr owner, int revision, const QString &text) {
+    if (broken || interpreter.isEmpty() || script.isEmpty()) {
+        return;
+    }
+
+    Job job;
+    job.owner = owner;
+    job.revision = revision;
+    job.text = text;
+    if (!waiting.contains(owner)) {
+        queue.append(owner);
+    }
+    waiting.insert(owner, job);
+    dispatch();
+}
+
+void LintWorker::cancel(quintptr owner) {
+    waiting.remove(owner);
+    queue.removeAll(owner);
+    if (busy && running.owner == owner) {
+        /* A quick check may as well finish unseen; a slow one is in the way of the next */
+        running.owner = 0;
+        if (sinceRequest.elapsed() > CancelAfter) {
+            restart();
+        }
+    }
+}
+
+/* Stops the interpreter; the next check starts it again */
+void LintWorker::restart() {
+    watchdog->stop();
+    if (process->state() != QProcess::NotRunning) {
+        process->blockSignals(true);
+        process->kill();
+        process->waitForFinished(1000);
+        process->blockSignals(false);
+    }
+    output.clear();
+    busy = false;
+    dispatch();
+}
+
+void LintWorker::dispatch() {
+    if (busy || queue.isEmpty() || broken) {
+        return;
+    }
+    if (process->state() == QProcess::NotRunning) {
+        process->start(interpreter, QStringList() << "-I" << "-c" << script);
+    }
+
+    running = waiting.take(queue.takeFirst());
+    const QByteArray source = running.text.toUtf8();
+    ++request;
+    process->write(QByteArray::number(request) + ' ' + QByteArray::number(source.size()) + '\n');
+    process->write(source);
+
+    busy = true;
+    sinceRequest.start();
+    watchdog->start();
+}
+
+void LintWorker::readOutput() {
+    output += process->readAllStandardOutput();
+    int newline;
+    while ((newline = output.indexOf('\n')) >= 0) {
+        const QJsonObject answer = QJsonDocument::fromJson(output.left(newline)).object();
+        output.remove(0, newline + 1);
+        if (!busy || answer.value("id").toInt() != request) {
+            continue;
+        }
+
+        watchdog->stop();
+        busy = false;
+        if (running.owner) {
+            QVector<LintProblem> problems;
+            const QJsonArray list = answer.value("problems").toArray();
+            for (int i = 0; i < list.size(); ++i) {
+                const QJsonArray item = list.at(i).toArray();
+                LintProblem problem;
+                problem.line = item.at(0).toInt() - 1;
+                problem.column = item.at(1).toInt();
+                problem.length = item.at(2).toInt();
+                problem.error = item.at(3).toString() == "error";
+                problem.message = item.at(4).toString();
+                problems.append(problem);
+            }
+            Q_EMIT checked(running.owner, running.revision, problems);
+        }
+        dispatch();
+    }
+}
+
+/* A snapshot that hangs the checker is dropped rather than tried again */
+void LintWorker::timedOut() {
+    qDebug() << "Lint check timed out, restarting the checker";
+    restart();
+}
+
+void LintWorker::failed(QProcess::ProcessError error) {
+    if (error == QProcess::FailedToStart) {
+        qDebug() << "Unable to start the lint interpreter" << interpreter;
+        broken = true;
+        waiting.clear();
+        queue.clear();
+        busy = false;
+        watchdog->stop();
+    } else if (error == QProcess::Crashed) {
+        output.clear();
+        busy = false;
+        watchdog->stop();
+        dispatch();
+    }
+}
+
+DocumentLint::DocumentLint(QTextDocument *document, GutterMarkers *markers) :
+    QObject(document),
+    doc(document),
+    markers(markers),
+    jobOwner(newJobOwner()) {
+
+    debounce = new QTimer(this);
+    debounce->setSingleShot(true);
+    debounce->setInterval(DebounceDelay);
+
+    connect(doc, SIGNAL(contentsChanged()), this, SLOT(documentChanged()));
+    connect(debounce, SIGNAL(timeout()), this, SLOT(post()));
+    connect(LintWorker::instance(), SIGNAL(checked(quintptr, int, QVector<LintProblem>)),
+        this, SLOT(checked(quintptr, int, QVector<LintProblem>)));
+    revision = doc->revision();
+
+    debounce->start();
+}
+
+DocumentLint::~DocumentLint() {
+    LintWorker::instance()->cancel(jobOwner);
+}
+
+void DocumentLint::setEnabled(bool on) {
+    enabled = on;
+    if (enabled) {
+        debounce->start();
+    } else {
+        debounce->stop();
+        LintWorker::instance()->cancel(jobOwner);
+        clear();
+    }
+}
+
+const QVector<DocumentLint::Problem> &DocumentLint::problems() const {
+    return found;
+}
+
+QString DocumentLint::messageAt(int position) const {
+    for (int i = 0; i < found.size(); ++i) {
+        if (position >= found.at(i).range.selectionStart() && position <= found.at(i).range.selectionEnd()) {
+            return found.at(i).message;
+        }
+    }
+    return QString();
+}
+
+void DocumentLint::clear() {
+    if (found.isEmpty()) {
+        return;
+    }
+    found.clear();
+    markers->clearLayer(ErrorLayer);
+    Q_EMIT problemsChanged();
+}
+
+/* Whatever is waiting or running for the old text is worthless now */
+void DocumentLint::documentChanged() {
+    if (doc->revision() == revision || !enabled) {
+        return;
+    }
+    revision = doc->revision();
+    LintWorker::instance()->cancel(jobOwner);
+    debounce->start();
+}
+
+void DocumentLint::post() {
+    revision = doc->revision();
+    LintWorker::instance()->post(jobOwner, revision, doc->toPlainText());
+}
+
+void DocumentLint::checked(quintptr owner, int checkedRevision, const QVector<LintProblem> &problems) {
+    if (owner != jobOwner || checkedRevision != revision || !enabled) {
+        return;
+    }
+
+    found.clear();
+    markers->clearLayer(ErrorLayer);
+    for (int i = 0; i < problems.size(); ++i) {
+        const LintProblem &problem = problems.at(i);
+        const QTextBlock block = doc->findBlockByNumber(problem.line);
+        if (!block.isValid()) {
+            continue;
+        }
+
+        /* Problems without a length, like syntax errors, mark the character they point at */
+        const int lineLength = block.length() - 1;
+        int start = qMin(problem.column, lineLength);
+        int end = qMin(start + problem.length, lineLength);
+        if (end == start) {
+            if (start < lineLength) {
+                ++end;
+            } else if (start > 0) {
+                --start;
+            }
+        }
+
+        Problem marked;
+        marked.range = QTextCursor(doc);
+        marked.range.setPosition(block.position() + start);
+        marked.range.setPosition(block.position() + end, QTextCursor::KeepAnchor);
+        marked.error = problem.error;
+        marked.message = problem.message;
+        found.append(marked);
+
+        const int worst = problem.error ? ErrorLine : WarningLine;
+        if (markers->marker(block, ErrorLayer) < worst) {
+            markers->setMarker(block, ErrorLayer, worst);
+        }
+    }
+    Q_EMIT problemsChanged();
+}
@@ -0,0 +1,131 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_LINT_H
+#define CODE_EDITOR_LINT_H
+
+#include "code_editor_gutter.h"
+#include <qelapsedtimer.h>
+#include <qhash.h>
+#include <qobject.h>
+#include <qprocess.h>
+#include <qtextcursor.h>
+#include <qtextdocument.h>
+#include <qtimer.h>
+#include <qvector.h>
+
+struct LintProblem {
+    int line = 0;       /* Zero-based */
+    int column = 0;
+    int length = 0;
+    bool error = false;
+    QString message;
+};
+
+/*
+* Checks document snapshots in a Python interpreter of its own, so the
+* console's session never sees them. The interpreter stays up between checks
+* and handles one at a time. Only the newest snapshot of each document waits
+* its turn, and a check that is still running when its document changes is
+* dropped, by restarting the interpreter if it has taken a while.
+*/
+class LintWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide worker */
+    static LintWorker *instance();
+    static QString defaultInterpreter();
+
+    void setInterpreter(const QString &interpreter);
+    void post(quintptr owner, int revision, const QString &text);
+
+    /* Drops the waiting and running checks of 'owner' */
+    void cancel(quintptr owner);
+
+Q_SIGNALS:
+    void checked(quintptr owner, int revision, const QVector<LintProblem> &problems);
+
+private:
+    enum { CancelAfter = 250, Timeout = 5000 };
+
+    struct Job {
+        quintptr owner = 0;
+        int revision = 0;
+        QString text;
+    };
+
+    LintWorker();
+
+    QProcess *process;
+    QTimer *watchdog;
+    QString interpreter;
+    QString script;
+    bool broken = false;
+
+    QHash<quintptr, Job> waiting;
+    QList<quintptr> queue;
+    Job running;
+    bool busy = false;
+    int request = 0;
+    QElapsedTimer sinceRequest;
+    QByteArray output;
+
+    void restart();
+    void dispatch();
+
+private Q_SLOTS:
+    void readOutput();
+    void timedOut();
+    void failed(QProcess::ProcessError error);
+};
+
+/*
+* Problems of one document, checked in the background after edits settle.
+* Squiggles keep to their text as it is edited, since each one is a cursor,
+* and the worst problem of a line shows in the gutter's error layer.
+*/
+class DocumentLint : public QObject {
+    Q_OBJECT
+
+public:
+    struct Problem {
+        QTextCursor range;
+        bool error;
+        QString message;
+    };
+
+    DocumentLint(QTextDocument *document, GutterMarkers *markers);
+    ~DocumentLint();
+
+    void setEnabled(bool enabled);
+    const QVector<Problem> &problems() const;
+
+    /* Message of the problem at 'position', or an empty string */
+    QString messageAt(int position) const;
+
+Q_SIGNALS:
+    void problemsChanged();
+
+private:
+    enum { DebounceDelay = 500 };
+
+    QTextDocument *doc;
+    GutterMarkers *markers;
+    QTimer *debounce;
+    QVector<Problem> found;
+    const quintptr jobOwner;
+    int revision = 0;
+    bool enabled = true;
+
+    void clear();
+
+private Q_SLOTS:
+    void documentChanged();
+    void post();
+    void checked(quintptr owner, int revision, const QVector<LintProblem> &problems);
+};
+
+#endif // CODE_EDITOR_LINT_H
@@ -0,0 +1,249 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_loader.h"
+#include <qcoreapplication.h>
+#include <qcryptographichash.h>
+#include <qfile.h>
+#include <qregexp.h>
+#include <qrunnable.h>
+#include <qtextcodec.h>
+#include <qtextcursor.h>
+#include <qthread.h>
+#include <cstring>
+
+namespace {
+
+enum { DetectionProbe = 4096 };
+
+/* Mostly ASCII text in UTF-16 has a zero in every other byte */
+QTextCodec *detectUtf16(const QByteArray &data) {
+    const int probe = qMin(data.size(), (int)DetectionProbe) & ~1;
+    if (probe < 2) {
+        return 0;
+    }
+    int evenZeros = 0;
+    int oddZeros = 0;
+    for (int i = 0; i < probe; i += 2) {
+        evenZeros += data.at(i) == 0;
+        oddZeros += data.at(i + 1) == 0;
+    }
+    const int pairs = probe / 2;
+    if (oddZeros * 10 > pairs * 4 && evenZeros * 20 < pairs) {
+        return QTextCodec::codecForName("UTF-16LE");
+    }
+    if (evenZeros * 10 > pairs * 4 && oddZeros * 20 < pairs) {
+        return QTextCodec::codecForName("UTF-16BE");
+    }
+    return 0;
+}
+
+/* PEP 263: a comment naming the encoding on the first or second line */
+QTextCodec *declaredCodec(const QByteArray &data) {
+    int end = data.indexOf('\n');
+    if (end >= 0) {
+        end = data.indexOf('\n', end + 1);
+    }
+    const QString head = QString::fromLatin1(data.left(end < 0 ? qMin(data.size(), (int)DetectionProbe) : end));
+    QRegExp cookie("^[ \\t\\f]*#.*coding[:=][ \\t]*([-\\w.]+)");
+    const QStringList lines = head.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        if (cookie.indexIn(lines.at(i)) >= 0) {
+            return QTextCodec::codecForName(cookie.cap(1).toLatin1());
+        }
+    }
+    return 0;
+}
+
+}
+
+bool TextDecoder::isUtf8(const char *data, qint64 size) {
+    const uchar *p = reinterpret_cast<const uchar*>(data);
+    const uchar *end = p + size;
+    while (p < end) {
+        /* Eight ASCII bytes at a time */
+        if (end - p >= 8) {
+            quint64 word;
+            std::memcpy(&word, p, 8);
+            if (!(word & Q_UINT64_C(0x8080808080808080))) {
+                p += 8;
+                continue;
+            }
+        }
+        const uchar lead = *p;
+        if (lead < 0x80) {
+            ++p;
+            continue;
+        }
+
+        int length;
+        quint32 lowest;
+        if ((lead & 0xE0) == 0xC0) {
+            length = 2;
+            lowest = 0x80;
+        } else if ((lead & 0xF0) == 0xE0) {
+            length = 3;
+            lowest = 0x800;
+        } else if ((lead & 0xF8) == 0xF0) {
+            length = 4;
+            lowest = 0x10000;
+        } else {
+            return false;
+        }
+        if (end - p < length) {
+            return false;
+        }
+        quint32 code = lead & (0x7F >> length);
+        for (int i = 1; i < length; ++i) {
+            if ((p[i] & 0xC0) != 0x80) {
+                return false;
+            }
+            code = (code << 6) | (p[i] & 0x3F);
+        }
+        if (code < lowest || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+            return false;
+        }
+        p += length;
+    }
+    return true;
+}
+
+QString TextDecoder::decode(const QByteArray &data, QByteArray *encoding, bool *byteOrderMark) {
+    QString text;
+    *byteOrderMark = false;
+    if (QTextCodec *marked = QTextCodec::codecForUtfText(data, 0)) {
+        *encoding = marked->name();
+        *byteOrderMark = true;
+        text = marked->toUnicode(data);
+    } else if (isUtf8(data.constData(), data.size())) {
+        *encoding = "UTF-8";
+        text = QString::fromUtf8(data);
+    } else {
+        QTextCodec *codec = detectUtf16(data);
+        if (!codec) {
+            codec = declaredCodec(data);
+        }
+        if (!codec) {
+            /* The locale's encoding, unless that is UTF-8, which the data just failed */
+            codec = QTextCodec::codecForLocale();
+            if (codec->mibEnum() == 106) {
+                codec = QTextCodec::codecForName("Windows-1252");
+            }
+        }
+        *encoding = codec->name();
+        text = codec->toUnicode(data);
+    }
+
+    if (text.contains(QLatin1Char('\r'))) {
+        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    }
+    return text;
+}
+
+namespace {
+
+class LoadTask : public QRunnable {
+public:
+    LoadTask(FileLoader *loader, quintptr owner, const QString &path) :
+        loader(loader),
+        owner(owner),
+        path(path) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        LoadedFile file;
+        file.owner = owner;
+        file.path = path;
+
+        QFile source(path);
+        if (source.open(QIODevice::ReadOnly)) {
+            const QByteArray data = source.readAll();
+            if (source.error() == QFile::NoError) {
+                file.text = TextDecoder::decode(data, &file.encoding, &file.byteOrderMark);
+                file.size = data.size();
+                file.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+            } else {
+                file.error = source.errorString();
+            }
+        } else {
+            file.error = source.errorString();
+        }
+
+        /* Queued to the receivers, which live on the GUI thread */
+        Q_EMIT loader->loaded(file);
+    }
+
+private:
+    FileLoader *loader;
+    const quintptr owner;
+    const QString path;
+};
+
+}
+
+FileLoader *FileLoader::instance() {
+    static FileLoader *loader = 0;
+    if (!loader) {
+        qRegisterMetaType<LoadedFile>("LoadedFile");
+        loader = new FileLoader;
+    }
+    return loader;
+}
+
+FileLoader::FileLoader() :
+    QObject(qApp) {
+    pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+}
+
+void FileLoader::load(quintptr owner, const QString &path) {
+    pool.start(new LoadTask(this, owner, path));
+}
+
+DocumentFiller::DocumentFiller(QPlainTextEdit *editor, const QString &text) :
+    QObject(editor),
+    editor(editor),
+    text(text) {
+
+    editor->setReadOnly(true);
+    editor->document()->setUndoRedoEnabled(false);
+    offset = sliceEnd(0, FirstSlice);
+    editor->setPlainText(text.left(offset));
+
+    timer = new QTimer(this);
+    timer->setInterval(0);
+    connect(timer, SIGNAL(timeout()), this, SLOT(fill()));
+    timer->start();
+}
+
+/* Slices end after a newline, so no line is laid out twice */
+int DocumentFiller::sliceEnd(int from, int length) const {
+    if (from + length >= text.length()) {
+        return text.length();
+    }
+    const int newline = text.indexOf(QLatin1Char('\n'), from + length);
+    return newline < 0 ? text.length() : newline + 1;
+}
+
+void DocumentFiller::fill() {
+    QElapsedTimer clock;
+    clock.start();
+    QTextCursor cursor(editor->document());
+    cursor.movePosition(QTextCursor::End);
+    while (offset < text.length() && clock.elapsed() < SliceBudget) {
+        const int end = sliceEnd(offset, SliceLength);
+        cursor.insertText(text.mid(offset, end - offset));
+        offset = end;
+    }
+    if (offset < text.length()) {
+        return;
+    }
+
+    timer->stop();
+    editor->document()->setUndoRedoEnabled(true);
+    editor->document()->setModified(false);
+    editor->setReadOnly(false);
+    Q_EMIT finished();
+    deleteLater();
+}
@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_LOADER_H
+#define CODE_EDITOR_LOADER_H
+
+#include <qelapsedtimer.h>
+#include <qmetatype.h>
+#include <qobject.h>
+#include <qplaintextedit.h>
+#include <qthreadpool.h>
+#include <qtimer.h>
+
+/* A file read and decoded for the editor 'owner' */
+struct LoadedFile {
+    quintptr owner = 0;
+    QString path;
+    QString text;
+    QByteArray encoding;
+    bool byteOrderMark = false;
+    qint64 size = 0;
+    QByteArray hash;        /* SHA-1 of the bytes read */
+    QString error;
+};
+
+Q_DECLARE_METATYPE(LoadedFile)
+
+class TextDecoder {
+public:
+    /* Whether 'data' is well-formed UTF-8: no overlong forms, surrogates or code points past U+10FFFF */
+    static bool isUtf8(const char *data, qint64 size);
+
+    /*
+    * Decodes a whole file. A byte order mark decides the encoding; without
+    * one, valid UTF-8 is taken as such, and anything else is read as UTF-16
+    * if it looks like it, in the encoding a Python coding declaration names,
+    * or in the locale's. Line endings come back as \n.
+    */
+    static QString decode(const QByteArray &data, QByteArray *encoding, bool *byteOrderMark);
+};
+
+/*
+* Reads and decodes files on a pool of threads, so opening several files at
+* once loads them in parallel and a slow disk never blocks the window.
+*/
+class FileLoader : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide loader */
+    static FileLoader *instance();
+    void load(quintptr owner, const QString &path);
+
+Q_SIGNALS:
+    void loaded(const LoadedFile &file);
+
+private:
+    FileLoader();
+    QThreadPool pool;
+};
+
+/*
+* Puts loaded text into an editor a slice at a time. The first screenful is
+* shown at once, and the rest goes in while the event loop is idle, so the
+* window keeps painting however large the file is. The editor is read-only
+* and keeps no undo history until it is full; the filler then deletes itself.
+*/
+class DocumentFiller : public QObject {
+    Q_OBJECT
+
+public:
+    DocumentFiller(QPlainTextEdit *editor, const QString &text);
+
+Q_SIGNALS:
+    void finished();
+
+private:
+    enum { FirstSlice = 16 * 1024, SliceLength = 256 * 1024, SliceBudget = 12 };
+
+    QPlainTextEdit *editor;
+    const QString text;
+    int offset = 0;
+    QTimer *timer;
+
+    int sliceEnd(int from, int length) const;
+
+private Q_SLOTS:
+    void fill();
+};
+
+#endif // CODE_EDITOR_LOADER_H
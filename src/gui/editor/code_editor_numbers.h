@@ -27,6 +27,9 @@ protected:
     void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE {
         codeEditor->lineNumbersPaintEvent(event);
     }
+    void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE {
+        codeEditor->lineNumbersMousePressEvent(event);
+    }
 
 private:
     CodeEditor *codeEditor;
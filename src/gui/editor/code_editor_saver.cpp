@@ -0,0 +1,228 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_saver.h"
+#include <qcoreapplication.h>
+#include <qcryptographichash.h>
+#include <qelapsedtimer.h>
+#include <qfile.h>
+#include <qrunnable.h>
+#include <qsavefile.h>
+#include <qscopedpointer.h>
+#include <qtextcodec.h>
+#include <qtextobject.h>
+#include <qthread.h>
+
+namespace {
+
+enum { ChunkLength = 256 * 1024, BlocksPerClockCheck = 256 };
+
+/*
+* Copies the lines from document position 'position' on into 'chunks' until
+* 'budget' milliseconds are spent, or all of them with a negative budget.
+* Returns whether the end of the document was reached.
+*/
+bool copyBlocks(QTextDocument *doc, int *position, QString *chunk, QVector<QString> *chunks, qint64 budget) {
+    QElapsedTimer clock;
+    clock.start();
+    QTextBlock block = doc->findBlock(*position);
+    int copied = 0;
+    while (block.isValid()) {
+        const QTextBlock next = block.next();
+        *chunk += block.text();
+        if (next.isValid()) {
+            *chunk += QLatin1Char('\n');
+        }
+        *position = block.position() + block.length();
+        block = next;
+
+        if (chunk->length() >= ChunkLength) {
+            chunks->append(*chunk);
+            chunk->clear();
+        }
+        if (budget >= 0 && ++copied % BlocksPerClockCheck == 0 && clock.elapsed() >= budget) {
+            return false;
+        }
+    }
+    if (!chunk->isEmpty()) {
+        chunks->append(*chunk);
+        chunk->clear();
+    }
+    return true;
+}
+
+class SaveTask : public QRunnable {
+public:
+    SaveTask(FileSaver *saver, const SaveJob &job) :
+        saver(saver),
+        job(job) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        const SavedFile file = FileSaver::write(job);
+        job.chunks.clear();
+
+        /* Queued to the receivers, which live on the GUI thread */
+        Q_EMIT saver->saved(file);
+    }
+
+private:
+    FileSaver *saver;
+    SaveJob job;
+};
+
+}
+
+FileSaver *FileSaver::instance() {
+    static FileSaver *saver = 0;
+    if (!saver) {
+        qRegisterMetaType<SavedFile>("SavedFile");
+        saver = new FileSaver;
+    }
+    return saver;
+}
+
+FileSaver::FileSaver() :
+    QObject(qApp) {
+    pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+    connect(qApp, SIGNAL(aboutToQuit()), this, SLOT(flush()));
+}
+
+void FileSaver::save(const SaveJob &job) {
+    pool.start(new SaveTask(this, job));
+}
+
+SavedFile FileSaver::write(const SaveJob &job) {
+    SavedFile file;
+    file.owner = job.owner;
+    file.revision = job.revision;
+    file.path = job.path;
+
+    QTextCodec *codec = QTextCodec::codecForName(job.encoding);
+    if (!codec) {
+        codec = QTextCodec::codecForName("UTF-8");
+    }
+    QScopedPointer<QTextEncoder> encoder(codec->makeEncoder(
+        job.byteOrderMark ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader));
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    /* Nothing replaces the original until commit(), which syncs the new file first */
+    QSaveFile target(job.path);
+    if (!target.open(QIODevice::WriteOnly)) {
+        file.error = target.errorString();
+        return file;
+    }
+    for (int i = 0; i < job.chunks.size(); ++i) {
+#ifdef Q_OS_WIN
+        QString text = job.chunks.at(i);
+        text.replace(QLatin1Char('\n'), QLatin1String("\r\n"));
+        const QByteArray bytes = encoder->fromUnicode(text);
+#else
+        const QByteArray bytes = encoder->fromUnicode(job.chunks.at(i));
+#endif
+        if (target.write(bytes) != bytes.size()) {
+            file.error = target.errorString();
+            target.cancelWriting();
+            return file;
+        }
+        hash.addData(bytes);
+        file.size += bytes.size();
+    }
+    if (!target.commit()) {
+        file.error = target.errorString();
+        return file;
+    }
+    file.hash = hash.result();
+    return file;
+}
+
+void FileSaver::finishSnapshots(QTextDocument *document) {
+    const QList<DocumentSnapshot*> pending = snapshots;
+    for (int i = 0; i < pending.size(); ++i) {
+        if (!document || pending.at(i)->document() == document) {
+            pending.at(i)->finish();
+        }
+    }
+}
+
+void FileSaver::flush() {
+    finishSnapshots();
+    pool.waitForDone();
+}
+
+DocumentSnapshot::DocumentSnapshot(QTextDocument *document, const SaveJob &job) :
+    QObject(document),
+    doc(document),
+    job(job) {
+
+    FileSaver::instance()->snapshots.append(this);
+    revision = doc->revision();
+    timer = new QTimer(this);
+    timer->setInterval(0);
+    connect(timer, SIGNAL(timeout()), this, SLOT(slice()));
+    connect(doc, SIGNAL(contentsChange(int, int, int)), this, SLOT(documentChanged(int, int, int)));
+}
+
+void DocumentSnapshot::start() {
+    slice();
+    if (!done) {
+        timer->start();
+    }
+}
+
+DocumentSnapshot::~DocumentSnapshot() {
+    FileSaver::instance()->snapshots.removeAll(this);
+}
+
+QVector<QString> DocumentSnapshot::chunksOf(QTextDocument *document) {
+    QVector<QString> chunks;
+    QString chunk;
+    int position = 0;
+    copyBlocks(document, &position, &chunk, &chunks, -1);
+    return chunks;
+}
+
+/* A document edited behind the copy again and again is copied in one go */
+void DocumentSnapshot::slice() {
+    if (done) {
+        return;
+    }
+    if (copyBlocks(doc, &taken, &chunk, &job.chunks, restarts > MaxRestarts ? -1 : SliceBudget)) {
+        complete();
+    }
+}
+
+void DocumentSnapshot::finish() {
+    if (done) {
+        return;
+    }
+    copyBlocks(doc, &taken, &chunk, &job.chunks, -1);
+    complete();
+}
+
+void DocumentSnapshot::complete() {
+    done = true;
+    timer->stop();
+    disconnect(doc, 0, this, 0);
+    job.revision = doc->revision();
+    FileSaver::instance()->snapshots.removeAll(this);
+    FileSaver::instance()->save(job);
+    Q_EMIT completed();
+    deleteLater();
+}
+
+/* Highlighting reports format changes here too, which replace nothing and leave the revision alone */
+void DocumentSnapshot::documentChanged(int position, int removed, int added) {
+    if (done || (removed == added && doc->revision() == revision)) {
+        return;
+    }
+    revision = doc->revision();
+    if (position < taken) {
+        job.chunks.clear();
+        chunk.clear();
+        taken = 0;
+        ++restarts;
+    }
+}
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_SAVER_H
+#define CODE_EDITOR_SAVER_H
+
+#include <qlist.h>
+#include <qmetatype.h>
+#include <qobject.h>
+#include <qtextdocument.h>
+#include <qthreadpool.h>
+#include <qtimer.h>
+#include <qvector.h>
+
+/* A document snapshot to write to 'path' for the editor 'owner' */
+struct SaveJob {
+    quintptr owner = 0;
+    int revision = 0;           /* Of the document when the snapshot was complete */
+    QString path;
+    QByteArray encoding;
+    bool byteOrderMark = false;
+    QVector<QString> chunks;    /* The text, a run of whole lines per chunk */
+};
+
+/* The outcome of a save; 'size' and 'hash' describe the bytes now on disk */
+struct SavedFile {
+    quintptr owner = 0;
+    int revision = 0;
+    QString path;
+    qint64 size = 0;
+    QByteArray hash;
+    QString error;
+};
+
+Q_DECLARE_METATYPE(SavedFile)
+
+class DocumentSnapshot;
+
+/*
+* Writes snapshots on a pool of threads, so saving every file at once writes
+* them in parallel. Each file is encoded chunk by chunk into a QSaveFile,
+* which is synced to disk and renamed over the original only once complete,
+* so a crash mid-save leaves the old file whole.
+*/
+class FileSaver : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide saver */
+    static FileSaver *instance();
+    void save(const SaveJob &job);
+
+    /* Writes 'job' on the calling thread */
+    static SavedFile write(const SaveJob &job);
+
+    /* Takes the rest of every snapshot of 'document', or of all documents, at once */
+    void finishSnapshots(QTextDocument *document = 0);
+
+public Q_SLOTS:
+    /* Finishes every snapshot and waits for the writes, e.g. before quitting */
+    void flush();
+
+Q_SIGNALS:
+    void saved(const SavedFile &file);
+
+private:
+    friend class DocumentSnapshot;
+
+    FileSaver();
+    QThreadPool pool;
+    QList<DocumentSnapshot*> snapshots;
+};
+
+/*
+* Copies a document's blocks for a save a slice at a time while the event
+* loop is idle, so a huge buffer is never copied in one go. An edit behind
+* the copied part starts the copy over; edits ahead of it just end up in
+* the snapshot. Once complete, the snapshot goes to the saver and this
+* object deletes itself.
+*/
+class DocumentSnapshot : public QObject {
+    Q_OBJECT
+
+public:
+    DocumentSnapshot(QTextDocument *document, const SaveJob &job);
+    ~DocumentSnapshot();
+
+    QTextDocument *document() const { return doc; }
+
+    /* Copies the first slice at once, which for small documents is all of it */
+    void start();
+
+    /* Copies whatever is left without yielding */
+    void finish();
+
+    /* A whole document's text in chunks, copied at once */
+    static QVector<QString> chunksOf(QTextDocument *document);
+
+private:
+    enum { SliceBudget = 8, MaxRestarts = 3 };
+
+    QTextDocument *doc;
+    SaveJob job;
+    QString chunk;
+    int taken = 0;              /* Document position the copy has reached */
+    int revision = 0;
+    int restarts = 0;
+    bool done = false;
+    QTimer *timer;
+
+    void complete();
+
+Q_SIGNALS:
+    /* The copy is whole and shows the document as it is now */
+    void completed();
+
+private Q_SLOTS:
+    void slice();
+    void documentChanged(int position, int removed, int added);
+};
+
+#endif // CODE_EDITOR_SAVER_H
@@ -0,0 +1,447 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_search.h"
+#include <qtextcursor.h>
+#include <qtextobject.h>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+bool startsBefore(const DocumentSearch::Match &match, int position) {
+    return match.start < position;
+}
+
+bool startsAfter(int position, const DocumentSearch::Match &match) {
+    return position < match.start;
+}
+
+bool isWordCharacter(const QChar &c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+bool isWordAt(const QString &line, int start, int length) {
+    return (start == 0 || !isWordCharacter(line.at(start - 1)))
+        && (start + length == line.length() || !isWordCharacter(line.at(start + length)));
+}
+
+/* Expands \0 to \9 and \\ in a replacement */
+QString expand(const QString &after, const QRegularExpressionMatch &match) {
+    QString result;
+    for (int i = 0; i < after.length(); ++i) {
+        const QChar c = after.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < after.length()) {
+            const QChar n = after.at(i + 1);
+            if (n.isDigit()) {
+                result += match.captured(n.digitValue());
+                ++i;
+                continue;
+            } else if (n == QLatin1Char('\\')) {
+                result += n;
+                ++i;
+                continue;
+            }
+        }
+        result += c;
+    }
+    return result;
+}
+
+}
+
+LineMatcher::LineMatcher() {
+}
+
+LineMatcher::LineMatcher(const QString &pattern, int flags) :
+    text(pattern),
+    searchFlags(flags) {
+
+    if (flags & RegularExpression) {
+        QString source = flags & WholeWords ? "(?<!\\w)(?:" + pattern + ")(?!\\w)" : pattern;
+        QRegularExpression::PatternOptions options = QRegularExpression::UseUnicodePropertiesOption;
+        if (!(flags & CaseSensitive)) {
+            options |= QRegularExpression::CaseInsensitiveOption;
+        }
+        expression = QRegularExpression(source, options);
+    }
+}
+
+QString LineMatcher::pattern() const {
+    return text;
+}
+
+int LineMatcher::flags() const {
+    return searchFlags;
+}
+
+bool LineMatcher::isEmpty() const {
+    return text.isEmpty();
+}
+
+bool LineMatcher::isValid() const {
+    return !(searchFlags & RegularExpression) || expression.isValid();
+}
+
+void LineMatcher::find(const QString &line, int base, std::vector<Match> &found) const {
+    if (searchFlags & RegularExpression) {
+        QRegularExpressionMatchIterator it = expression.globalMatch(line);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            if (match.capturedLength() > 0) {
+                Match hit = { base + match.capturedStart(), match.capturedLength() };
+                found.push_back(hit);
+            }
+        }
+        return;
+    }
+
+    const Qt::CaseSensitivity cs = searchFlags & CaseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    int i = line.indexOf(text, 0, cs);
+    while (i >= 0) {
+        if (!(searchFlags & WholeWords) || isWordAt(line, i, text.length())) {
+            Match hit = { base + i, text.length() };
+            found.push_back(hit);
+            i = line.indexOf(text, i + text.length(), cs);
+        } else {
+            i = line.indexOf(text, i + 1, cs);
+        }
+    }
+}
+
+QString LineMatcher::replacement(const QString &line, int start, const QString &after) const {
+    if (!(searchFlags & RegularExpression)) {
+        return after;
+    }
+    const QRegularExpressionMatch found = expression.match(line, start);
+    if (!found.hasMatch() || found.capturedStart() != start) {
+        return after;
+    }
+    return expand(after, found);
+}
+
+int LineMatcher::replaceIn(QString &line, const QString &after) const {
+    std::vector<Match> found;
+    find(line, 0, found);
+    if (found.empty()) {
+        return 0;
+    }
+
+    /* Replacements refer to the line as it was, so they are all worked out first */
+    QString result;
+    int copied = 0;
+    for (size_t i = 0; i < found.size(); ++i) {
+        result += line.midRef(copied, found[i].start - copied);
+        result += replacement(line, found[i].start, after);
+        copied = found[i].start + found[i].length;
+    }
+    result += line.midRef(copied);
+    line = result;
+    return (int)found.size();
+}
+
+/*
+* The longest run of plain characters outside of groups, classes, repeat
+* counts and alternatives. Characters made optional by a quantifier do not
+* count, and escapes that take an argument give up on the pattern.
+*/
+QString LineMatcher::requiredLiteral() const {
+    if (!(searchFlags & RegularExpression)) {
+        return text;
+    }
+    if (text.contains(QLatin1String("(?")) || text.contains(QLatin1Char('|'))) {
+        return QString();
+    }
+
+    QString best;
+    QString run;
+    int depth = 0;
+    for (int i = 0; i < text.length(); ++i) {
+        QChar c = text.at(i);
+        bool literal = false;
+        if (c == QLatin1Char('\\') && i + 1 < text.length()) {
+            c = text.at(++i);
+            if (c.isDigit() || QString("xuopPNkgc").contains(c)) {
+                /* Back references and escapes whose argument follows them are not worth telling apart */
+                return QString();
+            }
+            literal = !c.isLetterOrNumber();
+        } else if (c == QLatin1Char('{')) {
+            /* A repeat count; its digits are not text */
+            while (i + 1 < text.length() && text.at(i + 1) != QLatin1Char('}')) {
+                ++i;
+            }
+            ++i;
+        } else if (c == QLatin1Char('[')) {
+            while (i + 1 < text.length() && text.at(i + 1) != QLatin1Char(']')) {
+                i += text.at(i + 1) == QLatin1Char('\\') ? 2 : 1;
+            }
+            ++i;
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            --depth;
+        } else {
+            literal = !QString("^$.*+?{}").contains(c);
+        }
+
+        const QChar next = i + 1 < text.length() ? text.at(i + 1) : QChar();
+        const bool optional = next == QLatin1Char('*') || next == QLatin1Char('?') || next == QLatin1Char('{');
+        if (literal && depth == 0 && !optional) {
+            run += c;
+            if (next != QLatin1Char('+')) {
+                continue;
+            }
+        }
+        if (run.length() > best.length()) {
+            best = run;
+        }
+        run.clear();
+    }
+    return run.length() > best.length() ? run : best;
+}
+
+DocumentSearch::DocumentSearch(QTextDocument *document) :
+    QObject(document),
+    doc(document) {
+
+    slicer = new QTimer(this);
+    slicer->setSingleShot(true);
+    slicer->setInterval(0);
+
+    connect(slicer, SIGNAL(timeout()), this, SLOT(scanSlice()));
+    connect(doc, SIGNAL(contentsChange(int, int, int)), this, SLOT(contentsChange(int, int, int)));
+}
+
+void DocumentSearch::setQuery(const QString &pattern, int flags, int from) {
+    slicer->stop();
+    matches.clear();
+    matcher = LineMatcher(pattern, flags);
+    scanNext = -1;
+    revision = doc->revision();
+
+    if (!matcher.isEmpty() && matcher.isValid()) {
+        origin = doc->findBlock(from).position();
+        scanNext = origin;
+        wrapped = false;
+        scan(SliceTime);
+    }
+    notify(true);
+}
+
+QString DocumentSearch::pattern() const {
+    return matcher.pattern();
+}
+
+int DocumentSearch::flags() const {
+    return matcher.flags();
+}
+
+bool DocumentSearch::isValid() const {
+    return matcher.isValid();
+}
+
+bool DocumentSearch::isComplete() const {
+    return scanNext < 0;
+}
+
+void DocumentSearch::complete() {
+    if (scanNext < 0) {
+        return;
+    }
+    slicer->stop();
+    scan(-1);
+    notify(true);
+}
+
+int DocumentSearch::count() const {
+    return (int)matches.size();
+}
+
+const DocumentSearch::Match &DocumentSearch::at(int index) const {
+    return matches[index];
+}
+
+int DocumentSearch::next(int position) const {
+    if (matches.empty()) {
+        return -1;
+    }
+    std::vector<Match>::const_iterator it = std::lower_bound(matches.begin(), matches.end(), position, startsBefore);
+    return it == matches.end() ? 0 : (int)(it - matches.begin());
+}
+
+int DocumentSearch::previous(int position) const {
+    if (matches.empty()) {
+        return -1;
+    }
+    std::vector<Match>::const_iterator it = std::lower_bound(matches.begin(), matches.end(), position, startsBefore);
+    return it == matches.begin() ? (int)matches.size() - 1 : (int)(it - matches.begin()) - 1;
+}
+
+int DocumentSearch::indexOf(int start, int end) const {
+    std::vector<Match>::const_iterator it = std::lower_bound(matches.begin(), matches.end(), start, startsBefore);
+    if (it != matches.end() && it->start == start && it->start + it->length == end) {
+        return (int)(it - matches.begin());
+    }
+    return -1;
+}
+
+void DocumentSearch::range(int from, int to, int *first, int *last) const {
+    *first = (int)(std::lower_bound(matches.begin(), matches.end(), from, startsBefore) - matches.begin());
+    *last = (int)(std::lower_bound(matches.begin() + *first, matches.end(), to, startsBefore) - matches.begin());
+}
+
+QString DocumentSearch::replacement(int index, const QString &after) const {
+    const Match &match = matches[index];
+    const QTextBlock block = doc->findBlock(match.start);
+    return matcher.replacement(block.text(), match.start - block.position(), after);
+}
+
+int DocumentSearch::replaceAll(const QString &after) {
+    complete();
+    if (matches.empty()) {
+        return 0;
+    }
+
+    QStringList replacements;
+    for (int i = 0; i < (int)matches.size(); ++i) {
+        replacements << replacement(i, after);
+    }
+
+    /* Back to front so the earlier positions stay valid; the document reports one change at the end */
+    const std::vector<Match> replaced = matches;
+    QTextCursor cursor(doc);
+    cursor.beginEditBlock();
+    for (int i = (int)replaced.size() - 1; i >= 0; --i) {
+        cursor.setPosition(replaced[i].start);
+        cursor.setPosition(replaced[i].start + replaced[i].length, QTextCursor::KeepAnchor);
+        cursor.insertText(replacements.at(i));
+    }
+    cursor.endEditBlock();
+    return (int)replaced.size();
+}
+
+/* Merges sorted matches in, keeping one match per position */
+void DocumentSearch::insert(const std::vector<Match> &found) {
+    if (found.empty()) {
+        return;
+    }
+    std::vector<Match>::iterator first = std::lower_bound(matches.begin(), matches.end(), found.front().start, startsBefore);
+    std::vector<Match>::iterator last = std::upper_bound(first, matches.end(), found.back().start, startsAfter);
+    if (first == last) {
+        matches.insert(first, found.begin(), found.end());
+        return;
+    }
+
+    std::vector<Match> merged;
+    std::set_union(first, last, found.begin(), found.end(), std::back_inserter(merged),
+        [](const Match &a, const Match &b) { return a.start < b.start; });
+    const int at = (int)(first - matches.begin());
+    matches.erase(first, last);
+    matches.insert(matches.begin() + at, merged.begin(), merged.end());
+}
+
+/* Searches blocks until 'budget' milliseconds are spent, or to the end for a negative budget */
+void DocumentSearch::scan(int budget) {
+    QElapsedTimer timer;
+    timer.start();
+
+    int searched = 0;
+    while (scanNext >= 0) {
+        std::vector<Match> found;
+        QTextBlock block = doc->findBlock(scanNext);
+        const int stop = wrapped ? origin : doc->characterCount();
+        bool outOfTime = false;
+        while (block.isValid() && block.position() < stop) {
+            matcher.find(block.text(), block.position(), found);
+            block = block.next();
+            if (budget >= 0 && (++searched & 63) == 0 && timer.elapsed() >= budget) {
+                outOfTime = true;
+                break;
+            }
+        }
+        insert(found);
+
+        if (block.isValid() && block.position() < stop) {
+            scanNext = block.position();
+        } else if (!wrapped && origin > 0) {
+            wrapped = true;
+            scanNext = 0;
+        } else {
+            scanNext = -1;
+        }
+        if (outOfTime) {
+            break;
+        }
+    }
+}
+
+void DocumentSearch::scanSlice() {
+    scan(SliceTime);
+    if (scanNext >= 0) {
+        slicer->start();
+    }
+    notify(scanNext < 0);
+}
+
+/* Slices come back to back, so listeners only hear about them every so often */
+void DocumentSearch::notify(bool force) {
+    if (scanNext >= 0 && !slicer->isActive()) {
+        slicer->start();
+    }
+    if (force || !sinceEmit.isValid() || sinceEmit.elapsed() >= EmitInterval) {
+        sinceEmit.start();
+        Q_EMIT matchesChanged();
+    }
+}
+
+void DocumentSearch::contentsChange(int position, int removed, int added) {
+    /* Relayouts report a change of the same length without a new revision */
+    if (matcher.isEmpty() || !matcher.isValid() || (removed == added && doc->revision() == revision)) {
+        return;
+    }
+    revision = doc->revision();
+
+    const QTextBlock first = doc->findBlock(position);
+    QTextBlock last = doc->findBlock(position + added);
+    if (!last.isValid()) {
+        last = doc->lastBlock();
+    }
+    if (last.blockNumber() - first.blockNumber() >= RescanLimit) {
+        setQuery(matcher.pattern(), matcher.flags(), first.position());
+        return;
+    }
+
+    const int from = first.position();
+    const int newEnd = last.position() + last.length();
+    const int delta = added - removed;
+    const int oldEnd = newEnd - delta;
+
+    /* Matches never leave their block; drop the ones in the touched blocks and move the rest */
+    std::vector<Match>::iterator begin = std::lower_bound(matches.begin(), matches.end(), from, startsBefore);
+    std::vector<Match>::iterator end = std::lower_bound(begin, matches.end(), oldEnd, startsBefore);
+    begin = matches.erase(begin, end);
+    for (std::vector<Match>::iterator it = begin; it != matches.end(); ++it) {
+        it->start += delta;
+    }
+
+    /* Positions inside the touched blocks move past them, those get searched right here */
+    int *positions[] = { &origin, &scanNext };
+    for (int i = 0; i < 2; ++i) {
+        int &p = *positions[i];
+        if (p >= oldEnd) {
+            p += delta;
+        } else if (p > from) {
+            p = newEnd;
+        }
+    }
+
+    std::vector<Match> found;
+    for (QTextBlock block = first; block.isValid() && block.position() < newEnd; block = block.next()) {
+        matcher.find(block.text(), block.position(), found);
+    }
+    insert(found);
+    notify(true);
+}
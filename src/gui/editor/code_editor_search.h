@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_SEARCH_H
+#define CODE_EDITOR_SEARCH_H
+
+#include <qelapsedtimer.h>
+#include <qobject.h>
+#include <qregularexpression.h>
+#include <qtextdocument.h>
+#include <qtimer.h>
+#include <vector>
+
+/*
+* A find pattern compiled for matching within single lines. Matching is
+* reentrant, so one matcher can be shared by threads searching many files.
+*/
+class LineMatcher {
+public:
+    enum Flag {
+        CaseSensitive = 1,
+        WholeWords = 2,
+        RegularExpression = 4
+    };
+
+    struct Match {
+        int start;
+        int length;
+    };
+
+    LineMatcher();
+    LineMatcher(const QString &pattern, int flags);
+
+    QString pattern() const;
+    int flags() const;
+    bool isEmpty() const;
+
+    /* False for a regular expression that does not compile */
+    bool isValid() const;
+
+    /* Appends the matches in 'line', offset by 'base' */
+    void find(const QString &line, int base, std::vector<Match> &found) const;
+
+    /* Text that replaces the match at 'start' in 'line'; \0 to \9 refer to the groups of a regular expression */
+    QString replacement(const QString &line, int start, const QString &after) const;
+
+    /* Replaces every match in 'line' and returns how many there were */
+    int replaceIn(QString &line, const QString &after) const;
+
+    /* Text that every match contains, for skipping files quickly, or empty if there is none */
+    QString requiredLiteral() const;
+
+private:
+    QString text;
+    int searchFlags = 0;
+    QRegularExpression expression;
+};
+
+/*
+* Incremental search of one document.
+*
+* Matches never span lines, so every block is searched on its own. The scan
+* starts at a given block, runs to the end and wraps around, in slices short
+* enough not to stall the event loop; the blocks near the cursor are covered by
+* the first slice. Matches are kept sorted by position, so the next and previous
+* match and the matches on screen are binary searches. Edits only drop and
+* search again the blocks they touched and shift the matches after them.
+*/
+class DocumentSearch : public QObject {
+    Q_OBJECT
+
+public:
+    typedef LineMatcher::Match Match;
+
+    DocumentSearch(QTextDocument *document);
+
+    /* Searches for 'pattern' starting at the block of 'origin'; an empty pattern clears the matches */
+    void setQuery(const QString &pattern, int flags, int origin = 0);
+    QString pattern() const;
+    int flags() const;
+
+    /* False for a regular expression that does not compile */
+    bool isValid() const;
+    bool isComplete() const;
+
+    /* Finishes the scan without yielding */
+    void complete();
+
+    int count() const;
+    const Match &at(int index) const;
+
+    /* Index of the first match at or after 'position', wrapping around, or -1 */
+    int next(int position) const;
+
+    /* Index of the last match before 'position', wrapping around, or -1 */
+    int previous(int position) const;
+
+    /* Index of the match covering exactly [start, end), or -1 */
+    int indexOf(int start, int end) const;
+
+    /* Matches starting in [from, to) are [*first, *last) */
+    void range(int from, int to, int *first, int *last) const;
+
+    /* Text that replaces match 'index'; \0 to \9 refer to the groups of a regular expression */
+    QString replacement(int index, const QString &after) const;
+
+    /* Replaces every match as a single undo step and returns how many there were */
+    int replaceAll(const QString &after);
+
+Q_SIGNALS:
+    void matchesChanged();
+
+private:
+    enum { SliceTime = 8, EmitInterval = 50, RescanLimit = 2000 };
+
+    QTextDocument *doc;
+    QTimer *slicer;
+    QElapsedTimer sinceEmit;
+    LineMatcher matcher;
+    std::vector<Match> matches;
+
+    int origin = 0;
+    int scanNext = -1; /* Start of the next block to search, or -1 once done */
+    bool wrapped = false;
+    int revision = 0;
+
+    void insert(const std::vector<Match> &found);
+    void scan(int budget);
+    void notify(bool force);
+
+private Q_SLOTS:
+    void scanSlice();
+    void contentsChange(int position, int removed, int added);
+};
+
+#endif // CODE_EDITOR_SEARCH_H
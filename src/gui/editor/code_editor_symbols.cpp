@@ -0,0 +1,142 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_symbols.h"
+#include "code_editor_tokenizer.h"
+
+SymbolWorker *SymbolWorker::instance() {
+    static SymbolWorker *worker = 0;
+    if (!worker) {
+        qRegisterMetaType<SymbolJob>("SymbolJob");
+        qRegisterMetaType<SymbolResult>("SymbolResult");
+        qRegisterMetaType<quintptr>("quintptr");
+
+        worker = new SymbolWorker;
+        startWorkerThread(worker, "SymbolWorker");
+    }
+    return worker;
+}
+
+void SymbolWorker::post(const SymbolJob &job) {
+    QMetaObject::invokeMethod(this, "parse", Qt::QueuedConnection, Q_ARG(SymbolJob, job));
+}
+
+void SymbolWorker::forget(quintptr owner) {
+    QMetaObject::invokeMethod(this, "release", Qt::QueuedConnection, Q_ARG(quintptr, owner));
+}
+
+void SymbolWorker::parse(const SymbolJob &job) {
+    SymbolResult result;
+    result.owner = job.owner;
+    result.revision = job.revision;
+    result.symbols = PythonSymbols::parse(job.text.split(QLatin1Char('\n')), &caches[job.owner]);
+
+    Q_EMIT parsed(result);
+}
+
+void SymbolWorker::release(quintptr owner) {
+    caches.remove(owner);
+}
+
+DocumentSymbols::DocumentSymbols(QTextDocument *document) :
+    QObject(document),
+    doc(document),
+    jobOwner(newJobOwner()) {
+
+    debounce = new QTimer(this);
+    debounce->setSingleShot(true);
+    debounce->setInterval(DebounceDelay);
+
+    connect(doc, SIGNAL(contentsChanged()), this, SLOT(documentChanged()));
+    connect(debounce, SIGNAL(timeout()), this, SLOT(post()));
+    revision = doc->revision();
+    connect(SymbolWorker::instance(), SIGNAL(parsed(SymbolResult)), this, SLOT(parsed(SymbolResult)));
+
+    debounce->start();
+}
+
+DocumentSymbols::~DocumentSymbols() {
+    SymbolWorker::instance()->forget(jobOwner);
+}
+
+const QVector<PythonSymbols::Symbol> &DocumentSymbols::symbols() const {
+    return table;
+}
+
+int DocumentSymbols::find(const QString &name) const {
+    int found = -1;
+    for (int i = 0; i < table.size(); ++i) {
+        const PythonSymbols::Symbol &symbol = table.at(i);
+        if (symbol.name != name) {
+            continue;
+        }
+        if (symbol.kind == PythonSymbols::Class || symbol.kind == PythonSymbols::Function) {
+            return i;
+        }
+        if (found < 0 || (symbol.kind == PythonSymbols::Variable && table.at(found).kind == PythonSymbols::Import)) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+int DocumentSymbols::enclosing(int line) const {
+    int found = -1;
+    for (int i = 0; i < table.size(); ++i) {
+        const PythonSymbols::Symbol &symbol = table.at(i);
+        if (symbol.line > line) {
+            break;
+        }
+        if ((symbol.kind == PythonSymbols::Class || symbol.kind == PythonSymbols::Function) && symbol.endLine >= line) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+QString DocumentSymbols::qualifiedName(int index) const {
+    QString name = table.at(index).name;
+    for (int parent = table.at(index).parent; parent >= 0; parent = table.at(parent).parent) {
+        name.prepend(table.at(parent).name + QLatin1Char('.'));
+    }
+    return name;
+}
+
+/* Relayouts and reformatting also signal a change, only edits bump the document's revision */
+void DocumentSymbols::documentChanged() {
+    if (doc->revision() == revision) {
+        return;
+    }
+    revision = doc->revision();
+    debounce->start();
+}
+
+void DocumentSymbols::post() {
+    if (jobPending) {
+        return;
+    }
+
+    SymbolJob job;
+    job.owner = jobOwner;
+    job.revision = revision;
+    job.text = doc->toPlainText();
+
+    jobPending = true;
+    SymbolWorker::instance()->post(job);
+}
+
+void DocumentSymbols::parsed(const SymbolResult &result) {
+    if (result.owner != jobOwner) {
+        return;
+    }
+    jobPending = false;
+
+    /* Even a stale table beats none; parse again if edits came in meanwhile */
+    table = result.symbols;
+    Q_EMIT symbolsChanged();
+    if (result.revision != revision && !debounce->isActive()) {
+        post();
+    }
+}
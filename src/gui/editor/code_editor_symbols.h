@@ -0,0 +1,103 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_SYMBOLS_H
+#define CODE_EDITOR_SYMBOLS_H
+
+#include "src/python/python_symbols.h"
+#include <qhash.h>
+#include <qmetatype.h>
+#include <qobject.h>
+#include <qtextdocument.h>
+#include <qtimer.h>
+
+/* Snapshot of a whole document to be parsed for symbols */
+struct SymbolJob {
+    quintptr owner = 0;
+    int revision = 0;
+    QString text;
+};
+
+struct SymbolResult {
+    quintptr owner = 0;
+    int revision = 0;
+    QVector<PythonSymbols::Symbol> symbols;
+};
+
+Q_DECLARE_METATYPE(SymbolJob)
+Q_DECLARE_METATYPE(SymbolResult)
+
+/*
+* Parses document snapshots into symbol tables on a worker thread shared by
+* every editor. The chunks of each owner's last parse are kept, so parsing the
+* same document again only covers what was edited.
+*/
+class SymbolWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide worker, living on its own thread */
+    static SymbolWorker *instance();
+    void post(const SymbolJob &job);
+
+    /* Drops the chunks kept for 'owner' */
+    void forget(quintptr owner);
+
+public Q_SLOTS:
+    void parse(const SymbolJob &job);
+    void release(quintptr owner);
+
+Q_SIGNALS:
+    void parsed(const SymbolResult &result);
+
+private:
+    SymbolWorker() {}
+    QHash<quintptr, PythonSymbols::ChunkCache> caches;
+};
+
+/*
+* Symbol table of one document, kept up to date in the background.
+* Edits are debounced and at most one parse is in flight; the table always
+* holds the result of the latest finished parse, which may lag the text by a
+* moment but never blocks typing.
+*/
+class DocumentSymbols : public QObject {
+    Q_OBJECT
+
+public:
+    DocumentSymbols(QTextDocument *document);
+    ~DocumentSymbols();
+
+    const QVector<PythonSymbols::Symbol> &symbols() const;
+
+    /* Index of the definition of 'name', preferring classes and functions over assignments and imports, or -1 */
+    int find(const QString &name) const;
+
+    /* Index of the innermost class or function around zero-based 'line', or -1 */
+    int enclosing(int line) const;
+
+    /* Dotted path of a symbol, e.g. Class.method */
+    QString qualifiedName(int index) const;
+
+Q_SIGNALS:
+    void symbolsChanged();
+
+private:
+    enum { DebounceDelay = 300 };
+
+    QTextDocument *doc;
+    QTimer *debounce;
+    QVector<PythonSymbols::Symbol> table;
+    const quintptr jobOwner;
+    int revision = 0;  /* QTextDocument::revision() of the latest edit */
+    bool jobPending = false;
+
+private Q_SLOTS:
+    void documentChanged();
+    void post();
+    void parsed(const SymbolResult &result);
+};
+
+#endif // CODE_EDITOR_SYMBOLS_H
@@ -0,0 +1,67 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "code_editor_tokenizer.h"
+#include <qcoreapplication.h>
+#include <qthread.h>
+#include <vector>
+
+void startWorkerThread(QObject *worker, const char *name) {
+    /* Never deleted; the thread is stopped before the application goes away */
+    QThread *thread = new QThread;
+    thread->setObjectName(name);
+    worker->moveToThread(thread);
+    QObject::connect(qApp, &QCoreApplication::aboutToQuit, [thread]() {
+        thread->quit();
+        thread->wait();
+    });
+    thread->start(QThread::LowPriority);
+}
+
+/* Only asked for on the GUI thread */
+quintptr newJobOwner() {
+    static quintptr last = 0;
+    return ++last;
+}
+
+TokenizeWorker *TokenizeWorker::instance() {
+    static TokenizeWorker *worker = 0;
+    if (!worker) {
+        qRegisterMetaType<TokenizeJob>("TokenizeJob");
+        qRegisterMetaType<TokenizeResult>("TokenizeResult");
+
+        worker = new TokenizeWorker;
+        startWorkerThread(worker, "TokenizeWorker");
+    }
+    return worker;
+}
+
+void TokenizeWorker::post(const TokenizeJob &job) {
+    QMetaObject::invokeMethod(this, "tokenize", Qt::QueuedConnection, Q_ARG(TokenizeJob, job));
+}
+
+void TokenizeWorker::tokenize(const TokenizeJob &job) {
+    TokenizeResult result;
+    result.owner = job.owner;
+    result.revision = job.revision;
+    result.firstBlock = job.firstBlock;
+    result.tokenEnds.reserve(job.lines.size());
+    result.states.reserve(job.lines.size());
+
+    std::vector<PythonLexer::Token> lineTokens;
+    int state = job.startState;
+    for (int i = 0; i < job.lines.size(); ++i) {
+        const QString &line = job.lines.at(i);
+        lineTokens.clear();
+        state = PythonLexer::tokenize(line.utf16(), line.length(), state, lineTokens);
+        for (size_t j = 0; j < lineTokens.size(); ++j) {
+            result.tokens.append(lineTokens[j]);
+        }
+        result.tokenEnds.append(result.tokens.size());
+        result.states.append(state);
+    }
+
+    Q_EMIT tokenized(result);
+}
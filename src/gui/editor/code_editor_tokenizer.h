@@ -0,0 +1,67 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef CODE_EDITOR_TOKENIZER_H
+#define CODE_EDITOR_TOKENIZER_H
+
+#include "src/python/python_lexer.h"
+#include <qobject.h>
+#include <qmetatype.h>
+#include <qstringlist.h>
+#include <qvector.h>
+
+/* Snapshot of consecutive blocks to be tokenized off the GUI thread */
+struct TokenizeJob {
+    quintptr owner = 0;
+    int revision = 0;
+    int firstBlock = 0;
+    int startState = 0;
+    QStringList lines;
+};
+
+/* Token spans and end states of a job, all lines' tokens stored back to back */
+struct TokenizeResult {
+    quintptr owner = 0;
+    int revision = 0;
+    int firstBlock = 0;
+    QVector<PythonLexer::Token> tokens;
+    QVector<int> tokenEnds;
+    QVector<int> states;
+};
+
+Q_DECLARE_METATYPE(TokenizeJob)
+Q_DECLARE_METATYPE(TokenizeResult)
+
+/* Moves 'worker' to a low-priority thread of its own, named 'name', that runs until the application quits */
+void startWorkerThread(QObject *worker, const char *name);
+
+/* A new id for the jobs of one object; unlike its address, never taken by another object later */
+quintptr newJobOwner();
+
+/*
+* Lexes block snapshots on a worker thread shared by every editor. The worker
+* only ever sees immutable copies of the text; the highlighter that sent a job
+* recognizes its result by 'owner', an id from newJobOwner(), and drops it if
+* the revision is outdated.
+*/
+class TokenizeWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide worker, living on its own thread */
+    static TokenizeWorker *instance();
+    void post(const TokenizeJob &job);
+
+public Q_SLOTS:
+    void tokenize(const TokenizeJob &job);
+
+Q_SIGNALS:
+    void tokenized(const TokenizeResult &result);
+
+private:
+    TokenizeWorker() {}
+};
+
+#endif // CODE_EDITOR_TOKENIZER_H
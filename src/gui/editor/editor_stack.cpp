@@ -4,12 +4,17 @@
 */
 
 #include "editor_stack.h"
-#include <qfilesystemwatcher.h>
+#include <qcryptographichash.h>
 #include <qtemporaryfile.h>
+#include <qtextdocument.h>
+#include <qtextcursor.h>
+#include <qscrollbar.h>
 #include <qstandardpaths.h>
 #include <qapplication.h>
 #include <qmessagebox.h>
 #include <qfiledialog.h>
+#include <qinputdialog.h>
+#include <qdir.h>
 #include <qpainter.h>
 #include <qdebug.h>
 
@@ -23,6 +28,10 @@ EditorStack::EditorStack(QSettings* s, QWidget *parent) :
 
     connect(this, SIGNAL(tabCloseRequested(int)), this, SLOT(closeTab(int)));
     connect(qApp, SIGNAL(applicationStateChanged(Qt::ApplicationState)), this, SLOT(manageFocus()));
+    connect(FileLoader::instance(), SIGNAL(loaded(LoadedFile)), this, SLOT(fileLoaded(LoadedFile)));
+    connect(FileSaver::instance(), SIGNAL(saved(SavedFile)), this, SLOT(fileSaved(SavedFile)));
+    connect(this, SIGNAL(currentChanged(int)), this, SLOT(materialize(int)));
+    connect(FileWatcher::instance(), SIGNAL(changed(QString)), this, SLOT(manageExternalModification(QString)));
 }
 
 CodeEditor* EditorStack::currentEditor() {
@@ -34,21 +43,240 @@ CodeEditor* EditorStack::currentEditor() {
     }
 }
 
-void EditorStack::fileStream(CodeEditor* c, QFile* saveFile) {
-    if (saveFile->open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Text)) {
-        saveQueued = true;
+/* Snapshots the editor for the saver; a save asked for while one is under way follows it */
+void EditorStack::startSave(CodeEditor* c) {
+    if (c->saving) {
+        c->saveAgain = true;
+        return;
+    }
+    c->saving = true;
 
-        QTextStream stream(saveFile);
-        stream << c->toPlainText();
-        saveFile->flush();
-        saveFile->close();
+    SaveJob job;
+    job.owner = c->jobOwner;
+    job.path = c->location;
+    job.encoding = c->encoding;
+    job.byteOrderMark = c->byteOrderMark;
+    (new DocumentSnapshot(c->document(), job))->start();
+}
 
-        c->location = QFileInfo(*saveFile).canonicalFilePath();
-        c->filename = QFileInfo(*saveFile).fileName();
-        c->document()->setModified(false);
-    } else {
-        QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location."));
+/* The editor is clean if nothing changed since its snapshot was taken */
+void EditorStack::fileSaved(const SavedFile &file) {
+    CodeEditor* c = nullptr;
+    for (int index = 0; index < count() && !c; ++index) {
+        CodeEditor* candidate = qobject_cast<CodeEditor*>(widget(index));
+        if (candidate && candidate->jobOwner == file.owner && candidate->saving) {
+            c = candidate;
+        }
+    }
+    if (!c) {
+        return;
+    }
+    c->saving = false;
+
+    if (!file.error.isEmpty()) {
+        QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location.") +
+            "\n\n" + QDir::toNativeSeparators(file.path) + "\n" + file.error);
+    } else if (file.path == c->location) {
+        c->location = QFileInfo(file.path).canonicalFilePath();
+        c->updateLinting();
+        trackFile(c, file.size, file.hash);
+        if (c->document()->revision() == file.revision) {
+            c->document()->setModified(false);
+            setTabText(indexOf(c), c->filename);
+            c->journal->reset(journalBase(c, file.size, file.hash));
+        } else {
+            /* The journal's edits no longer apply to what the file holds */
+            c->journal->compact();
+        }
+        if (projectIndex) {
+            projectIndex->refresh(c->location);
+        }
+    }
+
+    /*
+    * The report may have been about this save. The watcher knows what was
+    * written by now, so it hashes the file again off this thread and only
+    * reports it once more if it holds something else.
+    */
+    if (c->externalChange) {
+        c->externalChange = false;
+        if (!file.error.isEmpty()) {
+            queueRefresh(c);
+        } else {
+            FileWatcher::instance()->recheck(c->location);
+        }
+    }
+    if (c->saveAgain) {
+        c->saveAgain = false;
+        if (c->document()->isModified()) {
+            startSave(c);
+        }
+    }
+    if (c->runAfterSave && !c->saving) {
+        c->runAfterSave = false;
+        if (file.error.isEmpty()) {
+            pyConsole->runFile(c->location.toStdString());
+        }
+    }
+}
+
+JournalBase EditorStack::journalBase(CodeEditor* c, qint64 size, const QByteArray &hash) const {
+    JournalBase base;
+    base.location = c->location;
+    base.title = c->filename.isEmpty() ? tabText(indexOf(c)) : c->filename;
+    base.encoding = c->encoding;
+    base.byteOrderMark = c->byteOrderMark;
+    base.size = size;
+    base.hash = hash;
+    return base;
+}
+
+void EditorStack::saveSession() const {
+    settingsPtr->remove("Session");
+    settingsPtr->beginGroup("Session");
+    settingsPtr->setValue("iZoom", globalZoom);
+    settingsPtr->beginWriteArray("aTabs");
+    int saved = 0;
+    int current = 0;
+    for (int index = 0; index < count(); ++index) {
+        QString location;
+        int cursor = 0;
+        int scroll = 0;
+        if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
+            location = c->location;
+            if (c->loading) {
+                cursor = qMax(c->pendingCursor, 0);
+                scroll = qMax(c->pendingScroll, 0);
+            } else {
+                cursor = c->textCursor().position();
+                scroll = c->verticalScrollBar()->value();
+            }
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+            location = v->location;
+        } else if (SessionTab* t = qobject_cast<SessionTab*>(widget(index))) {
+            location = t->location;
+            cursor = t->cursor;
+            scroll = t->scroll;
+        }
+        if (location.isEmpty()) {
+            continue;
+        }
+        if (index == currentIndex()) {
+            current = saved;
+        }
+        settingsPtr->setArrayIndex(saved++);
+        settingsPtr->setValue("sLocation", location);
+        settingsPtr->setValue("iCursor", cursor);
+        settingsPtr->setValue("iScroll", scroll);
+    }
+    settingsPtr->endArray();
+    settingsPtr->setValue("iCurrent", current);
+    settingsPtr->endGroup();
+}
+
+/*
+* Only placeholders are made here, so starting up costs the same however many
+* tabs were open; a file is read when its tab is first shown.
+*/
+void EditorStack::restoreSession() {
+    if (!settingsPtr->value("Editor/bRestoreSession", true).toBool()) {
+        return;
+    }
+    settingsPtr->beginGroup("Session");
+    QList<SessionTab*> placeholders;
+    const int tabs = settingsPtr->beginReadArray("aTabs");
+    restoring = true;
+    for (int i = 0; i < tabs; ++i) {
+        settingsPtr->setArrayIndex(i);
+        const QString location = settingsPtr->value("sLocation").toString();
+        if (location.isEmpty() || tabFor(location)) {
+            continue;
+        }
+        SessionTab* placeholder = new SessionTab(location, settingsPtr->value("iCursor", 0).toInt(),
+            settingsPtr->value("iScroll", 0).toInt(), this);
+        addTab(placeholder, QFileInfo(location).fileName());
+        setTabToolTip(indexOf(placeholder), QDir::toNativeSeparators(location));
+        placeholders.append(placeholder);
+    }
+    settingsPtr->endArray();
+    globalZoom = settingsPtr->value("iZoom", globalZoom).toInt();
+    const int current = settingsPtr->value("iCurrent", 0).toInt();
+    settingsPtr->endGroup();
+
+    if (placeholders.isEmpty()) {
+        restoring = false;
+        return;
+    }
+
+    /* The empty buffer opened at startup is not worth keeping next to them */
+    CodeEditor* blank = qobject_cast<CodeEditor*>(widget(0));
+    if (blank && blank->location.isEmpty() && !blank->document()->isModified() && blank->document()->isEmpty()) {
+        closeTab(0);
+    }
+    restoring = false;
+
+    SessionTab* active = placeholders.at(qBound(0, current, placeholders.size() - 1));
+    setCurrentWidget(active);
+    materialize(indexOf(active));
+}
+
+/* Swaps a placeholder that has just been shown for an editor loading its file */
+void EditorStack::materialize(int index) {
+    SessionTab* placeholder = qobject_cast<SessionTab*>(widget(index));
+    if (!placeholder || restoring) {
+        return;
+    }
+    if (CodeEditor* c = openPath(placeholder->location, index)) {
+        c->pendingCursor = placeholder->cursor;
+        c->pendingScroll = placeholder->scroll;
+    }
+    removeTab(indexOf(placeholder));
+    placeholder->deleteLater();
+    if (count() == 0) {
+        insertEditor();
+    }
+}
+
+void EditorStack::recoverJournals() {
+    JournalSession* session = JournalSession::instance();
+    const QVector<RecoveredDocument> documents = session->orphans();
+    if (!documents.isEmpty()) {
+        QString names;
+        for (int i = 0; i < documents.size(); ++i) {
+            const JournalBase &base = documents.at(i).base;
+            names += (base.location.isEmpty() ? base.title : QDir::toNativeSeparators(base.location)) + "\n";
+        }
+        QMessageBox::StandardButton recover;
+        recover = QMessageBox::question(this, "Recover", "Pylet closed without saving changes to:\n\n" + names +
+            "\nDo you want to recover them?", QMessageBox::Yes | QMessageBox::No);
+        if (recover == QMessageBox::Yes) {
+            for (int i = 0; i < documents.size(); ++i) {
+                const RecoveredDocument &document = documents.at(i);
+                CodeEditor* c = insertEditor(document.base.location);
+                c->encoding = document.base.encoding;
+                c->byteOrderMark = document.base.byteOrderMark;
+                if (!c->location.isEmpty()) {
+                    c->filename = QFileInfo(c->location).fileName();
+                    FileWatcher::instance()->watch(c, c->location);
+                }
+
+                /* Journaled afresh, as one edit of an empty document */
+                c->journal->reset(journalBase(c, -1, QByteArray()));
+                c->setPlainText(document.text);
+                c->document()->setModified(true);
+                if (!c->filename.isNull()) {
+                    setTabText(indexOf(c), c->filename + "*");
+                }
+            }
+        }
     }
+    session->removeOrphans();
+}
+
+/* Watches the editor's file, which has just been read or written with 'size' bytes hashing to 'hash' */
+void EditorStack::trackFile(CodeEditor* c, qint64 size, const QByteArray &hash) {
+    FileWatcher::instance()->watch(c, c->location);
+    FileWatcher::instance()->setContent(c->location, size, hash);
 }
 
 void EditorStack::refresh(CodeEditor* c) {
@@ -60,15 +288,18 @@ void EditorStack::refresh(CodeEditor* c) {
             QFileInfo(*checkFile).absoluteFilePath() + "\n\nDo you want to reload it?",
             QMessageBox::Yes | QMessageBox::No);
         if (reload == QMessageBox::Yes) {
-            if (checkFile->open(QIODevice::ReadOnly | QIODevice::Text)) {
-                QTextStream stream(checkFile);
-                c->setPlainText(stream.readAll());
+            if (checkFile->open(QIODevice::ReadOnly)) {
+                const QByteArray data = checkFile->readAll();
+                c->setPlainText(TextDecoder::decode(data, &c->encoding, &c->byteOrderMark));
+                const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+                c->journal->reset(journalBase(c, data.size(), hash));
+                FileWatcher::instance()->setContent(c->location, data.size(), hash);
                 setTabText(indexOf(c), c->filename);
                 modificationQueued = true;
             }
             checkFile->close();
         } else {
-            save(true);
+            save(indexOf(c), true);
         }
     } else {
         QMessageBox::StandardButton saveNew;
@@ -76,8 +307,10 @@ void EditorStack::refresh(CodeEditor* c) {
             QFileInfo(*checkFile).absoluteFilePath() + "\n\nWould you like to save a new copy?",
             QMessageBox::Yes | QMessageBox::No);
         if (saveNew == QMessageBox::No || saveAs() != 0) {
+            FileWatcher::instance()->unwatch(c);
             c->location = "";
             c->filename = nullptr;
+            c->updateLinting();
             int fileID = generateUntrackedID();
             setTabText(indexOf(c), "untitled" + QString::number(fileID) + ".py");
             untrackedFiles.insert(fileID, c);
@@ -112,6 +345,9 @@ void EditorStack::manageFocus() {
 
 void EditorStack::flagAsModified(bool modified) {
     if (CodeEditor* c = qobject_cast<CodeEditor*>(QObject::sender())) {
+        if (c->loading) {
+            return;
+        }
         if (!modificationQueued) {
             if (!c->filename.isNull()) {
                 setTabText(indexOf(c), c->filename + "*");
@@ -123,33 +359,51 @@ void EditorStack::flagAsModified(bool modified) {
     }
 }
 
-void EditorStack::manageExternalModification() {
+/* The watcher only reports files whose contents really changed */
+void EditorStack::manageExternalModification(const QString &path) {
     qDebug() << "modification triggered";
-    if (CodeEditor* c = qobject_cast<CodeEditor*>(QObject::sender()->parent())) {
-        if (qApp->applicationState() != Qt::ApplicationInactive) {
-            if (!saveQueued) {
-                refresh(c);
-            } else {
-                saveQueued = false;
-            }
+    QList<CodeEditor*> editors;
+    for (int index = 0; index < count(); ++index) {
+        CodeEditor* c = qobject_cast<CodeEditor*>(widget(index));
+        if (c && !c->loading && !c->location.isEmpty() && QFileInfo(c->location).absoluteFilePath() == path) {
+            editors.append(c);
+        }
+    }
+    for (int i = 0; i < editors.size(); ++i) {
+        /* The report may beat the saver's; it is judged once the save is known */
+        if (editors.at(i)->saving) {
+            editors.at(i)->externalChange = true;
         } else {
-            c->pendingRefresh = true;
+            queueRefresh(editors.at(i));
         }
     }
 }
 
-CodeEditor* EditorStack::insertEditor(const QString &filePath) {
+/* Asks about the change now, or once the window is active again */
+void EditorStack::queueRefresh(CodeEditor* c) {
+    if (qApp->applicationState() != Qt::ApplicationInactive) {
+        refresh(c);
+    } else {
+        c->pendingRefresh = true;
+    }
+}
+
+CodeEditor* EditorStack::insertEditor(const QString &filePath, int index) {
     CodeEditor* codeEditor = new CodeEditor(settingsPtr, this, filePath);
 
     if (filePath == "") {
         int fileID = generateUntrackedID();
-        addTab(codeEditor, "untitled" + QString::number(fileID) + ".py");
+        insertTab(index, codeEditor, "untitled" + QString::number(fileID) + ".py");
         untrackedFiles.insert(fileID, codeEditor);
         codeEditor->untrackedID = fileID;
     } else {
-        addTab(codeEditor, "");
+        insertTab(index, codeEditor, "");
     }
 
+    /* Files get their base once read; until then the editor is read-only */
+    codeEditor->journal = new DocumentJournal(codeEditor);
+    codeEditor->journal->reset(journalBase(codeEditor, -1, QByteArray()));
+
     qDebug() << "Code editor location is:" << codeEditor->location;
     connect(codeEditor, SIGNAL(modificationChanged(bool)),
         this, SLOT(flagAsModified(bool)));
@@ -159,33 +413,254 @@ CodeEditor* EditorStack::insertEditor(const QString &filePath) {
     return codeEditor;
 }
 
-void EditorStack::open(QFile* openFile) {
-    CodeEditor* codeEditor;
+CodeEditor* EditorStack::open(QFile* openFile) {
     if (openFile == nullptr) {
-        QString filename = QFileDialog::getOpenFileName(this, tr("Open File"),
+        const QStringList filenames = QFileDialog::getOpenFileNames(this, tr("Open File"),
             QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation),
             "Python files (*.py *.pyw);;Text files (*.txt);;All files (*.*)");
-        if (filename == "")
-            return;
+        CodeEditor* last = nullptr;
+        for (int i = 0; i < filenames.size(); ++i) {
+            if (CodeEditor* c = open(new QFile(filenames.at(i)))) {
+                last = c;
+            }
+        }
+        return last;
+    }
 
-        codeEditor = insertEditor(filename);
-        openFile = new QFile(filename, codeEditor);
-    } else {
-        codeEditor = insertEditor(QFileInfo(*openFile).absoluteFilePath());
+    const QString filePath = QFileInfo(*openFile).absoluteFilePath();
+    delete openFile;
+    return openPath(filePath);
+}
+
+/* Opens a file in a tab at 'index', or after the others */
+CodeEditor* EditorStack::openPath(const QString &filePath, int index) {
+    /* Huge and binary files are mapped into a read-only view instead of being loaded */
+    bool binary;
+    if (LargeFileView::isLarge(filePath, largeFileThreshold(), &binary)) {
+        openLarge(filePath, binary, index);
+        return nullptr;
     }
 
-    if (openFile->open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream stream(openFile);
-        codeEditor->setPlainText(stream.readAll());
-        codeEditor->filename = QFileInfo(*openFile).fileName();
-        setTabText(indexOf(codeEditor), codeEditor->filename);
-        codeEditor->document()->setModified(false);
-    } else {
+    /* The tab shows right away; the text follows once a pool thread has read and decoded it */
+    CodeEditor* codeEditor = insertEditor(filePath, index);
+    codeEditor->filename = QFileInfo(filePath).fileName();
+    codeEditor->loading = true;
+    codeEditor->setReadOnly(true);
+    setTabText(indexOf(codeEditor), codeEditor->filename);
+    FileLoader::instance()->load(codeEditor->jobOwner, filePath);
+    return codeEditor;
+}
+
+/* Fills the editor a file was read for, unless it has been closed meanwhile */
+void EditorStack::fileLoaded(const LoadedFile &file) {
+    CodeEditor* c = nullptr;
+    for (int index = 0; index < count() && !c; ++index) {
+        CodeEditor* candidate = qobject_cast<CodeEditor*>(widget(index));
+        if (candidate && candidate->jobOwner == file.owner && candidate->loading && candidate->location == file.path) {
+            c = candidate;
+        }
+    }
+    if (!c) {
+        return;
+    }
+
+    if (!file.error.isEmpty()) {
         QMessageBox::critical(this, tr("Error"), tr("Unable to read the specified file."));
-        codeEditor->location = "";
-        closeTab();
+        c->location = "";
+        closeTab(indexOf(c), true);
+        return;
     }
-    delete openFile;
+    c->encoding = file.encoding;
+    c->byteOrderMark = file.byteOrderMark;
+    c->journal->reset(journalBase(c, file.size, file.hash));
+    trackFile(c, file.size, file.hash);
+    DocumentFiller* filler = new DocumentFiller(c, file.text);
+    connect(filler, SIGNAL(finished()), this, SLOT(editorFilled()));
+}
+
+void EditorStack::editorFilled() {
+    if (CodeEditor* c = qobject_cast<CodeEditor*>(QObject::sender()->parent())) {
+        c->loading = false;
+        setTabText(indexOf(c), c->filename);
+        if (c->pendingLine >= 0) {
+            c->goToLine(c->pendingLine);
+        } else if (c->pendingCursor >= 0) {
+            QTextCursor cursor(c->document());
+            cursor.setPosition(qMin(c->pendingCursor, c->document()->characterCount() - 1));
+            c->setTextCursor(cursor);
+            c->verticalScrollBar()->setValue(c->pendingScroll);
+        }
+        c->pendingLine = -1;
+        c->pendingCursor = -1;
+        c->pendingScroll = -1;
+    }
+}
+
+void EditorStack::openLarge(const QString &filePath, bool binary, int index) {
+    LargeFileView* view = new LargeFileView(filePath, binary, this);
+    if (!view->isOpen()) {
+        QMessageBox::critical(this, tr("Error"), tr("Unable to read the specified file."));
+        delete view;
+        return;
+    }
+    view->resetZoom(globalZoom);
+    insertTab(index, view, view->filename + (binary ? " [binary]" : " [read-only]"));
+    connect(view, SIGNAL(modificationChanged(bool)), this, SLOT(flagLargeFileModified(bool)));
+    setCurrentWidget(view);
+}
+
+void EditorStack::flagLargeFileModified(bool modified) {
+    if (LargeFileView* v = qobject_cast<LargeFileView*>(QObject::sender())) {
+        setTabText(indexOf(v), v->filename + (modified ? "*" : ""));
+    }
+}
+
+/* The editor or large file view 'filePath' is open in, if any */
+QWidget* EditorStack::tabFor(const QString &filePath) const {
+    const QString absolute = QFileInfo(filePath).absoluteFilePath();
+    const QString canonical = QFileInfo(filePath).canonicalFilePath();
+    for (int index = 0; index < count(); ++index) {
+        QString location;
+        if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
+            location = c->location;
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+            location = v->location;
+        } else if (SessionTab* t = qobject_cast<SessionTab*>(widget(index))) {
+            location = t->location;
+        }
+        if (!location.isEmpty() && (location == absolute || location == canonical)) {
+            return widget(index);
+        }
+    }
+    return nullptr;
+}
+
+/* Switches to the file's tab, opening it if needed, and moves to zero-based 'line' */
+void EditorStack::openAt(const QString &filePath, int line) {
+    if (QWidget* w = tabFor(filePath)) {
+        /* Showing a placeholder replaces it with an editor */
+        setCurrentWidget(w);
+        w = tabFor(filePath);
+        if (CodeEditor* c = qobject_cast<CodeEditor*>(w)) {
+            if (c->loading) {
+                c->pendingLine = line;
+            } else {
+                c->goToLine(line);
+            }
+        }
+        return;
+    }
+
+    if (CodeEditor* c = open(new QFile(filePath))) {
+        c->pendingLine = line;
+    }
+}
+
+QHash<QString, QString> EditorStack::openBuffers() const {
+    QHash<QString, QString> buffers;
+    for (int index = 0; index < count(); ++index) {
+        CodeEditor* c = qobject_cast<CodeEditor*>(widget(index));
+        if (c && !c->location.isEmpty() && !c->loading) {
+            buffers.insert(QFileInfo(c->location).canonicalFilePath(), c->toPlainText());
+        }
+    }
+    return buffers;
+}
+
+/*
+* Everything is checked before anything changes, so a stale preview changes
+* nothing. Open files change in their editor as one undo step and are written
+* too unless they had unsaved edits; the others are replaced on disk.
+*/
+int EditorStack::applyChanges(const QVector<FileChange> &changes, QStringList *problems) {
+    QVector<CodeEditor*> editors(changes.size(), nullptr);
+    for (int i = 0; i < changes.size(); ++i) {
+        const FileChange &change = changes.at(i);
+        QWidget* w = tabFor(change.path);
+        if (qobject_cast<SessionTab*>(w)) {
+            /* A placeholder has no text of its own yet, so the file is changed on disk */
+            w = nullptr;
+        }
+        editors[i] = qobject_cast<CodeEditor*>(w);
+        QString problem;
+        if (w && !editors[i]) {
+            problem = "open in a read-only or large file view";
+        } else if (change.fromBuffer != (editors[i] != nullptr)) {
+            problem = change.fromBuffer ? "closed since the preview" : "opened since the preview";
+        } else if (change.fromBuffer) {
+            QTextDocument* doc = editors[i]->document();
+            for (int k = 0; k < change.lines.size() && problem.isEmpty(); ++k) {
+                if (doc->findBlockByNumber(change.lines.at(k).line).text() != change.lines.at(k).before) {
+                    problem = "edited since the preview";
+                }
+            }
+        } else {
+            problem = ProjectReplace::check(change);
+        }
+        if (!problem.isEmpty()) {
+            *problems << QDir::toNativeSeparators(change.path) + ": " + problem;
+        }
+    }
+    if (!problems->isEmpty()) {
+        return -1;
+    }
+
+    const QStringList errors = ProjectReplace::write(changes);
+    int written = 0;
+    for (int i = 0; i < changes.size(); ++i) {
+        const FileChange &change = changes.at(i);
+        QString error = errors.at(i);
+        if (CodeEditor* c = editors[i]) {
+            const bool wasModified = c->document()->isModified();
+            QTextCursor cursor(c->document());
+            cursor.beginEditBlock();
+            for (int k = change.lines.size() - 1; k >= 0; --k) {
+                const QTextBlock block = c->document()->findBlockByNumber(change.lines.at(k).line);
+                cursor.setPosition(block.position());
+                cursor.setPosition(block.position() + block.length() - 1, QTextCursor::KeepAnchor);
+                cursor.insertText(change.lines.at(k).after);
+            }
+            cursor.endEditBlock();
+            if (!wasModified) {
+                writeBuffer(c, &error);
+            }
+        }
+        if (error.isEmpty()) {
+            ++written;
+            if (projectIndex) {
+                projectIndex->refresh(change.path);
+            }
+        } else {
+            *problems << QDir::toNativeSeparators(change.path) + ": " + error;
+        }
+    }
+    return written;
+}
+
+/* Saves an editor atomically, without the reload prompt the file watcher would raise */
+bool EditorStack::writeBuffer(CodeEditor* c, QString *error) {
+    SaveJob job;
+    job.owner = c->jobOwner;
+    job.revision = c->document()->revision();
+    job.path = c->location;
+    job.encoding = c->encoding;
+    job.byteOrderMark = c->byteOrderMark;
+    job.chunks = DocumentSnapshot::chunksOf(c->document());
+    const SavedFile file = FileSaver::write(job);
+    if (!file.error.isEmpty()) {
+        *error = file.error;
+        return false;
+    }
+
+    trackFile(c, file.size, file.hash);
+    c->document()->setModified(false);
+    c->journal->reset(journalBase(c, file.size, file.hash));
+    setTabText(indexOf(c), c->filename);
+    return true;
+}
+
+qint64 EditorStack::largeFileThreshold() const {
+    return (qint64)settingsPtr->value("Editor/iLargeFileThresholdMB", 16).toInt() * 1024 * 1024;
 }
 
 /*
@@ -197,55 +672,60 @@ void EditorStack::save(int index, bool forceSave) {
         index = indexOf(currentWidget());
     qDebug() << "Index is:" << index;
     if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
+        if (c->loading) {
+            qDebug() << "Nothing to save - file is still loading.";
+            return;
+        }
         if (!c->document()->isModified() && !forceSave) {
             qDebug() << "Nothing to save - file has not been modified.";
             return;
         }
-        qDebug() << "Got here.";
-        QFile* saveFile = new QFile(c->location);
-        if (c->location != "" && saveFile->exists()) {
-            fileStream(c, saveFile);
-            setTabText(indexOf(c), c->filename);
+        if (c->location != "" && QFileInfo::exists(c->location)) {
+            startSave(c);
         } else {
             setCurrentWidget(c);
             saveAs();
         }
-        delete saveFile;
-        qDebug() << "File saved.";
+    } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+        if (v->isModified() || forceSave) {
+            v->save();
+        }
     } else {
         qDebug() << "Nothing to save - are any files open?";
     }
 }
 
-int EditorStack::saveAs() {
-    if (CodeEditor* c = qobject_cast<CodeEditor*>(currentWidget())) {
-        QString filename = QFileDialog::getSaveFileName(this, tr("Save File As"),
-            QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) +
-            "/untitled" + QString::number(c->untrackedID) + ".py",
-            "Python files (*.py *.pyw);;Text files (*.txt);;All files (*.*)");
-        if (filename != "") {
-            QFile* saveFile = new QFile(filename, c);
-            fileStream(c, saveFile);
-            setTabText(indexOf(c), c->filename);
-            saveQueued = false;
-            delete saveFile;
+/* Asks where to save the editor and moves it there; false if the user cancelled */
+bool EditorStack::chooseLocation(CodeEditor* c) {
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save File As"),
+        QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) +
+        "/untitled" + QString::number(c->untrackedID) + ".py",
+        "Python files (*.py *.pyw);;Text files (*.txt);;All files (*.*)");
+    if (filename == "") {
+        qDebug() << "Filename is empty.";
+        return false;
+    }
+    c->location = QFileInfo(filename).absoluteFilePath();
+    c->filename = QFileInfo(filename).fileName();
+    c->updateLinting();
+    setTabText(indexOf(c), c->filename + "*");
 
-            untrackedFiles.remove(c->untrackedID);
-            c->untrackedID = 0;
+    untrackedFiles.remove(c->untrackedID);
+    c->untrackedID = 0;
 
-            c->watchdog = new QFileSystemWatcher(c);
-            if (c->watchdog->addPath(filename)) {
-                connect(c->watchdog, SIGNAL(fileChanged(QString)), this, SLOT(manageExternalModification()));
-            } else {
-                qDebug() << "Unable to set file watchdog at path " << filename;
-            }
-            currentChanged(indexOf(c));
-            qDebug() << "File saved for the first time.";
-            return 0;
-        } else {
-            qDebug() << "Filename is empty.";
+    /* Watching starts once the file is written */
+    FileWatcher::instance()->unwatch(c);
+    return true;
+}
+
+int EditorStack::saveAs() {
+    if (CodeEditor* c = qobject_cast<CodeEditor*>(currentWidget())) {
+        if (!chooseLocation(c)) {
             return 1;
         }
+        startSave(c);
+        currentChanged(indexOf(c));
+        return 0;
     } else {
         qDebug() << "Nothing to save - are any files open?";
         return 2;
@@ -263,10 +743,11 @@ void EditorStack::closeTab(int index, bool forceClose) {
         index = indexOf(currentWidget());
     if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
         if (forceClose) {
+            c->journal->discard();
             c->deleteLater();
         } else {
             bool isUntracked = c->filename == "";
-            if (c->document()->isModified()) {
+            if (c->document()->isModified() && !c->loading) {
                 setCurrentWidget(c);
                 QString filename;
                 if (!isUntracked) {
@@ -280,20 +761,47 @@ void EditorStack::closeTab(int index, bool forceClose) {
                 if (saveQuery == QMessageBox::Cancel) {
                     return;
                 } else {
-                    if (isUntracked)
-                        untrackedFiles.remove(c->untrackedID);
+                    /* Written here, so the tab stays open with its journal if the write fails */
                     if (saveQuery == QMessageBox::Yes) {
-                        save();
-                    } else {
-                        c->deleteLater();
+                        if ((c->location == "" || !QFileInfo::exists(c->location)) && !chooseLocation(c)) {
+                            return;
+                        }
+                        if (c->saving) {
+                            /* A snapshot still being written would land over this one */
+                            FileSaver::instance()->flush();
+                        }
+                        QString error;
+                        if (!writeBuffer(c, &error)) {
+                            QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location.") +
+                                "\n\n" + QDir::toNativeSeparators(c->location) + "\n" + error);
+                            return;
+                        }
                     }
+                    if (isUntracked)
+                        untrackedFiles.remove(c->untrackedID);
+                    c->journal->discard();
+                    c->deleteLater();
                 }
             } else {
                 if (isUntracked)
                     untrackedFiles.remove(c->untrackedID);
+                c->journal->discard();
                 c->deleteLater();
             }
         }
+    } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+        if (v->isModified() && !forceClose) {
+            setCurrentWidget(v);
+            QMessageBox::StandardButton saveQuery;
+            saveQuery = QMessageBox::question(this, "Save", "Save file \"" + v->location + "\"?",
+                QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+            if (saveQuery == QMessageBox::Cancel || (saveQuery == QMessageBox::Yes && !v->save())) {
+                return;
+            }
+        }
+        v->deleteLater();
+    } else if (QWidget* w = widget(index)) {
+        w->deleteLater();
     }
     removeTab(index);
     if (count() == 0)
@@ -302,7 +810,12 @@ void EditorStack::closeTab(int index, bool forceClose) {
 
 void EditorStack::closeAll() {
     while (count() != 1) {
+        const int before = count();
         closeTab();
+        if (count() == before) {
+            /* Cancelled, or the tab could not be saved */
+            return;
+        }
     }
     // Close last tab manually since it will re-insert the default editor.
     closeTab();
@@ -312,10 +825,15 @@ void EditorStack::closeAll() {
 void EditorStack::run() {
     if (CodeEditor* c = qobject_cast<CodeEditor*>(currentWidget())) {
         if (c->filename != "") {
-            save();
-
-            QFile execFile(c->location);
-            pyConsole->runFile(execFile.fileName().toStdString());
+            /* Runs what the editor shows, so only once that is on disk */
+            if (c->document()->isModified()) {
+                save();
+            }
+            if (c->saving) {
+                c->runAfterSave = true;
+            } else if (!c->document()->isModified()) {
+                pyConsole->runFile(c->location.toStdString());
+            }
         } else {
             QTemporaryFile tempFile(QDir::tempPath() + "-pyrun-XXXXXX.py", c);
 
@@ -332,33 +850,177 @@ void EditorStack::run() {
 }
 
 void EditorStack::undo() {
-    currentEditor()->undo();
+    if (CodeEditor* c = currentEditor()) {
+        c->undo();
+    } else if (LargeFileView* v = qobject_cast<LargeFileView*>(currentWidget())) {
+        v->undo();
+    }
 }
 
 void EditorStack::redo() {
-    currentEditor()->redo();
+    if (CodeEditor* c = currentEditor()) {
+        c->redo();
+    } else if (LargeFileView* v = qobject_cast<LargeFileView*>(currentWidget())) {
+        v->redo();
+    }
 }
 
 void EditorStack::cut() {
-    currentEditor()->cut();
+    if (CodeEditor* c = currentEditor()) {
+        c->cut();
+    }
 }
 
 void EditorStack::copy() {
-    currentEditor()->copy();
+    if (CodeEditor* c = currentEditor()) {
+        c->copy();
+    }
 }
 
 void EditorStack::paste() {
-    currentEditor()->paste();
+    if (CodeEditor* c = currentEditor()) {
+        c->paste();
+    }
 }
 
 void EditorStack::selectAll() {
-    currentEditor()->selectAll();
+    if (CodeEditor* c = currentEditor()) {
+        c->selectAll();
+    }
+}
+
+void EditorStack::jumpToBracket() {
+    if (CodeEditor* c = currentEditor()) {
+        c->jumpToMatchingBracket();
+    }
+}
+
+void EditorStack::toggleFold() {
+    if (CodeEditor* c = currentEditor()) {
+        c->toggleFoldAtCursor();
+    }
+}
+
+void EditorStack::goToSymbol() {
+    CodeEditor* c = currentEditor();
+    if (!c) {
+        return;
+    }
+
+    QStringList names;
+    QList<int> lines;
+    const QVector<PythonSymbols::Symbol> &symbols = c->symbols->symbols();
+    for (int i = 0; i < symbols.size(); ++i) {
+        if (symbols.at(i).kind != PythonSymbols::Import) {
+            names << c->symbols->qualifiedName(i);
+            lines << symbols.at(i).line;
+        }
+    }
+    if (names.isEmpty()) {
+        return;
+    }
+
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, "Go To Symbol", "Symbol:", names, 0, true, &ok);
+    const int index = names.indexOf(choice);
+    if (ok && index >= 0) {
+        c->goToLine(lines.at(index));
+    }
+}
+
+/* Looks for the word under the cursor in the current file first, then in every other open tab */
+void EditorStack::goToDefinition() {
+    CodeEditor* c = currentEditor();
+    if (!c) {
+        return;
+    }
+    const QString name = c->wordUnderCursor();
+    if (name.isEmpty()) {
+        return;
+    }
+
+    int local = c->symbols->find(name);
+    if (local >= 0 && c->symbols->symbols().at(local).kind != PythonSymbols::Import) {
+        c->goToLine(c->symbols->symbols().at(local).line);
+        return;
+    }
+
+    for (int index = 0; index < count(); ++index) {
+        CodeEditor* other = qobject_cast<CodeEditor*>(widget(index));
+        if (!other || other == c) {
+            continue;
+        }
+        const int found = other->symbols->find(name);
+        if (found >= 0 && other->symbols->symbols().at(found).kind != PythonSymbols::Import) {
+            setCurrentIndex(index);
+            other->goToLine(other->symbols->symbols().at(found).line);
+            return;
+        }
+    }
+
+    /* Then the rest of the project, which knows top-level definitions only */
+    if (projectIndex) {
+        const QList<ProjectIndex::Location> found = projectIndex->definitions(name);
+        for (int i = 0; i < found.size(); ++i) {
+            if (found.at(i).kind != PythonSymbols::Import && found.at(i).path != c->location) {
+                openAt(found.at(i).path, found.at(i).line);
+                return;
+            }
+        }
+    }
+
+    /* Nothing better than the import itself */
+    if (local >= 0) {
+        c->goToLine(c->symbols->symbols().at(local).line);
+    }
+}
+
+void EditorStack::findUsages() {
+    CodeEditor* c = currentEditor();
+    if (!c || !projectIndex) {
+        return;
+    }
+    const QString name = c->wordUnderCursor();
+    if (name.isEmpty()) {
+        return;
+    }
+
+    pendingUsages = name;
+    connect(projectIndex, SIGNAL(usagesFound(QString, QList<ProjectIndex::Location>)),
+            this, SLOT(showUsages(QString, QList<ProjectIndex::Location>)), Qt::UniqueConnection);
+    projectIndex->findUsages(name);
+}
+
+void EditorStack::showUsages(const QString &name, const QList<ProjectIndex::Location> &found) {
+    if (name != pendingUsages) {
+        return;
+    }
+    pendingUsages.clear();
+    if (found.isEmpty()) {
+        QMessageBox::information(this, tr("Find Usages"), tr("No usages of '%1' found in the project.").arg(name));
+        return;
+    }
+
+    const QDir root(projectIndex->root());
+    QStringList items;
+    for (int i = 0; i < found.size(); ++i) {
+        items << root.relativeFilePath(found.at(i).path) + ":" + QString::number(found.at(i).line + 1) + ": " + found.at(i).detail;
+    }
+
+    bool ok = false;
+    const QString item = QInputDialog::getItem(this, tr("Find Usages"), tr("Usages of '%1':").arg(name), items, 0, false, &ok);
+    const int index = items.indexOf(item);
+    if (ok && index >= 0) {
+        openAt(found.at(index).path, found.at(index).line);
+    }
 }
 
 void EditorStack::zoomIn() {
     for (int index = 0; index < count(); ++index) {
         if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
             c->zoomInSlot();
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+            v->resetZoom(v->font().pointSize() + 2);
         }
     }
     globalZoom += 2;
@@ -368,6 +1030,8 @@ void EditorStack::zoomOut() {
     for (int index = 0; index < count(); ++index) {
         if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
             c->zoomOutSlot();
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+            v->resetZoom(v->font().pointSize() - 2);
         }
     }
     globalZoom += 2;
@@ -377,6 +1041,8 @@ void EditorStack::resetZoom() {
     for (int index = 0; index < count(); ++index) {
         if (CodeEditor* c = qobject_cast<CodeEditor*>(widget(index))) {
             c->resetZoom();
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(widget(index))) {
+            v->resetZoom();
         }
     }
     globalZoom = 12;
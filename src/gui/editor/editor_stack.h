@@ -7,6 +7,13 @@
 #define EDITOR_STACK_H
 
 #include "code_editor_interface.h"
+#include "code_editor_loader.h"
+#include "code_editor_saver.h"
+#include "file_watcher.h"
+#include "large_file_view.h"
+#include "session_tab.h"
+#include "src/gui/project_index.h"
+#include "src/gui/project_replace.h"
 #include "src/python/qpyconsole.h"
 #include <qtabwidget.h>
 
@@ -17,25 +24,58 @@ public:
     EditorStack(QSettings* s, QWidget *parent);
     CodeEditor* currentEditor();
     QPyConsole* pyConsole;
+    ProjectIndex* projectIndex = nullptr;
+
+    /* Text of every open file, by canonical path */
+    QHash<QString, QString> openBuffers() const;
+
+    /* Remembers the open files and where their views were, for restoreSession() */
+    void saveSession() const;
+
+    /* Reopens the last session's files as placeholders, each loaded once first shown */
+    void restoreSession();
+
+    /* Offers to reopen the unsaved edits journaled by sessions that ended without saving them */
+    void recoverJournals();
+
+    /* Applies changes from ProjectReplace and returns the number of files changed, or -1 if nothing could be */
+    int applyChanges(const QVector<FileChange> &changes, QStringList *problems);
 
 private:
-    void fileStream(CodeEditor* c, QFile* saveFile);
+    void startSave(CodeEditor* c);
+    void trackFile(CodeEditor* c, qint64 size, const QByteArray &hash);
+    void queueRefresh(CodeEditor* c);
+    JournalBase journalBase(CodeEditor* c, qint64 size, const QByteArray &hash) const;
     void refresh(CodeEditor* c);
     int generateUntrackedID();
+    CodeEditor* openPath(const QString &filePath, int index = -1);
+    void openLarge(const QString &filePath, bool binary, int index = -1);
+    qint64 largeFileThreshold() const;
+    QWidget* tabFor(const QString &filePath) const;
+    bool writeBuffer(CodeEditor* c, QString *error);
+    bool chooseLocation(CodeEditor* c);
     QMap<int, CodeEditor*> untrackedFiles;
     QSettings* settingsPtr;
     bool modificationQueued = false;
-    bool saveQueued = false;
+    bool restoring = false;
     int globalZoom = 12;
+    QString pendingUsages; /* The name whose usages are being looked for */
 
 private Q_SLOTS:
     void manageFocus();
     void flagAsModified(bool);
-    void manageExternalModification();
+    void flagLargeFileModified(bool);
+    void manageExternalModification(const QString &path);
+    void fileLoaded(const LoadedFile &file);
+    void editorFilled();
+    void fileSaved(const SavedFile &file);
+    void materialize(int index);
+    void showUsages(const QString &name, const QList<ProjectIndex::Location> &found);
 
 public Q_SLOTS:
-    CodeEditor* insertEditor(const QString &filePath = "");
-    void open(QFile* openFile = nullptr);
+    CodeEditor* insertEditor(const QString &filePath = "", int index = -1);
+    CodeEditor* open(QFile* openFile = nullptr);
+    void openAt(const QString &filePath, int line);
     void save(int index = -1, bool forceSave = false);
     int saveAs();
     void saveAll();
@@ -48,6 +88,11 @@ public Q_SLOTS:
     void copy();
     void paste();
     void selectAll();
+    void jumpToBracket();
+    void toggleFold();
+    void goToSymbol();
+    void goToDefinition();
+    void findUsages();
     void zoomIn();
     void zoomOut();
     void resetZoom();
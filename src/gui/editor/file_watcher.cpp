@@ -0,0 +1,239 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "file_watcher.h"
+#include <qcoreapplication.h>
+#include <qcryptographichash.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qrunnable.h>
+
+namespace {
+
+class HashTask : public QRunnable {
+public:
+    HashTask(FileWatcher *watcher, const QString &path) :
+        watcher(watcher),
+        path(path) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        qint64 size = -1;
+        QByteArray hash;
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QCryptographicHash sha1(QCryptographicHash::Sha1);
+            if (sha1.addData(&file)) {
+                size = file.size();
+                hash = sha1.result();
+            }
+        }
+
+        /* Queued to the watcher, which lives on the GUI thread */
+        Q_EMIT watcher->hashed(path, size, hash);
+    }
+
+private:
+    FileWatcher *watcher;
+    const QString path;
+};
+
+}
+
+FileWatcher *FileWatcher::instance() {
+    static FileWatcher *watcher = 0;
+    if (!watcher) {
+        watcher = new FileWatcher;
+    }
+    return watcher;
+}
+
+FileWatcher::FileWatcher() :
+    QObject(qApp) {
+
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged(QString)));
+    connect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+
+    coalesce = new QTimer(this);
+    coalesce->setSingleShot(true);
+    coalesce->setInterval(CoalesceDelay);
+    connect(coalesce, SIGNAL(timeout()), this, SLOT(settle()));
+
+    pool.setMaxThreadCount(2);
+    connect(this, SIGNAL(hashed(QString, qint64, QByteArray)), this, SLOT(compare(QString, qint64, QByteArray)));
+}
+
+void FileWatcher::watch(QObject *owner, const QString &path) {
+    const QString absolute = QFileInfo(path).absoluteFilePath();
+    QHash<QObject*, QString>::iterator watched = owners.find(owner);
+    if (watched != owners.end()) {
+        if (watched.value() == absolute) {
+            return;
+        }
+        release(watched.value());
+        watched.value() = absolute;
+    } else {
+        owners.insert(owner, absolute);
+        connect(owner, SIGNAL(destroyed(QObject*)), this, SLOT(ownerDestroyed(QObject*)));
+    }
+
+    if (uses[absolute]++ == 0 && !watcher->addPath(absolute)) {
+        gone.insert(absolute);
+        watchDirectory(absolute, true);
+    }
+}
+
+void FileWatcher::unwatch(QObject *owner) {
+    if (owners.contains(owner)) {
+        release(owners.take(owner));
+        disconnect(owner, SIGNAL(destroyed(QObject*)), this, SLOT(ownerDestroyed(QObject*)));
+    }
+}
+
+void FileWatcher::ownerDestroyed(QObject *owner) {
+    if (owners.contains(owner)) {
+        release(owners.take(owner));
+    }
+}
+
+void FileWatcher::release(const QString &path) {
+    if (--uses[path] > 0) {
+        return;
+    }
+    uses.remove(path);
+    contents.remove(path);
+    pending.remove(path);
+    rehash.remove(path);
+    missing.remove(path);
+    if (gone.remove(path)) {
+        watchDirectory(path, false);
+    }
+    if (watcher->files().contains(path)) {
+        watcher->removePath(path);
+    }
+}
+
+void FileWatcher::watchDirectory(const QString &path, bool on) {
+    const QString directory = QFileInfo(path).absolutePath();
+    if (on) {
+        if (directories[directory]++ == 0) {
+            watcher->addPath(directory);
+        }
+    } else if (--directories[directory] <= 0) {
+        directories.remove(directory);
+        watcher->removePath(directory);
+    }
+}
+
+void FileWatcher::setContent(const QString &path, qint64 size, const QByteArray &hash) {
+    const QString absolute = QFileInfo(path).absoluteFilePath();
+    if (!uses.contains(absolute)) {
+        return;
+    }
+    Content &known = contents[absolute];
+    known.size = size;
+    known.hash = hash;
+
+    /* Saving replaced the file, which ended the watch on the old one */
+    if (gone.remove(absolute)) {
+        watchDirectory(absolute, false);
+    }
+    if (!watcher->files().contains(absolute)) {
+        watcher->addPath(absolute);
+    }
+}
+
+void FileWatcher::recheck(const QString &path) {
+    const QString absolute = QFileInfo(path).absoluteFilePath();
+    if (uses.contains(absolute)) {
+        pending.insert(absolute);
+        coalesce->start();
+    }
+}
+
+void FileWatcher::fileChanged(const QString &path) {
+    pending.insert(path);
+    coalesce->start();
+}
+
+/* A deleted file may have come back */
+void FileWatcher::directoryChanged(const QString &directory) {
+    const QList<QString> candidates = gone.values();
+    for (int i = 0; i < candidates.size(); ++i) {
+        const QString &path = candidates.at(i);
+        if (QFileInfo(path).absolutePath() == directory && QFileInfo::exists(path)) {
+            gone.remove(path);
+            watchDirectory(path, false);
+            watcher->addPath(path);
+            pending.insert(path);
+        }
+    }
+    if (!pending.isEmpty()) {
+        coalesce->start();
+    }
+}
+
+void FileWatcher::settle() {
+    const QList<QString> paths = pending.values();
+    pending.clear();
+    bool retry = false;
+    for (int i = 0; i < paths.size(); ++i) {
+        const QString &path = paths.at(i);
+        if (!uses.contains(path)) {
+            continue;
+        }
+
+        /* Programs that save by deleting and writing anew leave a short gap */
+        if (!QFileInfo::exists(path)) {
+            if (++missing[path] < MissingRetries) {
+                pending.insert(path);
+                retry = true;
+            } else {
+                missing.remove(path);
+                gone.insert(path);
+                watchDirectory(path, true);
+                Q_EMIT changed(path);
+            }
+            continue;
+        }
+        missing.remove(path);
+
+        /* A rename over the file ends the watch on the old one */
+        if (!watcher->files().contains(path)) {
+            watcher->addPath(path);
+        }
+        if (hashing.contains(path)) {
+            rehash.insert(path);
+        } else {
+            hashing.insert(path);
+            pool.start(new HashTask(this, path));
+        }
+    }
+    if (retry) {
+        coalesce->start();
+    }
+}
+
+/* Only a file that now holds something else is reported; unreadable ones wait for the next change */
+void FileWatcher::compare(const QString &path, qint64 size, const QByteArray &hash) {
+    hashing.remove(path);
+    if (!uses.contains(path)) {
+        rehash.remove(path);
+        return;
+    }
+    if (size >= 0) {
+        Content &known = contents[path];
+        if (known.size != size || known.hash != hash) {
+            known.size = size;
+            known.hash = hash;
+            Q_EMIT changed(path);
+        }
+    }
+    if (rehash.remove(path)) {
+        hashing.insert(path);
+        pool.start(new HashTask(this, path));
+    }
+}
@@ -0,0 +1,85 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <qfilesystemwatcher.h>
+#include <qhash.h>
+#include <qobject.h>
+#include <qset.h>
+#include <qthreadpool.h>
+#include <qtimer.h>
+
+/*
+* The one file system watcher every editor shares.
+*
+* Paths are counted, so a file open in several places is watched once and
+* only until the last of them goes. Reports are coalesced, as one save can
+* raise several, and a file replaced by a rename, which ends the watch on the
+* old one, is watched again. A file that disappears is given a moment to come
+* back before it counts as deleted, after which its directory is watched for
+* it. What a file holds is hashed on a pool thread and compared with what it
+* is known to hold, so touches and Pylet's own saves are never reported.
+*/
+class FileWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    /* The process-wide watcher */
+    static FileWatcher *instance();
+
+    /* Watches 'path' for 'owner', in place of what it watched before, until the owner is destroyed */
+    void watch(QObject *owner, const QString &path);
+    void unwatch(QObject *owner);
+
+    /* What the file at 'path' holds, e.g. as just read or written; changes that leave it so are not reported */
+    void setContent(const QString &path, qint64 size, const QByteArray &hash);
+
+    /* Hashes the file at 'path' again as if it had been reported, e.g. when a report was set aside */
+    void recheck(const QString &path);
+
+Q_SIGNALS:
+    /* The contents of the watched file at 'path' changed, or it was deleted */
+    void changed(const QString &path);
+
+    /* Internal, queued from the pool */
+    void hashed(const QString &path, qint64 size, const QByteArray &hash);
+
+private:
+    enum { CoalesceDelay = 200, MissingRetries = 5 };
+
+    struct Content {
+        qint64 size = -1;
+        QByteArray hash;
+    };
+
+    FileWatcher();
+
+    QFileSystemWatcher *watcher;
+    QTimer *coalesce;
+    QThreadPool pool;
+    QHash<QObject*, QString> owners;
+    QHash<QString, int> uses;
+    QHash<QString, Content> contents;
+    QSet<QString> pending;          /* Reported and waiting for the reports to settle */
+    QSet<QString> hashing;
+    QSet<QString> rehash;           /* Reported again while being hashed */
+    QHash<QString, int> missing;    /* Not there, with the number of checks since */
+    QSet<QString> gone;             /* Counted as deleted; their directories are watched */
+    QHash<QString, int> directories;
+
+    void release(const QString &path);
+    void watchDirectory(const QString &path, bool on);
+
+private Q_SLOTS:
+    void fileChanged(const QString &path);
+    void directoryChanged(const QString &directory);
+    void settle();
+    void compare(const QString &path, qint64 size, const QByteArray &hash);
+    void ownerDestroyed(QObject *owner);
+};
+
+#endif // FILE_WATCHER_H
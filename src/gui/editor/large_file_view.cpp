@@ -0,0 +1,678 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "large_file_view.h"
+#include <qelapsedtimer.h>
+#include <qfileinfo.h>
+#include <qmessagebox.h>
+#include <qpainter.h>
+#include <qsavefile.h>
+#include <qscrollbar.h>
+#include <qevent.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <limits>
+
+LineIndexer::LineIndexer(const uchar *d, qint64 s, QObject *parent) :
+    QThread(parent),
+    data(d),
+    size(s) {
+    checkpoints.push_back(0);
+}
+
+LineIndexer::~LineIndexer() {
+    requestInterruption();
+    wait();
+}
+
+qint64 LineIndexer::lineCount() const {
+    QMutexLocker locker(&mutex);
+    return lines;
+}
+
+int LineIndexer::longestLine() const {
+    QMutexLocker locker(&mutex);
+    return longest;
+}
+
+qint64 LineIndexer::nearestStart(qint64 line, qint64 *known) const {
+    QMutexLocker locker(&mutex);
+    const qint64 stripe = line / LineStride;
+    if (line < 0 || stripe >= (qint64)checkpoints.size()) {
+        return -1;
+    }
+    *known = stripe * LineStride;
+    qint64 offset = checkpoints[stripe];
+
+    std::vector<std::pair<qint64, qint64> >::const_iterator it =
+        std::upper_bound(afterLong.begin(), afterLong.end(), std::make_pair(line, std::numeric_limits<qint64>::max()));
+    if (it != afterLong.begin() && (--it)->first > *known) {
+        *known = it->first;
+        offset = it->second;
+    }
+    return offset;
+}
+
+std::vector<qint64> LineIndexer::lineCheckpoints() const {
+    QMutexLocker locker(&mutex);
+    return checkpoints;
+}
+
+void LineIndexer::run() {
+    std::vector<qint64> found;
+    std::vector<std::pair<qint64, qint64> > foundLong;
+    qint64 pos = 0;
+    qint64 count = 1;
+    int longestSoFar = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (pos <= size && !isInterruptionRequested()) {
+        const void *newline = std::memchr(data + pos, '\n', size - pos);
+        const qint64 end = newline ? static_cast<const uchar*>(newline) - data : size;
+        longestSoFar = qMax(longestSoFar, (int)qMin<qint64>(end - pos, INT_MAX));
+        if (!newline) {
+            break;
+        }
+
+        const bool isLong = end - pos > LongLine;
+        pos = end + 1;
+        if (count % LineStride == 0) {
+            found.push_back(pos);
+        } else if (isLong) {
+            foundLong.push_back(std::make_pair(count, pos));
+        }
+        ++count;
+
+        /* Publish what is known every so often so the view can scroll further */
+        if ((count & 0xFFF) == 0 && timer.elapsed() >= 50) {
+            QMutexLocker locker(&mutex);
+            checkpoints.insert(checkpoints.end(), found.begin(), found.end());
+            afterLong.insert(afterLong.end(), foundLong.begin(), foundLong.end());
+            found.clear();
+            foundLong.clear();
+            lines = count;
+            longest = longestSoFar;
+            locker.unlock();
+            Q_EMIT progress(count);
+            timer.restart();
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    checkpoints.insert(checkpoints.end(), found.begin(), found.end());
+    afterLong.insert(afterLong.end(), foundLong.begin(), foundLong.end());
+    lines = count;
+    longest = longestSoFar;
+    locker.unlock();
+    Q_EMIT progress(count);
+}
+
+LargeFileView::LargeFileView(const QString &filePath, bool isBinary, QWidget *parent) :
+    QAbstractScrollArea(parent),
+    binary(isBinary) {
+
+    file.setFileName(filePath);
+    location = QFileInfo(file).canonicalFilePath();
+    filename = QFileInfo(file).fileName();
+
+    setFont(QFont("Courier New", 12, QFont::Normal, false));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setAutoFillBackground(false);
+
+    mapFile();
+    if (data && !binary) {
+        startIndexer();
+    }
+    updateScrollBars();
+}
+
+LargeFileView::~LargeFileView() {
+    /* The indexer and the pieces must be gone before the mapping is */
+    delete table;
+    table = nullptr;
+    delete indexer;
+    indexer = nullptr;
+    unmapFile();
+}
+
+/* Mapping is constant time, the pages are only read once they are painted or indexed */
+bool LargeFileView::mapFile() {
+    data = nullptr;
+    size = 0;
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    size = file.size();
+    if (size > 0) {
+        data = file.map(0, size);
+    }
+    return data || size == 0;
+}
+
+void LargeFileView::unmapFile() {
+    if (data) {
+        file.unmap(const_cast<uchar*>(data));
+        data = nullptr;
+    }
+    file.close();
+}
+
+void LargeFileView::startIndexer() {
+    delete indexer;
+    indexer = new LineIndexer(data, size, this);
+    connect(indexer, SIGNAL(progress(qint64)), this, SLOT(indexProgress(qint64)));
+    connect(indexer, SIGNAL(finished()), this, SLOT(indexFinished()));
+    indexer->start(QThread::LowPriority);
+}
+
+bool LargeFileView::isOpen() const {
+    return file.isOpen() && (data || size == 0);
+}
+
+bool LargeFileView::isReadOnly() const {
+    return !table;
+}
+
+bool LargeFileView::isModified() const {
+    return table && table->isModified();
+}
+
+/*
+* Streams the pieces into a new file that replaces the old one. Windows will
+* not rename over a file that is open and mapped, so the mapping is dropped
+* just before the commit and the file mapped again afterwards: the new one
+* under a fresh table, or the untouched old one under the same table.
+*/
+bool LargeFileView::save() {
+    if (!table) {
+        return false;
+    }
+    QSaveFile saveFile(location);
+    if (!saveFile.open(QIODevice::WriteOnly) || !table->write(&saveFile)) {
+        QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location."));
+        return false;
+    }
+
+    /* Where the saved lines start, so the new mapping needs no indexing */
+    std::vector<qint64> checkpoints;
+    const qint64 lines = table->lineCount();
+    const qint64 length = table->length();
+    for (qint64 line = 0; line < lines; line += PieceTable::PieceLines) {
+        checkpoints.push_back(table->lineStart(line));
+    }
+
+    unmapFile();
+    const bool committed = saveFile.commit();
+    const bool mapped = mapFile();
+
+    if (!mapped) {
+        delete table;
+        table = nullptr;
+        caret = 0;
+        QMessageBox::critical(this, tr("Error"), committed ? tr("The file was saved but could not be opened again.")
+                                                           : tr("Unable to write file at the specified location."));
+        Q_EMIT modificationChanged(false);
+        updateScrollBars();
+        viewport()->update();
+        return committed;
+    }
+    if (!committed) {
+        table->setOriginal(reinterpret_cast<const char*>(data));
+        QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location."));
+        return false;
+    }
+
+    /* The undo history goes with the old mapping */
+    delete table;
+    table = nullptr;
+    if (size == length) {
+        table = new PieceTable(reinterpret_cast<const char*>(data), size, checkpoints, lines);
+        caret = qMin(caret, size);
+    } else if (data) {
+        /* Someone else wrote to the file right after us */
+        caret = 0;
+        startIndexer();
+    }
+    Q_EMIT modificationChanged(false);
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+void LargeFileView::resetZoom(int zoom) {
+    QFont f = font();
+    f.setPointSize(zoom);
+    setFont(f);
+    updateScrollBars();
+    viewport()->update();
+}
+
+bool LargeFileView::isLarge(const QString &filePath, qint64 threshold, bool *binary) {
+    *binary = false;
+    QFile checkFile(filePath);
+    if (!checkFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    /* NUL bytes never occur in text we could edit */
+    *binary = checkFile.read(8192).contains('\0');
+    return *binary || checkFile.size() > threshold;
+}
+
+qint64 LargeFileView::rowCount() const {
+    if (table) {
+        return table->lineCount();
+    }
+    if (binary) {
+        return qMax<qint64>(1, (size + HexBytesPerRow - 1) / HexBytesPerRow);
+    }
+    return indexer ? indexer->lineCount() : 1;
+}
+
+qint64 LargeFileView::lineStart(qint64 line) const {
+    if (line <= 0 || !indexer) {
+        return 0;
+    }
+    /* Past the lines indexed so far there is nothing to find but a long scan */
+    if (line >= indexer->lineCount()) {
+        return -1;
+    }
+    qint64 known = 0;
+    qint64 pos = indexer->nearestStart(line, &known);
+    if (pos < 0) {
+        return -1;
+    }
+    for (qint64 k = known; k < line; ++k) {
+        const void *newline = std::memchr(data + pos, '\n', size - pos);
+        if (!newline) {
+            return -1;
+        }
+        pos = static_cast<const uchar*>(newline) - data + 1;
+    }
+    return pos;
+}
+
+static inline bool isContinuationByte(char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+/* Start of the UTF-8 character after the one at 'offset' in the mapping, stopping at 'end' */
+qint64 LargeFileView::nextMappedCharacter(qint64 offset, qint64 end) const {
+    ++offset;
+    while (offset < end && isContinuationByte((char)data[offset])) {
+        ++offset;
+    }
+    return offset;
+}
+
+/*
+* Decodes the visible characters of the line starting at 'start'. 'next' gets
+* where the next line starts, or -1 when the line goes on past the viewport
+* and the index has to tell.
+*/
+QString LargeFileView::textRow(qint64 start, int firstColumn, int columns, qint64 *next) const {
+    const qint64 remaining = size - start;
+
+    /* Only look as far as the viewport reaches, at four bytes per character at most */
+    const qint64 window = qMin<qint64>(remaining, ((qint64)firstColumn + columns) * 4);
+    const void *newline = std::memchr(data + start, '\n', window);
+    const qint64 end = newline ? static_cast<const uchar*>(newline) - data : start + window;
+    if (newline) {
+        *next = end + 1;
+    } else {
+        *next = window == remaining ? size + 1 : -1;
+    }
+
+    /* Columns count characters, so a multi-byte one is never cut in half */
+    qint64 from = start;
+    for (int column = 0; column < firstColumn && from < end; ++column) {
+        from = nextMappedCharacter(from, end);
+    }
+    qint64 to = from;
+    for (int column = 0; column < columns && to < end; ++column) {
+        to = nextMappedCharacter(to, end);
+    }
+
+    QString text = QString::fromUtf8(reinterpret_cast<const char*>(data) + from, (int)(to - from));
+    if (text.endsWith('\r')) {
+        text.chop(1);
+    }
+    text.replace('\t', ' ');
+    return text;
+}
+
+QString LargeFileView::hexRow(qint64 row) const {
+    const qint64 offset = row * HexBytesPerRow;
+    const int count = (int)qMin<qint64>(HexBytesPerRow, size - offset);
+
+    QString text = QString("%1  ").arg(offset, 10, 16, QChar('0'));
+    for (int i = 0; i < HexBytesPerRow; ++i) {
+        if (i < count) {
+            text += QString("%1 ").arg(data[offset + i], 2, 16, QChar('0'));
+        } else {
+            text += "   ";
+        }
+        if (i == HexBytesPerRow / 2 - 1) {
+            text += ' ';
+        }
+    }
+    text += " |";
+    for (int i = 0; i < count; ++i) {
+        const uchar c = data[offset + i];
+        text += (c >= 32 && c < 127) ? QChar(c) : QChar('.');
+    }
+    text += '|';
+    return text;
+}
+
+int LargeFileView::gutterWidth() const {
+    if (binary) {
+        return 4;
+    }
+    int digits = 1;
+    qint64 max = qMax<qint64>(1, rowCount());
+    while (max >= 10) {
+        max /= 10;
+        ++digits;
+    }
+    return fontMetrics().width(QLatin1Char('9')) * digits + 30;
+}
+
+void LargeFileView::updateScrollBars() {
+    const int lineHeight = qMax(1, fontMetrics().height());
+    const int charWidth = qMax(1, fontMetrics().width(QLatin1Char('9')));
+    const int rows = viewport()->height() / lineHeight;
+    const int visibleColumns = (viewport()->width() - gutterWidth()) / charWidth;
+    const int columns = binary ? 12 + HexBytesPerRow * 4 + 4 : (indexer ? indexer->longestLine() : 0);
+
+    verticalScrollBar()->setRange(0, (int)qMin<qint64>(INT_MAX, qMax<qint64>(0, rowCount() - rows)));
+    verticalScrollBar()->setPageStep(rows);
+    horizontalScrollBar()->setRange(0, qMax(0, columns - visibleColumns));
+    horizontalScrollBar()->setPageStep(visibleColumns);
+}
+
+void LargeFileView::indexProgress(qint64 lines) {
+    Q_UNUSED(lines);
+    updateScrollBars();
+    viewport()->update();
+}
+
+/* With every line start known, the mapping can be cut into pieces for editing */
+void LargeFileView::indexFinished() {
+    Q_STATIC_ASSERT((int)LineIndexer::LineStride == (int)PieceTable::PieceLines);
+    if (table || indexer->isInterruptionRequested()) {
+        return;
+    }
+    table = new PieceTable(reinterpret_cast<const char*>(data), size, indexer->lineCheckpoints(), indexer->lineCount());
+    caret = 0;
+    Q_EMIT modificationChanged(false);
+    viewport()->update();
+}
+
+void LargeFileView::undo() {
+    const qint64 offset = table ? table->undo() : -1;
+    if (offset >= 0) {
+        moveCaret(offset);
+        Q_EMIT modificationChanged(table->isModified());
+    }
+}
+
+void LargeFileView::redo() {
+    const qint64 offset = table ? table->redo() : -1;
+    if (offset >= 0) {
+        moveCaret(offset);
+        Q_EMIT modificationChanged(table->isModified());
+    }
+}
+
+QString LargeFileView::tableRow(qint64 line, int firstColumn, int columns) const {
+    const qint64 start = table->lineStart(line);
+    const qint64 end = table->lineEnd(line);
+    const qint64 from = start + firstColumn;
+    const qint64 to = qMin(end, from + columns);
+
+    QString text;
+    if (to > from) {
+        text = QString::fromUtf8(table->read(from, to - from));
+    }
+    if (text.endsWith('\r')) {
+        text.chop(1);
+    }
+    text.replace('\t', ' ');
+    return text;
+}
+
+qint64 LargeFileView::previousCharacter(qint64 offset) const {
+    if (offset <= 0) {
+        return 0;
+    }
+    --offset;
+    while (offset > 0 && isContinuationByte(table->read(offset, 1).at(0))) {
+        --offset;
+    }
+    /* Treat a CRLF pair as one character */
+    if (offset > 0 && table->read(offset - 1, 2) == "\r\n") {
+        --offset;
+    }
+    return offset;
+}
+
+qint64 LargeFileView::nextCharacter(qint64 offset) const {
+    const qint64 length = table->length();
+    if (offset >= length) {
+        return length;
+    }
+    if (table->read(offset, 2) == "\r\n") {
+        return offset + 2;
+    }
+    ++offset;
+    while (offset < length && isContinuationByte(table->read(offset, 1).at(0))) {
+        ++offset;
+    }
+    return offset;
+}
+
+/* Moves 'lines' lines up or down, keeping the byte column where possible */
+qint64 LargeFileView::verticalMove(qint64 offset, qint64 lines) const {
+    const qint64 line = table->lineOf(offset);
+    const qint64 column = offset - table->lineStart(line);
+    const qint64 target = qBound<qint64>(0, line + lines, table->lineCount() - 1);
+    qint64 result = qMin(table->lineStart(target) + column, table->lineEnd(target));
+    while (result > 0 && result < table->length() && isContinuationByte(table->read(result, 1).at(0))) {
+        --result;
+    }
+    return result;
+}
+
+void LargeFileView::replaceText(qint64 offset, qint64 count, const QByteArray &text) {
+    const bool wasModified = table->isModified();
+    if (count > 0) {
+        table->remove(offset, count);
+    }
+    if (!text.isEmpty()) {
+        table->insert(offset, text);
+    }
+    moveCaret(offset + text.size());
+    if (wasModified != table->isModified()) {
+        Q_EMIT modificationChanged(table->isModified());
+    }
+}
+
+/* Places the caret and scrolls it into view */
+void LargeFileView::moveCaret(qint64 offset) {
+    caret = qBound<qint64>(0, offset, table->length());
+    updateScrollBars();
+
+    const qint64 line = table->lineOf(caret);
+    const int rows = qMax(1, viewport()->height() / qMax(1, fontMetrics().height()));
+    QScrollBar *vertical = verticalScrollBar();
+    if (line < vertical->value()) {
+        vertical->setValue((int)qMin<qint64>(line, INT_MAX));
+    } else if (line >= vertical->value() + rows) {
+        vertical->setValue((int)qMin<qint64>(line - rows + 1, INT_MAX));
+    }
+
+    const qint64 column = caret - table->lineStart(line);
+    const int columns = qMax(1, (viewport()->width() - gutterWidth()) / qMax(1, fontMetrics().width(QLatin1Char('9'))));
+    QScrollBar *horizontal = horizontalScrollBar();
+    if (column < horizontal->value()) {
+        horizontal->setValue((int)column);
+    } else if (column >= horizontal->value() + columns) {
+        horizontal->setMaximum(qMax<int>(horizontal->maximum(), (int)qMin<qint64>(column, INT_MAX)));
+        horizontal->setValue((int)qMin<qint64>(column - columns + 1, INT_MAX));
+    }
+    viewport()->update();
+}
+
+/* Caret movement and editing once the piece table is there; returns false for keys it does not handle */
+bool LargeFileView::editKey(QKeyEvent *event) {
+    const int rows = qMax(1, viewport()->height() / qMax(1, fontMetrics().height()));
+    const bool control = event->modifiers() & Qt::ControlModifier;
+    switch (event->key()) {
+        case Qt::Key_Left: moveCaret(previousCharacter(caret)); return true;
+        case Qt::Key_Right: moveCaret(nextCharacter(caret)); return true;
+        case Qt::Key_Up: moveCaret(verticalMove(caret, -1)); return true;
+        case Qt::Key_Down: moveCaret(verticalMove(caret, 1)); return true;
+        case Qt::Key_PageUp: moveCaret(verticalMove(caret, -rows)); return true;
+        case Qt::Key_PageDown: moveCaret(verticalMove(caret, rows)); return true;
+        case Qt::Key_Home: moveCaret(control ? 0 : table->lineStart(table->lineOf(caret))); return true;
+        case Qt::Key_End: moveCaret(control ? table->length() : table->lineEnd(table->lineOf(caret))); return true;
+        case Qt::Key_Backspace: {
+            const qint64 previous = previousCharacter(caret);
+            replaceText(previous, caret - previous, QByteArray());
+            return true;
+        }
+        case Qt::Key_Delete: {
+            replaceText(caret, nextCharacter(caret) - caret, QByteArray());
+            return true;
+        }
+        case Qt::Key_Return: case Qt::Key_Enter: {
+            replaceText(caret, 0, "\n");
+            return true;
+        }
+        default: {
+            const QString text = event->text();
+            if (!control && !(event->modifiers() & Qt::AltModifier) && !text.isEmpty() && (text.at(0).isPrint() || text.at(0) == '\t')) {
+                replaceText(caret, 0, text.toUtf8());
+                return true;
+            }
+            return false;
+        }
+    }
+}
+
+void LargeFileView::paintEvent(QPaintEvent *event) {
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), Qt::white);
+    painter.setFont(font());
+
+    const int lineHeight = qMax(1, fontMetrics().height());
+    const int charWidth = qMax(1, fontMetrics().width(QLatin1Char('9')));
+    const int gutter = gutterWidth();
+    if (!binary) {
+        painter.fillRect(QRect(0, 0, gutter - 8, viewport()->height()), Qt::lightGray);
+    }
+    if (!data && !table) {
+        return;
+    }
+
+    const qint64 first = verticalScrollBar()->value();
+    const int rows = viewport()->height() / lineHeight + 1;
+    const int firstColumn = horizontalScrollBar()->value();
+    const int columns = (viewport()->width() - gutter) / charWidth + 1;
+
+    if (table) {
+        const qint64 caretLine = table->lineOf(caret);
+        for (int r = 0; r < rows && first + r < table->lineCount(); ++r) {
+            const qint64 line = first + r;
+            const int top = r * lineHeight;
+            painter.setPen(Qt::black);
+            painter.drawText(-20, top, gutter, lineHeight, Qt::AlignRight, QString::number(line + 1));
+            painter.drawText(gutter, top, viewport()->width() - gutter, lineHeight, Qt::AlignLeft, tableRow(line, firstColumn, columns));
+
+            if (line == caretLine && hasFocus()) {
+                /* Measure the decoded text in front of the caret, not its bytes */
+                const qint64 from = table->lineStart(line) + firstColumn;
+                const int x = gutter + (caret > from ? QString::fromUtf8(table->read(from, caret - from)).length() * charWidth : 0);
+                if (caret >= from) {
+                    painter.drawLine(x, top, x, top + lineHeight - 1);
+                }
+            }
+        }
+        return;
+    }
+
+    /* Rows are decoded one after another, only the first one needs the index */
+    qint64 pos = binary ? 0 : lineStart(first);
+    painter.setPen(Qt::black);
+    for (int r = 0; r < rows; ++r) {
+        const qint64 row = first + r;
+        QString text;
+        if (binary) {
+            if (row * HexBytesPerRow >= size) {
+                break;
+            }
+            text = hexRow(row).mid(firstColumn, columns);
+        } else {
+            if (pos < 0 || pos > size) {
+                break;
+            }
+            text = textRow(pos, firstColumn, columns, &pos);
+            if (pos < 0) {
+                pos = lineStart(row + 1);
+            }
+            painter.drawText(-20, r * lineHeight, gutter, lineHeight, Qt::AlignRight, QString::number(row + 1));
+        }
+        painter.drawText(gutter, r * lineHeight, viewport()->width() - gutter, lineHeight, Qt::AlignLeft, text);
+    }
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event) {
+    if (table && editKey(event)) {
+        event->accept();
+        return;
+    }
+
+    QScrollBar *vertical = verticalScrollBar();
+    QScrollBar *horizontal = horizontalScrollBar();
+    switch (event->key()) {
+        case Qt::Key_Up: vertical->triggerAction(QAbstractSlider::SliderSingleStepSub); break;
+        case Qt::Key_Down: vertical->triggerAction(QAbstractSlider::SliderSingleStepAdd); break;
+        case Qt::Key_PageUp: vertical->triggerAction(QAbstractSlider::SliderPageStepSub); break;
+        case Qt::Key_PageDown: vertical->triggerAction(QAbstractSlider::SliderPageStepAdd); break;
+        case Qt::Key_Left: horizontal->triggerAction(QAbstractSlider::SliderSingleStepSub); break;
+        case Qt::Key_Right: horizontal->triggerAction(QAbstractSlider::SliderSingleStepAdd); break;
+        case Qt::Key_Home: vertical->triggerAction(QAbstractSlider::SliderToMinimum); break;
+        case Qt::Key_End: vertical->triggerAction(QAbstractSlider::SliderToMaximum); break;
+        default: QAbstractScrollArea::keyPressEvent(event); break;
+    }
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event) {
+    if (!table || event->button() != Qt::LeftButton) {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+
+    const int lineHeight = qMax(1, fontMetrics().height());
+    const int charWidth = qMax(1, fontMetrics().width(QLatin1Char('9')));
+    const int firstColumn = horizontalScrollBar()->value();
+    const int columns = (viewport()->width() - gutterWidth()) / charWidth + 1;
+    const qint64 line = qMin(verticalScrollBar()->value() + event->pos().y() / lineHeight, table->lineCount() - 1);
+
+    /* Characters left of the click, converted back to bytes */
+    const QString text = tableRow(line, firstColumn, columns);
+    const int index = qBound(0, (event->pos().x() - gutterWidth() + charWidth / 2) / charWidth, text.length());
+    const qint64 start = table->lineStart(line);
+    moveCaret(qMin(start + firstColumn + text.left(index).toUtf8().size(), table->lineEnd(line)));
+}
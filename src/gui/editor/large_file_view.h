@@ -0,0 +1,134 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef LARGE_FILE_VIEW_H
+#define LARGE_FILE_VIEW_H
+
+#include "piece_table.h"
+#include <qabstractscrollarea.h>
+#include <qfile.h>
+#include <qmutex.h>
+#include <qthread.h>
+#include <utility>
+#include <vector>
+
+/*
+* Finds the line starts of a memory-mapped file on a background thread.
+* Only every LineStride-th line start is kept, plus the start of every line
+* following one longer than LongLine bytes; the lines in between are found
+* again with memchr when they are painted. That keeps the index of a file
+* with tens of millions of lines down to a few megabytes while no lookup
+* ever scans a long line.
+*/
+class LineIndexer : public QThread {
+    Q_OBJECT
+
+public:
+    enum { LineStride = 64, LongLine = 4096 };
+
+    LineIndexer(const uchar *data, qint64 size, QObject *parent = 0);
+    ~LineIndexer();
+
+    /* Number of lines whose start is known so far */
+    qint64 lineCount() const;
+    int longestLine() const;
+
+    /* Offset of the closest known line start at or before 'line', whose number goes to 'known', or -1 if none has been reached yet */
+    qint64 nearestStart(qint64 line, qint64 *known) const;
+    std::vector<qint64> lineCheckpoints() const;
+
+Q_SIGNALS:
+    void progress(qint64 lines);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    const uchar *data;
+    const qint64 size;
+
+    mutable QMutex mutex;
+    std::vector<qint64> checkpoints;
+    std::vector<std::pair<qint64, qint64> > afterLong; /* Line and offset of each line following a long one */
+    qint64 lines = 1;
+    int longest = 0;
+};
+
+/*
+* View of a file too large (or too binary) for a CodeEditor.
+*
+* The file is memory-mapped rather than read, so opening costs the same no
+* matter its size, and only the rows inside the viewport are ever decoded.
+* Text files are read-only until the line index is complete; from then on a
+* PieceTable over the mapping makes them editable without ever copying the
+* file. Binary files are shown as a hex dump. There is no highlighting.
+*/
+class LargeFileView : public QAbstractScrollArea {
+    Q_OBJECT
+
+public:
+    LargeFileView(const QString &filePath, bool binary, QWidget *parent = 0);
+    ~LargeFileView();
+    QString filename;
+    QString location;
+
+    bool isOpen() const;
+    bool isReadOnly() const;
+    bool isModified() const;
+    bool save();
+    void resetZoom(int zoom = 12);
+
+    /* Whether a file should go to a LargeFileView: above 'threshold' bytes or binary */
+    static bool isLarge(const QString &filePath, qint64 threshold, bool *binary);
+
+protected:
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+    void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    enum { HexBytesPerRow = 16 };
+
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    bool binary;
+    LineIndexer *indexer = nullptr;
+    PieceTable *table = nullptr;
+    qint64 caret = 0;
+
+    bool mapFile();
+    void unmapFile();
+    void startIndexer();
+    qint64 rowCount() const;
+    qint64 lineStart(qint64 line) const;
+    QString textRow(qint64 start, int firstColumn, int columns, qint64 *next) const;
+    qint64 nextMappedCharacter(qint64 offset, qint64 end) const;
+    QString hexRow(qint64 row) const;
+    int gutterWidth() const;
+    void updateScrollBars();
+
+    QString tableRow(qint64 line, int firstColumn, int columns) const;
+    bool editKey(QKeyEvent *event);
+    qint64 previousCharacter(qint64 offset) const;
+    qint64 nextCharacter(qint64 offset) const;
+    qint64 verticalMove(qint64 offset, qint64 lines) const;
+    void replaceText(qint64 offset, qint64 count, const QByteArray &text);
+    void moveCaret(qint64 offset);
+
+Q_SIGNALS:
+    void modificationChanged(bool modified);
+
+public Q_SLOTS:
+    void undo();
+    void redo();
+
+private Q_SLOTS:
+    void indexProgress(qint64 lines);
+    void indexFinished();
+};
+
+#endif // LARGE_FILE_VIEW_H
@@ -0,0 +1,386 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "piece_table.h"
+#include <cstring>
+
+PieceTable::PieceTable(const char *o, qint64 size, const std::vector<qint64> &lineStarts, qint64 lines) :
+    original(o) {
+    /* Node 0 is the empty sentinel */
+    nodes.push_back(Node());
+
+    /* The original is cut at the indexed line starts, so every piece holds exactly PieceLines newlines */
+    std::vector<Piece> pieces;
+    for (size_t i = 0; i < lineStarts.size(); ++i) {
+        const bool last = i + 1 == lineStarts.size();
+        const qint64 start = lineStarts[i];
+        const qint64 end = last ? size : lineStarts[i + 1];
+        const qint64 newlines = last ? (lines - 1) - (qint64)i * PieceLines : (qint64)PieceLines;
+        if (end > start) {
+            pieces.push_back(makePiece(false, start, end - start, newlines));
+        }
+    }
+    root = buildFrom(pieces);
+}
+
+qint64 PieceTable::length() const {
+    return nodes[root].bytes;
+}
+
+qint64 PieceTable::lineCount() const {
+    return nodes[root].lines + 1;
+}
+
+qint64 PieceTable::lineStart(qint64 line) const {
+    if (line <= 0) {
+        return 0;
+    }
+
+    /* Look for the newline ending the line before */
+    qint64 k = line - 1;
+    qint64 offset = 0;
+    int t = root;
+    while (t) {
+        const Node &node = nodes[t];
+        const Node &left = nodes[node.left];
+        if (k < left.lines) {
+            t = node.left;
+            continue;
+        }
+        k -= left.lines;
+        offset += left.bytes;
+        if (k < node.piece.newlines) {
+            const char *data = bytesOf(node.piece);
+            qint64 pos = 0;
+            for (;;) {
+                const char *newline = static_cast<const char*>(std::memchr(data + pos, '\n', node.piece.length - pos));
+                pos = newline - data + 1;
+                if (k-- == 0) {
+                    return offset + pos;
+                }
+            }
+        }
+        k -= node.piece.newlines;
+        offset += node.piece.length;
+        t = node.right;
+    }
+    return -1;
+}
+
+/* Offset of the newline ending 'line', or the length of the document for the last line */
+qint64 PieceTable::lineEnd(qint64 line) const {
+    const qint64 next = lineStart(line + 1);
+    return next < 0 ? length() : next - 1;
+}
+
+qint64 PieceTable::lineOf(qint64 offset) const {
+    qint64 line = 0;
+    int t = root;
+    while (t) {
+        const Node &node = nodes[t];
+        const Node &left = nodes[node.left];
+        if (offset < left.bytes) {
+            t = node.left;
+            continue;
+        }
+        offset -= left.bytes;
+        line += left.lines;
+        if (offset < node.piece.length) {
+            return line + countNewlines(bytesOf(node.piece), offset);
+        }
+        offset -= node.piece.length;
+        line += node.piece.newlines;
+        t = node.right;
+    }
+    return line;
+}
+
+QByteArray PieceTable::read(qint64 offset, qint64 count) const {
+    QByteArray result;
+    count = qMin(count, length() - offset);
+    while (count > 0) {
+        /* Find the piece holding 'offset' */
+        qint64 local = offset;
+        int t = root;
+        while (t) {
+            const Node &node = nodes[t];
+            const qint64 leftBytes = nodes[node.left].bytes;
+            if (local < leftBytes) {
+                t = node.left;
+            } else if (local < leftBytes + node.piece.length) {
+                local -= leftBytes;
+                break;
+            } else {
+                local -= leftBytes + node.piece.length;
+                t = node.right;
+            }
+        }
+        if (!t) {
+            break;
+        }
+        const Piece &piece = nodes[t].piece;
+        const qint64 taken = qMin(count, piece.length - local);
+        result.append(bytesOf(piece) + local, (int)taken);
+        offset += taken;
+        count -= taken;
+    }
+    return result;
+}
+
+bool PieceTable::write(QIODevice *device) const {
+    return writeTree(root, device);
+}
+
+void PieceTable::insert(qint64 offset, const QByteArray &text) {
+    const qint64 start = appended.size();
+    appended.append(text);
+
+    /* Split the text so that no piece exceeds PieceLines newlines */
+    std::vector<Piece> pieces;
+    const char *data = text.constData();
+    const qint64 size = text.size();
+    qint64 pos = 0;
+    while (pos < size) {
+        qint64 end = pos;
+        qint64 newlines = 0;
+        while (end < size && newlines < PieceLines) {
+            const char *newline = static_cast<const char*>(std::memchr(data + end, '\n', size - end));
+            if (!newline) {
+                end = size;
+                break;
+            }
+            end = newline - data + 1;
+            ++newlines;
+        }
+        pieces.push_back(makePiece(true, start + pos, end - pos, newlines));
+        pos = end;
+    }
+    edit(offset, 0, pieces);
+}
+
+void PieceTable::remove(qint64 offset, qint64 count) {
+    count = qMin(count, length() - offset);
+    if (count > 0) {
+        edit(offset, count, std::vector<Piece>());
+    }
+}
+
+qint64 PieceTable::undo() {
+    if (undoStack.empty()) {
+        return -1;
+    }
+    Operation operation = undoStack.back();
+    undoStack.pop_back();
+    replace(operation.offset, totalLength(operation.inserted), operation.removed, nullptr);
+    redoStack.push_back(operation);
+    return operation.offset + totalLength(operation.removed);
+}
+
+qint64 PieceTable::redo() {
+    if (redoStack.empty()) {
+        return -1;
+    }
+    Operation operation = redoStack.back();
+    redoStack.pop_back();
+    replace(operation.offset, totalLength(operation.removed), operation.inserted, nullptr);
+    undoStack.push_back(operation);
+    return operation.offset + totalLength(operation.inserted);
+}
+
+bool PieceTable::isModified() const {
+    return (int)undoStack.size() != savedDepth;
+}
+
+void PieceTable::setModified(bool modified) {
+    savedDepth = modified ? -1 : (int)undoStack.size();
+}
+
+void PieceTable::setOriginal(const char *o) {
+    original = o;
+}
+
+const char *PieceTable::bytesOf(const Piece &piece) const {
+    return (piece.added ? appended.constData() : original) + piece.start;
+}
+
+qint64 PieceTable::countNewlines(const char *data, qint64 length) {
+    qint64 count = 0;
+    qint64 pos = 0;
+    while (pos < length) {
+        const char *newline = static_cast<const char*>(std::memchr(data + pos, '\n', length - pos));
+        if (!newline) {
+            break;
+        }
+        pos = newline - data + 1;
+        ++count;
+    }
+    return count;
+}
+
+qint64 PieceTable::totalLength(const std::vector<Piece> &pieces) {
+    qint64 total = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        total += pieces[i].length;
+    }
+    return total;
+}
+
+PieceTable::Piece PieceTable::makePiece(bool added, qint64 start, qint64 length, qint64 newlines) {
+    Piece piece;
+    piece.added = added;
+    piece.start = start;
+    piece.length = length;
+    piece.newlines = newlines;
+    return piece;
+}
+
+int PieceTable::createNode(const Piece &piece) {
+    int t;
+    if (!freeNodes.empty()) {
+        t = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        t = (int)nodes.size();
+        nodes.push_back(Node());
+    }
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node &node = nodes[t];
+    node.left = node.right = 0;
+    node.priority = seed;
+    node.piece = piece;
+    update(t);
+    return t;
+}
+
+void PieceTable::update(int t) {
+    Node &node = nodes[t];
+    node.bytes = nodes[node.left].bytes + node.piece.length + nodes[node.right].bytes;
+    node.lines = nodes[node.left].lines + node.piece.newlines + nodes[node.right].lines;
+}
+
+int PieceTable::merge(int a, int b) {
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    if (nodes[a].priority > nodes[b].priority) {
+        const int right = merge(nodes[a].right, b);
+        nodes[a].right = right;
+        update(a);
+        return a;
+    }
+    const int left = merge(a, nodes[b].left);
+    nodes[b].left = left;
+    update(b);
+    return b;
+}
+
+/* Splits off the first 'offset' bytes of 't' into 'a', cutting a piece in two if needed */
+void PieceTable::split(int t, qint64 offset, int &a, int &b) {
+    if (!t) {
+        a = b = 0;
+        return;
+    }
+    const qint64 leftBytes = nodes[nodes[t].left].bytes;
+    const Piece piece = nodes[t].piece;
+
+    if (offset <= leftBytes) {
+        int rest;
+        split(nodes[t].left, offset, a, rest);
+        nodes[t].left = rest;
+        update(t);
+        b = t;
+    } else if (offset >= leftBytes + piece.length) {
+        int rest;
+        split(nodes[t].right, offset - leftBytes - piece.length, rest, b);
+        nodes[t].right = rest;
+        update(t);
+        a = t;
+    } else {
+        const qint64 local = offset - leftBytes;
+        const qint64 leftNewlines = countNewlines(bytesOf(piece), local);
+        const int right = nodes[t].right;
+
+        nodes[t].piece = makePiece(piece.added, piece.start, local, leftNewlines);
+        nodes[t].right = 0;
+        update(t);
+        a = t;
+
+        const int tail = createNode(makePiece(piece.added, piece.start + local, piece.length - local, piece.newlines - leftNewlines));
+        b = merge(tail, right);
+    }
+}
+
+void PieceTable::collect(int t, std::vector<Piece> &pieces) const {
+    if (!t) {
+        return;
+    }
+    collect(nodes[t].left, pieces);
+    pieces.push_back(nodes[t].piece);
+    collect(nodes[t].right, pieces);
+}
+
+void PieceTable::release(int t) {
+    if (!t) {
+        return;
+    }
+    release(nodes[t].left);
+    release(nodes[t].right);
+    freeNodes.push_back(t);
+}
+
+int PieceTable::buildFrom(const std::vector<Piece> &pieces) {
+    int t = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        t = merge(t, createNode(pieces[i]));
+    }
+    return t;
+}
+
+bool PieceTable::writeTree(int t, QIODevice *device) const {
+    if (!t) {
+        return true;
+    }
+    const Piece &piece = nodes[t].piece;
+    return writeTree(nodes[t].left, device) &&
+        device->write(bytesOf(piece), piece.length) == piece.length &&
+        writeTree(nodes[t].right, device);
+}
+
+void PieceTable::replace(qint64 offset, qint64 count, const std::vector<Piece> &pieces, std::vector<Piece> *removed) {
+    int before, middle, after;
+    split(root, offset, before, middle);
+    split(middle, count, middle, after);
+    if (removed) {
+        collect(middle, *removed);
+    }
+    release(middle);
+    const int inserted = buildFrom(pieces);
+    root = merge(merge(before, inserted), after);
+}
+
+void PieceTable::edit(qint64 offset, qint64 count, const std::vector<Piece> &inserted) {
+    Operation operation;
+    operation.offset = offset;
+    operation.inserted = inserted;
+    replace(offset, count, inserted, &operation.removed);
+
+    redoStack.clear();
+    if (savedDepth > (int)undoStack.size()) {
+        savedDepth = -1;
+    }
+
+    /* A run of typing is undone in one step */
+    if (!undoStack.empty() && operation.removed.empty() && (int)undoStack.size() != savedDepth) {
+        Operation &last = undoStack.back();
+        if (last.removed.empty() && last.offset + totalLength(last.inserted) == offset) {
+            last.inserted.insert(last.inserted.end(), inserted.begin(), inserted.end());
+            return;
+        }
+    }
+    undoStack.push_back(operation);
+}
@@ -0,0 +1,108 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include <qbytearray.h>
+#include <qiodevice.h>
+#include <vector>
+
+/*
+* Piece table over a read-only original buffer (the memory-mapped file) and an
+* append-only buffer holding everything typed or pasted.
+*
+* The document is the in-order sequence of pieces, kept in an implicit treap
+* that also sums up byte and newline counts, so finding an offset or the start
+* of a line is O(log n) regardless of how big the file is. No piece is ever
+* allowed to hold more than PieceLines newlines, which bounds the scan inside
+* a piece as well. Edits only split and splice pieces and undo simply puts the
+* old pieces back; the original bytes are never copied.
+*/
+class PieceTable {
+public:
+    enum { PieceLines = 64 };
+
+    /*
+    * 'lineStarts' holds the offset of every PieceLines-th line of 'original',
+    * starting with line 0, and 'lines' the total number of lines.
+    */
+    PieceTable(const char *original, qint64 size, const std::vector<qint64> &lineStarts, qint64 lines);
+
+    qint64 length() const;
+    qint64 lineCount() const;
+    qint64 lineStart(qint64 line) const;
+    qint64 lineEnd(qint64 line) const;
+    qint64 lineOf(qint64 offset) const;
+    QByteArray read(qint64 offset, qint64 count) const;
+    bool write(QIODevice *device) const;
+
+    void insert(qint64 offset, const QByteArray &text);
+    void remove(qint64 offset, qint64 count);
+
+    /* Both return the offset the cursor should go to, or -1 if there is nothing to undo or redo */
+    qint64 undo();
+    qint64 redo();
+
+    bool isModified() const;
+    void setModified(bool modified);
+
+    /* Points the original pieces at another copy of the same bytes, e.g. after the file was mapped again */
+    void setOriginal(const char *original);
+
+private:
+    struct Piece {
+        bool added;
+        qint64 start;
+        qint64 length;
+        qint64 newlines;
+    };
+
+    struct Node {
+        int left;
+        int right;
+        unsigned int priority;
+        Piece piece;
+        qint64 bytes;
+        qint64 lines;
+    };
+
+    /* One undoable edit: at 'offset', the 'removed' pieces were replaced by the 'inserted' ones */
+    struct Operation {
+        qint64 offset;
+        std::vector<Piece> removed;
+        std::vector<Piece> inserted;
+    };
+
+    const char *original;
+    QByteArray appended;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    int root = 0;
+    unsigned int seed = 0x2545F491u;
+
+    std::vector<Operation> undoStack;
+    std::vector<Operation> redoStack;
+    int savedDepth = 0; /* undo stack size at the last save, -1 if that state is gone */
+
+    const char *bytesOf(const Piece &piece) const;
+    static qint64 countNewlines(const char *data, qint64 length);
+    static qint64 totalLength(const std::vector<Piece> &pieces);
+    static Piece makePiece(bool added, qint64 start, qint64 length, qint64 newlines);
+
+    int createNode(const Piece &piece);
+    void update(int t);
+    int merge(int a, int b);
+    void split(int t, qint64 offset, int &a, int &b);
+    void collect(int t, std::vector<Piece> &pieces) const;
+    void release(int t);
+    int buildFrom(const std::vector<Piece> &pieces);
+    bool writeTree(int t, QIODevice *device) const;
+
+    void replace(qint64 offset, qint64 count, const std::vector<Piece> &pieces, std::vector<Piece> *removed);
+    void edit(qint64 offset, qint64 count, const std::vector<Piece> &inserted);
+};
+
+#endif // PIECE_TABLE_H
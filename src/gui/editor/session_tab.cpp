@@ -0,0 +1,13 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "session_tab.h"
+
+SessionTab::SessionTab(const QString &location, int cursor, int scroll, QWidget *parent) :
+    QWidget(parent),
+    location(location),
+    cursor(cursor),
+    scroll(scroll) {
+}
@@ -0,0 +1,27 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef SESSION_TAB_H
+#define SESSION_TAB_H
+
+#include <qwidget.h>
+
+/*
+* Stands in for a tab restored from the last session. It holds no more than
+* where the file is and where its view was; the editor stack swaps it for a
+* real editor, and only then reads the file, once the tab is first shown.
+*/
+class SessionTab : public QWidget {
+    Q_OBJECT
+
+public:
+    SessionTab(const QString &location, int cursor, int scroll, QWidget *parent = 0);
+
+    const QString location;
+    const int cursor;           /* Text cursor position */
+    const int scroll;           /* Vertical scroll bar value, i.e. the first visible line */
+};
+
+#endif // SESSION_TAB_H
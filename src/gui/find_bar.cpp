@@ -0,0 +1,280 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "find_bar.h"
+#include <qevent.h>
+#include <qlayout.h>
+
+FindBar::FindBar(QWidget *parent) : QWidget(parent) {
+    findEdit = new QLineEdit(this);
+    findEdit->setPlaceholderText("Find");
+    replaceEdit = new QLineEdit(this);
+    replaceEdit->setPlaceholderText("Replace");
+
+    caseButton = new QToolButton(this);
+    caseButton->setText("Aa");
+    caseButton->setToolTip("Match Case");
+    wordButton = new QToolButton(this);
+    wordButton->setText("W");
+    wordButton->setToolTip("Whole Words");
+    regexButton = new QToolButton(this);
+    regexButton->setText(".*");
+    regexButton->setToolTip("Regular Expression");
+    QToolButton *buttons[] = { caseButton, wordButton, regexButton };
+    for (int i = 0; i < 3; ++i) {
+        buttons[i]->setCheckable(true);
+        connect(buttons[i], SIGNAL(toggled(bool)), this, SLOT(queryChanged()));
+    }
+
+    QToolButton *previousButton = new QToolButton(this);
+    previousButton->setText("Previous");
+    QToolButton *nextButton = new QToolButton(this);
+    nextButton->setText("Next");
+    QToolButton *closeButton = new QToolButton(this);
+    closeButton->setText("x");
+    closeButton->setAutoRaise(true);
+    QToolButton *replaceButton = new QToolButton(this);
+    replaceButton->setText("Replace");
+    QToolButton *replaceAllButton = new QToolButton(this);
+    replaceAllButton->setText("Replace All");
+
+    countLabel = new QLabel(this);
+    countLabel->setMinimumWidth(100);
+
+    QHBoxLayout *findRow = new QHBoxLayout;
+    findRow->setMargin(0);
+    findRow->addWidget(findEdit, 1);
+    findRow->addWidget(caseButton);
+    findRow->addWidget(wordButton);
+    findRow->addWidget(regexButton);
+    findRow->addWidget(previousButton);
+    findRow->addWidget(nextButton);
+    findRow->addWidget(countLabel);
+    findRow->addWidget(closeButton);
+
+    replaceRow = new QWidget(this);
+    QHBoxLayout *replaceLayout = new QHBoxLayout(replaceRow);
+    replaceLayout->setMargin(0);
+    replaceLayout->addWidget(replaceEdit, 1);
+    replaceLayout->addWidget(replaceButton);
+    replaceLayout->addWidget(replaceAllButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->setSpacing(4);
+    layout->addLayout(findRow);
+    layout->addWidget(replaceRow);
+    setLayout(layout);
+
+    connect(findEdit, SIGNAL(textChanged(QString)), this, SLOT(queryChanged()));
+    connect(findEdit, SIGNAL(returnPressed()), this, SLOT(findNext()));
+    connect(replaceEdit, SIGNAL(returnPressed()), this, SLOT(replace()));
+    connect(previousButton, SIGNAL(clicked()), this, SLOT(findPrevious()));
+    connect(nextButton, SIGNAL(clicked()), this, SLOT(findNext()));
+    connect(replaceButton, SIGNAL(clicked()), this, SLOT(replace()));
+    connect(replaceAllButton, SIGNAL(clicked()), this, SLOT(replaceAll()));
+    connect(closeButton, SIGNAL(clicked()), this, SLOT(dismiss()));
+
+    hide();
+}
+
+void FindBar::setEditor(CodeEditor *codeEditor) {
+    if (editor == codeEditor) {
+        return;
+    }
+    if (editor) {
+        disconnect(editor->search, SIGNAL(matchesChanged()), this, SLOT(matchesChanged()));
+        editor->search->setQuery(QString(), 0);
+    }
+    editor = codeEditor;
+    if (editor) {
+        connect(editor->search, SIGNAL(matchesChanged()), this, SLOT(matchesChanged()));
+    }
+    if (isVisible()) {
+        queryChanged();
+    }
+}
+
+void FindBar::showFind() {
+    open(false);
+}
+
+void FindBar::showReplace() {
+    open(true);
+}
+
+void FindBar::open(bool withReplace) {
+    replaceRow->setVisible(withReplace);
+    show();
+
+    /* A selection on a single line is what the user is after */
+    if (editor) {
+        const QString selected = editor->textCursor().selectedText();
+        if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+            findEdit->setText(selected);
+        }
+        if (editor->search->pattern() != findEdit->text() || editor->search->flags() != searchFlags()) {
+            queryChanged();
+        }
+    }
+    findEdit->selectAll();
+    findEdit->setFocus();
+}
+
+int FindBar::searchFlags() const {
+    int flags = 0;
+    if (caseButton->isChecked()) {
+        flags |= LineMatcher::CaseSensitive;
+    }
+    if (wordButton->isChecked()) {
+        flags |= LineMatcher::WholeWords;
+    }
+    if (regexButton->isChecked()) {
+        flags |= LineMatcher::RegularExpression;
+    }
+    return flags;
+}
+
+void FindBar::queryChanged() {
+    if (!editor || !isVisible()) {
+        return;
+    }
+    anchor = editor->textCursor().selectionStart();
+    jumpPending = !findEdit->text().isEmpty();
+    editor->search->setQuery(findEdit->text(), searchFlags(), anchor);
+    findEdit->setStyleSheet(editor->search->isValid() ? "" : "background-color: #F4CCCC;");
+}
+
+void FindBar::matchesChanged() {
+    if (!editor) {
+        return;
+    }
+    DocumentSearch *search = editor->search;
+
+    /* Typing moves to the first hit at or after where the search started */
+    if (jumpPending) {
+        const int index = search->next(anchor);
+        if (index >= 0 && (search->at(index).start >= anchor || search->isComplete())) {
+            jumpPending = false;
+            select(index);
+            return;
+        }
+    }
+
+    const QTextCursor cursor = editor->textCursor();
+    const int current = search->indexOf(cursor.selectionStart(), cursor.selectionEnd());
+    const QString more = search->isComplete() ? "" : "+";
+    if (search->pattern().isEmpty()) {
+        countLabel->clear();
+    } else if (search->count() == 0) {
+        countLabel->setText(search->isComplete() ? "No results" : "Searching...");
+    } else if (current >= 0) {
+        countLabel->setText(QString("%1 of %2").arg(current + 1).arg(search->count()) + more);
+    } else {
+        countLabel->setText(QString("%1 matches").arg(search->count()) + more);
+    }
+}
+
+void FindBar::select(int index) {
+    if (!editor || index < 0) {
+        matchesChanged();
+        return;
+    }
+    const DocumentSearch::Match &match = editor->search->at(index);
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(match.start);
+    cursor.setPosition(match.start + match.length, QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);
+    editor->ensureCursorVisible();
+    matchesChanged();
+}
+
+void FindBar::findNext() {
+    if (!editor) {
+        return;
+    }
+    if (findEdit->text().isEmpty()) {
+        showFind();
+        return;
+    }
+    DocumentSearch *search = editor->search;
+    jumpPending = false;
+    if (search->pattern() != findEdit->text() || search->flags() != searchFlags()) {
+        search->setQuery(findEdit->text(), searchFlags(), editor->textCursor().selectionStart());
+    }
+
+    const QTextCursor cursor = editor->textCursor();
+    const int position = cursor.hasSelection() ? cursor.selectionStart() + 1 : cursor.position();
+    int index = search->next(position);
+    if (!search->isComplete() && (index < 0 || search->at(index).start < position)) {
+        /* Wrapping around, or the hit is in a part not searched yet */
+        search->complete();
+        index = search->next(position);
+    }
+    select(index);
+}
+
+void FindBar::findPrevious() {
+    if (!editor) {
+        return;
+    }
+    if (findEdit->text().isEmpty()) {
+        showFind();
+        return;
+    }
+    DocumentSearch *search = editor->search;
+    jumpPending = false;
+    if (search->pattern() != findEdit->text() || search->flags() != searchFlags()) {
+        search->setQuery(findEdit->text(), searchFlags(), editor->textCursor().selectionStart());
+    }
+
+    const int position = editor->textCursor().selectionStart();
+    int index = search->previous(position);
+    if (!search->isComplete() && (index < 0 || search->at(index).start >= position)) {
+        search->complete();
+        index = search->previous(position);
+    }
+    select(index);
+}
+
+void FindBar::replace() {
+    if (!editor || editor->isReadOnly()) {
+        return;
+    }
+    QTextCursor cursor = editor->textCursor();
+    const int index = editor->search->indexOf(cursor.selectionStart(), cursor.selectionEnd());
+    if (index >= 0) {
+        cursor.insertText(editor->search->replacement(index, replaceEdit->text()));
+        editor->setTextCursor(cursor);
+    }
+    findNext();
+}
+
+void FindBar::replaceAll() {
+    if (!editor || editor->isReadOnly() || findEdit->text().isEmpty()) {
+        return;
+    }
+    if (editor->search->pattern() != findEdit->text() || editor->search->flags() != searchFlags()) {
+        editor->search->setQuery(findEdit->text(), searchFlags());
+    }
+    const int replaced = editor->search->replaceAll(replaceEdit->text());
+    countLabel->setText(QString("Replaced %1").arg(replaced));
+}
+
+void FindBar::dismiss() {
+    hide();
+    if (editor) {
+        editor->search->setQuery(QString(), 0);
+        editor->setFocus();
+    }
+}
+
+void FindBar::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        dismiss();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
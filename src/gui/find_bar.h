@@ -0,0 +1,57 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "editor/code_editor_interface.h"
+#include <qlabel.h>
+#include <qlineedit.h>
+#include <qpointer.h>
+#include <qtoolbutton.h>
+#include <qwidget.h>
+
+#ifndef FIND_BAR_H
+#define FIND_BAR_H
+
+/* Find and replace in the current editor, driving its DocumentSearch as the pattern is typed */
+class FindBar : public QWidget {
+    Q_OBJECT
+
+public:
+    FindBar(QWidget *parent = 0);
+
+public Q_SLOTS:
+    void setEditor(CodeEditor *editor);
+    void showFind();
+    void showReplace();
+    void findNext();
+    void findPrevious();
+    void replace();
+    void replaceAll();
+    void dismiss();
+
+protected:
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    QPointer<CodeEditor> editor;
+    QLineEdit *findEdit;
+    QLineEdit *replaceEdit;
+    QToolButton *caseButton;
+    QToolButton *wordButton;
+    QToolButton *regexButton;
+    QLabel *countLabel;
+    QWidget *replaceRow;
+    int anchor = 0;              /* Where the incremental search started */
+    bool jumpPending = false;    /* Select the first match after 'anchor' once it is found */
+
+    int searchFlags() const;
+    void select(int index);
+    void open(bool withReplace);
+
+private Q_SLOTS:
+    void queryChanged();
+    void matchesChanged();
+};
+
+#endif // FIND_BAR_H
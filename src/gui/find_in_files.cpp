@@ -0,0 +1,410 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "find_in_files.h"
+#include <qdialogbuttonbox.h>
+#include <qevent.h>
+#include <qlayout.h>
+#include <qmessagebox.h>
+#include <qset.h>
+#include <qsplitter.h>
+#include <qtextcursor.h>
+#include <qtextformat.h>
+
+SearchResultModel::SearchResultModel(QObject *parent) : QAbstractListModel(parent) {
+}
+
+void SearchResultModel::setRoot(const QString &path) {
+    root = QDir(path);
+}
+
+void SearchResultModel::clear() {
+    beginResetModel();
+    hits.clear();
+    endResetModel();
+}
+
+void SearchResultModel::append(const QVector<SearchHit> &batch) {
+    if (batch.isEmpty()) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), hits.size(), hits.size() + batch.size() - 1);
+    hits += batch;
+    endInsertRows();
+}
+
+const SearchHit &SearchResultModel::hit(int row) const {
+    return hits.at(row);
+}
+
+QStringList SearchResultModel::files() const {
+    QStringList paths;
+    QSet<QString> seen;
+    for (int i = 0; i < hits.size(); ++i) {
+        if (!seen.contains(hits.at(i).path)) {
+            seen.insert(hits.at(i).path);
+            paths << hits.at(i).path;
+        }
+    }
+    return paths;
+}
+
+int SearchResultModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : hits.size();
+}
+
+QVariant SearchResultModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= hits.size()) {
+        return QVariant();
+    }
+    const SearchHit &hit = hits.at(index.row());
+    if (role == Qt::DisplayRole) {
+        return root.relativeFilePath(hit.path) + ":" + QString::number(hit.line + 1) + ": " + hit.text.trimmed();
+    } else if (role == Qt::ToolTipRole) {
+        return hit.path;
+    }
+    return QVariant();
+}
+
+ReplacePreview::ReplacePreview(const QVector<FileChange> &changes, const QString &root, QWidget *parent) :
+    QDialog(parent),
+    changes(changes) {
+
+    setWindowTitle("Replace in Files");
+    resize(900, 560);
+
+    int total = 0;
+    const QDir rootDir(root);
+    files = new QListWidget(this);
+    for (int i = 0; i < changes.size(); ++i) {
+        QListWidgetItem *item = new QListWidgetItem(rootDir.relativeFilePath(changes.at(i).path) +
+            QString(" (%1)").arg(changes.at(i).replacements), files);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Checked);
+        if (changes.at(i).fromBuffer) {
+            item->setToolTip("Open in an editor; changed there as one undo step");
+        }
+        total += changes.at(i).replacements;
+    }
+
+    diff = new QPlainTextEdit(this);
+    diff->setReadOnly(true);
+    diff->setLineWrapMode(QPlainTextEdit::NoWrap);
+    diff->setFont(QFont("Courier New", 10));
+
+    QSplitter *splitter = new QSplitter(this);
+    splitter->addWidget(files);
+    splitter->addWidget(diff);
+    splitter->setStretchFactor(0, 1);
+    splitter->setStretchFactor(1, 3);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    buttons->button(QDialogButtonBox::Ok)->setText("Replace");
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(new QLabel(QString("%1 replacements in %2 files. Uncheck the files to leave alone.")
+        .arg(total).arg(changes.size()), this));
+    layout->addWidget(splitter, 1);
+    layout->addWidget(buttons);
+    setLayout(layout);
+
+    connect(files, SIGNAL(currentRowChanged(int)), this, SLOT(showFile(int)));
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+    files->setCurrentRow(0);
+}
+
+QVector<FileChange> ReplacePreview::selected() const {
+    QVector<FileChange> chosen;
+    for (int i = 0; i < changes.size(); ++i) {
+        if (files->item(i)->checkState() == Qt::Checked) {
+            chosen.append(changes.at(i));
+        }
+    }
+    return chosen;
+}
+
+void ReplacePreview::showFile(int row) {
+    diff->clear();
+    if (row < 0 || row >= changes.size()) {
+        return;
+    }
+
+    QTextCharFormat plain;
+    QTextCharFormat removed;
+    removed.setBackground(QColor("#F4C7C3"));
+    QTextCharFormat added;
+    added.setBackground(QColor("#C9E7C9"));
+
+    const QVector<LineChange> &lines = changes.at(row).lines;
+    QTextCursor cursor(diff->document());
+    cursor.beginEditBlock();
+    for (int i = 0; i < lines.size(); ++i) {
+        cursor.insertText(QString("@@ line %1\n").arg(lines.at(i).line + 1), plain);
+        cursor.insertText("- " + lines.at(i).before, removed);
+        cursor.insertText("\n", plain);
+        cursor.insertText("+ " + lines.at(i).after, added);
+        cursor.insertText("\n", plain);
+    }
+    cursor.endEditBlock();
+    diff->moveCursor(QTextCursor::Start);
+}
+
+FindInFilesPanel::FindInFilesPanel(QSettings *s, EditorStack *editors, QWidget *parent) :
+    QWidget(parent),
+    settingsPtr(s),
+    editors(editors) {
+
+    patternEdit = new QLineEdit(this);
+    patternEdit->setPlaceholderText("Find in Files");
+
+    caseButton = new QToolButton(this);
+    caseButton->setText("Aa");
+    caseButton->setToolTip("Match Case");
+    wordButton = new QToolButton(this);
+    wordButton->setText("W");
+    wordButton->setToolTip("Whole Words");
+    regexButton = new QToolButton(this);
+    regexButton->setText(".*");
+    regexButton->setToolTip("Regular Expression");
+    caseButton->setCheckable(true);
+    wordButton->setCheckable(true);
+    regexButton->setCheckable(true);
+
+    searchButton = new QPushButton("Search", this);
+    QToolButton *closeButton = new QToolButton(this);
+    closeButton->setText("x");
+    closeButton->setAutoRaise(true);
+
+    replaceEdit = new QLineEdit(this);
+    replaceEdit->setPlaceholderText("Replace with");
+    QPushButton *replaceButton = new QPushButton("Replace All...", this);
+
+    replaceRow = new QWidget(this);
+    QHBoxLayout *replaceLayout = new QHBoxLayout(replaceRow);
+    replaceLayout->setMargin(0);
+    replaceLayout->addWidget(replaceEdit, 1);
+    replaceLayout->addWidget(replaceButton);
+    replaceRow->setLayout(replaceLayout);
+
+    statusLabel = new QLabel(this);
+    model = new SearchResultModel(this);
+    results = new QListView(this);
+    results->setModel(model);
+    results->setUniformItemSizes(true);
+    results->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    results->setStyleSheet("background-color: #DDD;");
+
+    QHBoxLayout *queryRow = new QHBoxLayout;
+    queryRow->setMargin(0);
+    queryRow->addWidget(patternEdit, 1);
+    queryRow->addWidget(caseButton);
+    queryRow->addWidget(wordButton);
+    queryRow->addWidget(regexButton);
+    queryRow->addWidget(searchButton);
+    queryRow->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->setSpacing(4);
+    layout->addLayout(queryRow);
+    layout->addWidget(replaceRow);
+    layout->addWidget(statusLabel);
+    layout->addWidget(results, 1);
+    setLayout(layout);
+    setMinimumHeight(200);
+
+    connect(patternEdit, SIGNAL(returnPressed()), this, SLOT(start()));
+    connect(searchButton, SIGNAL(clicked()), this, SLOT(toggleSearch()));
+    connect(closeButton, SIGNAL(clicked()), this, SLOT(dismiss()));
+    connect(replaceEdit, SIGNAL(returnPressed()), this, SLOT(replaceAll()));
+    connect(replaceButton, SIGNAL(clicked()), this, SLOT(replaceAll()));
+    connect(results, SIGNAL(activated(QModelIndex)), this, SLOT(activated(QModelIndex)));
+
+    hide();
+}
+
+void FindInFilesPanel::setRoot(const QString &root) {
+    rootPath = root;
+}
+
+void FindInFilesPanel::showPanel() {
+    replaceRow->hide();
+    show();
+    patternEdit->selectAll();
+    patternEdit->setFocus();
+}
+
+void FindInFilesPanel::showReplace() {
+    replaceRow->show();
+    show();
+    if (patternEdit->text().isEmpty()) {
+        patternEdit->setFocus();
+    } else {
+        replaceEdit->selectAll();
+        replaceEdit->setFocus();
+    }
+}
+
+int FindInFilesPanel::searchFlags() const {
+    int flags = 0;
+    if (caseButton->isChecked()) {
+        flags |= LineMatcher::CaseSensitive;
+    }
+    if (wordButton->isChecked()) {
+        flags |= LineMatcher::WholeWords;
+    }
+    if (regexButton->isChecked()) {
+        flags |= LineMatcher::RegularExpression;
+    }
+    return flags;
+}
+
+void FindInFilesPanel::start() {
+    cancel();
+    model->clear();
+
+    const LineMatcher matcher(patternEdit->text(), searchFlags());
+    if (matcher.isEmpty()) {
+        statusLabel->clear();
+        return;
+    }
+    if (!matcher.isValid()) {
+        statusLabel->setText("Invalid regular expression.");
+        return;
+    }
+    if (rootPath.isEmpty()) {
+        statusLabel->setText("Open a saved file to pick the folder to search.");
+        return;
+    }
+
+    model->setRoot(rootPath);
+    searched = matcher;
+    partial = false;
+    search = new ProjectSearch(rootPath, matcher, ProjectSearch::ignorePatterns(settingsPtr, rootPath), this);
+    connect(search, SIGNAL(found(QVector<SearchHit>)), this, SLOT(found(QVector<SearchHit>)));
+    connect(search, SIGNAL(finished()), this, SLOT(finished()));
+
+    elapsed.start();
+    statusLabel->setText("Searching " + QDir::toNativeSeparators(rootPath) + "...");
+    searchButton->setText("Stop");
+    search->start();
+}
+
+void FindInFilesPanel::stop() {
+    if (search) {
+        search->requestInterruption();
+    }
+}
+
+void FindInFilesPanel::toggleSearch() {
+    if (search) {
+        stop();
+    } else {
+        start();
+    }
+}
+
+/* Drops a running search without waiting for its results */
+void FindInFilesPanel::cancel() {
+    if (search) {
+        disconnect(search, 0, this, 0);
+        delete search;
+        search = nullptr;
+        searchButton->setText("Search");
+    }
+}
+
+void FindInFilesPanel::dismiss() {
+    stop();
+    hide();
+}
+
+void FindInFilesPanel::found(const QVector<SearchHit> &batch) {
+    model->append(batch);
+    statusLabel->setText(QString("%1 matches so far...").arg(model->rowCount()));
+}
+
+void FindInFilesPanel::finished() {
+    QString status = QString("%1 matches in %2 files searched (%3 ms)")
+        .arg(model->rowCount()).arg(search->filesSearched()).arg(elapsed.elapsed());
+    partial = search->limitReached() || search->isInterruptionRequested();
+    if (search->limitReached()) {
+        status += ", stopped at the result limit";
+    } else if (search->isInterruptionRequested()) {
+        status += ", stopped";
+    }
+    statusLabel->setText(status);
+
+    search->deleteLater();
+    search = nullptr;
+    searchButton->setText("Search");
+}
+
+/* Replaces in the files of the hits listed, after a preview */
+void FindInFilesPanel::replaceAll() {
+    if (search) {
+        statusLabel->setText("Wait for the search to finish before replacing.");
+        return;
+    }
+    if (searched.pattern() != patternEdit->text() || searched.flags() != searchFlags()) {
+        start();
+        return;
+    }
+    if (model->rowCount() == 0) {
+        statusLabel->setText("Nothing to replace.");
+        return;
+    }
+    if (partial && QMessageBox::question(this, "Replace in Files",
+            "The search did not finish, so only the files listed will be changed. Continue?",
+            QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes) {
+        return;
+    }
+
+    const QVector<FileChange> changes = ProjectReplace(searched, replaceEdit->text()).compute(model->files(), editors->openBuffers());
+    if (changes.isEmpty()) {
+        statusLabel->setText("Nothing to replace.");
+        return;
+    }
+    ReplacePreview preview(changes, rootPath, this);
+    if (preview.exec() != QDialog::Accepted) {
+        return;
+    }
+    const QVector<FileChange> chosen = preview.selected();
+
+    elapsed.start();
+    QStringList problems;
+    const int written = editors->applyChanges(chosen, &problems);
+    if (written < 0) {
+        QMessageBox::warning(this, "Replace in Files",
+            "Nothing was replaced, as some files changed since the preview:\n\n" + problems.join("\n"));
+        return;
+    }
+
+    int replacements = 0;
+    for (int i = 0; i < chosen.size(); ++i) {
+        replacements += chosen.at(i).replacements;
+    }
+    model->clear();
+    statusLabel->setText(QString("Replaced %1 matches in %2 files (%3 ms)").arg(replacements).arg(written).arg(elapsed.elapsed()));
+    if (!problems.isEmpty()) {
+        QMessageBox::warning(this, "Replace in Files", "Some files could not be written:\n\n" + problems.join("\n"));
+    }
+}
+
+void FindInFilesPanel::activated(const QModelIndex &index) {
+    if (index.isValid()) {
+        const SearchHit &hit = model->hit(index.row());
+        Q_EMIT openRequested(hit.path, hit.line);
+    }
+}
+
+void FindInFilesPanel::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        dismiss();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
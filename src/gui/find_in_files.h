@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "editor/editor_stack.h"
+#include "project_replace.h"
+#include "project_search.h"
+#include <qabstractitemmodel.h>
+#include <qdialog.h>
+#include <qdir.h>
+#include <qelapsedtimer.h>
+#include <qlabel.h>
+#include <qlineedit.h>
+#include <qlistview.h>
+#include <qlistwidget.h>
+#include <qplaintextedit.h>
+#include <qpushbutton.h>
+#include <qtoolbutton.h>
+#include <qwidget.h>
+
+#ifndef FIND_IN_FILES_H
+#define FIND_IN_FILES_H
+
+/* Hits of a project search, appended as they stream in; only the rows on screen are ever formatted */
+class SearchResultModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    SearchResultModel(QObject *parent = 0);
+
+    void setRoot(const QString &root);
+    void clear();
+    void append(const QVector<SearchHit> &batch);
+    const SearchHit &hit(int row) const;
+
+    /* Every file with a hit, in the order they were found */
+    QStringList files() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+
+private:
+    QDir root;
+    QVector<SearchHit> hits;
+};
+
+/* Shows the lines a replace would change, file by file, and which files to change */
+class ReplacePreview : public QDialog {
+    Q_OBJECT
+
+public:
+    ReplacePreview(const QVector<FileChange> &changes, const QString &root, QWidget *parent = 0);
+    QVector<FileChange> selected() const;
+
+private:
+    const QVector<FileChange> changes;
+    QListWidget *files;
+    QPlainTextEdit *diff;
+
+private Q_SLOTS:
+    void showFile(int row);
+};
+
+/* Searches the directory the file tree is rooted at, lists every hit and replaces them */
+class FindInFilesPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    FindInFilesPanel(QSettings *s, EditorStack *editors, QWidget *parent = 0);
+    void setRoot(const QString &root);
+
+public Q_SLOTS:
+    void showPanel();
+    void showReplace();
+    void replaceAll();
+    void start();
+    void stop();
+    void dismiss();
+
+Q_SIGNALS:
+    void openRequested(const QString &path, int line);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    QSettings *settingsPtr;
+    EditorStack *editors;
+    QString rootPath;
+    QLineEdit *patternEdit;
+    QLineEdit *replaceEdit;
+    QWidget *replaceRow;
+    QToolButton *caseButton;
+    QToolButton *wordButton;
+    QToolButton *regexButton;
+    QPushButton *searchButton;
+    QLabel *statusLabel;
+    QListView *results;
+    SearchResultModel *model;
+    ProjectSearch *search = nullptr;
+    LineMatcher searched;   /* Of the hits listed */
+    bool partial = false;
+    QElapsedTimer elapsed;
+
+    int searchFlags() const;
+    void cancel();
+
+private Q_SLOTS:
+    void toggleSearch();
+    void found(const QVector<SearchHit> &batch);
+    void finished();
+    void activated(const QModelIndex &index);
+};
+
+#endif // FIND_IN_FILES_H
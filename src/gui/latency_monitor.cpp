@@ -0,0 +1,168 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "latency_monitor.h"
+#include <qfile.h>
+#include <qtextstream.h>
+
+LatencyHistogram::LatencyHistogram(const QString &name) :
+    label(name),
+    counts(BucketCount, 0),
+    raw(RawSamples) {
+}
+
+QString LatencyHistogram::name() const {
+    return label;
+}
+
+qint64 LatencyHistogram::count() const {
+    return total;
+}
+
+qint64 LatencyHistogram::max() const {
+    return highest;
+}
+
+/* The largest value that lands in 'bucket' */
+qint64 LatencyHistogram::highestEquivalent(int bucket) {
+    if (bucket < SubBuckets) {
+        return bucket;
+    }
+    const int shift = (bucket - SubBuckets) / HalfBuckets + 1;
+    const qint64 mantissa = (bucket - SubBuckets) % HalfBuckets + HalfBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+qint64 LatencyHistogram::percentile(double percentile) const {
+    if (total == 0) {
+        return 0;
+    }
+    const qint64 wanted = qMax<qint64>(1, (qint64)(percentile / 100.0 * total + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= wanted) {
+            return qMin(highestEquivalent(i), highest);
+        }
+    }
+    return highest;
+}
+
+QVector<LatencyHistogram::Sample> LatencyHistogram::samples() const {
+    QVector<Sample> kept;
+    const qint64 first = qMax<qint64>(0, total - RawSamples);
+    kept.reserve((int)(total - first));
+    for (qint64 i = first; i < total; ++i) {
+        kept.append(raw[(size_t)i % RawSamples]);
+    }
+    return kept;
+}
+
+void LatencyHistogram::reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    highest = 0;
+}
+
+bool LatencyMonitor::enabled = false;
+
+LatencyMonitor *LatencyMonitor::getInstance() {
+    static LatencyMonitor *theInstance = nullptr;
+    if (!theInstance) {
+        theInstance = new LatencyMonitor();
+    }
+    return theInstance;
+}
+
+LatencyMonitor::LatencyMonitor() {
+    clock.start();
+}
+
+LatencyHistogram *LatencyMonitor::channel(const QString &name) {
+    for (int i = 0; i < histograms.size(); ++i) {
+        if (histograms.at(i)->name() == name) {
+            return histograms.at(i);
+        }
+    }
+    histograms.append(new LatencyHistogram(name));
+    return histograms.last();
+}
+
+const QVector<LatencyHistogram*> &LatencyMonitor::channels() const {
+    return histograms;
+}
+
+void LatencyMonitor::reset() {
+    for (int i = 0; i < histograms.size(); ++i) {
+        histograms.at(i)->reset();
+    }
+}
+
+bool LatencyMonitor::exportSamples(const QString &path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream stream(&file);
+    stream << "widget,at_ns,latency_ns\n";
+    for (int i = 0; i < histograms.size(); ++i) {
+        const QVector<LatencyHistogram::Sample> samples = histograms.at(i)->samples();
+        for (int k = 0; k < samples.size(); ++k) {
+            stream << histograms.at(i)->name() << ',' << samples.at(k).at << ',' << samples.at(k).latency << '\n';
+        }
+    }
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+LatencyProbe::LatencyProbe(const QString &channel) :
+    histogram(LatencyMonitor::getInstance()->channel(channel)) {
+}
+
+LatencyOverlay::LatencyOverlay(QWidget *parent) : QLabel(parent) {
+    setStyleSheet("background-color: rgba(32, 32, 32, 200); color: #EEE; padding: 6px;");
+    setFont(QFont("Courier New", 9));
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+
+    timer = new QTimer(this);
+    timer->setInterval(RefreshInterval);
+    connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+    hide();
+}
+
+void LatencyOverlay::setActive(bool active) {
+    if (active) {
+        LatencyMonitor::enabled = true;
+        refresh();
+        show();
+        raise();
+        timer->start();
+    } else {
+        timer->stop();
+        hide();
+    }
+}
+
+void LatencyOverlay::refresh() {
+    QStringList lines;
+    lines << "Key to paint     count    p50 ms   p99 ms   max ms";
+    const QVector<LatencyHistogram*> &channels = LatencyMonitor::getInstance()->channels();
+    for (int i = 0; i < channels.size(); ++i) {
+        const LatencyHistogram *h = channels.at(i);
+        lines << QString("%1 %2 %3 %4 %5")
+            .arg(h->name(), -14)
+            .arg(h->count(), 7)
+            .arg(h->percentile(50) / 1e6, 8, 'f', 2)
+            .arg(h->percentile(99) / 1e6, 8, 'f', 2)
+            .arg(h->max() / 1e6, 8, 'f', 2);
+    }
+    setText(lines.join("\n"));
+    adjustSize();
+
+    /* Top right of the parent, clear of its scroll bars */
+    if (QWidget *p = parentWidget()) {
+        move(p->width() - width() - 24, 8);
+    }
+}
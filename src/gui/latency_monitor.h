@@ -0,0 +1,221 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef LATENCY_MONITOR_H
+#define LATENCY_MONITOR_H
+
+#include <qelapsedtimer.h>
+#include <qlabel.h>
+#include <qscrollbar.h>
+#include <qtextcursor.h>
+#include <qtextdocument.h>
+#include <qtimer.h>
+#include <qvector.h>
+#include <algorithm>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+* Latencies in nanoseconds, in log-linear buckets as in HDR histograms: each
+* power of two is split into 64 buckets, so every value is kept to within
+* about 1.5%, from a nanosecond up to two minutes, in a fixed 8 KB.
+* The last RawSamples samples are kept as they are for exporting.
+*/
+class LatencyHistogram {
+public:
+    enum { RawSamples = 65536 };
+
+    struct Sample {
+        qint64 at;      /* When the key came in, in nanoseconds since the monitor started */
+        qint64 latency;
+    };
+
+    explicit LatencyHistogram(const QString &name);
+
+    QString name() const;
+    qint64 count() const;
+    qint64 max() const;
+
+    /* Smallest value at least 'percentile' percent of the samples are at or below, to bucket precision */
+    qint64 percentile(double percentile) const;
+
+    /* The raw samples kept, oldest first */
+    QVector<Sample> samples() const;
+
+    void reset();
+
+    inline void record(qint64 at, qint64 latency) {
+        ++counts[bucketOf(latency)];
+        ++total;
+        if (latency > highest) {
+            highest = latency;
+        }
+        Sample &sample = raw[(size_t)(total - 1) % RawSamples];
+        sample.at = at;
+        sample.latency = latency;
+    }
+
+private:
+    enum { SubBits = 7, SubBuckets = 1 << SubBits, HalfBuckets = SubBuckets / 2, MaxShift = 30 };
+    enum { BucketCount = SubBuckets + MaxShift * HalfBuckets };
+
+    const QString label;
+    std::vector<quint32> counts;
+    std::vector<Sample> raw;
+    qint64 total = 0;
+    qint64 highest = 0;
+
+    static inline int bucketOf(qint64 value) {
+        if (value < SubBuckets) {
+            return value < 0 ? 0 : (int)value;
+        }
+        int shift = highestBit((quint64)value) - (SubBits - 1);
+        if (shift > MaxShift) {
+            return BucketCount - 1;
+        }
+        return SubBuckets + (shift - 1) * HalfBuckets + (int)((quint64)value >> shift) - HalfBuckets;
+    }
+
+    static inline int highestBit(quint64 value) {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        if (_BitScanReverse(&bit, (unsigned long)(value >> 32))) {
+            return (int)bit + 32;
+        }
+        _BitScanReverse(&bit, (unsigned long)value);
+        return (int)bit;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    static qint64 highestEquivalent(int bucket);
+};
+
+/*
+* Opt-in timing of how long a key press takes to show on screen.
+*
+* Off, a probe costs a test of one flag per key press and paint. On, a key
+* press reads the monotonic clock and the paint after it records the time
+* since into the histogram of its widget kind.
+*/
+class LatencyMonitor {
+public:
+    static bool enabled;
+
+    static LatencyMonitor *getInstance();
+    static inline qint64 now() { return getInstance()->clock.nsecsElapsed(); }
+
+    LatencyHistogram *channel(const QString &name);
+    const QVector<LatencyHistogram*> &channels() const;
+    void reset();
+
+    /* Writes every raw sample as CSV */
+    bool exportSamples(const QString &path) const;
+
+private:
+    LatencyMonitor();
+
+    QElapsedTimer clock;
+    QVector<LatencyHistogram*> histograms;
+};
+
+/* The latency of one widget, from the first key press to the paint that shows it */
+class LatencyProbe {
+public:
+    explicit LatencyProbe(const QString &channel);
+
+    inline qint64 stamp() const {
+        return LatencyMonitor::enabled ? LatencyMonitor::now() : 0;
+    }
+
+    /* A key that changed what the widget shows; earlier keys not painted yet keep their time */
+    inline void arm(qint64 at) {
+        if (!pending) {
+            pending = at;
+        }
+    }
+
+    inline void painted() {
+        if (pending) {
+            histogram->record(pending, LatencyMonitor::now() - pending);
+            pending = 0;
+        }
+    }
+
+private:
+    LatencyHistogram *histogram;
+    qint64 pending = 0;
+};
+
+/*
+* Times one key press into a text widget for the life of the scope. Keys that
+* change neither the text, the cursor nor the scrolling are dropped, as no
+* paint follows them.
+*/
+template <typename Editor>
+class LatencyKey {
+public:
+    LatencyKey(LatencyProbe &probe, Editor *editor) :
+        probe(probe),
+        editor(editor),
+        at(probe.stamp()) {
+        if (at) {
+            before = state();
+        }
+    }
+
+    ~LatencyKey() {
+        if (at && state() != before) {
+            probe.arm(at);
+        }
+    }
+
+private:
+    LatencyProbe &probe;
+    Editor *editor;
+    const qint64 at;
+
+    struct State {
+        int values[5];
+
+        bool operator!=(const State &other) const {
+            return !std::equal(values, values + 5, other.values);
+        }
+    } before;
+
+    State state() const {
+        const QTextCursor cursor = editor->textCursor();
+        State current = { {
+            editor->document()->revision(),
+            cursor.position(),
+            cursor.anchor(),
+            editor->verticalScrollBar()->value(),
+            editor->horizontalScrollBar()->value()
+        } };
+        return current;
+    }
+};
+
+/* Percentiles of every channel, drawn over a corner of its parent */
+class LatencyOverlay : public QLabel {
+    Q_OBJECT
+
+public:
+    LatencyOverlay(QWidget *parent);
+
+public Q_SLOTS:
+    void setActive(bool active);
+    void refresh();
+
+private:
+    enum { RefreshInterval = 500 };
+
+    QTimer *timer;
+};
+
+#endif // LATENCY_MONITOR_H
@@ -0,0 +1,139 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "literal_finder.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LITERAL_FINDER_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+inline unsigned char lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+inline bool isLowerLetter(unsigned char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+bool equals(const char *data, const char *needle, int length, bool fold) {
+    if (!fold) {
+        return std::memcmp(data, needle, length) == 0;
+    }
+    for (int i = 0; i < length; ++i) {
+        if (lower((unsigned char)data[i]) != (unsigned char)needle[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 findScalar(const char *data, qint64 size, qint64 from, const char *needle, int length, bool fold) {
+    const unsigned char first = (unsigned char)needle[0];
+    if (!fold || !isLowerLetter(first)) {
+        /* memchr is vectorized by the C library already */
+        const char *end = data + size - length + 1;
+        for (const char *p = data + from; p < end; ++p) {
+            p = static_cast<const char*>(std::memchr(p, first, end - p));
+            if (!p) {
+                return -1;
+            }
+            if (equals(p, needle, length, fold)) {
+                return p - data;
+            }
+        }
+        return -1;
+    }
+    for (qint64 i = from; i + length <= size; ++i) {
+        if (lower((unsigned char)data[i]) == first && equals(data + i, needle, length, fold)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifdef LITERAL_FINDER_SSE2
+inline int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+qint64 findSse2(const char *data, qint64 size, qint64 from, const char *needle, int length, bool fold) {
+    const unsigned char firstByte = (unsigned char)needle[0];
+    const unsigned char lastByte = (unsigned char)needle[length - 1];
+    const __m128i first = _mm_set1_epi8((char)firstByte);
+    const __m128i last = _mm_set1_epi8((char)lastByte);
+
+    /* Setting bit 5 folds an ASCII letter to lower case; anything else it turns into is weeded out below */
+    const __m128i firstFold = _mm_set1_epi8(fold && isLowerLetter(firstByte) ? 0x20 : 0);
+    const __m128i lastFold = _mm_set1_epi8(fold && isLowerLetter(lastByte) ? 0x20 : 0);
+
+    qint64 i = from;
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        const __m128i a = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), firstFold);
+        const __m128i b = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + length - 1)), lastFold);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            const qint64 candidate = i + lowestBit(mask);
+            if (equals(data + candidate, needle, length, fold)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(data, size, i, needle, length, fold);
+}
+#endif
+
+} // namespace
+
+LiteralFinder::LiteralFinder(const QByteArray &bytes, bool caseSensitive) :
+    needle(bytes),
+    fold(!caseSensitive),
+    usable(!bytes.isEmpty()) {
+
+    if (fold) {
+        for (int i = 0; i < needle.size(); ++i) {
+            if ((unsigned char)needle.at(i) >= 0x80) {
+                usable = false;
+            }
+            needle[i] = (char)lower((unsigned char)needle.at(i));
+        }
+    }
+}
+
+bool LiteralFinder::isUsable() const {
+    return usable;
+}
+
+qint64 LiteralFinder::find(const char *data, qint64 size, qint64 from) const {
+    if (!usable || size - from < needle.size()) {
+        return -1;
+    }
+#ifdef LITERAL_FINDER_SSE2
+    return findSse2(data, size, from, needle.constData(), needle.size(), fold);
+#else
+    return findScalar(data, size, from, needle.constData(), needle.size(), fold);
+#endif
+}
+
+const char *LiteralFinder::implementation() {
+#ifdef LITERAL_FINDER_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
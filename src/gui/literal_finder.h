@@ -0,0 +1,40 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef LITERAL_FINDER_H
+#define LITERAL_FINDER_H
+
+#include <qbytearray.h>
+
+/**
+ * Vectorized search for a literal in raw UTF-8 bytes.
+ *
+ * Used by the project search to throw away files that cannot match before
+ * anything is decoded. Candidates are found 16 positions at a time by
+ * comparing the needle's first and last byte, and only those are checked in
+ * full. Without case sensitivity ASCII letters are folded on the fly, which
+ * is why needles with other letters cannot be searched that way. Platforms
+ * without SSE2 fall back to a scalar loop.
+ */
+class LiteralFinder {
+public:
+    LiteralFinder(const QByteArray &needle, bool caseSensitive);
+
+    /* False when the bytes alone cannot tell, e.g. a non-ASCII needle without case sensitivity */
+    bool isUsable() const;
+
+    /* Offset of the first occurrence in [from, size), or -1 */
+    qint64 find(const char *data, qint64 size, qint64 from = 0) const;
+
+    /* Name of the implementation in use: "sse2" or "scalar" */
+    static const char *implementation();
+
+private:
+    QByteArray needle;  /* Lower case when folding */
+    bool fold;
+    bool usable;
+};
+
+#endif // LITERAL_FINDER_H
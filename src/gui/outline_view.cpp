@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "outline_view.h"
+#include <qheaderview.h>
+#include <qvector.h>
+
+OutlineView::OutlineView(QWidget *parent) : QTreeWidget(parent) {
+    setStyleSheet("background-color: #DDD;");
+    setHeaderHidden(true);
+    setColumnCount(1);
+    setUniformRowHeights(true);
+
+    connect(this, SIGNAL(itemActivated(QTreeWidgetItem*, int)), this, SLOT(jumpTo(QTreeWidgetItem*)));
+}
+
+void OutlineView::setEditor(CodeEditor *codeEditor) {
+    if (editor == codeEditor) {
+        return;
+    }
+    if (editor) {
+        disconnect(editor->symbols, SIGNAL(symbolsChanged()), this, SLOT(rebuild()));
+    }
+    editor = codeEditor;
+    if (editor) {
+        connect(editor->symbols, SIGNAL(symbolsChanged()), this, SLOT(rebuild()));
+    }
+    rebuild();
+}
+
+void OutlineView::rebuild() {
+    setUpdatesEnabled(false);
+    clear();
+
+    if (editor) {
+        const QVector<PythonSymbols::Symbol> &symbols = editor->symbols->symbols();
+        QVector<QTreeWidgetItem*> items(symbols.size(), nullptr);
+        for (int i = 0; i < symbols.size(); ++i) {
+            const PythonSymbols::Symbol &symbol = symbols.at(i);
+            if (symbol.kind == PythonSymbols::Import) {
+                continue;
+            }
+
+            QTreeWidgetItem *parent = symbol.parent >= 0 ? items.at(symbol.parent) : nullptr;
+            QTreeWidgetItem *item = parent ? new QTreeWidgetItem(parent) : new QTreeWidgetItem(this);
+            switch (symbol.kind) {
+                case PythonSymbols::Class: item->setText(0, "class " + symbol.name); break;
+                case PythonSymbols::Function: item->setText(0, "def " + symbol.name); break;
+                default: item->setText(0, symbol.name); break;
+            }
+            item->setData(0, Qt::UserRole, symbol.line);
+            items[i] = item;
+        }
+        expandAll();
+    }
+
+    setUpdatesEnabled(true);
+}
+
+void OutlineView::jumpTo(QTreeWidgetItem *item) {
+    if (editor && item) {
+        editor->goToLine(item->data(0, Qt::UserRole).toInt());
+    }
+}
@@ -0,0 +1,31 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "editor/code_editor_interface.h"
+#include <qpointer.h>
+#include <qtreewidget.h>
+
+#ifndef OUTLINE_VIEW_H
+#define OUTLINE_VIEW_H
+
+/* Classes, functions and assignments of the current editor, fed by its DocumentSymbols */
+class OutlineView : public QTreeWidget {
+    Q_OBJECT
+
+public:
+    OutlineView(QWidget *parent = 0);
+
+public Q_SLOTS:
+    void setEditor(CodeEditor *editor);
+
+private:
+    QPointer<CodeEditor> editor;
+
+private Q_SLOTS:
+    void rebuild();
+    void jumpTo(QTreeWidgetItem *item);
+};
+
+#endif // OUTLINE_VIEW_H
@@ -0,0 +1,677 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "project_index.h"
+#include "src/python/python_lexer.h"
+#include <qcryptographichash.h>
+#include <qdatastream.h>
+#include <qdatetime.h>
+#include <qdir.h>
+#include <qdiriterator.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qrunnable.h>
+#include <qsavefile.h>
+#include <qstandardpaths.h>
+#include <qthreadpool.h>
+#include <algorithm>
+
+namespace {
+
+const quint32 CacheMagic = 0x50594958; /* "PYIX" */
+
+/* Parses the files of a batch on one pool thread, taking the next unclaimed file until none are left */
+class ParseTask : public QRunnable {
+public:
+    ParseTask(const QStringList &paths, std::vector<ProjectScanner::Parsed> &results, QAtomicInt &next, const QThread *scanner) :
+        paths(paths),
+        results(results),
+        next(next),
+        scanner(scanner) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        for (int i = next.fetchAndAddRelaxed(1); i < paths.size(); i = next.fetchAndAddRelaxed(1)) {
+            if (scanner->isInterruptionRequested()) {
+                return;
+            }
+            results[i] = ProjectScanner::parse(paths.at(i));
+        }
+    }
+
+private:
+    const QStringList &paths;
+    std::vector<ProjectScanner::Parsed> &results;
+    QAtomicInt &next;
+    const QThread *scanner;
+};
+
+/* Reads the candidate files of one usage search, giving up as soon as a newer search starts */
+class UsageTask : public QRunnable {
+public:
+    UsageTask(ProjectIndex *index, const QString &name, const QStringList &candidates, const QAtomicInt &search, int id) :
+        index(index),
+        name(name),
+        candidates(candidates),
+        search(search),
+        id(id) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        QList<ProjectIndex::Location> found;
+        std::vector<PythonLexer::Token> tokens;
+        for (int i = 0; i < candidates.size(); ++i) {
+            if (search.loadAcquire() != id) {
+                return;
+            }
+            QFile file(candidates.at(i));
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            const QStringList lines = QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'));
+            int state = PythonLexer::StateNormal;
+            for (int j = 0; j < lines.size(); ++j) {
+                const QString &line = lines.at(j);
+                tokens.clear();
+                state = PythonLexer::tokenize(line.utf16(), line.length(), state, tokens);
+                for (size_t k = 0; k < tokens.size(); ++k) {
+                    const PythonLexer::Token &token = tokens[k];
+                    if ((token.kind == PythonLexer::Identifier || token.kind == PythonLexer::DefClass)
+                        && QStringRef(&line, token.start, token.length) == name) {
+                        ProjectIndex::Location location;
+                        location.path = candidates.at(i);
+                        location.line = j;
+                        location.kind = PythonSymbols::Variable;
+                        location.detail = line.trimmed();
+                        found.append(location);
+                        break;
+                    }
+                }
+            }
+        }
+        if (search.loadAcquire() == id) {
+            Q_EMIT index->usagesFound(name, found);
+        }
+    }
+
+private:
+    ProjectIndex *index;
+    const QString name;
+    const QStringList candidates;
+    const QAtomicInt &search;
+    const int id;
+};
+
+bool isPythonFile(const QString &path) {
+    return path.endsWith(QLatin1String(".py"));
+}
+
+/* Version control, caches and installed packages are never part of the project's own code */
+bool isSkippedDirectory(const QString &path, const QString &name) {
+    static const QSet<QString> skipped = QSet<QString>()
+        << ".git" << ".hg" << ".svn" << "__pycache__" << "node_modules" << "site-packages"
+        << ".tox" << ".mypy_cache" << ".pytest_cache" << "venv" << ".venv";
+    return skipped.contains(name) || QFileInfo::exists(path + QLatin1String("/pyvenv.cfg"));
+}
+
+/* The file lists of a name stay sorted, so a file is linked and unlinked with a binary search */
+void insertSorted(QVector<int> &fileList, int id) {
+    QVector<int>::iterator it = std::lower_bound(fileList.begin(), fileList.end(), id);
+    if (it == fileList.end() || *it != id) {
+        fileList.insert(it, id);
+    }
+}
+
+void removeSorted(QVector<int> &fileList, int id) {
+    QVector<int>::iterator it = std::lower_bound(fileList.begin(), fileList.end(), id);
+    if (it != fileList.end() && *it == id) {
+        fileList.erase(it);
+    }
+}
+
+}
+
+ProjectScanner::ProjectScanner(ProjectIndex *index, const QString &root, bool loadCache, const QStringList &paths) :
+    index(index),
+    root(root),
+    loadCache(loadCache),
+    paths(paths) {
+}
+
+ProjectScanner::~ProjectScanner() {
+    requestInterruption();
+    wait();
+}
+
+ProjectScanner::Parsed ProjectScanner::parse(const QString &path) {
+    Parsed parsed;
+    parsed.path = path;
+
+    QFileInfo info(path);
+    QFile file(path);
+    if (!info.isFile() || !file.open(QIODevice::ReadOnly)) {
+        return parsed;
+    }
+    parsed.exists = true;
+    parsed.modified = info.lastModified().toMSecsSinceEpoch();
+    parsed.size = info.size();
+
+    /* Generated monsters are listed but not worth their parse */
+    if (parsed.size > MaxFileSize) {
+        return parsed;
+    }
+
+    const QString text = QString::fromUtf8(file.readAll());
+    const QStringList lines = text.split(QLatin1Char('\n'));
+
+    const QVector<PythonSymbols::Symbol> symbols = PythonSymbols::parse(lines);
+    for (int i = 0; i < symbols.size(); ++i) {
+        if (symbols.at(i).parent < 0) {
+            parsed.symbols.append(symbols.at(i));
+        }
+    }
+
+    QSet<QString> names;
+    std::vector<PythonLexer::Token> tokens;
+    int state = PythonLexer::StateNormal;
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString &line = lines.at(i);
+        tokens.clear();
+        state = PythonLexer::tokenize(line.utf16(), line.length(), state, tokens);
+        for (size_t j = 0; j < tokens.size(); ++j) {
+            if (tokens[j].kind == PythonLexer::Identifier || tokens[j].kind == PythonLexer::DefClass) {
+                names.insert(line.mid(tokens[j].start, tokens[j].length));
+            }
+        }
+    }
+    parsed.names = names.toList();
+    return parsed;
+}
+
+void ProjectScanner::run() {
+    if (loadCache && index->load(root)) {
+        Q_EMIT merged();
+    }
+
+    /* What is on disk below the requested paths, and which indexed files have gone */
+    QStringList found;
+    QSet<QString> seen;
+    QStringList scanned;
+    QStringList removed;
+    const QStringList targets = paths.isEmpty() ? QStringList(root) : paths;
+    for (int i = 0; i < targets.size() && !isInterruptionRequested(); ++i) {
+        const QString &target = targets.at(i);
+        QFileInfo info(target);
+        if (info.isDir()) {
+            scanned.append(target + QLatin1Char('/'));
+            directories.append(target);
+            /* Walked by hand so skipped directories are never entered */
+            QStringList pending(target);
+            while (!pending.isEmpty() && !isInterruptionRequested()) {
+                QDirIterator it(pending.takeLast(), QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+                while (it.hasNext()) {
+                    const QString path = it.next();
+                    if (it.fileInfo().isDir()) {
+                        if (!it.fileInfo().isSymLink() && !isSkippedDirectory(path, it.fileName())) {
+                            directories.append(path);
+                            pending.append(path);
+                        }
+                    } else if (isPythonFile(path) && !seen.contains(path)) {
+                        seen.insert(path);
+                        found.append(path);
+                    }
+                }
+            }
+        } else if (info.isFile() && isPythonFile(target)) {
+            if (!seen.contains(target)) {
+                seen.insert(target);
+                found.append(target);
+            }
+        } else {
+            removed.append(target);
+        }
+    }
+    if (isInterruptionRequested()) {
+        return;
+    }
+
+    QStringList stale;
+    {
+        QReadLocker locker(&index->lock);
+        for (int i = 0; i < index->files.size(); ++i) {
+            const QString &path = index->files.at(i).path;
+            if (path.isEmpty() || seen.contains(path)) {
+                continue;
+            }
+            for (int j = 0; j < scanned.size(); ++j) {
+                if (path.startsWith(scanned.at(j))) {
+                    removed.append(path);
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < found.size(); ++i) {
+            const int id = index->fileIds.value(found.at(i), -1);
+            if (id < 0) {
+                stale.append(found.at(i));
+                continue;
+            }
+            QFileInfo info(found.at(i));
+            const ProjectIndex::File &file = index->files.at(id);
+            if (file.modified != info.lastModified().toMSecsSinceEpoch() || file.size != info.size()) {
+                stale.append(found.at(i));
+            }
+        }
+    }
+
+    bool changed = false;
+    {
+        QWriteLocker locker(&index->lock);
+        for (int i = 0; i < removed.size(); ++i) {
+            const int id = index->fileIds.value(removed.at(i), -1);
+            if (id >= 0) {
+                index->removeFile(id);
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        Q_EMIT merged();
+    }
+
+    /* Parse in batches on every core, merging each batch as soon as it is done */
+    QThreadPool pool;
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+    for (int first = 0; first < stale.size() && !isInterruptionRequested(); first += BatchSize) {
+        const QStringList batch = stale.mid(first, BatchSize);
+        std::vector<Parsed> results(batch.size());
+        QAtomicInt next(0);
+        for (int i = 0; i < pool.maxThreadCount(); ++i) {
+            pool.start(new ParseTask(batch, results, next, this));
+        }
+        pool.waitForDone();
+        if (isInterruptionRequested()) {
+            break;
+        }
+
+        QWriteLocker locker(&index->lock);
+        for (size_t i = 0; i < results.size(); ++i) {
+            index->storeFile(results[i]);
+        }
+        locker.unlock();
+        changed = true;
+        Q_EMIT merged();
+    }
+
+    if (changed && !isInterruptionRequested()) {
+        index->save(root);
+    }
+}
+
+ProjectIndex::ProjectIndex(QObject *parent) :
+    QObject(parent) {
+
+    qRegisterMetaType<QList<ProjectIndex::Location> >("QList<ProjectIndex::Location>");
+    usagePool.setMaxThreadCount(1);
+    watcher = new QFileSystemWatcher(this);
+    refreshTimer = new QTimer(this);
+    refreshTimer->setSingleShot(true);
+    refreshTimer->setInterval(RefreshDelay);
+
+    connect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(startScan()));
+}
+
+ProjectIndex::~ProjectIndex() {
+    usageSearch.fetchAndAddRelaxed(1);
+    usagePool.waitForDone();
+    stopScanner();
+}
+
+QString ProjectIndex::root() const {
+    return rootPath;
+}
+
+void ProjectIndex::setRoot(const QString &directory) {
+    QString path = QFileInfo(directory).canonicalFilePath();
+    if (path.isEmpty() || path == rootPath) {
+        return;
+    }
+
+    stopScanner();
+    refreshTimer->stop();
+    pendingPaths.clear();
+    if (!watcher->directories().isEmpty()) {
+        watcher->removePaths(watcher->directories());
+    }
+
+    QWriteLocker locker(&lock);
+    clear();
+    rootPath = path;
+    locker.unlock();
+
+    cacheLoaded = false;
+    Q_EMIT updated();
+    startScan();
+}
+
+void ProjectIndex::refresh(const QString &filePath) {
+    if (rootPath.isEmpty() || !isPythonFile(filePath) || !filePath.startsWith(rootPath + QLatin1Char('/'))) {
+        return;
+    }
+    pendingPaths.insert(filePath);
+    refreshTimer->start();
+}
+
+QList<ProjectIndex::Location> ProjectIndex::definitions(const QString &name) const {
+    QList<Location> found;
+    QReadLocker locker(&lock);
+    const int id = nameIds.value(name, -1);
+    if (id < 0) {
+        return found;
+    }
+    const QVector<int> &fileList = definedIn.at(id);
+    for (int i = 0; i < fileList.size(); ++i) {
+        const File &file = files.at(fileList.at(i));
+        for (int j = 0; j < file.definitions.size(); ++j) {
+            const Definition &definition = file.definitions.at(j);
+            if (definition.name == id) {
+                Location location;
+                location.path = file.path;
+                location.line = definition.line;
+                location.kind = definition.kind;
+                location.detail = definition.detail;
+                found.append(location);
+            }
+        }
+    }
+    return found;
+}
+
+QStringList ProjectIndex::filesUsing(const QString &name) const {
+    QStringList found;
+    QReadLocker locker(&lock);
+    const int id = nameIds.value(name, -1);
+    if (id < 0) {
+        return found;
+    }
+    const QVector<int> &fileList = usedIn.at(id);
+    for (int i = 0; i < fileList.size(); ++i) {
+        found.append(files.at(fileList.at(i)).path);
+    }
+    found.sort();
+    return found;
+}
+
+QHash<QString, int> ProjectIndex::identifiers() const {
+    QHash<QString, int> found;
+    QReadLocker locker(&lock);
+    found.reserve(names.size());
+    for (int i = 0; i < names.size(); ++i) {
+        if (!usedIn.at(i).isEmpty()) {
+            found.insert(names.at(i), usedIn.at(i).size());
+        }
+    }
+    return found;
+}
+
+void ProjectIndex::findUsages(const QString &name) {
+    const QStringList candidates = filesUsing(name).mid(0, MaxUsageFiles);
+    usagePool.start(new UsageTask(this, name, candidates, usageSearch, usageSearch.fetchAndAddRelaxed(1) + 1));
+}
+
+int ProjectIndex::internName(const QString &name) {
+    QHash<QString, int>::const_iterator it = nameIds.constFind(name);
+    if (it != nameIds.constEnd()) {
+        return *it;
+    }
+    const int id = names.size();
+    names.append(name);
+    nameIds.insert(name, id);
+    definedIn.append(QVector<int>());
+    usedIn.append(QVector<int>());
+    return id;
+}
+
+void ProjectIndex::unlinkFile(int id) {
+    const File &file = files.at(id);
+    for (int i = 0; i < file.names.size(); ++i) {
+        removeSorted(usedIn[file.names.at(i)], id);
+    }
+    for (int i = 0; i < file.definitions.size(); ++i) {
+        removeSorted(definedIn[file.definitions.at(i).name], id);
+    }
+}
+
+void ProjectIndex::linkFile(int id) {
+    const File &file = files.at(id);
+    for (int i = 0; i < file.names.size(); ++i) {
+        insertSorted(usedIn[file.names.at(i)], id);
+    }
+    for (int i = 0; i < file.definitions.size(); ++i) {
+        insertSorted(definedIn[file.definitions.at(i).name], id);
+    }
+}
+
+void ProjectIndex::removeFile(int id) {
+    unlinkFile(id);
+    fileIds.remove(files.at(id).path);
+    files[id] = File();
+    freeFiles.append(id);
+}
+
+void ProjectIndex::storeFile(const ProjectScanner::Parsed &parsed) {
+    int id = fileIds.value(parsed.path, -1);
+    if (!parsed.exists) {
+        if (id >= 0) {
+            removeFile(id);
+        }
+        return;
+    }
+
+    if (id >= 0) {
+        unlinkFile(id);
+    } else if (!freeFiles.isEmpty()) {
+        id = freeFiles.takeLast();
+        fileIds.insert(parsed.path, id);
+    } else {
+        id = files.size();
+        files.append(File());
+        fileIds.insert(parsed.path, id);
+    }
+
+    File &file = files[id];
+    file.path = parsed.path;
+    file.modified = parsed.modified;
+    file.size = parsed.size;
+    file.names.clear();
+    file.definitions.clear();
+    for (int i = 0; i < parsed.names.size(); ++i) {
+        file.names.append(internName(parsed.names.at(i)));
+    }
+    std::sort(file.names.begin(), file.names.end());
+
+    /* Definitions stay sorted by name, as in the cache */
+    for (int i = 0; i < parsed.symbols.size(); ++i) {
+        const PythonSymbols::Symbol &symbol = parsed.symbols.at(i);
+        Definition definition;
+        definition.name = internName(symbol.name);
+        definition.line = symbol.line;
+        definition.kind = symbol.kind;
+        definition.detail = symbol.detail;
+        file.definitions.append(definition);
+    }
+    std::stable_sort(file.definitions.begin(), file.definitions.end(), [](const Definition &a, const Definition &b) {
+        return a.name < b.name;
+    });
+
+    linkFile(id);
+}
+
+void ProjectIndex::clear() {
+    files.clear();
+    freeFiles.clear();
+    fileIds.clear();
+    names.clear();
+    nameIds.clear();
+    definedIn.clear();
+    usedIn.clear();
+}
+
+QString ProjectIndex::cachePath(const QString &root) {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/index/"
+        + QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Md5).toHex() + ".idx";
+}
+
+/* Reads the index saved for 'root' and replaces the current one with it */
+bool ProjectIndex::load(const QString &root) {
+    QFile file(cachePath(root));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    QString savedRoot;
+    in >> magic >> version >> savedRoot;
+    if (magic != CacheMagic || version != CacheVersion || savedRoot != root) {
+        return false;
+    }
+
+    QStringList savedNames;
+    quint32 fileCount;
+    in >> savedNames >> fileCount;
+    QVector<File> savedFiles;
+    for (quint32 i = 0; i < fileCount && in.status() == QDataStream::Ok; ++i) {
+        File saved;
+        quint32 definitionCount;
+        in >> saved.path >> saved.modified >> saved.size >> saved.names >> definitionCount;
+        for (quint32 j = 0; j < definitionCount && in.status() == QDataStream::Ok; ++j) {
+            Definition definition;
+            qint32 name, line, kind;
+            in >> name >> line >> kind >> definition.detail;
+            definition.name = name;
+            definition.line = line;
+            definition.kind = PythonSymbols::Kind(kind);
+            saved.definitions.append(definition);
+        }
+        savedFiles.append(saved);
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    /* Never trust ids from disk */
+    for (int i = 0; i < savedFiles.size(); ++i) {
+        const File &saved = savedFiles.at(i);
+        for (int j = 0; j < saved.names.size(); ++j) {
+            if (saved.names.at(j) < 0 || saved.names.at(j) >= savedNames.size()) {
+                return false;
+            }
+        }
+        for (int j = 0; j < saved.definitions.size(); ++j) {
+            if (saved.definitions.at(j).name < 0 || saved.definitions.at(j).name >= savedNames.size()) {
+                return false;
+            }
+        }
+    }
+
+    QWriteLocker locker(&lock);
+    clear();
+    names = savedNames;
+    for (int i = 0; i < names.size(); ++i) {
+        nameIds.insert(names.at(i), i);
+    }
+    definedIn.resize(names.size());
+    usedIn.resize(names.size());
+    files = savedFiles;
+    for (int i = 0; i < files.size(); ++i) {
+        fileIds.insert(files.at(i).path, i);
+        linkFile(i);
+    }
+    return true;
+}
+
+bool ProjectIndex::save(const QString &root) const {
+    const QString path = cachePath(root);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    QReadLocker locker(&lock);
+    out << CacheMagic << quint32(CacheVersion) << root << names << quint32(fileIds.size());
+    for (int i = 0; i < files.size(); ++i) {
+        const File &saved = files.at(i);
+        if (saved.path.isEmpty()) {
+            continue;
+        }
+        out << saved.path << saved.modified << saved.size << saved.names << quint32(saved.definitions.size());
+        for (int j = 0; j < saved.definitions.size(); ++j) {
+            const Definition &definition = saved.definitions.at(j);
+            out << qint32(definition.name) << qint32(definition.line) << qint32(definition.kind) << definition.detail;
+        }
+    }
+    locker.unlock();
+
+    return file.commit();
+}
+
+void ProjectIndex::stopScanner() {
+    if (scanner) {
+        disconnect(scanner, 0, this, 0);
+        delete scanner;
+        scanner = nullptr;
+    }
+}
+
+void ProjectIndex::startScan() {
+    if (rootPath.isEmpty()) {
+        return;
+    }
+    /* One scan at a time; whatever comes in meanwhile is picked up afterwards */
+    if (scanner) {
+        refreshTimer->start();
+        return;
+    }
+
+    const bool full = !cacheLoaded;
+    scanner = new ProjectScanner(this, rootPath, full, full ? QStringList() : pendingPaths.toList());
+    pendingPaths.clear();
+    cacheLoaded = true;
+
+    connect(scanner, SIGNAL(merged()), this, SIGNAL(updated()));
+    connect(scanner, SIGNAL(finished()), this, SLOT(scanFinished()));
+    scanner->start(QThread::LowPriority);
+}
+
+void ProjectIndex::scanFinished() {
+    QStringList added;
+    const QSet<QString> watched = watcher->directories().toSet();
+    for (int i = 0; i < scanner->directories.size(); ++i) {
+        if (!watched.contains(scanner->directories.at(i))) {
+            added.append(scanner->directories.at(i));
+        }
+    }
+    if (!added.isEmpty()) {
+        watcher->addPaths(added);
+    }
+
+    scanner->deleteLater();
+    scanner = nullptr;
+    if (!pendingPaths.isEmpty()) {
+        refreshTimer->start();
+    }
+}
+
+/* Something was added, removed or renamed; only files that really changed get parsed again */
+void ProjectIndex::directoryChanged(const QString &path) {
+    pendingPaths.insert(path);
+    refreshTimer->start();
+}
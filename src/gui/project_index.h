@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PROJECT_INDEX_H
+#define PROJECT_INDEX_H
+
+#include "src/python/python_symbols.h"
+#include <qatomic.h>
+#include <qfilesystemwatcher.h>
+#include <qhash.h>
+#include <qreadwritelock.h>
+#include <qset.h>
+#include <qstringlist.h>
+#include <qthread.h>
+#include <qthreadpool.h>
+#include <qtimer.h>
+#include <qvector.h>
+
+class ProjectIndex;
+
+/* One pass over the project: finds stale files, parses them on every core and merges the results */
+class ProjectScanner : public QThread {
+    Q_OBJECT
+
+public:
+    /* A file as found on disk, names not interned yet */
+    struct Parsed {
+        QString path;
+        qint64 modified = -1;
+        qint64 size = -1;
+        bool exists = false;
+        QVector<PythonSymbols::Symbol> symbols; /* Top-level only */
+        QStringList names;
+    };
+
+    ProjectScanner(ProjectIndex *index, const QString &root, bool loadCache, const QStringList &paths);
+    ~ProjectScanner();
+
+    /* Reads and parses one file; safe to call from any thread */
+    static Parsed parse(const QString &path);
+
+    /* Every directory seen, for the file watcher */
+    QStringList directories;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    enum { BatchSize = 512, MaxFileSize = 4 * 1024 * 1024 };
+
+    ProjectIndex *index;
+    const QString root;
+    const bool loadCache;
+    const QStringList paths; /* Files and directories to check, or empty for the whole tree */
+
+Q_SIGNALS:
+    void merged();
+};
+
+/*
+* Persistent index of the top-level symbols and the identifiers used in every
+* .py file below a project root.
+*
+* The index is written to AppDataLocation after every change, keyed by the
+* files' paths, modification times and sizes, so the next start loads it and
+* only parses what changed in between. Scans run on a ProjectScanner thread
+* and parse on all cores; afterwards the watched directories and saved files
+* trigger scans of just the affected paths. Queries take a read lock and only
+* touch the inverted indices, so they answer in milliseconds no matter how
+* large the tree is.
+*/
+class ProjectIndex : public QObject {
+    Q_OBJECT
+
+public:
+    struct Location {
+        QString path;
+        int line;
+        PythonSymbols::Kind kind;
+        QString detail;
+    };
+
+    ProjectIndex(QObject *parent = 0);
+    ~ProjectIndex();
+
+    QString root() const;
+    void setRoot(const QString &directory);
+
+    /* Re-indexes a file soon, e.g. after it has been saved */
+    void refresh(const QString &filePath);
+
+    QList<Location> definitions(const QString &name) const;
+    QStringList filesUsing(const QString &name) const;
+
+    /* Every identifier used in the project, with the number of files using it */
+    QHash<QString, int> identifiers() const;
+
+    /*
+    * Looks for every line that uses 'name' as a word in the files the index
+    * points at. The files are read on a pool thread and usagesFound() brings
+    * the lines; a newer search cancels the one still running.
+    */
+    void findUsages(const QString &name);
+
+Q_SIGNALS:
+    void updated();
+    void usagesFound(const QString &name, const QList<ProjectIndex::Location> &found);
+
+private:
+    friend class ProjectScanner;
+
+    enum { CacheVersion = 1, RefreshDelay = 500, MaxUsageFiles = 500 };
+
+    struct Definition {
+        int name;
+        int line;
+        PythonSymbols::Kind kind;
+        QString detail;
+    };
+
+    struct File {
+        QString path;
+        qint64 modified = -1;
+        qint64 size = -1;
+        QVector<Definition> definitions;
+        QVector<int> names; /* Sorted ids of every identifier in the file */
+    };
+
+    mutable QReadWriteLock lock;
+    QString rootPath;
+    QVector<File> files;
+    QVector<int> freeFiles;
+    QHash<QString, int> fileIds;
+    QStringList names;
+    QHash<QString, int> nameIds;
+    QVector<QVector<int> > definedIn; /* Sorted file ids by name id */
+    QVector<QVector<int> > usedIn;
+
+    ProjectScanner *scanner = nullptr;
+    QFileSystemWatcher *watcher;
+    QTimer *refreshTimer;
+    QSet<QString> pendingPaths;
+    bool cacheLoaded = false;
+    QThreadPool usagePool;
+    QAtomicInt usageSearch;
+
+    /* All of these expect the write lock to be held */
+    int internName(const QString &name);
+    void linkFile(int id);
+    void unlinkFile(int id);
+    void removeFile(int id);
+    void storeFile(const ProjectScanner::Parsed &parsed);
+    void clear();
+
+    bool load(const QString &root);
+    bool save(const QString &root) const;
+    static QString cachePath(const QString &root);
+    void stopScanner();
+
+private Q_SLOTS:
+    void startScan();
+    void scanFinished();
+    void directoryChanged(const QString &path);
+};
+
+Q_DECLARE_METATYPE(ProjectIndex::Location)
+
+#endif // PROJECT_INDEX_H
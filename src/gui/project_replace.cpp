@@ -0,0 +1,275 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "project_replace.h"
+#include "literal_finder.h"
+#include <qatomic.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qrunnable.h>
+#include <qsavefile.h>
+#include <qthread.h>
+#include <qthreadpool.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+enum { BinaryProbe = 8192 };
+
+/* Each pool thread takes the next index until all are done */
+class IndexedTask : public QRunnable {
+public:
+    IndexedTask(QAtomicInt &next, int count) :
+        next(next),
+        count(count) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        for (int i = next.fetchAndAddRelaxed(1); i < count; i = next.fetchAndAddRelaxed(1)) {
+            process(i);
+        }
+    }
+
+protected:
+    virtual void process(int index) = 0;
+
+private:
+    QAtomicInt &next;
+    const int count;
+};
+
+class ComputeTask : public IndexedTask {
+public:
+    ComputeTask(QAtomicInt &next, const QStringList &paths, const QHash<QString, QString> &buffers,
+                const LineMatcher &matcher, const LiteralFinder &finder, const QString &after,
+                std::vector<FileChange> &changes) :
+        IndexedTask(next, paths.size()),
+        paths(paths),
+        buffers(buffers),
+        matcher(matcher),
+        finder(finder),
+        after(after),
+        changes(changes) {
+    }
+
+protected:
+    void process(int index) Q_DECL_OVERRIDE {
+        FileChange &change = changes[index];
+        const QFileInfo info(paths.at(index));
+        change.path = info.absoluteFilePath();
+        change.modified = info.lastModified();
+        change.size = info.size();
+
+        QHash<QString, QString>::const_iterator buffer = buffers.find(info.canonicalFilePath());
+        if (buffer != buffers.end()) {
+            change.fromBuffer = true;
+            computeBuffer(change, buffer.value());
+        } else {
+            computeFile(change);
+        }
+    }
+
+private:
+    const QStringList &paths;
+    const QHash<QString, QString> &buffers;
+    const LineMatcher &matcher;
+    const LiteralFinder &finder;
+    const QString &after;
+    std::vector<FileChange> &changes;
+
+    void replaceLine(FileChange &change, int line, const QString &text) {
+        LineChange edit;
+        edit.line = line;
+        edit.before = text;
+        edit.after = text;
+        const int count = matcher.replaceIn(edit.after, after);
+        if (count > 0) {
+            change.replacements += count;
+            change.lines.append(edit);
+        }
+    }
+
+    void computeBuffer(FileChange &change, const QString &text) {
+        const QString literal = matcher.requiredLiteral();
+        const Qt::CaseSensitivity cs = matcher.flags() & LineMatcher::CaseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+        int line = 0;
+        int start = 0;
+        while (start <= text.length()) {
+            int end = text.indexOf(QLatin1Char('\n'), start);
+            if (end < 0) {
+                end = text.length();
+            }
+            const QStringRef candidate = text.midRef(start, end - start);
+            if (literal.isEmpty() || candidate.contains(literal, cs)) {
+                replaceLine(change, line, candidate.toString());
+            }
+            start = end + 1;
+            ++line;
+        }
+    }
+
+    /* Copies the bytes between replaced lines as they are */
+    void computeFile(FileChange &change) {
+        QFile file(change.path);
+        if (change.size <= 0 || !file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        uchar *mapped = file.map(0, change.size);
+        if (!mapped) {
+            return;
+        }
+        const char *data = reinterpret_cast<const char*>(mapped);
+        const qint64 size = change.size;
+        if (std::memchr(data, 0, (size_t)qMin<qint64>(size, BinaryProbe))) {
+            file.unmap(mapped);
+            return;
+        }
+
+        QByteArray contents;
+        const bool prefilter = finder.isUsable();
+        int line = 0;
+        qint64 counted = 0;
+        qint64 copied = 0;
+        qint64 pos = 0;
+        while (pos < size) {
+            qint64 lineStart = pos;
+            if (prefilter) {
+                const qint64 candidate = finder.find(data, size, pos);
+                if (candidate < 0) {
+                    break;
+                }
+                lineStart = candidate;
+                while (lineStart > pos && data[lineStart - 1] != '\n') {
+                    --lineStart;
+                }
+            }
+            const void *newline = std::memchr(data + lineStart, '\n', (size_t)(size - lineStart));
+            const qint64 lineEnd = newline ? static_cast<const char*>(newline) - data : size;
+            line += (int)std::count(data + counted, data + lineStart, '\n');
+            counted = lineStart;
+
+            qint64 textEnd = lineEnd;
+            if (textEnd > lineStart && data[textEnd - 1] == '\r') {
+                --textEnd;
+            }
+            const QByteArray raw = QByteArray::fromRawData(data + lineStart, (int)(textEnd - lineStart));
+            const QString text = QString::fromUtf8(raw);
+
+            /* A line that does not survive decoding would be mangled by writing it back */
+            const int before = change.lines.size();
+            if (text.toUtf8() == raw) {
+                replaceLine(change, line, text);
+            }
+            if (change.lines.size() > before) {
+                if (contents.isEmpty()) {
+                    contents.reserve((int)(size + size / 8));
+                }
+                contents.append(data + copied, (int)(lineStart - copied));
+                contents.append(change.lines.last().after.toUtf8());
+                copied = textEnd;
+            }
+            pos = lineEnd + 1;
+        }
+
+        if (change.replacements > 0) {
+            contents.append(data + copied, (int)(size - copied));
+            change.contents = contents;
+        }
+        file.unmap(mapped);
+    }
+};
+
+class WriteTask : public IndexedTask {
+public:
+    WriteTask(QAtomicInt &next, const QVector<FileChange> &changes, std::vector<QString> &errors) :
+        IndexedTask(next, changes.size()),
+        changes(changes),
+        errors(errors) {
+    }
+
+protected:
+    void process(int index) Q_DECL_OVERRIDE {
+        const FileChange &change = changes.at(index);
+        if (change.fromBuffer || change.replacements == 0) {
+            return;
+        }
+        QString error = ProjectReplace::check(change);
+        if (error.isEmpty()) {
+            QSaveFile file(change.path);
+            if (!file.open(QIODevice::WriteOnly) || file.write(change.contents) != change.contents.size() || !file.commit()) {
+                error = file.errorString();
+            }
+        }
+        errors[index] = error;
+    }
+
+private:
+    const QVector<FileChange> &changes;
+    std::vector<QString> &errors;
+};
+
+}
+
+ProjectReplace::ProjectReplace(const LineMatcher &matcher, const QString &after) :
+    matcher(matcher),
+    after(after) {
+}
+
+QVector<FileChange> ProjectReplace::compute(const QStringList &paths, const QHash<QString, QString> &buffers) const {
+    QVector<FileChange> result;
+    if (matcher.isEmpty() || !matcher.isValid()) {
+        return result;
+    }
+
+    const LiteralFinder finder(matcher.requiredLiteral().toUtf8(), matcher.flags() & LineMatcher::CaseSensitive);
+    std::vector<FileChange> changes(paths.size());
+    QAtomicInt next;
+    QThreadPool pool;
+    const int threads = qMax(1, qMin(QThread::idealThreadCount(), paths.size()));
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new ComputeTask(next, paths, buffers, matcher, finder, after, changes));
+    }
+    pool.waitForDone();
+
+    for (size_t i = 0; i < changes.size(); ++i) {
+        if (changes[i].replacements > 0) {
+            result.append(changes[i]);
+        }
+    }
+    return result;
+}
+
+QStringList ProjectReplace::write(const QVector<FileChange> &changes) {
+    std::vector<QString> errors(changes.size());
+    QAtomicInt next;
+    QThreadPool pool;
+    const int threads = qMax(1, qMin(QThread::idealThreadCount(), changes.size()));
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new WriteTask(next, changes, errors));
+    }
+    pool.waitForDone();
+
+    QStringList result;
+    for (size_t i = 0; i < errors.size(); ++i) {
+        result << errors[i];
+    }
+    return result;
+}
+
+QString ProjectReplace::check(const FileChange &change) {
+    const QFileInfo info(change.path);
+    if (!info.exists()) {
+        return "deleted since the preview";
+    }
+    if (info.lastModified() != change.modified || info.size() != change.size) {
+        return "changed on disk since the preview";
+    }
+    if (!info.isWritable()) {
+        return "not writable";
+    }
+    return QString();
+}
@@ -0,0 +1,57 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PROJECT_REPLACE_H
+#define PROJECT_REPLACE_H
+
+#include "editor/code_editor_search.h"
+#include <qdatetime.h>
+#include <qhash.h>
+#include <qstringlist.h>
+#include <qvector.h>
+
+struct LineChange {
+    int line = 0;   /* Zero-based */
+    QString before;
+    QString after;
+};
+
+struct FileChange {
+    QString path;
+    QDateTime modified;     /* Of the file the change was worked out from */
+    qint64 size = 0;
+    bool fromBuffer = false;
+    int replacements = 0;
+    QVector<LineChange> lines;
+    QByteArray contents;    /* New contents of a file that is not open */
+};
+
+/*
+* Replaces a pattern in many files at once.
+*
+* The changes are worked out on all cores, from the text of the editor for
+* files that are open and from the disk for the rest, without touching
+* anything, so they can be previewed. Lines that are not replaced keep their
+* bytes, line endings included. Writing replaces each file atomically.
+*/
+class ProjectReplace {
+public:
+    ProjectReplace(const LineMatcher &matcher, const QString &after);
+
+    /* Changes to 'paths'; 'buffers' maps the canonical path of every open file to its text */
+    QVector<FileChange> compute(const QStringList &paths, const QHash<QString, QString> &buffers) const;
+
+    /* Writes the contents of changes to files that are not open, returning an error per change or an empty string */
+    static QStringList write(const QVector<FileChange> &changes);
+
+    /* Why the file of 'change' may not be written now, or an empty string */
+    static QString check(const FileChange &change);
+
+private:
+    const LineMatcher matcher;
+    const QString after;
+};
+
+#endif // PROJECT_REPLACE_H
@@ -0,0 +1,344 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "project_search.h"
+#include "literal_finder.h"
+#include <qdir.h>
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qmutex.h>
+#include <qrunnable.h>
+#include <qthreadpool.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace {
+
+enum {
+    MaxHits = 100000,
+    MaxFileSize = 64 * 1024 * 1024,
+    BinaryProbe = 8192,
+    MaxLineText = 400,
+    IdleWait = 200
+};
+
+/* Wildcard match with * and ? only, as in .gitignore names */
+bool globMatch(const QChar *p, const QChar *pe, const QChar *s, const QChar *se) {
+    const QChar *star = 0;
+    const QChar *mark = 0;
+    while (s < se) {
+        if (p < pe && (*p == QLatin1Char('?') || *p == *s)) {
+            ++p;
+            ++s;
+        } else if (p < pe && *p == QLatin1Char('*')) {
+            star = p++;
+            mark = s;
+        } else if (star) {
+            p = star + 1;
+            s = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pe && *p == QLatin1Char('*')) {
+        ++p;
+    }
+    return p == pe;
+}
+
+struct IgnoreRule {
+    QString glob;
+    bool directoryOnly;
+    bool anchored;      /* Matched against the path below the root instead of the name */
+};
+
+struct DirectoryStack {
+    QMutex mutex;
+    std::deque<QString> directories;
+};
+
+struct SearchState {
+    SearchState(int threads, const QString &root, const LineMatcher &matcher, const QThread *owner) :
+        stacks(threads),
+        root(root),
+        matcher(matcher),
+        finder(matcher.requiredLiteral().toUtf8(), matcher.flags() & LineMatcher::CaseSensitive),
+        owner(owner) {
+    }
+
+    std::vector<DirectoryStack> stacks;
+    const QString root;
+    const LineMatcher &matcher;
+    const LiteralFinder finder;
+    QVector<IgnoreRule> rules;
+    const QThread *owner;
+
+    QAtomicInt pending;  /* Directories queued or being listed */
+    QAtomicInt hits;
+    QAtomicInt *files = nullptr;
+    QAtomicInt *limited = nullptr;
+
+    QMutex resultsMutex;
+    QVector<SearchHit> results;
+
+    bool stopped() const {
+        return owner->isInterruptionRequested() || limited->load();
+    }
+
+    bool isIgnored(const QString &relative, const QString &name, bool isDirectory) const {
+        for (int i = 0; i < rules.size(); ++i) {
+            const IgnoreRule &rule = rules.at(i);
+            if (rule.directoryOnly && !isDirectory) {
+                continue;
+            }
+            const QString &subject = rule.anchored ? relative : name;
+            if (globMatch(rule.glob.constData(), rule.glob.constData() + rule.glob.length(),
+                          subject.constData(), subject.constData() + subject.length())) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/* One pool thread: lists directories from its own stack, or steals one, and searches the files in them */
+class Walker : public QRunnable {
+public:
+    Walker(SearchState &state, int self) :
+        state(state),
+        self(self) {
+    }
+
+    void run() Q_DECL_OVERRIDE {
+        QString directory;
+        while (!state.stopped()) {
+            if (!take(directory)) {
+                if (state.pending.load() == 0) {
+                    return;
+                }
+                QThread::usleep(IdleWait);
+                continue;
+            }
+            list(directory);
+            state.pending.deref();
+        }
+    }
+
+private:
+    SearchState &state;
+    const int self;
+
+    /* Newest from the own stack keeps the caches warm, oldest from another one steals the biggest piece */
+    bool take(QString &directory) {
+        const int count = (int)state.stacks.size();
+        for (int k = 0; k < count; ++k) {
+            DirectoryStack &stack = state.stacks[(self + k) % count];
+            QMutexLocker locker(&stack.mutex);
+            if (stack.directories.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                directory = stack.directories.back();
+                stack.directories.pop_back();
+            } else {
+                directory = stack.directories.front();
+                stack.directories.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void push(const QString &directory) {
+        state.pending.ref();
+        DirectoryStack &stack = state.stacks[self];
+        QMutexLocker locker(&stack.mutex);
+        stack.directories.push_back(directory);
+    }
+
+    void list(const QString &directory) {
+        const QFileInfoList entries = QDir(directory).entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot, QDir::NoSort);
+        for (int i = 0; i < entries.size() && !state.stopped(); ++i) {
+            const QFileInfo &info = entries.at(i);
+            const QString path = info.filePath();
+            const bool isDirectory = info.isDir();
+            if (state.isIgnored(path.mid(state.root.length() + 1), info.fileName(), isDirectory)) {
+                continue;
+            }
+            if (isDirectory) {
+                /* Linked directories could loop */
+                if (!info.isSymLink()) {
+                    push(path);
+                }
+            } else if (info.size() > 0 && info.size() <= MaxFileSize) {
+                search(path, info.size());
+            }
+        }
+    }
+
+    void search(const QString &path, qint64 size) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        uchar *mapped = file.map(0, size);
+        if (!mapped) {
+            return;
+        }
+        const char *data = reinterpret_cast<const char*>(mapped);
+        state.files->ref();
+
+        /* NUL bytes never occur in text */
+        if (std::memchr(data, 0, (size_t)qMin<qint64>(size, BinaryProbe))) {
+            file.unmap(mapped);
+            return;
+        }
+
+        QVector<SearchHit> hits;
+        std::vector<LineMatcher::Match> matches;
+        const bool prefilter = state.finder.isUsable();
+        int line = 0;
+        qint64 counted = 0;
+        qint64 pos = 0;
+        while (pos < size) {
+            /* Only lines holding the literal are worth decoding */
+            qint64 lineStart = pos;
+            if (prefilter) {
+                const qint64 candidate = state.finder.find(data, size, pos);
+                if (candidate < 0) {
+                    break;
+                }
+                lineStart = candidate;
+                while (lineStart > pos && data[lineStart - 1] != '\n') {
+                    --lineStart;
+                }
+            }
+            const void *newline = std::memchr(data + lineStart, '\n', (size_t)(size - lineStart));
+            const qint64 lineEnd = newline ? static_cast<const char*>(newline) - data : size;
+            line += (int)std::count(data + counted, data + lineStart, '\n');
+            counted = lineStart;
+
+            qint64 textEnd = lineEnd;
+            if (textEnd > lineStart && data[textEnd - 1] == '\r') {
+                --textEnd;
+            }
+            const QString text = QString::fromUtf8(data + lineStart, (int)(textEnd - lineStart));
+            matches.clear();
+            state.matcher.find(text, 0, matches);
+            for (size_t i = 0; i < matches.size(); ++i) {
+                SearchHit hit;
+                hit.path = path;
+                hit.line = line;
+                hit.column = matches[i].start;
+                hit.length = matches[i].length;
+                hit.text = text.left(MaxLineText);
+                hits.append(hit);
+            }
+            pos = lineEnd + 1;
+        }
+        file.unmap(mapped);
+
+        if (!hits.isEmpty()) {
+            if (state.hits.fetchAndAddRelaxed(hits.size()) + hits.size() >= MaxHits) {
+                state.limited->store(1);
+            }
+            QMutexLocker locker(&state.resultsMutex);
+            state.results += hits;
+        }
+    }
+};
+
+}
+
+ProjectSearch::ProjectSearch(const QString &root, const LineMatcher &matcher, const QStringList &ignorePatterns, QObject *parent) :
+    QThread(parent),
+    root(QDir(root).absolutePath()),
+    matcher(matcher),
+    ignores(ignorePatterns) {
+    qRegisterMetaType<QVector<SearchHit> >("QVector<SearchHit>");
+}
+
+ProjectSearch::~ProjectSearch() {
+    requestInterruption();
+    wait();
+}
+
+QStringList ProjectSearch::ignorePatterns(QSettings *settings, const QString &root) {
+    QStringList patterns = settings->value("Search/sIgnorePatterns",
+        ".git;.hg;.svn;__pycache__;node_modules;.venv;venv;.tox;*.pyc;*.pyo").toString().split(';', QString::SkipEmptyParts);
+
+    /* Plain names and paths only; negations are not worth the trouble */
+    QFile gitignore(root + "/.gitignore");
+    if (gitignore.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        while (!gitignore.atEnd()) {
+            const QString line = QString::fromUtf8(gitignore.readLine()).trimmed();
+            if (!line.isEmpty() && !line.startsWith('#') && !line.startsWith('!')) {
+                patterns << line;
+            }
+        }
+    }
+    return patterns;
+}
+
+int ProjectSearch::filesSearched() const {
+    return files.load();
+}
+
+bool ProjectSearch::limitReached() const {
+    return limited.load() != 0;
+}
+
+void ProjectSearch::run() {
+    if (matcher.isEmpty() || !matcher.isValid()) {
+        return;
+    }
+
+    const int threads = qMax(1, QThread::idealThreadCount());
+    SearchState state(threads, root, matcher, this);
+    state.files = &files;
+    state.limited = &limited;
+    for (int i = 0; i < ignores.size(); ++i) {
+        IgnoreRule rule;
+        rule.glob = ignores.at(i);
+        if (rule.glob.startsWith("**/")) {
+            rule.glob.remove(0, 3);
+        }
+        rule.directoryOnly = rule.glob.endsWith('/');
+        if (rule.directoryOnly) {
+            rule.glob.chop(1);
+        }
+        rule.anchored = rule.glob.contains('/');
+        if (rule.glob.startsWith('/')) {
+            rule.glob.remove(0, 1);
+        }
+        if (!rule.glob.isEmpty()) {
+            state.rules.append(rule);
+        }
+    }
+
+    state.pending.store(1);
+    state.stacks[0].directories.push_back(root);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new Walker(state, i));
+    }
+
+    /* Hand out what was found every so often until the pool is done */
+    bool done = false;
+    while (!done) {
+        done = pool.waitForDone(FlushInterval);
+        QVector<SearchHit> batch;
+        QMutexLocker locker(&state.resultsMutex);
+        batch.swap(state.results);
+        locker.unlock();
+        if (!batch.isEmpty()) {
+            Q_EMIT found(batch);
+        }
+    }
+}
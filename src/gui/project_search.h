@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PROJECT_SEARCH_H
+#define PROJECT_SEARCH_H
+
+#include "editor/code_editor_search.h"
+#include <qatomic.h>
+#include <qmetatype.h>
+#include <qsettings.h>
+#include <qstringlist.h>
+#include <qthread.h>
+#include <qvector.h>
+
+struct SearchHit {
+    QString path;
+    int line = 0;   /* Zero-based */
+    int column = 0; /* In UTF-16 units, like the editor */
+    int length = 0;
+    QString text;
+};
+
+Q_DECLARE_METATYPE(QVector<SearchHit>)
+
+/*
+* Searches every text file below a directory on all cores.
+*
+* Each pool thread keeps its own stack of directories to list and steals from
+* the others when it runs dry, so deep and wide trees keep every core busy.
+* Ignored names and binaries are skipped, files are mapped rather than read,
+* and the literal every match must contain is looked for in the raw bytes
+* first, so only the lines around candidates are ever decoded and matched.
+* Hits are handed out in batches while the search runs.
+*/
+class ProjectSearch : public QThread {
+    Q_OBJECT
+
+public:
+    ProjectSearch(const QString &root, const LineMatcher &matcher, const QStringList &ignorePatterns, QObject *parent = 0);
+    ~ProjectSearch();
+
+    /* Ignore patterns from the settings and the root's .gitignore */
+    static QStringList ignorePatterns(QSettings *settings, const QString &root);
+
+    int filesSearched() const;
+    bool limitReached() const;
+
+Q_SIGNALS:
+    void found(const QVector<SearchHit> &hits);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    enum { FlushInterval = 50 };
+
+    const QString root;
+    const LineMatcher matcher;
+    const QStringList ignores;
+    QAtomicInt files;
+    QAtomicInt limited;
+};
+
+#endif // PROJECT_SEARCH_H
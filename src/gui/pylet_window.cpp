@@ -17,6 +17,8 @@
 #include <qsplitter.h>
 #include <qdebug.h>
 #include <qdir.h>
+#include <qfiledialog.h>
+#include <qmessagebox.h>
 
 PyletWindow::PyletWindow(QWidget *parent) :
     QMainWindow(parent) {
@@ -28,10 +30,13 @@ PyletWindow::PyletWindow(QWidget *parent) :
 
     initWindow();
     initWidgets();
+    editorStack->recoverJournals();
+    editorStack->restoreSession();
     showMaximized();
 }
 
 PyletWindow::~PyletWindow() {
+    editorStack->saveSession();
     /* Clean up QSettings that were passed around. */
     delete s;
 }
@@ -47,6 +52,9 @@ void PyletWindow::initWindow() {
 }
 
 void PyletWindow::initWidgets() {
+    /* Off unless asked for, as it only matters when chasing lag */
+    LatencyMonitor::enabled = s->value("Diagnostics/bLatencyMonitor", false).toBool();
+
     QSplitter* coreWidget = new QSplitter(Qt::Horizontal);
     setCentralWidget(coreWidget);
 
@@ -68,15 +76,35 @@ void PyletWindow::initWidgets() {
     fileTree = new QTreeView(navigator);
     fileTree->setModel(emptyModel);
     fileTree->setStyleSheet("background-color: #DDD;");
+    fileTree->setSelectionMode(QAbstractItemView::ExtendedSelection);
     connect(fileTree, SIGNAL(doubleClicked(const QModelIndex &)), this, SLOT(openFromFileTree(const QModelIndex &)));
     navLayout->addWidget(fileTree, 3);
 
+    outline = new OutlineView(navigator);
+    navLayout->addWidget(outline, 2);
+
     InfoBox* infoBox = new InfoBox(coreWidget);
     navLayout->addWidget(infoBox, 1);
 
-    editorStack = new EditorStack(s, coreWidget);
+    QWidget* editorPane = new QWidget(coreWidget);
+    QVBoxLayout* editorLayout = new QVBoxLayout(editorPane);
+    editorLayout->setMargin(0);
+    editorLayout->setSpacing(0);
+    editorPane->setLayout(editorLayout);
+    coreWidget->insertWidget(1, editorPane);
+
+    editorStack = new EditorStack(s, editorPane);
     editorStack->setMinimumWidth(280);
-    coreWidget->insertWidget(1, editorStack);
+    editorLayout->addWidget(editorStack, 1);
+
+    findBar = new FindBar(editorPane);
+    editorLayout->addWidget(findBar);
+
+    findInFiles = new FindInFilesPanel(s, editorStack, editorPane);
+    editorLayout->addWidget(findInFiles);
+    connect(findInFiles, SIGNAL(openRequested(QString, int)), editorStack, SLOT(openAt(QString, int)));
+
+    latencyOverlay = new LatencyOverlay(editorPane);
 
     editorStack->insertEditor();
 
@@ -94,6 +122,10 @@ void PyletWindow::initWidgets() {
     coreWidget->insertWidget(2, pyConsole);
     editorStack->pyConsole = pyConsole;
 
+    projectIndex = new ProjectIndex(this);
+    editorStack->projectIndex = projectIndex;
+    connect(projectIndex, SIGNAL(updated()), this, SLOT(updateCompletionWords()));
+
     coreWidget->setStretchFactor(0, 2);
     coreWidget->setStretchFactor(1, 4);
     coreWidget->setStretchFactor(2, 4);
@@ -102,6 +134,10 @@ void PyletWindow::initWidgets() {
 
     connect(editorStack, SIGNAL(currentChanged(int)), this, SLOT(updateWindowTitle(int)));
     connect(editorStack, SIGNAL(currentChanged(int)), this, SLOT(updateFileTree()));
+    connect(editorStack, SIGNAL(currentChanged(int)), this, SLOT(updateOutline()));
+    connect(editorStack, SIGNAL(currentChanged(int)), this, SLOT(updateFindBar()));
+    updateOutline();
+    updateFindBar();
 
     /* Do action population and fill out menus correspondingly */
     QAction* newFile = new QAction("New", this); actions << newFile;
@@ -143,9 +179,49 @@ void PyletWindow::initWidgets() {
     QAction* selectAll = new QAction("Select All", this); actions << selectAll;
     connect(selectAll, SIGNAL(triggered()), editorStack, SLOT(selectAll()));
 
+    QAction* jumpToBracket = new QAction("Jump To Bracket", this); actions << jumpToBracket;
+    connect(jumpToBracket, SIGNAL(triggered()), editorStack, SLOT(jumpToBracket()));
+
+    QAction* toggleFold = new QAction("Toggle Fold", this); actions << toggleFold;
+    connect(toggleFold, SIGNAL(triggered()), editorStack, SLOT(toggleFold()));
+
+    QAction* find = new QAction("Find", this); actions << find;
+    connect(find, SIGNAL(triggered()), findBar, SLOT(showFind()));
+
+    QAction* replace = new QAction("Replace", this); actions << replace;
+    connect(replace, SIGNAL(triggered()), findBar, SLOT(showReplace()));
+
+    QAction* findNext = new QAction("Find Next", this); actions << findNext;
+    connect(findNext, SIGNAL(triggered()), findBar, SLOT(findNext()));
+
+    QAction* findPrevious = new QAction("Find Previous", this); actions << findPrevious;
+    connect(findPrevious, SIGNAL(triggered()), findBar, SLOT(findPrevious()));
+
+    QAction* findInFilesAction = new QAction("Find in Files", this); actions << findInFilesAction;
+    connect(findInFilesAction, SIGNAL(triggered()), findInFiles, SLOT(showPanel()));
+
+    QAction* replaceInFiles = new QAction("Replace in Files", this); actions << replaceInFiles;
+    connect(replaceInFiles, SIGNAL(triggered()), findInFiles, SLOT(showReplace()));
+
+    QAction* goToSymbol = new QAction("Go To Symbol", this); actions << goToSymbol;
+    connect(goToSymbol, SIGNAL(triggered()), editorStack, SLOT(goToSymbol()));
+
+    QAction* goToDefinition = new QAction("Go To Definition", this); actions << goToDefinition;
+    connect(goToDefinition, SIGNAL(triggered()), editorStack, SLOT(goToDefinition()));
+
+    QAction* findUsages = new QAction("Find Usages", this); actions << findUsages;
+    connect(findUsages, SIGNAL(triggered()), editorStack, SLOT(findUsages()));
+
     QAction* run = new QAction("Run", this); actions << run;
     connect(run, SIGNAL(triggered()), editorStack, SLOT(run()));
 
+    QAction* showLatency = new QAction("Latency Overlay", this); actions << showLatency;
+    showLatency->setCheckable(true);
+    connect(showLatency, SIGNAL(toggled(bool)), latencyOverlay, SLOT(setActive(bool)));
+
+    QAction* exportLatency = new QAction("Export Latency Samples...", this); actions << exportLatency;
+    connect(exportLatency, SIGNAL(triggered()), this, SLOT(exportLatency()));
+
     QAction* zoomIn = new QAction("Zoom In", this); actions << zoomIn;
     connect(zoomIn, SIGNAL(triggered()), editorStack, SLOT(zoomIn()));
 
@@ -190,7 +266,20 @@ void PyletWindow::initWidgets() {
     editMenu->addAction(copy);
     editMenu->addAction(paste);
     editMenu->addAction(selectAll);
+    editMenu->addSeparator();
+    editMenu->addAction(jumpToBracket);
+    editMenu->addAction(toggleFold);
     QMenu *searchMenu = menuBar()->addMenu("Search");
+    searchMenu->addAction(find);
+    searchMenu->addAction(replace);
+    searchMenu->addAction(findNext);
+    searchMenu->addAction(findPrevious);
+    searchMenu->addAction(findInFilesAction);
+    searchMenu->addAction(replaceInFiles);
+    searchMenu->addSeparator();
+    searchMenu->addAction(goToSymbol);
+    searchMenu->addAction(goToDefinition);
+    searchMenu->addAction(findUsages);
     QMenu *runMenu = menuBar()->addMenu("Run");
     runMenu->addAction(run);
     QMenu *viewMenu = menuBar()->addMenu("View");
@@ -198,6 +287,9 @@ void PyletWindow::initWidgets() {
     zoomMenu->addAction(zoomIn);
     zoomMenu->addAction(zoomOut);
     zoomMenu->addAction(resetZoom);
+    viewMenu->addSeparator();
+    viewMenu->addAction(showLatency);
+    viewMenu->addAction(exportLatency);
     QMenu *settingsMenu = menuBar()->addMenu("Settings");
     QMenu *helpMenu = menuBar()->addMenu("Help");
 
@@ -259,6 +351,8 @@ void PyletWindow::updateWindowTitle(int index) {
             } else {
                 setWindowTitle(editorStack->tabText(index) + " - Pylet");
             }
+        } else if (LargeFileView* v = qobject_cast<LargeFileView*>(editorStack->widget(index))) {
+            setWindowTitle(v->location + (v->isReadOnly() ? " [read-only]" : "") + " - Pylet");
         } else {
             setWindowTitle("Pylet");
         }
@@ -273,6 +367,8 @@ void PyletWindow::updateFileTree() {
             qDebug() << "Root path is:" << QFileInfo(checkFile).absolutePath() + "/";
             model->setRootPath(QString(QDir::Drives));
             fileTree->setRootIndex(model->index(QFileInfo(checkFile).absolutePath()));
+            projectIndex->setRoot(QFileInfo(checkFile).absolutePath());
+            findInFiles->setRoot(QFileInfo(checkFile).absolutePath());
             model->setFilter(QDir::NoDotAndDotDot | QDir::AllDirs | QDir::Files);
             fileTree->hideColumn(1);
             fileTree->hideColumn(2);
@@ -283,10 +379,40 @@ void PyletWindow::updateFileTree() {
     }
 }
 
+void PyletWindow::updateOutline() {
+    outline->setEditor(qobject_cast<CodeEditor*>(editorStack->currentWidget()));
+}
+
+void PyletWindow::updateFindBar() {
+    findBar->setEditor(qobject_cast<CodeEditor*>(editorStack->currentWidget()));
+}
+
+void PyletWindow::updateCompletionWords() {
+    CompletionIndex::instance()->setWords(quintptr(projectIndex), projectIndex->identifiers());
+}
+
+/* Opens every selected file when the one activated is part of the selection; they load in parallel */
 void PyletWindow::openFromFileTree(const QModelIndex &index) {
-    QFile* openFile = new QFile(model->filePath(index));
-    if (QFileInfo(*openFile).isFile()) {
-        editorStack->open(openFile);
+    QModelIndexList indexes = fileTree->selectionModel()->selectedRows();
+    if (!indexes.contains(index.sibling(index.row(), 0))) {
+        indexes = QModelIndexList() << index;
+    }
+    for (int i = 0; i < indexes.size(); ++i) {
+        const QString path = model->filePath(indexes.at(i));
+        if (QFileInfo(path).isFile()) {
+            editorStack->open(new QFile(path));
+        }
+    }
+}
+
+void PyletWindow::exportLatency() {
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export Latency Samples"),
+        QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/pylet-latency.csv",
+        "CSV files (*.csv)");
+    if (filename == "")
+        return;
+    if (!LatencyMonitor::getInstance()->exportSamples(filename)) {
+        QMessageBox::critical(this, tr("Error"), tr("Unable to write file at the specified location."));
     }
 }
 
@@ -8,6 +8,11 @@
 
 #include "editor\code_editor_interface.h"
 #include "editor\editor_stack.h"
+#include "outline_view.h"
+#include "find_bar.h"
+#include "find_in_files.h"
+#include "latency_monitor.h"
+#include "project_index.h"
 #include <qstandarditemmodel.h>
 #include <qfilesystemmodel.h>
 #include <qmainwindow.h>
@@ -33,6 +38,11 @@ private:
     QFileSystemModel* model;
     QStandardItemModel* emptyModel = new QStandardItemModel(this);
     QTreeView* fileTree;
+    OutlineView* outline;
+    FindBar* findBar;
+    FindInFilesPanel* findInFiles;
+    LatencyOverlay* latencyOverlay;
+    ProjectIndex* projectIndex;
     QList<QAction*> actions;
     QToolBar *toolBar;
     QSettings *s;
@@ -41,7 +51,11 @@ private:
 private Q_SLOTS:
     void updateWindowTitle(int index = -1);
     void updateFileTree();
+    void updateOutline();
+    void updateFindBar();
+    void updateCompletionWords();
     void openFromFileTree(const QModelIndex&);
+    void exportLatency();
 
 public Q_SLOTS:
     void finalizeRuntime();
@@ -108,6 +108,12 @@ static void g_initFonts(const QApplication &application) {
     }
 }
 
+static void g_setDefault(QSettings &config, const QString &key, const QVariant &value) {
+    if (!config.contains(key)) {
+        config.setValue(key, value);
+    }
+}
+
 static void g_initSettings(const QApplication &application) {
     QString appDataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir dir(appDataPath);
@@ -116,36 +122,51 @@ static void g_initSettings(const QApplication &application) {
     QString configFile = dir.absolutePath() + "/config.ini";
     QSettings config(configFile, QSettings::IniFormat);
 
-    if (!QFile(configFile).exists() && config.isWritable()) {
+    /* Every missing key gets its default, so settings added since the file was written show up too */
+    if (config.isWritable()) {
         config.beginGroup("Editor");
 
-        config.setValue("iTabSpacing", 4);
-        config.setValue("bTabsEmitSpaces", true);
+        g_setDefault(config, "iTabSpacing", 4);
+        g_setDefault(config, "bTabsEmitSpaces", true);
+        g_setDefault(config, "bAutoComplete", true);
+        g_setDefault(config, "iLargeFileThresholdMB", 16);
+        g_setDefault(config, "bRestoreSession", true);
         config.endGroup();
 
         config.beginGroup("Shortcuts");
 
-        config.setValue("New", QKeySequence(Qt::CTRL + Qt::Key_N));
-        config.setValue("Open", QKeySequence(Qt::CTRL + Qt::Key_O));
-        config.setValue("Save", QKeySequence(Qt::CTRL + Qt::Key_S));
-        config.setValue("Save As...", QKeySequence(Qt::CTRL + Qt::ALT + Qt::Key_S));
-        config.setValue("Save All", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_S));
-        config.setValue("Close", QKeySequence(Qt::CTRL + Qt::Key_W));
-        config.setValue("Close All", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_W));
-        config.setValue("Undo", QKeySequence(Qt::CTRL + Qt::Key_Z));
-        config.setValue("Redo", QKeySequence(Qt::CTRL + Qt::Key_Y));
-        config.setValue("Cut", QKeySequence(Qt::CTRL + Qt::Key_X));
-        config.setValue("Copy", QKeySequence(Qt::CTRL + Qt::Key_C));
-        config.setValue("Paste", QKeySequence(Qt::CTRL + Qt::Key_V));
-        config.setValue("Select All", QKeySequence(Qt::CTRL + Qt::Key_A));
-        config.setValue("Run", QKeySequence(Qt::CTRL + Qt::Key_R));
-        config.setValue("Zoom In", QKeySequence(Qt::CTRL + Qt::Key_Plus));
-        config.setValue("Zoom In Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Plus));
-        config.setValue("Zoom In Alt2", QKeySequence(Qt::CTRL + Qt::Key_Equal));
-        config.setValue("Zoom Out", QKeySequence(Qt::CTRL + Qt::Key_Minus));
-        config.setValue("Zoom Out Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Minus));
-        config.setValue("Reset Zoom", QKeySequence(Qt::CTRL + Qt::Key_Slash));
-        config.setValue("Reset Zoom Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Slash));
+        g_setDefault(config, "New", QKeySequence(Qt::CTRL + Qt::Key_N));
+        g_setDefault(config, "Open", QKeySequence(Qt::CTRL + Qt::Key_O));
+        g_setDefault(config, "Save", QKeySequence(Qt::CTRL + Qt::Key_S));
+        g_setDefault(config, "Save As...", QKeySequence(Qt::CTRL + Qt::ALT + Qt::Key_S));
+        g_setDefault(config, "Save All", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_S));
+        g_setDefault(config, "Close", QKeySequence(Qt::CTRL + Qt::Key_W));
+        g_setDefault(config, "Close All", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_W));
+        g_setDefault(config, "Undo", QKeySequence(Qt::CTRL + Qt::Key_Z));
+        g_setDefault(config, "Redo", QKeySequence(Qt::CTRL + Qt::Key_Y));
+        g_setDefault(config, "Cut", QKeySequence(Qt::CTRL + Qt::Key_X));
+        g_setDefault(config, "Copy", QKeySequence(Qt::CTRL + Qt::Key_C));
+        g_setDefault(config, "Paste", QKeySequence(Qt::CTRL + Qt::Key_V));
+        g_setDefault(config, "Select All", QKeySequence(Qt::CTRL + Qt::Key_A));
+        g_setDefault(config, "Jump To Bracket", QKeySequence(Qt::CTRL + Qt::Key_BracketRight));
+        g_setDefault(config, "Toggle Fold", QKeySequence(Qt::CTRL + Qt::Key_BracketLeft));
+        g_setDefault(config, "Find", QKeySequence(Qt::CTRL + Qt::Key_F));
+        g_setDefault(config, "Replace", QKeySequence(Qt::CTRL + Qt::Key_H));
+        g_setDefault(config, "Find Next", QKeySequence(Qt::Key_F3));
+        g_setDefault(config, "Find Previous", QKeySequence(Qt::SHIFT + Qt::Key_F3));
+        g_setDefault(config, "Find in Files", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_F));
+        g_setDefault(config, "Replace in Files", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_H));
+        g_setDefault(config, "Go To Symbol", QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_O));
+        g_setDefault(config, "Go To Definition", QKeySequence(Qt::Key_F12));
+        g_setDefault(config, "Find Usages", QKeySequence(Qt::SHIFT + Qt::Key_F12));
+        g_setDefault(config, "Run", QKeySequence(Qt::CTRL + Qt::Key_R));
+        g_setDefault(config, "Zoom In", QKeySequence(Qt::CTRL + Qt::Key_Plus));
+        g_setDefault(config, "Zoom In Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Plus));
+        g_setDefault(config, "Zoom In Alt2", QKeySequence(Qt::CTRL + Qt::Key_Equal));
+        g_setDefault(config, "Zoom Out", QKeySequence(Qt::CTRL + Qt::Key_Minus));
+        g_setDefault(config, "Zoom Out Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Minus));
+        g_setDefault(config, "Reset Zoom", QKeySequence(Qt::CTRL + Qt::Key_Slash));
+        g_setDefault(config, "Reset Zoom Alt", QKeySequence(Qt::CTRL + Qt::KeypadModifier + Qt::Key_Slash));
         config.endGroup();
     }
 }
@@ -0,0 +1,148 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "delimiter_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DELIMITER_SCANNER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/* i386 builds cannot assume SSE2 */
+#if defined(DELIMITER_SCANNER_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DELIMITER_SCANNER_SSE2
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCANNER_AVX2 __attribute__((target("avx2")))
+#else
+#define SCANNER_AVX2
+#endif
+
+namespace {
+
+typedef int (*FindFunction)(const unsigned short *, int, int, unsigned short, unsigned short, unsigned short);
+
+int findScalar(const unsigned short *text, int i, int length,
+               unsigned short a, unsigned short b, unsigned short c) {
+    for (; i < length; ++i) {
+        const unsigned short ch = text[i];
+        if (ch == a || ch == b || ch == c) {
+            return i;
+        }
+    }
+    return length;
+}
+
+#ifdef DELIMITER_SCANNER_X86
+
+inline int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+#ifdef DELIMITER_SCANNER_SSE2
+int findSse2(const unsigned short *text, int i, int length,
+             unsigned short a, unsigned short b, unsigned short c) {
+    const __m128i va = _mm_set1_epi16((short)a);
+    const __m128i vb = _mm_set1_epi16((short)b);
+    const __m128i vc = _mm_set1_epi16((short)c);
+    for (; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, va), _mm_cmpeq_epi16(v, vb)),
+                                          _mm_cmpeq_epi16(v, vc));
+        const unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) {
+            /* Two mask bits per 16-bit lane */
+            return i + (lowestBit(mask) >> 1);
+        }
+    }
+    return findScalar(text, i, length, a, b, c);
+}
+#endif
+
+SCANNER_AVX2 int findAvx2(const unsigned short *text, int i, int length,
+                          unsigned short a, unsigned short b, unsigned short c) {
+    const __m256i va = _mm256_set1_epi16((short)a);
+    const __m256i vb = _mm256_set1_epi16((short)b);
+    const __m256i vc = _mm256_set1_epi16((short)c);
+    for (; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        const __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, va), _mm256_cmpeq_epi16(v, vb)),
+                                             _mm256_cmpeq_epi16(v, vc));
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) {
+            return i + (lowestBit(mask) >> 1);
+        }
+    }
+    return findScalar(text, i, length, a, b, c);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    /* The OS has to save the YMM registers as well (OSXSAVE + AVX, then XCR0) */
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+        return false;
+    }
+    if ((_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // DELIMITER_SCANNER_X86
+
+struct Dispatch {
+    FindFunction find;
+    const char *name;
+
+    Dispatch() : find(findScalar), name("scalar") {
+#ifdef DELIMITER_SCANNER_X86
+#ifdef DELIMITER_SCANNER_SSE2
+        find = findSse2;
+        name = "sse2";
+#endif
+        if (cpuHasAvx2()) {
+            find = findAvx2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+
+const Dispatch &dispatch() {
+    static const Dispatch selected;
+    return selected;
+}
+
+} // namespace
+
+int DelimiterScanner::find(const unsigned short *text, int from, int length,
+                           unsigned short a, unsigned short b, unsigned short c) {
+    return dispatch().find(text, from, length, a, b, c);
+}
+
+const char *DelimiterScanner::implementation() {
+    return dispatch().name;
+}
@@ -0,0 +1,27 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef DELIMITER_SCANNER_H
+#define DELIMITER_SCANNER_H
+
+/**
+ * Vectorized search for delimiter characters in UTF-16 text.
+ *
+ * Used by the lexer to jump over the plain part of string literals, which is
+ * where long lines (embedded data, minified JSON) spend their time. On x86 the
+ * SSE2 version is the baseline and an AVX2 version is picked at runtime when
+ * the CPU supports it; other platforms fall back to a scalar loop.
+ */
+class DelimiterScanner {
+public:
+    /* Returns the first position in [from, length) holding a, b or c, or 'length' if there is none */
+    static int find(const unsigned short *text, int from, int length,
+                    unsigned short a, unsigned short b, unsigned short c);
+
+    /* Name of the implementation in use: "avx2", "sse2" or "scalar" */
+    static const char *implementation();
+};
+
+#endif // DELIMITER_SCANNER_H
@@ -0,0 +1,541 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "python_lexer.h"
+#include "delimiter_scanner.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+/*
+* Character classes of the lexer DFA:
+* O = other, S = space, I = identifier, D = digit, Q = quote, H = hash,
+* B = brace, P = operator, T = dot, E = backslash.
+* Anything outside of ASCII is treated as an identifier character.
+*/
+enum CharClass { O, S, I, D, Q, H, B, P, T, E };
+
+const unsigned char charClasses[128] = {
+    O, O, O, O, O, O, O, O, O, S, S, S, S, S, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    S, P, Q, H, O, P, P, Q, B, B, P, P, P, P, T, P,
+    D, D, D, D, D, D, D, D, D, D, P, P, P, P, P, O,
+    P, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    I, I, I, I, I, I, I, I, I, I, I, B, E, B, P, I,
+    O, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,
+    I, I, I, I, I, I, I, I, I, I, I, B, P, B, P, O,
+};
+
+inline int classOf(unsigned short c) {
+    return c < 128 ? charClasses[c] : (int)I;
+}
+
+inline bool isIdentChar(unsigned short c) {
+    int cls = classOf(c);
+    return cls == I || cls == D;
+}
+
+inline bool isDigit(unsigned short c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isHexDigit(unsigned short c) {
+    return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+const char *const keywordList[] = {
+    "False", "None", "True", "and", "as", "assert", "async", "await", "break",
+    "class", "continue", "def", "del", "elif", "else", "except", "exec", "finally",
+    "for", "from", "global", "if", "import", "in", "is", "lambda", "nonlocal",
+    "not", "or", "pass", "print", "raise", "return", "try", "while", "with", "yield",
+    0
+};
+
+const char *const builtinList[] = {
+    "abs", "all", "any", "ascii", "bin", "bool", "bytearray", "bytes", "callable",
+    "chr", "classmethod", "compile", "complex", "delattr", "dict", "dir", "divmod",
+    "enumerate", "eval", "exec", "filter", "float", "format", "frozenset", "getattr",
+    "globals", "hasattr", "hash", "help", "hex", "id", "input", "int", "isinstance",
+    "issubclass", "iter", "len", "list", "locals", "map", "max", "memoryview", "min",
+    "next", "object", "oct", "open", "ord", "pow", "print", "property", "range",
+    "repr", "reversed", "round", "set", "setattr", "slice", "sorted", "staticmethod",
+    "str", "sum", "super", "tuple", "type", "vars", "zip", "__import__",
+    0
+};
+
+/* FNV-1a over the word, seeded so the perfect hash can pick a displacement per bucket */
+template <typename Char>
+inline unsigned hashWord(const Char *word, int length, unsigned seed) {
+    unsigned h = 2166136261u ^ (seed * 16777619u);
+    for (int i = 0; i < length; ++i) {
+        h = (h ^ (unsigned char)word[i]) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+/*
+* Perfect hash of the reserved words (hash-and-displace): every word's bucket
+* stores the seed that sends all of its words to free slots, so a lookup is
+* exactly two hashes and one comparison.
+*/
+struct WordTable {
+    enum { Size = 256, Buckets = 64, MinLength = 2, MaxLength = 12 };
+
+    const char *words[Size];
+    unsigned char lengths[Size];
+    unsigned char flags[Size];
+    unsigned char seeds[Buckets];
+
+    WordTable() {
+        std::memset(words, 0, sizeof(words));
+        std::memset(lengths, 0, sizeof(lengths));
+        std::memset(flags, 0, sizeof(flags));
+        std::memset(seeds, 0, sizeof(seeds));
+
+        struct Entry { const char *word; int flags; };
+        std::vector<Entry> entries;
+        for (const char *const *w = keywordList; *w; ++w) {
+            int f = PythonLexer::WordKeyword;
+            if (!std::strcmp(*w, "def") || !std::strcmp(*w, "class")) {
+                f |= PythonLexer::WordDefinition;
+            }
+            entries.push_back(Entry{ *w, f });
+        }
+        for (const char *const *w = builtinList; *w; ++w) {
+            bool merged = false;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (!std::strcmp(entries[i].word, *w)) {
+                    entries[i].flags |= PythonLexer::WordBuiltin;
+                    merged = true;
+                }
+            }
+            if (!merged) {
+                entries.push_back(Entry{ *w, PythonLexer::WordBuiltin });
+            }
+        }
+        entries.push_back(Entry{ "self", PythonLexer::WordSelf });
+
+        /* Place the largest buckets first, they are the hardest to fit */
+        std::vector<std::vector<int>> buckets(Buckets);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const char *w = entries[i].word;
+            buckets[hashWord(w, (int)std::strlen(w), 0) % Buckets].push_back((int)i);
+        }
+        std::vector<int> order(Buckets);
+        for (int b = 0; b < Buckets; ++b) {
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&buckets](int a, int b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        for (int b : order) {
+            const std::vector<int> &bucket = buckets[b];
+            if (bucket.empty()) {
+                continue;
+            }
+            bool placed = false;
+            for (unsigned seed = 1; seed < 256 && !placed; ++seed) {
+                std::vector<unsigned> slots;
+                placed = true;
+                for (int index : bucket) {
+                    const char *w = entries[index].word;
+                    unsigned slot = hashWord(w, (int)std::strlen(w), seed) % Size;
+                    if (words[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                        placed = false;
+                        break;
+                    }
+                    slots.push_back(slot);
+                }
+                if (placed) {
+                    seeds[b] = (unsigned char)seed;
+                    for (size_t k = 0; k < bucket.size(); ++k) {
+                        words[slots[k]] = entries[bucket[k]].word;
+                        lengths[slots[k]] = (unsigned char)std::strlen(entries[bucket[k]].word);
+                        flags[slots[k]] = (unsigned char)entries[bucket[k]].flags;
+                    }
+                }
+            }
+            assert(placed);
+        }
+    }
+
+    int lookup(const unsigned short *word, int length) const {
+        if (length < MinLength || length > MaxLength) {
+            return 0;
+        }
+        for (int i = 0; i < length; ++i) {
+            if (word[i] >= 128) {
+                return 0;
+            }
+        }
+        unsigned slot = hashWord(word, length, seeds[hashWord(word, length, 0) % Buckets]) % Size;
+        if (lengths[slot] != length) {
+            return 0;
+        }
+        const char *candidate = words[slot];
+        for (int i = 0; i < length; ++i) {
+            if (candidate[i] != word[i]) {
+                return 0;
+            }
+        }
+        return flags[slot];
+    }
+};
+
+const WordTable &wordTable() {
+    static const WordTable table;
+    return table;
+}
+
+/*
+* Lexes a single line. f-string replacement fields are lexed as code by
+* recursing into lexCode(), which is why the state is kept in an object.
+*/
+class LineLexer {
+public:
+    LineLexer(const unsigned short *t, int n, std::vector<PythonLexer::Token> &out) :
+        text(t), length(n), tokens(out), table(wordTable()) {
+    }
+
+    int run(int state) {
+        int i = 0;
+        if (state > 0 && (state & PythonLexer::StateStringMask)) {
+            i = lexStringBody(0, 0, state);
+        }
+        lexCode(i, false);
+        return openState;
+    }
+
+private:
+    enum { MaxFieldDepth = 16 };
+
+    const unsigned short *text;
+    const int length;
+    std::vector<PythonLexer::Token> &tokens;
+    const WordTable &table;
+    int openState = PythonLexer::StateNormal;
+    int fieldDepth = 0;
+    bool expectName = false;
+
+    void emit(int start, int end, PythonLexer::TokenKind kind) {
+        if (end > start) {
+            PythonLexer::Token token = { start, end - start, kind };
+            tokens.push_back(token);
+        }
+        expectName = false;
+    }
+
+    unsigned short at(int i) const {
+        return i < length ? text[i] : 0;
+    }
+
+    int lexCode(int i, bool inField) {
+        int bracketDepth = 0;
+        while (i < length) {
+            const unsigned short c = text[i];
+            switch (classOf(c)) {
+                case S: {
+                    ++i;
+                    break;
+                }
+                case I: {
+                    int end = i + 1;
+                    while (end < length && isIdentChar(text[end])) {
+                        ++end;
+                    }
+                    if (end < length && (text[end] == '\'' || text[end] == '"')) {
+                        int prefix = prefixFlags(i, end);
+                        if (prefix >= 0) {
+                            i = lexString(i, end, prefix);
+                            break;
+                        }
+                    }
+                    lexWord(i, end);
+                    i = end;
+                    break;
+                }
+                case D: {
+                    i = lexNumber(i);
+                    break;
+                }
+                case T: {
+                    if (isDigit(at(i + 1))) {
+                        i = lexNumber(i);
+                    } else if (at(i + 1) == '.' && at(i + 2) == '.') {
+                        emit(i, i + 3, PythonLexer::Operator);
+                        i += 3;
+                    } else {
+                        emit(i, i + 1, PythonLexer::Operator);
+                        ++i;
+                    }
+                    break;
+                }
+                case Q: {
+                    i = lexString(i, i, 0);
+                    break;
+                }
+                case H: {
+                    emit(i, length, PythonLexer::Comment);
+                    i = length;
+                    break;
+                }
+                case B: {
+                    if (inField) {
+                        if (c == '(' || c == '[' || c == '{') {
+                            ++bracketDepth;
+                        } else if (bracketDepth == 0 && c == '}') {
+                            return i;
+                        } else if (bracketDepth > 0) {
+                            --bracketDepth;
+                        }
+                    }
+                    emit(i, i + 1, PythonLexer::Brace);
+                    ++i;
+                    break;
+                }
+                case P: {
+                    /* Conversion and format spec of an f-string field */
+                    if (inField && bracketDepth == 0 && (c == ':' || (c == '!' && at(i + 1) != '='))) {
+                        return i;
+                    }
+                    i = lexOperator(i);
+                    break;
+                }
+                default: {
+                    ++i;
+                    break;
+                }
+            }
+        }
+        return i;
+    }
+
+    void lexWord(int start, int end) {
+        if (expectName) {
+            emit(start, end, PythonLexer::DefClass);
+            return;
+        }
+
+        const int flags = table.lookup(text + start, end - start);
+        const bool isCall = at(end) == '(';
+        const bool isAttribute = start > 0 && text[start - 1] == '.';
+        PythonLexer::TokenKind kind = PythonLexer::Identifier;
+
+        if (flags & PythonLexer::WordKeyword) {
+            kind = ((flags & PythonLexer::WordBuiltin) && isCall) ? PythonLexer::Builtin : PythonLexer::Keyword;
+        } else if ((flags & PythonLexer::WordBuiltin) && isCall && !isAttribute) {
+            kind = PythonLexer::Builtin;
+        } else if (flags & PythonLexer::WordSelf) {
+            kind = PythonLexer::Self;
+        }
+
+        emit(start, end, kind);
+        if (flags & PythonLexer::WordDefinition) {
+            expectName = true;
+        }
+    }
+
+    int lexNumber(int i) {
+        const int start = i;
+        unsigned short next = at(i + 1) | 0x20;
+        if (text[i] == '0' && (next == 'x' || next == 'o' || next == 'b')) {
+            i += 2;
+            while (i < length && (isHexDigit(text[i]) || text[i] == '_')) {
+                ++i;
+            }
+        } else {
+            while (i < length && (isDigit(text[i]) || text[i] == '_')) {
+                ++i;
+            }
+            if (at(i) == '.') {
+                ++i;
+                while (i < length && (isDigit(text[i]) || text[i] == '_')) {
+                    ++i;
+                }
+            }
+            if ((at(i) | 0x20) == 'e') {
+                int exponent = i + 1;
+                if (at(exponent) == '+' || at(exponent) == '-') {
+                    ++exponent;
+                }
+                if (isDigit(at(exponent))) {
+                    i = exponent;
+                    while (i < length && (isDigit(text[i]) || text[i] == '_')) {
+                        ++i;
+                    }
+                }
+            }
+        }
+        unsigned short suffix = at(i) | 0x20;
+        if (suffix == 'j' || suffix == 'l') {
+            ++i;
+        }
+        emit(start, i, PythonLexer::Number);
+        return i;
+    }
+
+    int lexOperator(int i) {
+        const unsigned short c = text[i];
+        const unsigned short next = at(i + 1);
+        int size = 1;
+        if ((c == '*' || c == '/' || c == '<' || c == '>') && next == c) {
+            size = (at(i + 2) == '=') ? 3 : 2;
+        } else if (next == '=' && std::strchr("=!<>+-*/%&|^:@", (char)c)) {
+            size = 2;
+        } else if (c == '-' && next == '>') {
+            size = 2;
+        }
+        emit(i, i + size, PythonLexer::Operator);
+        return i + size;
+    }
+
+    /* Returns the state flags of a string prefix such as rb or f, or -1 if the word is not one */
+    int prefixFlags(int start, int end) const {
+        if (end - start > 2) {
+            return -1;
+        }
+        int flags = 0;
+        int seen = 0;
+        for (int i = start; i < end; ++i) {
+            switch (text[i] | 0x20) {
+                case 'r': flags |= PythonLexer::StateRaw; seen |= 1; break;
+                case 'f': flags |= PythonLexer::StateFormat; seen |= 2; break;
+                case 'b': seen |= 4; break;
+                case 'u': seen |= 8; break;
+                default: return -1;
+            }
+        }
+        /* Valid prefixes: r, u, b, f, br, rb, fr, rf */
+        if (end - start == 2 && seen != (1 | 4) && seen != (1 | 2)) {
+            return -1;
+        }
+        return flags;
+    }
+
+    int lexString(int start, int quotePos, int flags) {
+        const unsigned short quote = text[quotePos];
+        const bool triple = at(quotePos + 1) == quote && at(quotePos + 2) == quote;
+        int kind;
+        if (triple) {
+            kind = (quote == '\'') ? PythonLexer::StateTripleSingle : PythonLexer::StateTripleDouble;
+        } else {
+            kind = (quote == '\'') ? PythonLexer::StateContinuedSingle : PythonLexer::StateContinuedDouble;
+        }
+        return lexStringBody(start, quotePos + (triple ? 3 : 1), kind | flags);
+    }
+
+    /* Scans a string body from 'i' up to and including its closing quote */
+    int lexStringBody(int start, int i, int state) {
+        const int kind = state & PythonLexer::StateStringMask;
+        const bool triple = kind == PythonLexer::StateTripleSingle || kind == PythonLexer::StateTripleDouble;
+        const unsigned short quote = (kind == PythonLexer::StateTripleSingle || kind == PythonLexer::StateContinuedSingle) ? '\'' : '"';
+        const bool format = (state & PythonLexer::StateFormat) != 0;
+        const PythonLexer::TokenKind tokenKind = triple ? PythonLexer::DocString : PythonLexer::String;
+
+        int segment = start;
+        while (i < length) {
+            /* Jump over the plain text to the next quote, backslash or field */
+            i = DelimiterScanner::find(text, i, length, quote, '\\', format ? '{' : quote);
+            if (i >= length) {
+                break;
+            }
+            const unsigned short c = text[i];
+            if (c == '\\') {
+                /* Even raw strings cannot end on an escaped quote */
+                i += 2;
+            } else if (c == quote) {
+                if (!triple) {
+                    emit(segment, i + 1, tokenKind);
+                    return i + 1;
+                }
+                if (at(i + 1) == quote && at(i + 2) == quote) {
+                    emit(segment, i + 3, tokenKind);
+                    return i + 3;
+                }
+                ++i;
+            } else {
+                /* Only reachable for f-strings: c is an opening brace */
+                if (at(i + 1) == '{') {
+                    i += 2;
+                    continue;
+                }
+                emit(segment, i + 1, tokenKind);
+                i = lexField(i + 1);
+                segment = i;
+                if (i < length) {
+                    ++i;
+                }
+            }
+        }
+
+        emit(segment, length, tokenKind);
+        if (fieldDepth == 0) {
+            /* Triple quotes stay open, single quotes only through a trailing backslash */
+            if (triple || i > length) {
+                openState = state;
+            } else {
+                openState = PythonLexer::StateNormal;
+            }
+        }
+        return length;
+    }
+
+    /* Lexes an f-string replacement field and returns the position of its closing brace */
+    int lexField(int i) {
+        if (fieldDepth >= MaxFieldDepth) {
+            return i;
+        }
+        ++fieldDepth;
+        i = lexCode(i, true);
+        if (at(i) == '!') {
+            int end = i + 1;
+            while (end < length && isIdentChar(text[end])) {
+                ++end;
+            }
+            emit(i, end, PythonLexer::String);
+            i = end;
+        }
+        if (at(i) == ':') {
+            int segment = i;
+            while (i < length && text[i] != '}') {
+                if (text[i] == '{') {
+                    emit(segment, i + 1, PythonLexer::String);
+                    i = lexField(i + 1);
+                    segment = i;
+                    if (i < length) {
+                        ++i;
+                    }
+                } else {
+                    ++i;
+                }
+            }
+            emit(segment, i, PythonLexer::String);
+        }
+        --fieldDepth;
+        return i;
+    }
+};
+
+} // namespace
+
+int PythonLexer::tokenize(const unsigned short *text, int length, int state, std::vector<Token> &tokens) {
+    LineLexer lexer(text, length, tokens);
+    return lexer.run(state);
+}
+
+int PythonLexer::lookupWord(const unsigned short *word, int length) {
+    return wordTable().lookup(word, length);
+}
+
+const char *const *PythonLexer::keywords() {
+    return keywordList;
+}
+
+const char *const *PythonLexer::builtins() {
+    return builtinList;
+}
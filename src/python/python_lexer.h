@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PYTHON_LEXER_H
+#define PYTHON_LEXER_H
+
+#include <vector>
+
+/**
+ * Single-pass Python tokenizer working on UTF-16 text (as returned by QString::utf16()).
+ *
+ * A line is split into token spans in one sweep using a character class table,
+ * so every character is visited once regardless of how many keywords exist.
+ * Multi-line constructs (triple-quoted and backslash-continued strings) are
+ * carried from one line to the next through an integer state, which maps
+ * directly onto QSyntaxHighlighter block states. The lexer holds no per-document
+ * data and can be used from any thread.
+ */
+class PythonLexer {
+public:
+    enum TokenKind {
+        Normal,
+        Identifier,
+        Keyword,
+        Builtin,
+        Self,
+        DefClass,
+        Operator,
+        Brace,
+        Number,
+        String,
+        DocString,
+        Comment,
+        KindCount
+    };
+
+    struct Token {
+        int start;
+        int length;
+        TokenKind kind;
+    };
+
+    /* Line states: the open string kind lives in the low bits, prefix flags above */
+    enum State {
+        StateNormal = 0,
+        StateTripleSingle = 1,
+        StateTripleDouble = 2,
+        StateContinuedSingle = 3,
+        StateContinuedDouble = 4,
+        StateStringMask = 7,
+        StateRaw = 8,
+        StateFormat = 16
+    };
+
+    /* Flags returned by lookupWord() */
+    enum WordFlags {
+        WordKeyword = 1,
+        WordBuiltin = 2,
+        WordSelf = 4,
+        WordDefinition = 8
+    };
+
+    /* Appends the tokens of one line to 'tokens' and returns the state at its end */
+    static int tokenize(const unsigned short *text, int length, int state, std::vector<Token> &tokens);
+
+    /* Returns a combination of WordFlags for an identifier, or 0 if it is not reserved */
+    static int lookupWord(const unsigned short *word, int length);
+
+    /* Null-terminated lists of the reserved words, e.g. for completion */
+    static const char *const *keywords();
+    static const char *const *builtins();
+};
+
+#endif // PYTHON_LEXER_H
@@ -0,0 +1,332 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "python_symbols.h"
+#include "python_lexer.h"
+#include <QSet>
+#include <QStringRef>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/* Lexes one chunk line by line, collecting statements and turning them into symbols */
+class ChunkParser {
+public:
+    ChunkParser(const QStringList &lines, int first) :
+        lines(lines),
+        first(first),
+        current(first) {
+    }
+
+    void run(int end) {
+        for (; current < end; ++current) {
+            parseLine(lines.at(current));
+        }
+    }
+
+    /* Whether the next line starts a fresh statement */
+    bool isClosed() const {
+        return depth == 0 && !continued && !(state & PythonLexer::StateStringMask);
+    }
+
+    QVector<PythonSymbols::Symbol> finish() {
+        if (!words.isEmpty()) {
+            endStatement();
+        }
+        closeScopes(-1);
+        return symbols;
+    }
+
+private:
+    struct Word {
+        QStringRef text;
+        PythonLexer::TokenKind kind;
+        int depth;
+    };
+
+    const QStringList &lines;
+    const int first;
+    int current;
+
+    int state = PythonLexer::StateNormal;
+    int depth = 0;
+    bool continued = false;
+    std::vector<PythonLexer::Token> tokens;
+
+    QVector<Word> words;
+    int statementLine = 0;
+    int statementIndent = 0;
+    int lastCode = 0;
+    QVector<PythonSymbols::Symbol> symbols;
+    std::vector<std::pair<int, int> > scopes; /* Indent and symbol index of open classes and functions */
+    QSet<QString> assigned;
+
+    void parseLine(const QString &text) {
+        const bool starts = isClosed();
+        tokens.clear();
+        state = PythonLexer::tokenize(text.utf16(), text.length(), state, tokens);
+
+        if (starts) {
+            int column = 0;
+            int position = 0;
+            for (; position < text.length(); ++position) {
+                const QChar c = text.at(position);
+                if (c == QLatin1Char(' ')) {
+                    ++column;
+                } else if (c == QLatin1Char('\t')) {
+                    column += 8 - column % 8;
+                } else {
+                    break;
+                }
+            }
+            if (position == text.length() || text.at(position) == QLatin1Char('#')) {
+                return;
+            }
+            closeScopes(column);
+            statementLine = current - first;
+            statementIndent = column;
+        }
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const PythonLexer::Token &token = tokens[i];
+            if (token.kind == PythonLexer::Comment) {
+                continue;
+            }
+            Word word;
+            word.text = QStringRef(&text, token.start, token.length);
+            word.kind = token.kind;
+            if (token.kind == PythonLexer::Brace) {
+                const QChar c = text.at(token.start);
+                if (c == QLatin1Char('(') || c == QLatin1Char('[') || c == QLatin1Char('{')) {
+                    word.depth = depth++;
+                } else {
+                    depth = qMax(0, depth - 1);
+                    word.depth = depth;
+                }
+            } else {
+                word.depth = depth;
+            }
+            words.append(word);
+            lastCode = current - first;
+        }
+
+        /* A backslash outside of a string joins the next line */
+        int end = text.length();
+        while (end > 0 && text.at(end - 1).isSpace()) {
+            --end;
+        }
+        continued = end > 0 && text.at(end - 1) == QLatin1Char('\\') && !(state & PythonLexer::StateStringMask)
+            && (tokens.empty() || tokens.back().kind != PythonLexer::Comment);
+
+        if (isClosed() && !words.isEmpty()) {
+            endStatement();
+        }
+    }
+
+    void closeScopes(int indent) {
+        while (!scopes.empty() && scopes.back().first >= indent) {
+            symbols[scopes.back().second].endLine = lastCode;
+            scopes.pop_back();
+        }
+    }
+
+    int parent() const {
+        return scopes.empty() ? -1 : scopes.back().second;
+    }
+
+    void addSymbol(const QString &name, const QString &detail, PythonSymbols::Kind kind) {
+        PythonSymbols::Symbol symbol;
+        symbol.name = name;
+        symbol.detail = detail;
+        symbol.kind = kind;
+        symbol.line = statementLine;
+        symbol.endLine = lastCode;
+        symbol.parent = parent();
+        symbols.append(symbol);
+    }
+
+    void endStatement() {
+        int i = 0;
+        if (words.at(0).text == QLatin1String("async")) {
+            ++i;
+        }
+        if (i >= words.size()) {
+            words.clear();
+            return;
+        }
+
+        if (i + 1 < words.size() && words.at(i).kind == PythonLexer::Keyword && words.at(i + 1).kind == PythonLexer::DefClass) {
+            const bool isClass = words.at(i).text == QLatin1String("class");
+            addSymbol(words.at(i + 1).text.toString(), QString(), isClass ? PythonSymbols::Class : PythonSymbols::Function);
+            scopes.push_back(std::make_pair(statementIndent, symbols.size() - 1));
+        } else if (words.at(i).text == QLatin1String("import")) {
+            addImports(i + 1, QString());
+        } else if (words.at(i).text == QLatin1String("from")) {
+            QString module;
+            int j = i + 1;
+            for (; j < words.size() && words.at(j).text != QLatin1String("import"); ++j) {
+                module += words.at(j).text;
+            }
+            addImports(j + 1, module);
+        } else if (scopes.empty() || symbols.at(scopes.back().second).kind == PythonSymbols::Class) {
+            /* Assignments only count at module and class level */
+            addAssignment(i);
+        }
+
+        words.clear();
+    }
+
+    /* import a.b as c, d  or  from m import (x as y, z) */
+    void addImports(int i, const QString &module) {
+        QString path;
+        QString alias;
+        bool renamed = false;
+        for (; i <= words.size(); ++i) {
+            if (i == words.size() || words.at(i).text == QLatin1String(",")) {
+                if (!path.isEmpty() && path != QLatin1String("*")) {
+                    QString detail = path;
+                    QString name = alias;
+                    if (!module.isEmpty()) {
+                        detail = module.endsWith(QLatin1Char('.')) ? module + path : module + QLatin1Char('.') + path;
+                    }
+                    if (name.isEmpty()) {
+                        name = module.isEmpty() ? path.section(QLatin1Char('.'), 0, 0) : path;
+                    }
+                    addSymbol(name, detail, PythonSymbols::Import);
+                }
+                path.clear();
+                alias.clear();
+                renamed = false;
+            } else if (words.at(i).text == QLatin1String("as")) {
+                renamed = true;
+            } else if (words.at(i).kind == PythonLexer::Brace) {
+                continue;
+            } else if (renamed) {
+                alias = words.at(i).text.toString();
+            } else {
+                path += words.at(i).text;
+            }
+        }
+    }
+
+    /* a = ...,  a, b = ...,  (a, b) = ...,  a: int = ... */
+    void addAssignment(int i) {
+        QVector<int> targets;
+        bool assignment = false;
+        for (int j = i; j < words.size() && !assignment; ++j) {
+            const Word &word = words.at(j);
+            if (word.kind == PythonLexer::Identifier) {
+                targets.append(j);
+            } else if (word.kind == PythonLexer::Operator && word.depth == 0 && word.text == QLatin1String("=")) {
+                assignment = true;
+            } else if (word.kind == PythonLexer::Operator && j == i + 1 && word.text == QLatin1String(":")) {
+                assignment = true;
+            } else if (word.kind != PythonLexer::Brace && word.text != QLatin1String(",")) {
+                return;
+            }
+        }
+        if (!assignment) {
+            return;
+        }
+
+        for (int j = 0; j < targets.size(); ++j) {
+            const QString name = words.at(targets.at(j)).text.toString();
+            const QString key = QString::number(parent()) + QLatin1Char(':') + name;
+            if (!assigned.contains(key)) {
+                assigned.insert(key);
+                addSymbol(name, QString(), PythonSymbols::Variable);
+            }
+        }
+    }
+};
+
+}
+
+QVector<PythonSymbols::Symbol> PythonSymbols::parse(const QStringList &lines, ChunkCache *cache) {
+    QVector<Symbol> symbols;
+    ChunkCache used;
+    const int count = lines.size();
+
+    int first = 0;
+    while (first < count) {
+        int next = nextChunk(lines, first);
+        quint64 key = hashLines(lines, first, next);
+        if (cache) {
+            ChunkCache::const_iterator hit = cache->constFind(key);
+            if (hit != cache->constEnd() && hit->lines == next - first && (hit->closed || next == count)) {
+                append(symbols, hit->symbols, first);
+                used.insert(key, *hit);
+                first = next;
+                continue;
+            }
+        }
+
+        /* A chunk boundary inside a string or brackets is no boundary, keep going */
+        ChunkParser parser(lines, first);
+        parser.run(next);
+        while (!parser.isClosed() && next < count) {
+            next = nextChunk(lines, next);
+            parser.run(next);
+        }
+
+        Chunk chunk;
+        chunk.lines = next - first;
+        chunk.closed = parser.isClosed();
+        chunk.symbols = parser.finish();
+        append(symbols, chunk.symbols, first);
+        if (cache) {
+            used.insert(hashLines(lines, first, next), chunk);
+        }
+        first = next;
+    }
+
+    if (cache) {
+        cache->swap(used);
+    }
+    return symbols;
+}
+
+/* The next line after 'from' that starts with a name or a decorator in column zero */
+int PythonSymbols::nextChunk(const QStringList &lines, int from) {
+    for (int i = from + 1; i < lines.size(); ++i) {
+        const QString &line = lines.at(i);
+        if (line.isEmpty()) {
+            continue;
+        }
+        const QChar c = line.at(0);
+        if (c.isLetter() || c == QLatin1Char('_') || c == QLatin1Char('@')) {
+            return i;
+        }
+    }
+    return lines.size();
+}
+
+/* 64-bit FNV-1a over the lines' UTF-16 and their breaks */
+quint64 PythonSymbols::hashLines(const QStringList &lines, int first, int last) {
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (int i = first; i < last; ++i) {
+        const QString &line = lines.at(i);
+        const ushort *data = line.utf16();
+        for (int j = 0; j < line.length(); ++j) {
+            hash = (hash ^ data[j]) * Q_UINT64_C(1099511628211);
+        }
+        hash = (hash ^ '\n') * Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+void PythonSymbols::append(QVector<Symbol> &symbols, const QVector<Symbol> &chunk, int firstLine) {
+    const int base = symbols.size();
+    for (int i = 0; i < chunk.size(); ++i) {
+        Symbol symbol = chunk.at(i);
+        symbol.line += firstLine;
+        symbol.endLine += firstLine;
+        if (symbol.parent >= 0) {
+            symbol.parent += base;
+        }
+        symbols.append(symbol);
+    }
+}
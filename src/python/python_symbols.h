@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef PYTHON_SYMBOLS_H
+#define PYTHON_SYMBOLS_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/*
+* Symbol table of a Python source: classes, functions, module and class
+* level assignments and imports, each with the lines it spans.
+*
+* The source is cut into chunks at every line that starts a statement in
+* column zero. Every chunk is parsed on its own with PythonLexer and remembered
+* by a hash of its text, so parsing a document again after an edit only looks
+* at the chunks that changed. Nothing in here touches the GUI; parse() is meant
+* to be called from a worker thread.
+*/
+class PythonSymbols {
+public:
+    enum Kind {
+        Class,
+        Function,
+        Variable,
+        Import
+    };
+
+    struct Symbol {
+        QString name;
+        QString detail;  /* Full module path of an import */
+        Kind kind;
+        int line;        /* Zero-based */
+        int endLine;
+        int parent;      /* Index of the enclosing class or function, or -1 */
+    };
+
+    /* A parsed chunk, lines and parents relative to the chunk */
+    struct Chunk {
+        int lines;
+        bool closed;     /* Ends outside of any string or bracket */
+        QVector<Symbol> symbols;
+    };
+    typedef QHash<quint64, Chunk> ChunkCache;
+
+    /*
+    * Parses 'lines', reusing the chunks found in 'cache'. Afterwards 'cache'
+    * holds exactly the chunks of 'lines', ready for the next call.
+    */
+    static QVector<Symbol> parse(const QStringList &lines, ChunkCache *cache = 0);
+
+private:
+    static int nextChunk(const QStringList &lines, int from);
+    static quint64 hashLines(const QStringList &lines, int first, int last);
+    static void append(QVector<Symbol> &symbols, const QVector<Symbol> &chunk, int firstLine);
+};
+
+#endif // PYTHON_SYMBOLS_H
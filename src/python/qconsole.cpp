@@ -213,7 +213,8 @@ void QConsole::reset(const QString &welcomeText) {
 QConsole::QConsole(QWidget *parent, const QString &welcomeText)
     : QTextEdit(parent), errColor_(Qt::red),
     outColor_(Qt::blue), completionColor(Qt::darkGreen),
-    promptLength(0), promptParagraph(0) {
+    promptLength(0), promptParagraph(0), executingParagraph(-1),
+    latency("QConsole") {
     QPalette palette = QApplication::palette();
     setCmdColor(palette.text().color());
 
@@ -377,8 +378,16 @@ void QConsole::setHome(bool select) {
     setTextCursor(cursor);
 }
 
+//Reimplemented paint event, ends the latency of the keys it shows
+void QConsole::paintEvent(QPaintEvent *e) {
+    QTextEdit::paintEvent(e);
+    latency.painted();
+}
+
 //Reimplemented key press event
 void QConsole::keyPressEvent(QKeyEvent *e) {
+    LatencyKey<QTextEdit> key(latency, this);
+
     //If the user wants to copy or cut outside
     //the editing area we perform a copy
     if (textCursor().hasSelection()) {
@@ -516,6 +525,15 @@ bool QConsole::isInEditionZone() {
 }
 
 
+//Tests whether a paragraph belongs to the command being edited (prompt line
+//and its continuation lines) as opposed to the history or program output
+bool QConsole::isCodeBlock(int blockNumber) const {
+    if (blockNumber < promptParagraph)
+        return false;
+    return executingParagraph < 0 || blockNumber <= executingParagraph;
+}
+
+
 //Tests whether position (in parameter) is in the edition zone or not (after the prompt
 //or in the next lines (in case of multi-line mode)
 bool QConsole::isInEditionZone(const int& pos) {
@@ -576,8 +594,11 @@ bool QConsole::execCommand(const QString &command, bool writeCommand,
         textCursor().insertText(modifiedCommand);
     }
     //execute the command and get back its text result and its return value
+    //anything written past the command's last paragraph until then is output
     int res = 0;
+    executingParagraph = document()->lastBlock().blockNumber();
     QString strRes = interpretCommand(modifiedCommand, &res);
+    executingParagraph = -1;
     //According to the return value, display the result either in red or in blue
     if (res == 0)
         setTextColor(outColor_);
@@ -31,6 +31,7 @@
 #include <QDialog>
 #include <QListWidget>
 #include <QDebug>
+#include "src/gui/latency_monitor.h"
 
 #if QT_VERSION < 0x040000
 #error "supports only Qt 4.0 or greater"
@@ -150,6 +151,13 @@ public:
     //Replace current command with a new one
     void replaceCurrentCommand(const QString &newCommand);
 
+    //Paragraph number and column where the edition zone starts
+    int promptBlock() const { return promptParagraph; }
+    int promptColumn() const { return promptLength; }
+
+    //Test whether a paragraph holds editable code rather than output or history
+    bool isCodeBlock(int blockNumber) const;
+
     //colors
     QColor cmdColor_, errColor_, outColor_, completionColor;
 
@@ -158,6 +166,7 @@ private:
     void dragMoveEvent(QDragMoveEvent * event);
 
     void keyPressEvent(QKeyEvent * e);
+    void paintEvent(QPaintEvent * e);
     void contextMenuEvent(QContextMenuEvent * event);
 
     //Return false if the command is incomplete (e.g. unmatched braces)
@@ -189,6 +198,8 @@ protected:
     int historyIndex;
     //Holds the paragraph number of the prompt (useful for multi-line command handling)
     int promptParagraph;
+    //Last paragraph of the command being executed, or -1 when idle (anything below it is output)
+    int executingParagraph;
 
 protected:
     //Implement paste with middle mouse button
@@ -223,6 +234,9 @@ private:
     void handleUpKeyPress();
     void handleDownKeyPress();
     void setHome(bool);
+
+    //Key to paint latency, when measured
+    LatencyProbe latency;
 };
 
 #endif // QCONSOLE_H
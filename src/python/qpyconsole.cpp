@@ -593,6 +593,7 @@ QPyConsole::QPyConsole(QWidget *parent, const QString& welcomeText, InfoBox* inf
     infoBoxPtr = infoBox;
     launchPythonInstance(true);
     setWordWrapMode(QTextOption::WrapAnywhere);
+    highlighter = new ConsoleHighlighter(this);
 }
 
 QString QPyConsole::generateRestartString() {
@@ -734,6 +735,70 @@ QString QPyConsole::interpretCommand(const QString &command, int *res) {
     }
 }
 
+/* Looks 'name' up in the dictionaries of a module or a plain class and its
+bases, which runs none of the session's code: no __getattr__, no property
+and no descriptor. Anything else is not looked through. */
+static PyObject* lookupAttribute(PyObject *scope, const char *name) {
+    if (PyModule_CheckExact(scope)) {
+        return PyDict_GetItemString(PyModule_GetDict(scope), name);
+    }
+    if (PyType_Check(scope) && Py_TYPE(scope) == &PyType_Type) {
+        PyObject *mro = ((PyTypeObject*)scope)->tp_mro;
+        for (Py_ssize_t i = 0; mro && i < PyTuple_Size(mro); ++i) {
+            PyObject *dict = ((PyTypeObject*)PyTuple_GetItem(mro, i))->tp_dict;
+            if (PyObject *value = dict ? PyDict_GetItemString(dict, name) : 0) {
+                return value;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Lists a module's own names, or the names dir() gives for a plain class or
+the plain class of an instance. dir() of anything else could run a __dir__
+of the session, so those list nothing. */
+QStringList QPyConsole::attributes(const QString &expression) {
+    QStringList names;
+    const QStringList parts = expression.split('.');
+    if (!Py_IsInitialized() || !glb || parts.first().isEmpty()) {
+        return names;
+    }
+
+    const QByteArray first = parts.first().toUtf8();
+    PyObject *object = PyDict_GetItemString(glb, first.constData());
+    if (!object) {
+        object = PyDict_GetItemString(PyEval_GetBuiltins(), first.constData());
+    }
+    for (int i = 1; object && i < parts.size(); ++i) {
+        object = lookupAttribute(object, parts.at(i).toUtf8().constData());
+    }
+    if (!object) {
+        return names;
+    }
+
+    /* Borrowed all the way: nothing looked up above ran code that could drop it */
+    PyObject *list = 0;
+    if (PyModule_CheckExact(object)) {
+        list = PyDict_Keys(PyModule_GetDict(object));
+    } else {
+        PyObject *type = PyType_Check(object) ? object : (PyObject*)Py_TYPE(object);
+        if (Py_TYPE(type) == &PyType_Type) {
+            list = PyObject_Dir(type);
+        }
+    }
+    if (list) {
+        for (Py_ssize_t i = 0; i < PyList_Size(list); ++i) {
+            const char *name = PyUnicode_AsUTF8(PyList_GetItem(list, i));
+            if (name) {
+                names << QString::fromUtf8(name);
+            }
+        }
+        Py_DECREF(list);
+    }
+    PyErr_Clear();
+    return names;
+}
+
 QStringList QPyConsole::suggestCommand(const QString &cmd, QString& prefix) {
     char run[255];
     int n = 0;
@@ -29,6 +29,7 @@
 
 #include "Python.h"
 #include "qconsole.h"
+#include "qpyconsole_highlighter.h"
 #include "src/gui/info_box.h"
 
 /**An emulated singleton console for Python within a Qt application (based on the QConsole class)
@@ -57,6 +58,9 @@ public:
     QString interpretCommand(const QString &command, int *res);
     void runFile(const std::string &filename);
 
+    //names of a dotted name of the session, e.g. for completion; runs none of its code
+    static QStringList attributes(const QString &expression);
+
     InfoBox* infoBoxPtr;
 
 protected:
@@ -78,6 +82,9 @@ private:
     //The instance
     static QPyConsole *theInstance;
 
+    //Highlights the command being typed
+    ConsoleHighlighter *highlighter;
+
     void launchPythonInstance(bool firstRun);
     QString generateRestartString();
 
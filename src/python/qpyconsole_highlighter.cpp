@@ -0,0 +1,61 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "qpyconsole_highlighter.h"
+#include "qconsole.h"
+
+ConsoleHighlighter::ConsoleHighlighter(QConsole *console) :
+    QSyntaxHighlighter(console->document()),
+    consolePtr(console),
+    formats(PythonHighlighter::tokenFormats()) {
+}
+
+void ConsoleHighlighter::highlightBlock(const QString &text) {
+    ConsoleBlockData *data = static_cast<ConsoleBlockData*>(currentBlockUserData());
+    const int blockNumber = currentBlock().blockNumber();
+
+    if (consolePtr->isCodeBlock(blockNumber)) {
+        /* Only the text after the prompt is code */
+        int offset = (blockNumber == consolePtr->promptBlock()) ? consolePtr->promptColumn() : 0;
+        offset = qMin(offset, text.length());
+
+        tokens.clear();
+        int state = PythonLexer::tokenize(text.utf16() + offset, text.length() - offset, previousBlockState(), tokens);
+        setCurrentBlockState(state);
+
+        if (!data) {
+            data = new ConsoleBlockData;
+            setCurrentBlockUserData(data);
+        }
+        data->isOutput = false;
+        data->formats.clear();
+
+        /* Remember the formats so the paragraph can be frozen once the command is run */
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const PythonLexer::Token &token = tokens[i];
+            if (formats[token.kind] != formats[PythonLexer::Normal]) {
+                QTextLayout::FormatRange range;
+                range.start = offset + token.start;
+                range.length = token.length;
+                range.format = formats[token.kind];
+                setFormat(range.start, range.length, range.format);
+                data->formats.append(range);
+            }
+        }
+    } else if (data && !data->isOutput) {
+        /* History paragraph: replay the frozen formats and keep the stored state */
+        Q_FOREACH(const QTextLayout::FormatRange &range, data->formats) {
+            setFormat(range.start, range.length, range.format);
+        }
+    } else {
+        /* Output paragraph: nothing to highlight and never a multi-line string */
+        if (!data) {
+            data = new ConsoleBlockData;
+            data->isOutput = true;
+            setCurrentBlockUserData(data);
+        }
+        setCurrentBlockState(0);
+    }
+}
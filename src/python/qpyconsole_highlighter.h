@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#ifndef QPYCONSOLE_HIGHLIGHTER_H
+#define QPYCONSOLE_HIGHLIGHTER_H
+
+#include "src/gui/editor/code_editor_highlighter.h"
+#include <QSyntaxHighlighter>
+#include <QTextLayout>
+#include <QVector>
+#include <vector>
+
+class QConsole;
+
+/**
+ * Per-paragraph cache of the console highlighter. Once a paragraph leaves the
+ * edition zone its formats are frozen here so it never has to be tokenized again.
+ */
+class ConsoleBlockData : public QTextBlockUserData {
+public:
+    bool isOutput = false;
+    QVector<QTextLayout::FormatRange> formats;
+};
+
+/**
+ * Python highlighter restricted to the command being typed in the console.
+ * Output paragraphs are left alone and history paragraphs replay their
+ * cached formats, so typing cost does not depend on the scrollback size.
+ */
+class ConsoleHighlighter : public QSyntaxHighlighter {
+    Q_OBJECT
+
+public:
+    ConsoleHighlighter(QConsole *console);
+
+protected:
+    void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
+
+private:
+    QConsole *consolePtr;
+    const QVector<QTextCharFormat> &formats;
+    std::vector<PythonLexer::Token> tokens;
+};
+
+#endif // QPYCONSOLE_HIGHLIGHTER_H
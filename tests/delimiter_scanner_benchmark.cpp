@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "src/python/delimiter_scanner.h"
+#include <qelapsedtimer.h>
+#include <qregexp.h>
+#include <qtest.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCHMARK_CYCLES
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_CYCLES
+#endif
+
+namespace {
+
+enum { MinimumTime = 200 * 1000 * 1000 }; /* Nanoseconds per row */
+
+/* Finds every delimiter the way the lexer walks a formatted string literal */
+int scanAll(const QString &text) {
+    const unsigned short *data = text.utf16();
+    const int length = text.length();
+    int count = 0;
+    for (int i = DelimiterScanner::find(data, 0, length, '"', '\\', '{'); i < length;
+         i = DelimiterScanner::find(data, i + 1, length, '"', '\\', '{')) {
+        ++count;
+    }
+    return count;
+}
+
+/* The same walk through QRegExp, as the highlighter searched before the scanner */
+int regexpAll(const QRegExp &pattern, const QString &text) {
+    int count = 0;
+    for (int i = pattern.indexIn(text); i >= 0; i = pattern.indexIn(text, i + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+quint64 cycles() {
+#ifdef BENCHMARK_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+QString repeated(const QString &piece, int size) {
+    QString text;
+    text.reserve(size + piece.length());
+    while (text.length() < size) {
+        text += piece;
+    }
+    return text;
+}
+
+}
+
+/*
+* Throughput of the delimiter scan against the QRegExp path on the lines it
+* was written for. Each row runs for a fixed time and prints bytes of UTF-16
+* text per cycle where the time stamp counter is available, per nanosecond
+* everywhere.
+*/
+class DelimiterScannerBenchmark : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void scan_data();
+    void scan();
+};
+
+void DelimiterScannerBenchmark::initTestCase() {
+    qDebug("Scanner implementation: %s", DelimiterScanner::implementation());
+}
+
+void DelimiterScannerBenchmark::scan_data() {
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("regexp");
+
+    const int size = 1 << 20;
+    const QString data = QString(size, QLatin1Char('A')) + QLatin1Char('"');
+    const QString json = repeated("{\\\"id\\\": 42, \\\"name\\\": \\\"pylet\\\", \\\"tags\\\": [1, 2, 3]}, ", size);
+    const QString prose = repeated("Plain words with the odd \\n escape in them. ", size);
+
+    QTest::newRow("embedded data, scanner") << data << false;
+    QTest::newRow("embedded data, regexp") << data << true;
+    QTest::newRow("minified json, scanner") << json << false;
+    QTest::newRow("minified json, regexp") << json << true;
+    QTest::newRow("prose, scanner") << prose << false;
+    QTest::newRow("prose, regexp") << prose << true;
+}
+
+void DelimiterScannerBenchmark::scan() {
+    QFETCH(QString, text);
+    QFETCH(bool, regexp);
+
+    const QRegExp pattern("[\"\\\\{]");
+    const int expected = scanAll(text);
+    QCOMPARE(regexpAll(pattern, text), expected);
+
+    int runs = 0;
+    volatile int found = 0;
+    QElapsedTimer timer;
+    timer.start();
+    const quint64 start = cycles();
+    do {
+        found = regexp ? regexpAll(pattern, text) : scanAll(text);
+        ++runs;
+    } while (timer.nsecsElapsed() < MinimumTime);
+    const quint64 spent = cycles() - start;
+    const qint64 elapsed = timer.nsecsElapsed();
+    QCOMPARE(int(found), expected);
+
+    const double bytes = double(runs) * text.length() * sizeof(ushort);
+    if (spent > 0) {
+        qDebug("%.3f bytes/cycle, %.3f bytes/ns", bytes / spent, bytes / elapsed);
+    } else {
+        qDebug("%.3f bytes/ns", bytes / elapsed);
+    }
+}
+
+QTEST_APPLESS_MAIN(DelimiterScannerBenchmark)
+#include "delimiter_scanner_benchmark.moc"
@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "src/gui/editor/code_editor_search.h"
+#include <qtest.h>
+
+class LineMatcherTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void requiredLiteral_data();
+    void requiredLiteral();
+    void literalIsInEveryMatch_data();
+    void literalIsInEveryMatch();
+};
+
+void LineMatcherTest::requiredLiteral_data() {
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<QString>("literal");
+
+    QTest::newRow("plain") << "abc" << "abc";
+    QTest::newRow("escaped dot") << "hello\\.world" << "hello.world";
+    QTest::newRow("optional character") << "colou?r" << "colo";
+    QTest::newRow("class between runs") << "def\\s+name" << "name";
+    QTest::newRow("group") << "(abc)def" << "def";
+    QTest::newRow("alternative") << "abc|def" << "";
+    QTest::newRow("repeat count") << "ab{2,3}" << "a";
+    QTest::newRow("repeated class") << "\\d{3}" << "";
+    QTest::newRow("count between runs") << "foo\\d{2}bar" << "foo";
+    QTest::newRow("hex escape") << "\\x41" << "";
+    QTest::newRow("braced hex escape") << "\\x{41}BC" << "";
+    QTest::newRow("octal escape") << "\\101" << "";
+    QTest::newRow("braced octal escape") << "\\o{101}" << "";
+    QTest::newRow("back reference") << "(a)\\1" << "";
+    QTest::newRow("property") << "\\p{Lu}x" << "";
+    QTest::newRow("negated property") << "\\P{Lu}x" << "";
+    QTest::newRow("named character") << "\\N{U+41}" << "";
+    QTest::newRow("named reference") << "(?<n>a)\\k<n>" << "";
+    QTest::newRow("numbered reference") << "(a)\\g{1}" << "";
+    QTest::newRow("control character") << "\\cJ" << "";
+}
+
+void LineMatcherTest::requiredLiteral() {
+    QFETCH(QString, pattern);
+    QFETCH(QString, literal);
+
+    const LineMatcher matcher(pattern, LineMatcher::RegularExpression | LineMatcher::CaseSensitive);
+    QVERIFY(matcher.isValid());
+    QCOMPARE(matcher.requiredLiteral(), literal);
+}
+
+void LineMatcherTest::literalIsInEveryMatch_data() {
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<QString>("line");
+
+    QTest::newRow("repeated class") << "\\d{3}" << "456";
+    QTest::newRow("repeat count") << "ab{2,3}" << "abbb";
+    QTest::newRow("hex escape") << "\\x41" << "A";
+    QTest::newRow("octal escape") << "\\101" << "A";
+    QTest::newRow("property") << "\\p{Lu}x" << "Qx";
+    QTest::newRow("back reference") << "(a)\\1" << "aa";
+}
+
+/* The literal is only used to skip lines without it, so it must never skip a line that matches */
+void LineMatcherTest::literalIsInEveryMatch() {
+    QFETCH(QString, pattern);
+    QFETCH(QString, line);
+
+    const LineMatcher matcher(pattern, LineMatcher::RegularExpression | LineMatcher::CaseSensitive);
+    std::vector<LineMatcher::Match> found;
+    matcher.find(line, 0, found);
+    QVERIFY(!found.empty());
+    QVERIFY(line.contains(matcher.requiredLiteral()));
+}
+
+QTEST_APPLESS_MAIN(LineMatcherTest)
+#include "line_matcher_test.moc"
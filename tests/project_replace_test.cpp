@@ -0,0 +1,73 @@
+/*
+* Copyright (c) 2016 Jake Dharmasiri.
+* Licensed under the GNU GPLv3 License. See LICENSE for details.
+*/
+
+#include "src/gui/project_replace.h"
+#include <qfile.h>
+#include <qfileinfo.h>
+#include <qtemporarydir.h>
+#include <qtest.h>
+
+class ProjectReplaceTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void replacesLinesWithoutTheLiteral_data();
+    void replacesLinesWithoutTheLiteral();
+
+private:
+    QString writeFile(const QTemporaryDir &dir, const QString &name, const QByteArray &contents);
+};
+
+QString ProjectReplaceTest::writeFile(const QTemporaryDir &dir, const QString &name, const QByteArray &contents) {
+    QFile file(dir.path() + "/" + name);
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size()) {
+        return QString();
+    }
+    return QFileInfo(file).canonicalFilePath();
+}
+
+void ProjectReplaceTest::replacesLinesWithoutTheLiteral_data() {
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<QByteArray>("before");
+    QTest::addColumn<QByteArray>("after");
+    QTest::addColumn<QString>("line");
+
+    QTest::newRow("repeated class") << "\\d{3}" << QByteArray("a = 456\nb = 7\n") << QByteArray("a = N\nb = 7\n") << "a = N";
+    QTest::newRow("repeat count") << "ab{2}" << QByteArray("xabb\n") << QByteArray("xN\n") << "xN";
+    QTest::newRow("hex escape") << "\\x41" << QByteArray("BAB\r\n") << QByteArray("BNB\r\n") << "BNB";
+    QTest::newRow("property") << "\\p{Lu}x" << QByteArray("Qx qx\n") << QByteArray("N qx\n") << "N qx";
+}
+
+/* Every matching line shows up in the preview, from the disk and from an open buffer alike */
+void ProjectReplaceTest::replacesLinesWithoutTheLiteral() {
+    QFETCH(QString, pattern);
+    QFETCH(QByteArray, before);
+    QFETCH(QByteArray, after);
+    QFETCH(QString, line);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString onDisk = writeFile(dir, "disk.py", before);
+    const QString open = writeFile(dir, "open.py", QByteArray());
+    QVERIFY(!onDisk.isEmpty() && !open.isEmpty());
+
+    QHash<QString, QString> buffers;
+    buffers.insert(open, QString::fromUtf8(before).remove(QLatin1Char('\r')));
+
+    const LineMatcher matcher(pattern, LineMatcher::RegularExpression | LineMatcher::CaseSensitive);
+    const QVector<FileChange> changes = ProjectReplace(matcher, "N").compute(QStringList() << onDisk << open, buffers);
+    QCOMPARE(changes.size(), 2);
+    for (int i = 0; i < changes.size(); ++i) {
+        QCOMPARE(changes.at(i).replacements, 1);
+        QCOMPARE(changes.at(i).lines.size(), 1);
+        QCOMPARE(changes.at(i).lines.first().after, line);
+        if (!changes.at(i).fromBuffer) {
+            QCOMPARE(changes.at(i).contents, after);
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(ProjectReplaceTest)
+#include "project_replace_test.moc"
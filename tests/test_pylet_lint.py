@@ -0,0 +1,120 @@
+# Copyright (c) 2016 Jake Dharmasiri.
+# Licensed under the GNU GPLv3 License. See LICENSE for details.
+#
+# Name binding cases of the background checker in res/scripts/pylet_lint.py.
+
+import os
+import sys
+import textwrap
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'res', 'scripts'))
+
+import pylet_lint  # noqa: E402
+
+
+def undefined(source):
+    problems = pylet_lint.check(textwrap.dedent(source))
+    return sorted(problem[4] for problem in problems if problem[4].startswith('undefined name'))
+
+
+class BindingsTest(unittest.TestCase):
+    def test_undefined_name_is_still_reported(self):
+        self.assertEqual(undefined('''
+            def f():
+                return missing
+        '''), ["undefined name 'missing'"])
+
+    @unittest.skipIf(sys.version_info < (3, 10), 'match needs Python 3.10')
+    def test_match_as_capture(self):
+        self.assertEqual(undefined('''
+            def f(point):
+                match point:
+                    case (0, 0) as origin:
+                        return origin
+                    case [first, *_]:
+                        return first
+                    case other:
+                        return other
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 10), 'match needs Python 3.10')
+    def test_match_star_capture(self):
+        self.assertEqual(undefined('''
+            def f(items):
+                match items:
+                    case [head, *tail]:
+                        return head, tail
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 10), 'match needs Python 3.10')
+    def test_match_mapping_rest(self):
+        self.assertEqual(undefined('''
+            def f(config):
+                match config:
+                    case {'name': name, **rest}:
+                        return name, rest
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 12), 'type parameters need Python 3.12')
+    def test_generic_function(self):
+        self.assertEqual(undefined('''
+            def first[T](items: list[T]) -> T:
+                result: T = items[0]
+                return result
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 12), 'type parameters need Python 3.12')
+    def test_generic_class(self):
+        self.assertEqual(undefined('''
+            class Box[T, *Ts, **P]:
+                def get(self) -> T:
+                    return self.value
+
+                def call(self, *args: P.args, **kwargs: P.kwargs) -> tuple[*Ts]:
+                    return args
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 12), 'type parameters need Python 3.12')
+    def test_generic_type_alias(self):
+        self.assertEqual(undefined('''
+            type Pairs[K, V] = list[tuple[K, V]]
+            pairs: Pairs[int, str] = []
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 12), 'type parameters need Python 3.12')
+    def test_type_parameter_is_not_global(self):
+        self.assertEqual(undefined('''
+            def first[T](items: list[T]) -> T:
+                return items[0]
+            value: T = None
+        '''), ["undefined name 'T'"])
+
+    @unittest.skipIf(sys.version_info < (3, 8), 'walrus needs Python 3.8')
+    def test_walrus_in_comprehension_binds_in_function(self):
+        self.assertEqual(undefined('''
+            def f(lines):
+                if any((found := line).startswith('#') for line in lines):
+                    return found
+                return [last := n for n in range(3)], last
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 8), 'walrus needs Python 3.8')
+    def test_walrus_in_nested_comprehension(self):
+        self.assertEqual(undefined('''
+            def f(rows):
+                cells = [[(cell := value) for value in row] for row in rows]
+                return cells, cell
+        '''), [])
+
+    @unittest.skipIf(sys.version_info < (3, 8), 'walrus needs Python 3.8')
+    def test_comprehension_variable_stays_inside(self):
+        self.assertEqual(undefined('''
+            def f(lines):
+                count = [line for line in lines]
+                return count, line
+        '''), ["undefined name 'line'"])
+
+
+if __name__ == '__main__':
+    unittest.main()